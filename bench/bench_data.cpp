@@ -0,0 +1,113 @@
+#include "bench_data.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+#include "../src/generator/market_data_generator.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace bench_data
+{
+    const std::filesystem::path& work_dir()
+    {
+        static const std::filesystem::path dir = []()
+        {
+            auto path = std::filesystem::temp_directory_path() / ("csv_parser_bench_" + std::to_string(::getpid()));
+            std::filesystem::create_directories(path);
+            return path;
+        }();
+        return dir;
+    }
+
+    void cleanup()
+    {
+        std::error_code ec;
+        std::filesystem::remove_all(work_dir(), ec);
+    }
+
+    std::vector<CsvParser::ParserData> make_records(size_t rows, uint64_t seed)
+    {
+        std::mt19937_64 rng(seed);
+        std::uniform_int_distribution<int> step(-2, 2);
+        std::vector<CsvParser::ParserData> data;
+        data.reserve(rows);
+        int64_t ticks = 684800;
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            ticks += step(rng);
+            data.push_back({1716810808000000 + i * 10, ticks / 10.0});
+        }
+        return data;
+    }
+
+    std::vector<std::vector<CsvParser::ParserData>> make_chunks(size_t rows, size_t files, size_t chunk_rows)
+    {
+        const auto data = make_records(rows);
+        std::vector<std::vector<CsvParser::ParserData>> per_file(files);
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            per_file[i % files].push_back(data[i]);
+        }
+
+        std::vector<std::vector<CsvParser::ParserData>> chunks;
+        for (size_t begin = 0; ; begin += chunk_rows)
+        {
+            bool any = false;
+            for (const auto& file : per_file)
+            {
+                if (begin < file.size())
+                {
+                    chunks.emplace_back(file.begin() + begin, file.begin() + std::min(begin + chunk_rows, file.size()));
+                    any = true;
+                }
+            }
+            if (!any)
+            {
+                break;
+            }
+        }
+        return chunks;
+    }
+
+    const CsvSet& csv_set(size_t rows, size_t files)
+    {
+        static std::map<std::pair<size_t, size_t>, CsvSet> sets;
+        auto it = sets.find({rows, files});
+        if (it != sets.end())
+        {
+            return it->second;
+        }
+
+        MarketDataGenerator::Options options;
+        options.output_dir = work_dir();
+        options.prefix = "trades_" + std::to_string(rows);
+        options.files = files;
+        options.rows = rows;
+        options.threads = std::max(1u, std::thread::hardware_concurrency());
+        CsvSet set;
+        for (const auto& file : MarketDataGenerator(options).run())
+        {
+            set.files.push_back(file.path);
+            set.bytes += file.bytes;
+        }
+        return sets.emplace(std::make_pair(rows, files), std::move(set)).first->second;
+    }
+
+    void write_sorted_file(const std::filesystem::path& file, const std::vector<CsvParser::ParserData>& data)
+    {
+        ParserDataSerializer serializer;
+        std::ofstream out(file, std::ios::binary);
+        uint64_t size = data.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        for (const auto& record : data)
+        {
+            serializer.write(out, record);
+        }
+    }
+} //namespace bench_data
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../src/csv_parser/csv_parser.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace bench_data
+{
+    struct CsvSet
+    {
+        std::vector<std::filesystem::path> files;
+        uint64_t bytes = 0;
+    };
+
+    // Temporary directory of the run, removed by cleanup
+    const std::filesystem::path& work_dir();
+    void cleanup();
+
+    // Random walk on a 0.1 grid with strictly increasing receive_ts, the same for equal arguments
+    std::vector<CsvParser::ParserData> make_records(size_t rows, uint64_t seed = 7);
+    // Records dealt round-robin to `files` parser tasks and cut into chunks as the parser hands them over:
+    // every chunk is sorted, chunks of different tasks interleave in time
+    std::vector<std::vector<CsvParser::ParserData>> make_chunks(size_t rows, size_t files, size_t chunk_rows);
+    // Files of MarketDataGenerator with default options holding `rows` records in total, written once per argument pair
+    const CsvSet& csv_set(size_t rows, size_t files);
+    // Run file as written by OutWriter::write_to_temporary, the input of MedianAlgorithm::process_file
+    void write_sorted_file(const std::filesystem::path& file, const std::vector<CsvParser::ParserData>& data);
+} //namespace bench_data
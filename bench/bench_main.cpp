@@ -0,0 +1,173 @@
+#include "bench_data.hpp"
+#include "../src/logger/logger.hpp"
+
+#include <benchmark/benchmark.h>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    struct Rates
+    {
+        std::optional<double> items;
+        std::optional<double> bytes;
+    };
+
+    // Keeps the rate counters of every run next to the usual console output
+    class RateReporter : public benchmark::ConsoleReporter
+    {
+    public:
+        void ReportRuns(const std::vector<Run>& runs) override
+        {
+            for (const auto& run : runs)
+            {
+                Rates rates;
+                if (auto it = run.counters.find("items_per_second"); it != run.counters.end())
+                {
+                    rates.items = it->second.value;
+                }
+                if (auto it = run.counters.find("bytes_per_second"); it != run.counters.end())
+                {
+                    rates.bytes = it->second.value;
+                }
+                m_rates[run.benchmark_name()] = rates;
+            }
+            ConsoleReporter::ReportRuns(runs);
+        }
+
+        inline const std::map<std::string, Rates>& rates() const
+        {
+            return m_rates;
+        }
+    private:
+        std::map<std::string, Rates> m_rates;
+    };
+
+    // Reads a file written with --benchmark_out=<file> --benchmark_out_format=json
+    std::map<std::string, Rates> load_baseline(const std::string& file)
+    {
+        boost::property_tree::ptree root;
+        boost::property_tree::read_json(file, root);
+
+        std::map<std::string, Rates> baseline;
+        for (const auto& [key, entry] : root.get_child("benchmarks"))
+        {
+            Rates rates;
+            if (auto items = entry.get_optional<double>("items_per_second"))
+            {
+                rates.items = *items;
+            }
+            if (auto bytes = entry.get_optional<double>("bytes_per_second"))
+            {
+                rates.bytes = *bytes;
+            }
+            baseline[entry.get<std::string>("name")] = rates;
+        }
+        return baseline;
+    }
+
+    // Prints every rate next to its baseline, returns the number of rates that dropped by more than max_regression
+    size_t compare(const std::map<std::string, Rates>& baseline, const std::map<std::string, Rates>& current, double max_regression)
+    {
+        size_t regressions = 0;
+        std::printf("\n%-60s %-6s %14s %14s %9s\n", "Benchmark", "Rate", "Baseline", "Current", "Change");
+        auto report = [&](const std::string& name, const char* unit, const std::optional<double>& before, const std::optional<double>& after)
+        {
+            if (!before || !after || *before <= 0.0)
+            {
+                return;
+            }
+            const double change = *after / *before - 1.0;
+            const bool regressed = change < -max_regression;
+            regressions += regressed;
+            std::printf("%-60s %-6s %14.4g %14.4g %+8.1f%%%s\n", name.c_str(), unit, *before, *after, change * 100.0, regressed ? "  REGRESSION" : "");
+        };
+
+        for (const auto& [name, rates] : current)
+        {
+            auto it = baseline.find(name);
+            if (it == baseline.end())
+            {
+                std::printf("%-60s not in baseline\n", name.c_str());
+                continue;
+            }
+            report(name, "rows/s", it->second.items, rates.items);
+            report(name, "B/s", it->second.bytes, rates.bytes);
+        }
+        return regressions;
+    }
+} //anonymous namespace
+
+// Google Benchmark flags plus:
+//   --baseline=<file.json>    compare the rates against an earlier --benchmark_out json, exit code 1 on a regression
+//   --max-regression=<ratio>  tolerated slowdown before a rate counts as a regression (default: 0.10)
+int main(int argc, char* argv[])
+{
+    std::string baseline_file;
+    double max_regression = 0.10;
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string_view arg(argv[i]);
+        if (arg.starts_with("--baseline="))
+        {
+            baseline_file = arg.substr(std::string_view("--baseline=").size());
+        }
+        else if (arg.starts_with("--max-regression="))
+        {
+            max_regression = std::strtod(argv[i] + std::string_view("--max-regression=").size(), nullptr);
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+
+    std::map<std::string, Rates> baseline;
+    if (!baseline_file.empty())
+    {
+        try
+        {
+            baseline = load_baseline(baseline_file);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Cannot read baseline {}: {}", baseline_file, err.what());
+            return EXIT_FAILURE;
+        }
+    }
+
+    int bench_argc = static_cast<int>(args.size());
+    benchmark::Initialize(&bench_argc, args.data());
+    if (benchmark::ReportUnrecognizedArguments(bench_argc, args.data()))
+    {
+        return EXIT_FAILURE;
+    }
+
+    RateReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    bench_data::cleanup();
+
+    if (baseline_file.empty())
+    {
+        return EXIT_SUCCESS;
+    }
+    const size_t regressions = compare(baseline, reporter.rates(), max_regression);
+    if (regressions != 0)
+    {
+        std::printf("\n%zu rates regressed by more than %.1f%% against %s\n", regressions, max_regression * 100.0, baseline_file.c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
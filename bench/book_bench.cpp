@@ -0,0 +1,159 @@
+#include "bench_data.hpp"
+#include "../src/book/order_book.hpp"
+#include "../src/generator/market_data_generator.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Lines of one level.csv file of MarketDataGenerator, header dropped
+    const std::vector<std::string>& level_lines(size_t rows)
+    {
+        static std::map<size_t, std::vector<std::string>> sets;
+        auto it = sets.find(rows);
+        if (it != sets.end())
+        {
+            return it->second;
+        }
+        MarketDataGenerator::Options options;
+        options.output_dir = bench_data::work_dir();
+        options.kind = MarketDataGenerator::Kind::level;
+        options.prefix = "level_" + std::to_string(rows);
+        options.rows = rows;
+        std::vector<std::string> lines;
+        std::ifstream in(MarketDataGenerator(options).run().front().path);
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line))
+        {
+            lines.push_back(line);
+        }
+        return sets.emplace(rows, std::move(lines)).first->second;
+    }
+
+    // BookBuilder::push: row parsing, the ladder update and the mid price at every event end
+    void BM_BookBuilder(benchmark::State& state)
+    {
+        const auto& lines = level_lines(state.range(0));
+        for (auto _ : state)
+        {
+            BookBuilder builder(BookBuilder::Options{0.1, BookBuilder::Price::mid});
+            double sum = 0.0;
+            for (const auto& line : lines)
+            {
+                if (auto sample = builder.push(line))
+                {
+                    sum += sample->price;
+                }
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * lines.size());
+    }
+
+    // The ladder updates alone against the same updates on node-based maps, rows parsed beforehand
+    struct Update
+    {
+        bool bid;
+        int64_t ticks;
+        double quantity;
+    };
+
+    std::vector<Update> level_updates(size_t rows)
+    {
+        std::vector<Update> updates;
+        OrderBook book(0.1);
+        for (const auto& line : level_lines(rows))
+        {
+            std::vector<std::string_view> columns;
+            std::string_view rest = line;
+            for (size_t pos = rest.find(';'); pos != std::string_view::npos; pos = rest.find(';'))
+            {
+                columns.push_back(rest.substr(0, pos));
+                rest.remove_prefix(pos + 1);
+            }
+            columns.push_back(rest);
+            double price = 0.0;
+            double quantity = 0.0;
+            std::from_chars(columns[2].data(), columns[2].data() + columns[2].size(), price);
+            std::from_chars(columns[3].data(), columns[3].data() + columns[3].size(), quantity);
+            updates.push_back({columns[4] == "bid", book.ticks(price), quantity});
+        }
+        return updates;
+    }
+
+    void BM_LadderUpdates(benchmark::State& state)
+    {
+        const auto updates = level_updates(state.range(0));
+        for (auto _ : state)
+        {
+            OrderBook book(0.1);
+            double sum = 0.0;
+            for (const auto& update : updates)
+            {
+                book.update(update.bid, update.ticks, update.quantity);
+                sum += book.mid().value_or(0.0);
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * updates.size());
+    }
+
+    void BM_MapUpdates(benchmark::State& state)
+    {
+        const auto updates = level_updates(state.range(0));
+        for (auto _ : state)
+        {
+            std::map<int64_t, double, std::greater<>> bids;
+            std::map<int64_t, double> asks;
+            double sum = 0.0;
+            for (const auto& update : updates)
+            {
+                if (update.bid)
+                {
+                    update.quantity == 0.0 ? void(bids.erase(update.ticks)) : void(bids[update.ticks] = update.quantity);
+                    while (update.quantity != 0.0 && !asks.empty() && asks.begin()->first <= update.ticks)
+                    {
+                        asks.erase(asks.begin());
+                    }
+                }
+                else
+                {
+                    update.quantity == 0.0 ? void(asks.erase(update.ticks)) : void(asks[update.ticks] = update.quantity);
+                    while (update.quantity != 0.0 && !bids.empty() && bids.begin()->first >= update.ticks)
+                    {
+                        bids.erase(bids.begin());
+                    }
+                }
+                if (!bids.empty() && !asks.empty())
+                {
+                    sum += (bids.begin()->first + asks.begin()->first) * 0.05;
+                }
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * updates.size());
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_BookBuilder)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_LadderUpdates)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_MapUpdates)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,126 @@
+#include "bench_data.hpp"
+#include "../src/system/bulk_memory.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <random>
+
+namespace
+{
+    using Record = CsvParser::ParserData;
+
+    // dTLB read misses of the calling thread, -1 when perf events are not allowed (perf_event_paranoid, containers)
+    class TlbMissCounter
+    {
+    public:
+        TlbMissCounter()
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        ~TlbMissCounter()
+        {
+            if (m_fd >= 0)
+            {
+                ::close(m_fd);
+            }
+        }
+
+        void start()
+        {
+            if (m_fd >= 0)
+            {
+                ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        int64_t stop()
+        {
+            uint64_t value = 0;
+            if (m_fd < 0)
+            {
+                return -1;
+            }
+            ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            return ::read(m_fd, &value, sizeof(value)) == sizeof(value) ? static_cast<int64_t>(value) : -1;
+        }
+    private:
+        int m_fd = -1;
+    };
+
+    long thread_page_faults()
+    {
+        rusage usage;
+        ::getrusage(RUSAGE_THREAD, &usage);
+        return usage.ru_minflt + usage.ru_majflt;
+    }
+
+    // Ingest into a freshly reserved buffer as OutWriter does, then a random gather over it as the merge heap and the
+    // parallel median blocks see it. Page faults are those of the ingest thread, so prefaulted pages do not count
+    void BM_BulkBuffer(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        bulk_memory::configure(bulk_memory::Options{state.range(1) != 0, state.range(2) != 0});
+        const auto data = bench_data::make_records(1 << 16);
+        std::vector<uint32_t> probes(1 << 20);
+        std::mt19937 rng(3);
+        for (auto& probe : probes)
+        {
+            probe = rng() % rows;
+        }
+
+        TlbMissCounter tlb;
+        double faults = 0;
+        double tlb_misses = 0;
+        for (auto _ : state)
+        {
+            const long faults_before = thread_page_faults();
+            std::vector<Record> buffer;
+            buffer.reserve(rows);
+            std::jthread prefault = bulk_memory::prepare(buffer);
+            for (size_t i = 0; i < rows; ++i)
+            {
+                buffer.push_back(data[i & (data.size() - 1)]);
+            }
+            faults += thread_page_faults() - faults_before;
+
+            tlb.start();
+            double sum = 0;
+            for (uint32_t probe : probes)
+            {
+                sum += buffer[probe].price;
+            }
+            tlb_misses += static_cast<double>(tlb.stop());
+            benchmark::DoNotOptimize(sum);
+        }
+        bulk_memory::configure(bulk_memory::Options{});
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+        state.counters["page_faults"] = benchmark::Counter(faults, benchmark::Counter::kAvgIterations);
+        if (tlb_misses >= 0)
+        {
+            state.counters["dtlb_misses"] = benchmark::Counter(tlb_misses, benchmark::Counter::kAvgIterations);
+        }
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_BulkBuffer)
+    ->ArgNames({"rows", "huge_pages", "prefault"})
+    ->ArgsProduct({{1 << 24}, {0, 1}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,72 @@
+#include "bench_data.hpp"
+#include "../src/out_writer/algorithm_median.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+    using Record = CsvParser::ParserData;
+
+    // Median pass over sorted data plus writing the csv output; mode 0 is heaps, 1 is parallel, 2 is offline
+    void BM_ProcessInMemory(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const auto mode = static_cast<MedianAlgorithm::Mode>(state.range(1));
+        const uint32_t threads = state.range(2);
+        const auto data = bench_data::make_records(rows);
+        const std::string output = (bench_data::work_dir() / "median_in_memory.csv").string();
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            auto input = data;
+            MedianAlgorithm algorithm(mode, threads);
+            state.ResumeTiming();
+
+            algorithm.process_in_memory(std::move(input), output);
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+    }
+
+    // Median pass over a merged run file (P^2 after the first rows) plus writing the csv output
+    void BM_ProcessFile(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const auto data = bench_data::make_records(rows);
+        const auto input = bench_data::work_dir() / "median_sorted.bin";
+        const std::string output = (bench_data::work_dir() / "median_file.csv").string();
+        auto serializer = std::make_shared<ParserDataSerializer>();
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            // process_file deletes its input
+            bench_data::write_sorted_file(input, data);
+            MedianAlgorithm algorithm;
+            state.ResumeTiming();
+
+            algorithm.process_file(serializer, input.string(), output);
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_ProcessInMemory)
+    ->ArgNames({"rows", "mode", "threads"})
+    ->ArgsProduct({{1 << 16, 1 << 20, 1 << 22}, {0}, {1}})
+    ->ArgsProduct({{1 << 20, 1 << 22}, {1}, {2, 4, 8}})
+    ->ArgsProduct({{1 << 20, 1 << 22}, {2}, {1, 4}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_ProcessFile)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 16)->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,48 @@
+#include "bench_data.hpp"
+#include "../src/stream/median_stream.hpp"
+#include "../src/follow/latency_histogram.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+namespace
+{
+    // Latency of a single MedianStream::push after the heaps are reserved, as an embedded feed handler would call it.
+    // Every push is timed on its own; p50/p99/p99.9 are reported in nanoseconds next to the throughput
+    void BM_MedianStreamPush(benchmark::State& state)
+    {
+        using Clock = std::chrono::steady_clock;
+        const size_t rows = state.range(0);
+        const auto data = bench_data::make_records(rows);
+        LatencyHistogram latency;
+        uint64_t changes = 0;
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            MedianStream stream(MedianStream::Options{rows});
+            state.ResumeTiming();
+
+            for (const auto& record : data)
+            {
+                const auto start = Clock::now();
+                const bool changed = stream.push(record.receive_ts, record.price);
+                latency.record(Clock::now() - start);
+                changes += changed;
+            }
+            benchmark::DoNotOptimize(changes);
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.counters["p50_ns"] = static_cast<double>(latency.percentile(0.5).count());
+        state.counters["p99_ns"] = static_cast<double>(latency.percentile(0.99).count());
+        state.counters["p99.9_ns"] = static_cast<double>(latency.percentile(0.999).count());
+        state.counters["max_ns"] = static_cast<double>(latency.max().count());
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_MedianStreamPush)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 22)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
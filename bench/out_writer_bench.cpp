@@ -0,0 +1,167 @@
+#include "bench_data.hpp"
+#include "../src/out_writer/out_writer.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+#include "../src/out_writer/algorithm_median.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <memory>
+
+namespace
+{
+    using Record = CsvParser::ParserData;
+
+    struct ByReceiveTs
+    {
+        inline bool operator()(const Record& a, const Record& b) const
+        {
+            return a.receive_ts < b.receive_ts;
+        }
+    };
+
+    // Opens up the spill and merge stages so they can be timed without the rest of write_data
+    class OutWriterProbe : public OutWriter<Record, ByReceiveTs>
+    {
+    public:
+        OutWriterProbe(uint64_t max_elements, uint32_t max_threads)
+            : OutWriter(max_elements, std::make_shared<ParserDataSerializer>(), std::make_shared<MedianAlgorithm>(), ByReceiveTs(), max_threads)
+        {
+
+        }
+
+        ~OutWriterProbe()
+        {
+            m_queue->wait_for_pending();
+            remove_runs();
+        }
+
+        using OutWriter::write_to_temporary;
+        using OutWriter::merge_sort;
+
+        void wait_spills()
+        {
+            m_queue->wait_for_pending();
+        }
+
+        void remove_runs()
+        {
+            for (const auto& file : m_file_to_merge)
+            {
+                std::filesystem::remove(file);
+            }
+            m_file_to_merge.clear();
+        }
+    };
+
+    // Chunks of 4 parser tasks into a budget of almost all rows: the staging moves, the sorts and packing of every
+    // staged batch. Packed records take half the budget, so nothing is spilled
+    void BM_CollectDataSort(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const auto chunks = bench_data::make_chunks(rows, 4, 1 << 14);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            auto input = chunks;
+            OutWriterProbe writer(rows - 1, 1);
+            state.ResumeTiming();
+
+            for (auto& chunk : input)
+            {
+                writer.collect_data(std::move(chunk));
+            }
+
+            state.PauseTiming();
+            writer.wait_spills();
+            writer.remove_runs();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+    }
+
+    // One sorted run per spill thread, written concurrently
+    void BM_WriteToTemporary(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const uint32_t threads = state.range(1);
+        const auto data = bench_data::make_records(rows);
+        OutWriterProbe writer(rows, threads);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::vector<std::vector<Record>> runs(threads);
+            for (size_t i = 0; i < threads; ++i)
+            {
+                runs[i].assign(data.begin() + rows * i / threads, data.begin() + rows * (i + 1) / threads);
+            }
+            state.ResumeTiming();
+
+            for (auto& run : runs)
+            {
+                writer.write_to_temporary(std::move(run));
+            }
+            writer.wait_spills();
+
+            state.PauseTiming();
+            writer.remove_runs();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+    }
+
+    // k-way merge of `fan_in` runs whose timestamps interleave, as runs cut from parallel parser output do
+    void BM_MergeSort(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const size_t fan_in = state.range(1);
+        const auto data = bench_data::make_records(rows);
+        OutWriterProbe writer(rows, 4);
+
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            std::vector<std::vector<Record>> runs(fan_in);
+            for (size_t i = 0; i < data.size(); ++i)
+            {
+                runs[i % fan_in].push_back(data[i]);
+            }
+            for (auto& run : runs)
+            {
+                writer.write_to_temporary(std::move(run));
+            }
+            writer.wait_spills();
+            state.ResumeTiming();
+
+            const std::string merged = writer.merge_sort();
+
+            state.PauseTiming();
+            std::filesystem::remove(merged);
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * rows * sizeof(Record));
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_CollectDataSort)
+    ->ArgNames({"rows"})
+    ->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 22)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_WriteToTemporary)
+    ->ArgNames({"rows", "threads"})
+    ->ArgsProduct({{1 << 16, 1 << 20}, {1, 2, 4}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_MergeSort)
+    ->ArgNames({"rows", "fan_in"})
+    ->ArgsProduct({{1 << 16, 1 << 20}, {2, 8, 32}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
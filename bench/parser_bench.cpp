@@ -0,0 +1,47 @@
+#include "bench_data.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+    constexpr uint64_t parser_memory = 524288000;
+    constexpr size_t parser_files = 8;
+
+    // add_file_to_parse + draining get_ready_data, i.e. parse_csv_data on every worker plus the hand-over queue
+    void BM_ParseCsv(benchmark::State& state)
+    {
+        const size_t rows = state.range(0);
+        const uint32_t threads = state.range(1);
+        const auto& set = bench_data::csv_set(rows, parser_files);
+
+        for (auto _ : state)
+        {
+            CsvParser parser(parser_memory, threads);
+            for (const auto& file : set.files)
+            {
+                parser.add_file_to_parse(file.string());
+            }
+            parser.wait_task_done();
+            uint64_t parsed = 0;
+            while (auto data = parser.get_ready_data())
+            {
+                parsed += data->size();
+            }
+            benchmark::DoNotOptimize(parsed);
+            if (parsed != rows)
+            {
+                state.SkipWithError("parser lost rows");
+                break;
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * rows);
+        state.SetBytesProcessed(state.iterations() * set.bytes);
+    }
+} //anonymous namespace
+
+BENCHMARK(BM_ParseCsv)
+    ->ArgNames({"rows", "threads"})
+    ->ArgsProduct({{1 << 16, 1 << 20}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
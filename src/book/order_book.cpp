@@ -0,0 +1,173 @@
+#include "order_book.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    constexpr size_t level_columns = 6;
+    // Relative distance from the grid still taken as on it, to absorb the decimal to binary rounding
+    constexpr double tick_tolerance = 1e-6;
+
+    template<typename T>
+    T parse_number(std::string_view text, const char* column)
+    {
+        T value {};
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc() || ptr != text.data() + text.size())
+        {
+            throw std::invalid_argument(std::string("bad ") + column);
+        }
+        return value;
+    }
+} //anonymous namespace
+
+OrderBook::OrderBook(double tick_size, size_t max_levels) : m_bids(true, max_levels), m_asks(false, max_levels), m_tick_size(tick_size)
+{
+    if (!(tick_size > 0.0))
+    {
+        throw std::invalid_argument("Tick size must be positive");
+    }
+}
+
+bool OrderBook::update(bool bid, int64_t ticks, double quantity)
+{
+    PriceLadder& same = bid ? m_bids : m_asks;
+    if (!same.set(ticks, quantity))
+    {
+        return false;
+    }
+    if (quantity != 0.0)
+    {
+        m_crossed += (bid ? m_asks : m_bids).erase_through(ticks);
+    }
+    return true;
+}
+
+void OrderBook::clear()
+{
+    m_bids.clear();
+    m_asks.clear();
+}
+
+int64_t OrderBook::ticks(double price) const
+{
+    const double exact = price / m_tick_size;
+    const double rounded = std::nearbyint(exact);
+    if (!std::isfinite(exact) || std::abs(exact - rounded) > tick_tolerance * std::max(1.0, std::abs(exact)))
+    {
+        throw std::invalid_argument("price is off the tick grid");
+    }
+    return static_cast<int64_t>(rounded);
+}
+
+std::optional<double> OrderBook::mid() const
+{
+    if (m_bids.empty() || m_asks.empty())
+    {
+        return std::nullopt;
+    }
+    return static_cast<double>(m_bids.best_ticks() + m_asks.best_ticks()) * m_tick_size / 2.0;
+}
+
+std::optional<double> OrderBook::microprice() const
+{
+    if (m_bids.empty() || m_asks.empty())
+    {
+        return std::nullopt;
+    }
+    const double bid = static_cast<double>(m_bids.best_ticks()) * m_tick_size;
+    const double ask = static_cast<double>(m_asks.best_ticks()) * m_tick_size;
+    const double bid_quantity = m_bids.best_quantity();
+    const double ask_quantity = m_asks.best_quantity();
+    return (bid * ask_quantity + ask * bid_quantity) / (bid_quantity + ask_quantity);
+}
+
+BookBuilder::BookBuilder(Options options) : m_book(options.tick_size), m_price(options.price)
+{
+
+}
+
+std::optional<BookBuilder::Sample> BookBuilder::push(std::string_view line)
+{
+    std::array<std::string_view, level_columns> columns;
+    size_t count = 0;
+    for (size_t pos = 0; count < level_columns; ++count)
+    {
+        const size_t end = line.find(';', pos);
+        columns[count] = line.substr(pos, end == std::string_view::npos ? std::string_view::npos : end - pos);
+        if (end == std::string_view::npos)
+        {
+            ++count;
+            break;
+        }
+        pos = end + 1;
+    }
+    if (count < level_columns)
+    {
+        throw std::invalid_argument("missing columns");
+    }
+    const uint64_t ts = parse_number<uint64_t>(columns[0], "receive_ts");
+    const double quantity = parse_number<double>(columns[3], "quantity");
+    const int64_t ticks = m_book.ticks(parse_number<double>(columns[2], "price"));
+    bool bid;
+    if (columns[4] == "bid" || columns[4] == "buy")
+    {
+        bid = true;
+    }
+    else if (columns[4] == "ask" || columns[4] == "sell")
+    {
+        bid = false;
+    }
+    else
+    {
+        throw std::invalid_argument("bad side");
+    }
+    if (columns[5] != "0" && columns[5] != "1")
+    {
+        throw std::invalid_argument("bad rebuild flag");
+    }
+    if (quantity < 0.0)
+    {
+        throw std::invalid_argument("negative quantity");
+    }
+
+    std::optional<Sample> sample;
+    if (m_event_open && ts != m_event_ts)
+    {
+        sample = close_event();
+    }
+    m_event_open = true;
+    m_event_ts = ts;
+    if (columns[5] == "1" && !m_event_rebuilt)
+    {
+        m_book.clear();
+        m_event_rebuilt = true;
+    }
+    if (!m_book.update(bid, ticks, quantity))
+    {
+        ++m_dropped;
+    }
+    return sample;
+}
+
+std::optional<BookBuilder::Sample> BookBuilder::finish()
+{
+    return m_event_open ? close_event() : std::nullopt;
+}
+
+std::optional<BookBuilder::Sample> BookBuilder::close_event()
+{
+    m_event_open = false;
+    m_event_rebuilt = false;
+    const auto price = m_price == Price::mid ? m_book.mid() : m_book.microprice();
+    if (!price)
+    {
+        return std::nullopt;
+    }
+    return Sample{m_event_ts, *price};
+}
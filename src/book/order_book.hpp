@@ -0,0 +1,96 @@
+#pragma once
+
+#include "price_ladder.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Price levels of both sides on tick-indexed ladders
+class OrderBook
+{
+public:
+    explicit OrderBook(double tick_size, size_t max_levels = PriceLadder::default_max_levels);
+    // Quantity 0 removes the level. A level at or through the other side's best removes the levels it crosses, the
+    // newer price wins. False when the price does not fit the ladder
+    bool update(bool bid, int64_t ticks, double quantity);
+    void clear();
+    // Price in ticks, throws std::invalid_argument when it is off the tick grid
+    int64_t ticks(double price) const;
+    // Both need a level on each side
+    std::optional<double> mid() const;
+    // Best prices weighted by the opposite quantity, leaning to the side that is about to be taken out
+    std::optional<double> microprice() const;
+    inline const PriceLadder& bids() const
+    {
+        return m_bids;
+    }
+    inline const PriceLadder& asks() const
+    {
+        return m_asks;
+    }
+    // Levels removed because a newer level crossed them
+    inline uint64_t crossed_levels() const
+    {
+        return m_crossed;
+    }
+private:
+    PriceLadder m_bids;
+    PriceLadder m_asks;
+    double m_tick_size;
+    uint64_t m_crossed = 0;
+};
+
+// Rebuilds the book from level.csv rows (receive_ts;exchange_ts;price;quantity;side;rebuild) and derives one price
+// per event, the consecutive rows sharing a receive_ts. The first rebuild=1 row of an event replaces the whole book
+class BookBuilder
+{
+public:
+    enum class Price
+    {
+        mid,
+        microprice
+    };
+
+    struct Options
+    {
+        double tick_size = 0.01;
+        Price price = Price::mid;
+    };
+
+    struct Sample
+    {
+        uint64_t receive_ts;
+        double price;
+    };
+
+    explicit BookBuilder(Options options);
+    // Price after the event this row closes, when the book then had both sides. Throws std::invalid_argument on a
+    // malformed row, which leaves the book as it was
+    std::optional<Sample> push(std::string_view line);
+    // Price after the last event
+    std::optional<Sample> finish();
+    inline const OrderBook& book() const
+    {
+        return m_book;
+    }
+    // receive_ts of the last row pushed
+    inline uint64_t last_ts() const
+    {
+        return m_event_ts;
+    }
+    // Levels too far from the rest of their side to fit the ladder, they are left out of the book
+    inline uint64_t dropped_levels() const
+    {
+        return m_dropped;
+    }
+private:
+    std::optional<Sample> close_event();
+
+    OrderBook m_book;
+    Price m_price;
+    uint64_t m_event_ts = 0;
+    uint64_t m_dropped = 0;
+    bool m_event_open = false;
+    bool m_event_rebuilt = false;
+};
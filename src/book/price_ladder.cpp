@@ -0,0 +1,173 @@
+#include "price_ladder.hpp"
+
+#include <algorithm>
+#include <bit>
+
+PriceLadder::PriceLadder(bool bids, size_t max_levels) : m_max_levels(std::bit_floor(std::max(max_levels, initial_levels))), m_bids(bids)
+{
+
+}
+
+bool PriceLadder::set(int64_t ticks, double quantity)
+{
+    if (quantity == 0.0)
+    {
+        if (m_count == 0 || ticks < m_base || ticks - m_base >= static_cast<int64_t>(m_quantity.size()))
+        {
+            return true;
+        }
+        const size_t index = static_cast<size_t>(ticks - m_base);
+        if (!occupied(index))
+        {
+            return true;
+        }
+        m_quantity[index] = 0.0;
+        m_occupied[index / 64] &= ~(uint64_t{1} << (index % 64));
+        if (--m_count != 0 && index == m_best)
+        {
+            m_best = next_worse(index);
+        }
+        return true;
+    }
+    if (!fit(ticks))
+    {
+        return false;
+    }
+    const size_t index = static_cast<size_t>(ticks - m_base);
+    if (!occupied(index))
+    {
+        m_occupied[index / 64] |= uint64_t{1} << (index % 64);
+        if (m_count++ == 0 || better(index, m_best))
+        {
+            m_best = index;
+        }
+    }
+    m_quantity[index] = quantity;
+    return true;
+}
+
+size_t PriceLadder::erase_through(int64_t ticks)
+{
+    size_t removed = 0;
+    while (m_count != 0 && (m_bids ? best_ticks() >= ticks : best_ticks() <= ticks))
+    {
+        set(best_ticks(), 0.0);
+        ++removed;
+    }
+    return removed;
+}
+
+void PriceLadder::clear()
+{
+    for (size_t word = 0; word < m_occupied.size() && m_count != 0; ++word)
+    {
+        for (uint64_t bits = m_occupied[word]; bits != 0; bits &= bits - 1)
+        {
+            m_quantity[word * 64 + std::countr_zero(bits)] = 0.0;
+            --m_count;
+        }
+        m_occupied[word] = 0;
+    }
+}
+
+double PriceLadder::quantity(int64_t ticks) const
+{
+    if (ticks < m_base || ticks - m_base >= static_cast<int64_t>(m_quantity.size()))
+    {
+        return 0.0;
+    }
+    return m_quantity[static_cast<size_t>(ticks - m_base)];
+}
+
+size_t PriceLadder::next_worse(size_t index) const
+{
+    size_t word = index / 64;
+    if (m_bids)
+    {
+        uint64_t bits = m_occupied[word] & (~uint64_t{0} >> (63 - index % 64));
+        while (bits == 0)
+        {
+            if (word == 0)
+            {
+                return npos;
+            }
+            bits = m_occupied[--word];
+        }
+        return word * 64 + 63 - std::countl_zero(bits);
+    }
+    uint64_t bits = m_occupied[word] & (~uint64_t{0} << (index % 64));
+    while (bits == 0)
+    {
+        if (++word == m_occupied.size())
+        {
+            return npos;
+        }
+        bits = m_occupied[word];
+    }
+    return word * 64 + std::countr_zero(bits);
+}
+
+bool PriceLadder::fit(int64_t ticks)
+{
+    const int64_t size = static_cast<int64_t>(m_quantity.size());
+    if (size != 0 && ticks >= m_base && ticks - m_base < size)
+    {
+        return true;
+    }
+    if (m_count == 0)
+    {
+        // Nothing to keep, so the ladder is only moved to centre on the price
+        if (size == 0)
+        {
+            m_quantity.assign(initial_levels, 0.0);
+            m_occupied.assign(initial_levels / 64, 0);
+        }
+        m_base = ticks - static_cast<int64_t>(m_quantity.size() / 2);
+        return true;
+    }
+
+    // Only the occupied levels are kept, so a price drifting away moves the ladder rather than growing it
+    size_t first = npos;
+    size_t last = 0;
+    for (size_t word = 0; word < m_occupied.size(); ++word)
+    {
+        if (m_occupied[word] != 0)
+        {
+            first = std::min(first, word * 64 + std::countr_zero(m_occupied[word]));
+            last = word * 64 + 63 - std::countl_zero(m_occupied[word]);
+        }
+    }
+    const int64_t lo = std::min(m_base + static_cast<int64_t>(first), ticks);
+    const int64_t hi = std::max(m_base + static_cast<int64_t>(last), ticks) + 1;
+    const uint64_t span = static_cast<uint64_t>(hi - lo);
+    if (span > m_max_levels)
+    {
+        return false;
+    }
+    // Room on both sides, so the next levels past the new one fit without another move
+    size_t new_size = m_quantity.size();
+    while (new_size < 2 * span && new_size < m_max_levels)
+    {
+        new_size *= 2;
+    }
+    const int64_t new_base = lo - static_cast<int64_t>((new_size - span) / 2);
+
+    std::vector<double> quantity(new_size, 0.0);
+    std::vector<uint64_t> occupied(new_size / 64, 0);
+    const int64_t shift = m_base - new_base;
+    for (size_t word = 0; word < m_occupied.size(); ++word)
+    {
+        for (uint64_t bits = m_occupied[word]; bits != 0; bits &= bits - 1)
+        {
+            const size_t index = word * 64 + std::countr_zero(bits);
+            const size_t moved = static_cast<size_t>(static_cast<int64_t>(index) + shift);
+            quantity[moved] = m_quantity[index];
+            occupied[moved / 64] |= uint64_t{1} << (moved % 64);
+        }
+    }
+    m_quantity = std::move(quantity);
+    m_occupied = std::move(occupied);
+    m_best = static_cast<size_t>(static_cast<int64_t>(m_best) + shift);
+    m_base = new_base;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One side of an order book as a flat array of quantities indexed by price in ticks. Occupied levels are also marked
+// in a bitmap, so when the best level goes away the next one is found 64 levels per step instead of level by level.
+// When a price falls outside the array, it is recentred on the occupied levels and grows if they need the room
+class PriceLadder
+{
+public:
+    // Bids are best at the highest price, asks at the lowest. max_levels is rounded down to a power of two
+    explicit PriceLadder(bool bids, size_t max_levels = default_max_levels);
+    // Quantity 0 removes the level. False when the price is more than max_levels away from the occupied ones
+    bool set(int64_t ticks, double quantity);
+    // Removes the levels from the best one through ticks, e.g. the asks at or below a newer bid; returns how many
+    size_t erase_through(int64_t ticks);
+    void clear();
+    double quantity(int64_t ticks) const;
+    inline bool empty() const
+    {
+        return m_count == 0;
+    }
+    inline size_t levels() const
+    {
+        return m_count;
+    }
+    // Best level, only when the ladder is not empty
+    inline int64_t best_ticks() const
+    {
+        return m_base + static_cast<int64_t>(m_best);
+    }
+    inline double best_quantity() const
+    {
+        return m_quantity[m_best];
+    }
+
+    inline static constexpr size_t default_max_levels = 1 << 22;
+    inline static constexpr size_t initial_levels = 1 << 12;
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    inline bool occupied(size_t index) const
+    {
+        return (m_occupied[index / 64] >> (index % 64) & 1) != 0;
+    }
+    inline bool better(size_t a, size_t b) const
+    {
+        return m_bids ? a > b : a < b;
+    }
+    // Occupied index nearest to index on the side of the worse prices, index included
+    size_t next_worse(size_t index) const;
+    // Makes ticks an index of the array, false when that would take more than max_levels
+    bool fit(int64_t ticks);
+
+    std::vector<double> m_quantity;
+    std::vector<uint64_t> m_occupied;
+    int64_t m_base = 0;
+    size_t m_best = 0;
+    size_t m_count = 0;
+    size_t m_max_levels;
+    bool m_bids;
+};
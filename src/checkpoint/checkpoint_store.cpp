@@ -0,0 +1,124 @@
+#include "checkpoint_store.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint64_t checkpoint_magic = 0x31544e504b484343; // "CCHKPNT1"
+
+    template<typename T>
+    inline void write_value(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    inline T read_value(std::istream& is)
+    {
+        T value {};
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        if (!is)
+        {
+            throw std::runtime_error("Checkpoint is truncated");
+        }
+        return value;
+    }
+
+    inline void write_string(std::ostream& os, const std::string& value)
+    {
+        write_value<uint64_t>(os, value.size());
+        os.write(value.data(), value.size());
+    }
+
+    inline std::string read_string(std::istream& is)
+    {
+        std::string value(read_value<uint64_t>(is), '\0');
+        is.read(value.data(), value.size());
+        if (!is)
+        {
+            throw std::runtime_error("Checkpoint is truncated");
+        }
+        return value;
+    }
+} //anonymous namespace
+
+std::optional<CheckpointStore::Checkpoint> CheckpointStore::load(const std::filesystem::path& file_path)
+{
+    if (!std::filesystem::exists(file_path))
+    {
+        return std::nullopt;
+    }
+    std::ifstream in(file_path, std::ios::binary);
+    if (!in.is_open())
+    {
+        throw std::runtime_error("Cannot open checkpoint: " + file_path.string());
+    }
+    if (read_value<uint64_t>(in) != checkpoint_magic)
+    {
+        throw std::runtime_error("Not a checkpoint file: " + file_path.string());
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.output_file = read_string(in);
+    uint64_t files = read_value<uint64_t>(in);
+    for (uint64_t i = 0; i < files; ++i)
+    {
+        std::string name = read_string(in);
+        FileEntry entry;
+        entry.offset = read_value<uint64_t>(in);
+        entry.last_ts = read_value<uint64_t>(in);
+        checkpoint.files.emplace(std::move(name), entry);
+    }
+    checkpoint.watermark = read_value<uint64_t>(in);
+    checkpoint.median.count = read_value<uint64_t>(in);
+    checkpoint.median.has_median = read_value<uint8_t>(in) != 0;
+    checkpoint.median.last_median = read_value<double>(in);
+    uint64_t values = read_value<uint64_t>(in);
+    checkpoint.median.histogram.reserve(values);
+    for (uint64_t i = 0; i < values; ++i)
+    {
+        double price = read_value<double>(in);
+        uint64_t count = read_value<uint64_t>(in);
+        checkpoint.median.histogram.emplace_back(price, count);
+    }
+    return checkpoint;
+}
+
+void CheckpointStore::save(const std::filesystem::path& file_path, const Checkpoint& checkpoint)
+{
+    std::filesystem::path tmp_path = file_path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            throw std::runtime_error("Cannot create checkpoint: " + tmp_path.string());
+        }
+        write_value(out, checkpoint_magic);
+        write_string(out, checkpoint.output_file);
+        write_value<uint64_t>(out, checkpoint.files.size());
+        for (const auto& [name, entry] : checkpoint.files)
+        {
+            write_string(out, name);
+            write_value(out, entry.offset);
+            write_value(out, entry.last_ts);
+        }
+        write_value(out, checkpoint.watermark);
+        write_value(out, checkpoint.median.count);
+        write_value<uint8_t>(out, checkpoint.median.has_median ? 1 : 0);
+        write_value(out, checkpoint.median.last_median);
+        write_value<uint64_t>(out, checkpoint.median.histogram.size());
+        for (const auto& [price, count] : checkpoint.median.histogram)
+        {
+            write_value(out, price);
+            write_value(out, count);
+        }
+        out.flush();
+        if (!out)
+        {
+            throw std::runtime_error("Cannot write checkpoint: " + tmp_path.string());
+        }
+    }
+    std::filesystem::rename(tmp_path, file_path);
+}
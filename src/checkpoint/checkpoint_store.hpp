@@ -0,0 +1,34 @@
+#pragma once
+
+#include "../out_writer/median_state.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+class CheckpointStore
+{
+public:
+
+    struct FileEntry
+    {
+        uint64_t offset;
+        uint64_t last_ts;
+    };
+
+    struct Checkpoint
+    {
+        std::string output_file;
+        std::map<std::string, FileEntry> files;
+        // Largest receive_ts already folded into the median, older rows cannot be appended
+        uint64_t watermark = 0;
+        MedianState median;
+    };
+
+    // Returns nullopt when there is no checkpoint, throws when it is unreadable
+    static std::optional<Checkpoint> load(const std::filesystem::path& file_path);
+    // Written to a temporary file and renamed, so a crash never leaves a torn checkpoint
+    static void save(const std::filesystem::path& file_path, const Checkpoint& checkpoint);
+};
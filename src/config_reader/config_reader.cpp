@@ -1,76 +1,190 @@
 #include "config_reader.hpp"
+#include "../csv_parser/compressed_input.hpp"
 
 #include <toml++/toml.h>
 
 #include <stdexcept>
 #include <iostream>
 
-ConfigReader::Config ConfigReader::load_from_file(const std::filesystem::path& file_path) 
+namespace
 {
-    if (!std::filesystem::exists(file_path)) 
-    {
-        throw std::runtime_error("Config file not found: " + file_path.string());
-    }
-    toml::parse_result result;
-    try 
+    toml::parse_result parse_file(const std::filesystem::path& file_path)
     {
-        result = toml::parse_file(file_path.string());
-    } 
-    catch (const toml::parse_error& err) 
-    {
-        std::ostringstream oss;
-        oss << "Failed to parse TOML: " << err.description();
-        if (err.source().path) 
+        if (!std::filesystem::exists(file_path)) 
+        {
+            throw std::runtime_error("Config file not found: " + file_path.string());
+        }
+        toml::parse_result result;
+        try 
+        {
+            result = toml::parse_file(file_path.string());
+        } 
+        catch (const toml::parse_error& err) 
         {
-            oss << " in file " << *err.source().path;
+            std::ostringstream oss;
+            oss << "Failed to parse TOML: " << err.description();
+            if (err.source().path) 
+            {
+                oss << " in file " << *err.source().path;
+            }
+            oss << " at line " << err.source().begin.line << ", column " << err.source().begin.column;
+            throw std::runtime_error(oss.str());
         }
-        oss << " at line " << err.source().begin.line << ", column " << err.source().begin.column;
-        throw std::runtime_error(oss.str());
+        return result;
     }
 
-    if (!result.contains("main")) 
+    // Keys of one job; where names the table in the errors
+    ConfigReader::Config parse_table(toml::node_view<toml::node> table, const std::string& where)
     {
-        throw std::runtime_error("Missing required table [main] in config file");
-    }
+        ConfigReader::Config cfg;
 
-    auto main_table = result["main"];
+        if (auto input_str = table["input"].value<std::string>()) 
+        {
+            cfg.input = std::filesystem::path(*input_str);
+        } 
+        else 
+        {
+            throw std::runtime_error("Missing or invalid 'input' field in " + where + " (must be string)");
+        }
 
-    Config cfg;
+        if (auto output_str = table["output"].value<std::string>()) 
+        {
+            cfg.output = std::filesystem::path(*output_str);
+        } 
+        else 
+        {
+            cfg.output = std::filesystem::path("./output");
+        }
 
-    if (auto input_str = main_table["input"].value<std::string>()) 
-    {
-        cfg.input = std::filesystem::path(*input_str);
-    } 
-    else 
-    {
-        throw std::runtime_error("Missing or invalid 'input' field in [main] (must be string)");
+        if (auto mask_array = table["filename_mask"].as_array()) 
+        {
+            for (auto&& elem : *mask_array) 
+            {
+                if (auto mask = elem.value<std::string>()) 
+                {
+                    cfg.filename_mask.push_back(*mask);
+                } 
+                else 
+                {
+                    throw std::runtime_error("All elements of 'filename_mask' must be strings");
+                }
+            }
+        }
+
+        if (table["output_format"])
+        {
+            if (auto format = table["output_format"].value<std::string>())
+            {
+                cfg.output_format = *format;
+            }
+            else
+            {
+                throw std::runtime_error("Invalid 'output_format' field in " + where + " (must be string)");
+            }
+        }
+
+        auto read_ts = [&table, &where](const char* key, uint64_t& value)
+        {
+            if (!table[key])
+            {
+                return;
+            }
+            auto ts = table[key].value<int64_t>();
+            if (!ts || *ts < 0)
+            {
+                throw std::runtime_error(std::string("Invalid '") + key + "' field in " + where + " (must be a non-negative integer receive_ts)");
+            }
+            value = static_cast<uint64_t>(*ts);
+        };
+        read_ts("from_ts", cfg.from_ts);
+        read_ts("to_ts", cfg.to_ts);
+        if (cfg.from_ts >= cfg.to_ts)
+        {
+            throw std::runtime_error("'from_ts' must be less than 'to_ts' in " + where);
+        }
+
+        if (table["sorted_input"])
+        {
+            if (auto sorted = table["sorted_input"].value<bool>())
+            {
+                cfg.sorted_input = *sorted;
+            }
+            else
+            {
+                throw std::runtime_error("Invalid 'sorted_input' field in " + where + " (must be boolean)");
+            }
+        }
+
+        if (table["book_price"])
+        {
+            auto price = table["book_price"].value<std::string>();
+            if (!price || (*price != "mid" && *price != "microprice"))
+            {
+                throw std::runtime_error("Invalid 'book_price' field in " + where + " (must be \"mid\" or \"microprice\")");
+            }
+            cfg.book_price = *price;
+        }
+
+        if (table["tick_size"])
+        {
+            auto tick_size = table["tick_size"].value<double>();
+            if (!tick_size || !(*tick_size > 0.0))
+            {
+                throw std::runtime_error("Invalid 'tick_size' field in " + where + " (must be a positive number)");
+            }
+            cfg.tick_size = *tick_size;
+        }
+
+        return cfg;
     }
+} //anonymous namespace
 
-    if (auto output_str = main_table["output"].value<std::string>()) 
-    {
-        cfg.output = std::filesystem::path(*output_str);
-    } 
-    else 
+ConfigReader::Config ConfigReader::load_from_file(const std::filesystem::path& file_path) 
+{
+    toml::parse_result result = parse_file(file_path);
+    if (!result.contains("main")) 
     {
-        cfg.output = std::filesystem::path("./output");
+        throw std::runtime_error("Missing required table [main] in config file");
     }
+    return parse_table(result["main"], "[main]");
+}
 
-    if (auto mask_array = main_table["filename_mask"].as_array()) 
+std::vector<ConfigReader::Config> ConfigReader::load_jobs(const std::filesystem::path& file_path)
+{
+    toml::parse_result result = parse_file(file_path);
+    std::vector<Config> jobs;
+    if (auto tables = result["jobs"].as_array())
     {
-        for (auto&& elem : *mask_array) 
+        for (size_t i = 0; i < tables->size(); ++i)
         {
-            if (auto mask = elem.value<std::string>()) 
+            const std::string where = "[[jobs]] #" + std::to_string(i + 1);
+            if (!(*tables)[i].is_table())
             {
-                cfg.filename_mask.push_back(*mask);
-            } 
-            else 
+                throw std::runtime_error(where + " must be a table");
+            }
+            toml::node_view<toml::node> table((*tables)[i]);
+            Config cfg = parse_table(table, where);
+            if (table["name"])
             {
-                throw std::runtime_error("All elements of 'filename_mask' must be strings");
+                if (auto name = table["name"].value<std::string>())
+                {
+                    cfg.name = *name;
+                }
+                else
+                {
+                    throw std::runtime_error("Invalid 'name' field in " + where + " (must be string)");
+                }
             }
+            jobs.push_back(std::move(cfg));
         }
+        return jobs;
     }
-
-    return cfg;
+    if (!result.contains("main")) 
+    {
+        throw std::runtime_error("Missing required table [main] or [[jobs]] in config file");
+    }
+    jobs.push_back(parse_table(result["main"], "[main]"));
+    return jobs;
 }
 
 
@@ -83,32 +197,36 @@ std::vector<std::filesystem::path> ConfigReader::find_files(const Config& cfg)
         throw std::runtime_error("Input directory does not exist or is not a directory: " + cfg.input.string());
     }
 
-    std::vector<std::filesystem::path> csv_files;
     for (const auto& entry : std::filesystem::directory_iterator(cfg.input)) 
     {
-        if (entry.is_regular_file() && entry.path().extension() == ".csv") 
+        if (entry.is_regular_file() && matches_mask(cfg, entry.path())) 
         {
-            csv_files.push_back(entry.path());
+            result.push_back(entry.path());
         }
     }
 
+    return result;
+}
+
+bool ConfigReader::matches_mask(const Config& cfg, const std::filesystem::path& file)
+{
+    // .csv.gz and .csv.zst are read without unpacking them first
+    if (!compressed_input::is_csv(file))
+    {
+        return false;
+    }
     if (cfg.filename_mask.empty()) 
     {
-        return csv_files;
+        return true;
     }
 
-    for (const auto& file : csv_files) 
+    std::string filename = file.filename().string();
+    for (const auto& mask : cfg.filename_mask) 
     {
-        std::string filename = file.filename().string();
-        for (const auto& mask : cfg.filename_mask) 
+        if (filename.find(mask) != std::string::npos) 
         {
-            if (filename.find(mask) != std::string::npos) 
-            {
-                result.push_back(file);
-                break;
-            }
+            return true;
         }
     }
-
-    return result;
+    return false;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <vector>
 #include <filesystem>
@@ -10,11 +12,28 @@ public:
 
     struct Config 
     {
+        // Job name in a batch, from the name key of a [[jobs]] table
+        std::string name;
         std::filesystem::path input;
         std::filesystem::path output;
         std::vector<std::string> filename_mask;
+        std::string output_format = "csv";
+        // Only rows with from_ts <= receive_ts < to_ts are used
+        uint64_t from_ts = 0;
+        uint64_t to_ts = std::numeric_limits<uint64_t>::max();
+        // Every input file is ordered by receive_ts, so the window can be found by binary search
+        bool sorted_input = false;
+        // "mid" or "microprice": the inputs are level.csv files and the median is taken over this price of the
+        // rebuilt book. Empty for trades
+        std::string book_price;
+        // Price grid of the book levels
+        double tick_size = 0.01;
     };
 
     static Config load_from_file(const std::filesystem::path& filepath);
+    // Every [[jobs]] table of the file with the keys of [main], or the [main] table as the only job
+    static std::vector<Config> load_jobs(const std::filesystem::path& filepath);
     static std::vector<std::filesystem::path> find_files(const Config& cfg);
+    // CSV files, plain or compressed, whose name contains one of the masks
+    static bool matches_mask(const Config& cfg, const std::filesystem::path& file);
 };
\ No newline at end of file
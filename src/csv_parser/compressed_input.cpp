@@ -0,0 +1,457 @@
+#include "compressed_input.hpp"
+#include "../logger/logger.hpp"
+#include "../system/read_ahead.hpp"
+
+#include <zlib.h>
+#ifdef CSV_PARSER_ZSTD
+#include <zstd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <fstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+
+namespace
+{
+    constexpr size_t buffer_size = 1 << 17;
+    constexpr uint32_t zstd_magic = 0xFD2FB528;
+    // The low four bits of a skippable frame's magic are free
+    constexpr uint32_t skippable_magic = 0x184D2A50;
+    constexpr uint32_t seekable_magic = 0x8F92EAB1;
+    // Frame count, descriptor and magic at the very end of a seekable file
+    constexpr size_t seek_table_footer = 9;
+
+    uint64_t read_le(const unsigned char* data, size_t bytes)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            value |= static_cast<uint64_t>(data[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    bool read_at(std::ifstream& in, uint64_t offset, unsigned char* data, size_t bytes)
+    {
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(bytes));
+        return static_cast<size_t>(in.gcount()) == bytes;
+    }
+
+    // Frames listed by the seek table of the zstd seekable format, empty when there is none
+    std::vector<compressed_input::Frame> seek_table(std::ifstream& in, uint64_t size)
+    {
+        std::array<unsigned char, seek_table_footer> footer;
+        if (size < seek_table_footer + 8 || !read_at(in, size - seek_table_footer, footer.data(), footer.size())
+            || read_le(footer.data() + 5, 4) != seekable_magic)
+        {
+            return {};
+        }
+        const uint64_t count = read_le(footer.data(), 4);
+        const size_t entry_size = (footer[4] & 0x80) != 0 ? 12 : 8;
+        const uint64_t table_size = 8 + count * entry_size + seek_table_footer;
+        std::vector<unsigned char> entries(count * entry_size);
+        if (table_size > size || !read_at(in, size - table_size + 8, entries.data(), entries.size()))
+        {
+            return {};
+        }
+        std::vector<compressed_input::Frame> frames;
+        uint64_t offset = 0;
+        uint64_t content_offset = 0;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            const unsigned char* entry = entries.data() + i * entry_size;
+            const uint64_t compressed = read_le(entry, 4);
+            const uint64_t content = read_le(entry + 4, 4);
+            frames.push_back({offset, compressed, content_offset, content});
+            offset += compressed;
+            content_offset += content;
+        }
+        // A table that does not add up to the file is not trusted, the frames are walked instead
+        return offset == size - table_size ? frames : std::vector<compressed_input::Frame>();
+    }
+
+    // Frame boundaries from the frame headers and the 3-byte block headers, without decompressing
+    std::vector<compressed_input::Frame> walk_frames(std::ifstream& in, uint64_t size)
+    {
+        constexpr std::array<size_t, 4> dict_id_bytes {0, 1, 2, 4};
+        std::vector<compressed_input::Frame> frames;
+        uint64_t offset = 0;
+        uint64_t content_offset = 0;
+        while (offset < size)
+        {
+            std::array<unsigned char, 18> header {};
+            const size_t header_bytes = std::min<uint64_t>(header.size(), size - offset);
+            if (header_bytes < 8 || !read_at(in, offset, header.data(), header_bytes))
+            {
+                return {};
+            }
+            const uint64_t magic = read_le(header.data(), 4);
+            if ((magic & 0xFFFFFFF0) == skippable_magic)
+            {
+                offset += 8 + read_le(header.data() + 4, 4);
+                continue;
+            }
+            if (magic != zstd_magic)
+            {
+                return {};
+            }
+            const unsigned char descriptor = header[4];
+            const bool single_segment = (descriptor & 0x20) != 0;
+            const size_t fcs_flag = descriptor >> 6;
+            const size_t fcs_bytes = fcs_flag == 0 ? (single_segment ? 1 : 0) : size_t{1} << fcs_flag;
+            if (fcs_bytes == 0)
+            {
+                // Streamed without its content size, so its decompressed offset is unknown
+                return {};
+            }
+            const size_t fcs_pos = 5 + (single_segment ? 0 : 1) + dict_id_bytes[descriptor & 3];
+            const uint64_t content = read_le(header.data() + fcs_pos, fcs_bytes) + (fcs_bytes == 2 ? 256 : 0);
+            uint64_t block = offset + fcs_pos + fcs_bytes;
+            bool last = false;
+            while (!last)
+            {
+                std::array<unsigned char, 3> block_header;
+                if (!read_at(in, block, block_header.data(), block_header.size()))
+                {
+                    return {};
+                }
+                const uint64_t value = read_le(block_header.data(), 3);
+                last = (value & 1) != 0;
+                const uint64_t type = (value >> 1) & 3;
+                if (type == 3)
+                {
+                    return {};
+                }
+                // An RLE block stores its one repeated byte
+                block += 3 + (type == 1 ? 1 : value >> 3);
+            }
+            if ((descriptor & 0x04) != 0)
+            {
+                block += 4;
+            }
+            frames.push_back({offset, block - offset, content_offset, content});
+            offset = block;
+            content_offset += content;
+        }
+        return offset == size ? frames : std::vector<compressed_input::Frame>();
+    }
+
+    // Decompressed bytes of one file for std::istream; the codec fills the get area one buffer at a time while the
+    // compressed blocks are read ahead
+    class DecodingBuffer : public std::streambuf
+    {
+    public:
+        DecodingBuffer(const std::string& file, uint64_t compressed_offset) : m_file(file), m_in(file, compressed_offset),
+        m_output(buffer_size)
+        {
+
+        }
+        virtual ~DecodingBuffer() = default;
+        inline bool is_open() const
+        {
+            return m_in.is_open();
+        }
+    protected:
+        int_type underflow() override
+        {
+            if (gptr() < egptr())
+            {
+                return traits_type::to_int_type(*gptr());
+            }
+            size_t produced = 0;
+            try
+            {
+                produced = decode(m_output.data(), m_output.size());
+            }
+            catch (const std::exception& err)
+            {
+                // The istream sets badbit, so a corrupt file is not mistaken for one that ended
+                spdlog::error("Cannot decompress {}: {}", m_file, err.what());
+                throw;
+            }
+            if (produced == 0)
+            {
+                return traits_type::eof();
+            }
+            setg(m_output.data(), m_output.data(), m_output.data() + produced);
+            return traits_type::to_int_type(*gptr());
+        }
+        // Up to capacity decompressed bytes, 0 at the end of the file; throws on corrupt input
+        virtual size_t decode(char* out, size_t capacity) = 0;
+        // Takes the next compressed block once the current one is consumed, false at the end of the file
+        bool refill()
+        {
+            if (m_in_pos < m_in_end)
+            {
+                return true;
+            }
+            m_input = m_in.next();
+            m_in_pos = 0;
+            m_in_end = m_input.size();
+            return m_in_end != 0;
+        }
+
+        std::string m_file;
+        read_ahead::File m_in;
+        std::span<const char> m_input;
+        size_t m_in_pos = 0;
+        size_t m_in_end = 0;
+        std::vector<char> m_output;
+    };
+
+    // Concatenated gzip members read as one stream, like gzip -d does
+    class GzipBuffer : public DecodingBuffer
+    {
+    public:
+        explicit GzipBuffer(const std::string& file) : DecodingBuffer(file, 0)
+        {
+            if (inflateInit2(&m_stream, 16 + MAX_WBITS) != Z_OK)
+            {
+                throw std::runtime_error("Cannot initialize zlib");
+            }
+        }
+        ~GzipBuffer() override
+        {
+            inflateEnd(&m_stream);
+        }
+    protected:
+        size_t decode(char* out, size_t capacity) override
+        {
+            m_stream.next_out = reinterpret_cast<Bytef*>(out);
+            m_stream.avail_out = static_cast<uInt>(capacity);
+            while (m_stream.avail_out == capacity)
+            {
+                const bool input_left = refill();
+                m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(m_input.data() + m_in_pos));
+                m_stream.avail_in = static_cast<uInt>(m_in_end - m_in_pos);
+                const int res = inflate(&m_stream, Z_NO_FLUSH);
+                m_in_pos = m_in_end - m_stream.avail_in;
+                if (res == Z_STREAM_END)
+                {
+                    m_member_done = true;
+                    inflateReset(&m_stream);
+                }
+                else if (res == Z_OK)
+                {
+                    m_member_done = false;
+                }
+                else if (res == Z_BUF_ERROR && !input_left)
+                {
+                    if (!m_member_done)
+                    {
+                        throw std::runtime_error("truncated gzip stream");
+                    }
+                    break;
+                }
+                else if (m_member_done && res == Z_DATA_ERROR)
+                {
+                    spdlog::warn("File {} has trailing bytes after its last gzip member", m_file);
+                    break;
+                }
+                else if (res != Z_BUF_ERROR)
+                {
+                    throw std::runtime_error(m_stream.msg != nullptr ? m_stream.msg : "corrupt gzip stream");
+                }
+            }
+            return capacity - m_stream.avail_out;
+        }
+    private:
+        z_stream m_stream {};
+        bool m_member_done = false;
+    };
+
+#ifdef CSV_PARSER_ZSTD
+    // Decompresses frame after frame from a frame start; skippable frames, such as a seek table, are passed over
+    class ZstdBuffer : public DecodingBuffer
+    {
+    public:
+        ZstdBuffer(const std::string& file, uint64_t compressed_offset) : DecodingBuffer(file, compressed_offset),
+        m_stream(ZSTD_createDStream())
+        {
+            if (m_stream == nullptr)
+            {
+                throw std::runtime_error("Cannot initialize zstd");
+            }
+            ZSTD_initDStream(m_stream);
+        }
+        ~ZstdBuffer() override
+        {
+            ZSTD_freeDStream(m_stream);
+        }
+    protected:
+        size_t decode(char* out, size_t capacity) override
+        {
+            ZSTD_outBuffer output {out, capacity, 0};
+            while (output.pos == 0)
+            {
+                const bool input_left = refill();
+                ZSTD_inBuffer input {m_input.data() + m_in_pos, m_in_end - m_in_pos, 0};
+                const size_t res = ZSTD_decompressStream(m_stream, &output, &input);
+                m_in_pos += input.pos;
+                if (ZSTD_isError(res))
+                {
+                    throw std::runtime_error(ZSTD_getErrorName(res));
+                }
+                m_frame_open = res != 0;
+                if (!input_left && output.pos == 0)
+                {
+                    if (m_frame_open)
+                    {
+                        throw std::runtime_error("truncated zstd frame");
+                    }
+                    break;
+                }
+            }
+            return output.pos;
+        }
+    private:
+        ZSTD_DStream* m_stream;
+        bool m_frame_open = false;
+    };
+#endif
+
+    class DecodedStream : public std::istream
+    {
+    public:
+        explicit DecodedStream(std::unique_ptr<DecodingBuffer> buffer) : std::istream(buffer.get()), m_buffer(std::move(buffer))
+        {
+            if (!m_buffer->is_open())
+            {
+                setstate(std::ios::failbit);
+            }
+        }
+    private:
+        std::unique_ptr<DecodingBuffer> m_buffer;
+    };
+
+    std::unique_ptr<std::istream> failed_stream()
+    {
+        auto stream = std::make_unique<std::ifstream>();
+        stream->setstate(std::ios::failbit);
+        return stream;
+    }
+} //anonymous namespace
+
+namespace compressed_input
+{
+    Codec codec(const std::filesystem::path& file)
+    {
+        const auto extension = file.extension();
+        if (extension == ".gz")
+        {
+            return Codec::gzip;
+        }
+        if (extension == ".zst")
+        {
+            return Codec::zstd;
+        }
+        return Codec::none;
+    }
+
+    bool is_csv(const std::filesystem::path& file)
+    {
+        return (codec(file) == Codec::none ? file : file.stem()).extension() == ".csv";
+    }
+
+    bool supported(Codec codec)
+    {
+#ifdef CSV_PARSER_ZSTD
+        const bool zstd = true;
+#else
+        const bool zstd = false;
+#endif
+        return zstd || codec != Codec::zstd;
+    }
+
+    std::vector<Frame> frames(const std::string& file)
+    {
+        if (codec(file) != Codec::zstd)
+        {
+            return {};
+        }
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(file, ec);
+        std::ifstream in(file, std::ios::binary);
+        if (ec || !in.is_open())
+        {
+            return {};
+        }
+        auto res = seek_table(in, size);
+        return res.empty() ? walk_frames(in, size) : res;
+    }
+
+    std::optional<uint64_t> content_size(const std::string& file)
+    {
+        switch (codec(file))
+        {
+        case Codec::none:
+        {
+            std::error_code ec;
+            const uint64_t size = std::filesystem::file_size(file, ec);
+            return ec ? std::nullopt : std::optional<uint64_t>(size);
+        }
+        case Codec::zstd:
+        {
+            const auto found = frames(file);
+            if (found.empty())
+            {
+                return std::nullopt;
+            }
+            return found.back().content_offset + found.back().content_size;
+        }
+        default:
+            return std::nullopt;
+        }
+    }
+
+    std::unique_ptr<std::istream> open(const std::string& file, uint64_t offset, uint64_t limit)
+    {
+        const Codec type = codec(file);
+        if (!supported(type))
+        {
+            spdlog::error("File {} is zstd compressed, but this build has no zstd support", file);
+            return failed_stream();
+        }
+        if (type == Codec::none)
+        {
+            return std::make_unique<read_ahead::Stream>(file, offset, limit);
+        }
+        std::unique_ptr<DecodingBuffer> buffer;
+        uint64_t skip = offset;
+#ifdef CSV_PARSER_ZSTD
+        if (type == Codec::zstd)
+        {
+            // The last frame starting at or before offset; without frame sizes the file is read from its beginning
+            const auto found = frames(file);
+            auto frame = std::upper_bound(found.begin(), found.end(), offset, [](uint64_t value, const Frame& frame)
+            {
+                return value < frame.content_offset;
+            });
+            uint64_t compressed_offset = 0;
+            if (frame != found.begin())
+            {
+                --frame;
+                compressed_offset = frame->offset;
+                skip = offset - frame->content_offset;
+            }
+            buffer = std::make_unique<ZstdBuffer>(file, compressed_offset);
+        }
+#endif
+        if (type == Codec::gzip)
+        {
+            buffer = std::make_unique<GzipBuffer>(file);
+        }
+        auto stream = std::make_unique<DecodedStream>(std::move(buffer));
+        if (skip != 0 && *stream)
+        {
+            stream->ignore(static_cast<std::streamsize>(skip));
+        }
+        return stream;
+    }
+} //namespace compressed_input
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Inputs stored as .csv.gz or .csv.zst are decompressed while they are read, without temporary files. Offsets into
+// such a file count decompressed bytes, so parse tasks, checkpoints and spill coverage treat it like a plain CSV
+namespace compressed_input
+{
+    enum class Codec
+    {
+        none,
+        gzip,
+        zstd
+    };
+
+    Codec codec(const std::filesystem::path& file);
+    // .csv, .csv.gz or .csv.zst
+    bool is_csv(const std::filesystem::path& file);
+    // zstd needs libzstd at build time (CSV_PARSER_ZSTD)
+    bool supported(Codec codec);
+
+    // A zstd frame decompresses on its own, so frames are where a compressed file can be split between workers
+    struct Frame
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t content_offset;
+        uint64_t content_size;
+    };
+    // Frames of a zstd file, from its seek table or else from the frame and block headers. Empty when the file
+    // cannot be split: gzip, a plain file, or a frame without its content size
+    std::vector<Frame> frames(const std::string& file);
+    // Decompressed size when it is known without decompressing; the file size of a plain file
+    std::optional<uint64_t> content_size(const std::string& file);
+
+    // Decompressed bytes from offset on, read with std::getline like an ifstream. A zstd file starts at the frame
+    // holding offset, a gzip file is decompressed from its beginning. A plain file is read ahead up to limit and
+    // block by block past it. The stream fails when the file cannot be opened and goes bad on corrupt or truncated
+    // compressed data
+    std::unique_ptr<std::istream> open(const std::string& file, uint64_t offset = 0, uint64_t limit = std::numeric_limits<uint64_t>::max());
+} //namespace compressed_input
@@ -1,131 +1,351 @@
 #include "csv_parser.hpp"
+#include "compressed_input.hpp"
 #include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+#include "../system/bulk_memory.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 
-CsvParser::CsvParser(uint64_t total_space_to_use, uint32_t max_threads) : m_queue(std::make_unique<ThreadPoolQueue>()), 
-m_ready_data_queue(std::make_unique<ThreadQueue<std::vector<ParserData>>>()), m_total_task(0),
+namespace
+{
+    constexpr size_t reject_batch_size = 1 << 16;
+} //anonymous namespace
+
+CsvParser::CsvParser(uint64_t total_space_to_use, uint32_t max_threads, uint32_t ready_capacity) : m_queue(std::make_unique<ThreadPoolQueue>()), 
+m_ready_data_queue(std::make_unique<coro::Channel<ReadyChunk>>(ready_capacity != 0 ? ready_capacity : max_threads)), m_total_task(0),
 m_vec_size(total_space_to_use / max_threads / sizeof(ParserData)), m_max_elements(total_space_to_use / sizeof(ParserData)), m_max_threads(max_threads)
 {
-    m_queue->start_async(m_max_threads);
-    spdlog::debug("CsvParser created");
+    m_queue->start_async(m_max_threads, "parse");
+    SPDLOG_DEBUG("CsvParser created");
 }
 
 CsvParser::~CsvParser()
 {
+    metrics::high_water("csv_parser_ready_queue_high_water", m_ready_data_queue->high_water());
     m_total_task.store(0, std::memory_order_release);
+    // Workers blocked on a full queue must return before the pool can be joined
+    m_ready_data_queue->cancel();
     m_queue->stop();
-    m_ready_data_queue->delete_queue();
     if (m_task_wait_thread.joinable())
     {
         m_task_wait_thread.join();
     }
-    spdlog::debug("CsvParser destroyed");
+    SPDLOG_DEBUG("CsvParser destroyed");
 }
 
 void CsvParser::wait_task_done()
 {
-    spdlog::debug("Started waiting for the tasks to finish. Total tasks {}", m_total_task.load());
+    SPDLOG_DEBUG("Started waiting for the tasks to finish. Total tasks {}", m_total_task.load());
     m_task_wait_thread = std::thread([this] {
         m_queue->wait_for_pending();
-        m_ready_data_queue->stop();
-        spdlog::debug("All tasks finished. Queue is stopped!");
+        m_ready_data_queue->close();
+        SPDLOG_DEBUG("All tasks finished. Queue is stopped!");
     });
 }
 
-void CsvParser::add_file_to_parse(const std::string& file_name)
+void CsvParser::add_file_to_parse(const std::string& file_name, uint64_t start_offset, uint64_t end_offset)
 {
     if (!check_empty_file(file_name))
     {
         return;
     }
-    m_queue->push(std::bind(&CsvParser::parse_csv_data, this, file_name));
+    m_queue->push(std::bind(&CsvParser::parse_csv_data, this, file_name, start_offset, end_offset));
     ++m_total_task;
-    spdlog::debug("Added new task for file {}. Total tasks {}",file_name, m_total_task.load());
+    SPDLOG_DEBUG("Added new task for file {}. Total tasks {}",file_name, m_total_task.load());
 }
 
-void CsvParser::parse_csv_data(const std::string& file_name)
+void CsvParser::parse_csv_data(const std::string& file_name, uint64_t start_offset, uint64_t end_offset)
 {
+    metrics::ScopedTimer timer("csv_parser_parse_seconds_total", true);
     std::vector<ParserData> data {};
-    data.reserve(m_vec_size);
+    reserve_chunk(data);
 
-    std::ifstream file(file_name, std::ios::binary);
-    if (!file.is_open()) 
+    // Plain files are read ahead from start_offset to end_offset, compressed ones are decompressed up to start_offset
+    const auto stream = compressed_input::open(file_name, start_offset, end_offset);
+    std::istream& file = *stream;
+    if (!file) 
     {
-        spdlog::error("Cannot open file: {}", file_name);
+        if (file.bad())
+        {
+            spdlog::error("Cannot read file {} up to offset {}", file_name, start_offset);
+            m_failed.store(true, std::memory_order_release);
+        }
+        else
+        {
+            spdlog::error("Cannot open file: {}", file_name);
+        }
         notify_task(file_name);
         return;
     }
-    spdlog::info("Started to parse file {}", file_name);
+    spdlog::info("Started to parse file {} from offset {}", file_name, start_offset);
     std::string line {};
+    FileProgress progress {start_offset, 0, 0};
 
-    if (!std::getline(file, line))
+    if (start_offset == 0)
     {
-        spdlog::error("File {} is empty or cannot read header", file_name);
-        notify_task(file_name);
-        return;
+        if (!std::getline(file, line) || (m_complete_lines_only && file.eof()))
+        {
+            spdlog::error("File {} is empty or cannot read header", file_name);
+            if (file.bad())
+            {
+                m_failed.store(true, std::memory_order_release);
+            }
+            notify_task(file_name);
+            return;
+        }
+        progress.offset = line.size() + 1;
     }
 
-    uint64_t line_num = 1;
-    while (std::getline(file, line))
+    // Byte offset of the current line; a split task does not know how many lines come before its start
+    uint64_t line_start = progress.offset;
+    uint64_t rejected = 0;
+    uint64_t skipped = 0;
+    const bool filter = m_time_range.bounded();
+    std::string rejects;
+    auto reject = [&](std::string_view reason)
     {
-        ++line_num;
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-
-        while (std::getline(ss, token, ';')) 
+        ++rejected;
+        if (!m_reject_writer)
         {
-            tokens.push_back(token);
+            LOG_RATE_LIMITED(spdlog::level::err, "File {} has incorrect line at offset {}: {}", file_name, line_start, reason);
+            return;
         }
-
-        if (tokens.size() < 5)
+        RejectWriter::add(rejects, file_name, line_start, reason, line);
+        if (rejects.size() >= reject_batch_size)
+        {
+            m_reject_writer->write(rejects);
+            rejects.clear();
+        }
+    };
+    // Hands a record to the consumer; false when the run is cancelled
+    auto emit = [&](const ParserData& record, uint64_t chunk_end)
+    {
+        if (data.size() == m_vec_size)
+        {
+            if (!m_ready_data_queue->push(ReadyChunk{std::move(data), file_name, start_offset, chunk_end}))
+            {
+                SPDLOG_DEBUG("Parsing of {} is cancelled", file_name);
+                return false;
+            }
+            data = std::vector<ParserData>();
+            reserve_chunk(data);
+        }
+        data.push_back(record);
+        progress.last_ts = std::max(progress.last_ts, record.receive_ts);
+        ++progress.rows;
+        return true;
+    };
+    std::optional<BookBuilder> book;
+    if (m_book)
+    {
+        book.emplace(*m_book);
+    }
+    bool cancelled = false;
+    while (progress.offset < end_offset && std::getline(file, line))
+    {
+        if (file.eof() && m_complete_lines_only)
+        {
+            break;
+        }
+        line_start = progress.offset;
+        progress.offset += line.size() + (file.eof() ? 0 : 1);
+        if (book)
         {
-            spdlog::error("File {} have incorrect line {}", file_name, line_num);
+            // Every row updates the book, the window only selects the derived prices
+            try
+            {
+                const auto sample = book->push(line);
+                if (sample && (!filter || m_time_range.contains(sample->receive_ts)) && !emit(ParserData{sample->receive_ts, sample->price}, line_start))
+                {
+                    cancelled = true;
+                    break;
+                }
+            }
+            catch (const std::exception& err)
+            {
+                reject(err.what());
+                continue;
+            }
+            if (m_sorted_input && filter && book->last_ts() >= m_time_range.to_ts)
+            {
+                break;
+            }
             continue;
         }
+        if (filter)
+        {
+            // Cheap check of the first column; lines it cannot read are checked after parse_line
+            const auto ts = parse_ts(line);
+            if (ts && !m_time_range.contains(*ts))
+            {
+                ++skipped;
+                if (m_sorted_input && *ts >= m_time_range.to_ts)
+                {
+                    break;
+                }
+                continue;
+            }
+        }
         try
         {
-            uint64_t time = std::stoull(tokens[0]);
-            double price = std::stod(tokens[2]);
-            if (data.size() == m_vec_size)
+            ParserData record;
+            if (!parse_line(line, record))
+            {
+                reject("missing columns");
+                continue;
+            }
+            if (filter && !m_time_range.contains(record.receive_ts))
             {
-                m_ready_data_queue->push(std::move(data));
-                data.clear();
+                ++skipped;
+                continue;
+            }
+            if (!emit(record, line_start))
+            {
+                cancelled = true;
+                break;
             }
-            data.push_back({time, price});
         }
         catch (const std::exception& err)
         {
-            spdlog::error("Error in line {} : {}", line_num, err.what());
+            reject(err.what());
             continue;
         }
     }
+    if (file.bad())
+    {
+        // A read error is not the end of the file: the cut-off line is dropped and the task records no progress
+        spdlog::error("Cannot read file {} past offset {}", file_name, progress.offset);
+        m_failed.store(true, std::memory_order_release);
+        notify_task(file_name);
+        return;
+    }
+    if (book && !cancelled)
+    {
+        const auto sample = book->finish();
+        if (sample && (!filter || m_time_range.contains(sample->receive_ts)))
+        {
+            emit(ParserData{sample->receive_ts, sample->price}, progress.offset);
+        }
+        metrics::count("csv_parser_book_crossed_levels_total", book->book().crossed_levels(), "file", file_name);
+        if (book->dropped_levels() != 0)
+        {
+            spdlog::warn("File {} has {} levels too far from the book to keep", file_name, book->dropped_levels());
+        }
+    }
+    if (m_reject_writer)
+    {
+        m_reject_writer->write(rejects);
+    }
+    if (rejected != 0)
+    {
+        spdlog::warn("File {} has {} rejected lines", file_name, rejected);
+    }
     if (!data.empty())
     {
-        m_ready_data_queue->push(std::move(data));
+        m_ready_data_queue->push(ReadyChunk{std::move(data), file_name, start_offset, progress.offset});
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_progress_mutex);
+        auto [entry, inserted] = m_progress.try_emplace(file_name, progress);
+        if (!inserted)
+        {
+            entry->second.offset = std::max(entry->second.offset, progress.offset);
+            entry->second.last_ts = std::max(entry->second.last_ts, progress.last_ts);
+            entry->second.rows += progress.rows;
+        }
     }
+    metrics::count("csv_parser_rows_parsed_total", progress.rows, "file", file_name);
+    metrics::count("csv_parser_rows_rejected_total", rejected, "file", file_name);
+    metrics::count("csv_parser_rows_out_of_range_total", skipped, "file", file_name);
+    metrics::count("csv_parser_bytes_read_total", progress.offset - start_offset, "file", file_name);
     notify_task(file_name);
 }
 
+void CsvParser::reserve_chunk(std::vector<ParserData>& data) const
+{
+    // A pooled chunk keeps the pages another thread faulted in, wherever they were placed; only a new reservation
+    // is first touched by this worker and lands on its NUMA node
+    if (m_buffers)
+    {
+        data = m_buffers->acquire(m_vec_size);
+    }
+    else
+    {
+        data.reserve(m_vec_size);
+    }
+    if (bulk_memory::options().huge_pages)
+    {
+        bulk_memory::advise_huge_pages(data.data(), data.capacity() * sizeof(ParserData));
+    }
+}
+
+bool CsvParser::parse_line(const std::string& line, ParserData& record)
+{
+    std::stringstream ss(line);
+    std::string token;
+    std::vector<std::string> tokens;
+
+    while (std::getline(ss, token, ';')) 
+    {
+        tokens.push_back(token);
+    }
+
+    if (tokens.size() < 5)
+    {
+        return false;
+    }
+    record.receive_ts = std::stoull(tokens[0]);
+    record.price = std::stod(tokens[2]);
+    return true;
+}
+
+std::optional<uint64_t> CsvParser::parse_ts(std::string_view line)
+{
+    const char* end = line.data() + line.size();
+    uint64_t ts = 0;
+    auto [ptr, ec] = std::from_chars(line.data(), end, ts);
+    if (ec != std::errc() || (ptr != end && *ptr != ';'))
+    {
+        return std::nullopt;
+    }
+    return ts;
+}
+
 void CsvParser::notify_task(const std::string& file_name)
 {
     m_total_task.fetch_sub(1, std::memory_order_relaxed);
-    spdlog::debug("Task finished for file {}. Tasks left {}", file_name, m_total_task.load());
+    SPDLOG_DEBUG("Task finished for file {}. Tasks left {}", file_name, m_total_task.load());
 }
 
 std::optional<std::vector<CsvParser::ParserData>> CsvParser::get_ready_data()
 {
-    std::vector<ParserData> data;
-    if (m_ready_data_queue->front(data))
+    if (auto chunk = get_ready_chunk())
     {
-        return data;
+        return std::move(chunk->data);
     }
     return std::nullopt;
 }
 
+std::optional<CsvParser::ReadyChunk> CsvParser::get_ready_chunk()
+{
+    return m_ready_data_queue->pop();
+}
+
+void CsvParser::cancel()
+{
+    m_ready_data_queue->cancel();
+}
+
+std::map<std::string, CsvParser::FileProgress> CsvParser::get_file_progress() const
+{
+    std::lock_guard<std::mutex> lock(m_progress_mutex);
+    return m_progress;
+}
+
 bool CsvParser::check_empty_file(const std::string& file_path) const
 {
     if (std::filesystem::is_empty(file_path))
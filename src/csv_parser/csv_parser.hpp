@@ -1,7 +1,10 @@
 #pragma once
 
 #include "thread_pool_queue.hpp"
-#include "thread_queue.hpp"
+#include "reject_writer.hpp"
+#include "../book/order_book.hpp"
+#include "../pipeline/channel.hpp"
+#include "../system/buffer_pool.hpp"
 
 #include <thread>
 #include <vector>
@@ -9,35 +12,132 @@
 #include <condition_variable>
 #include <atomic>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 
 class CsvParser
 {
 public:
-    explicit CsvParser(uint64_t total_space_to_use, uint32_t max_threads = 4);
+    // At most ready_capacity parsed chunks wait for the consumer, workers block beyond that (0: one per worker)
+    explicit CsvParser(uint64_t total_space_to_use, uint32_t max_threads = 4, uint32_t ready_capacity = 0);
     ~CsvParser();
-    void add_file_to_parse(const std::string& file_path);
+    // A non-zero start offset continues a file after its header, e.g. from a checkpoint. Parsing stops at
+    // end_offset, which must be a line start; ranges of one file are merged in get_file_progress
+    void add_file_to_parse(const std::string& file_path, uint64_t start_offset = 0, uint64_t end_offset = std::numeric_limits<uint64_t>::max());
     struct ParserData
     {
         uint64_t receive_ts;
         double price;
     };
+    // Half-open receive_ts window [from_ts, to_ts)
+    struct TimeRange
+    {
+        uint64_t from_ts = 0;
+        uint64_t to_ts = std::numeric_limits<uint64_t>::max();
+        inline bool contains(uint64_t ts) const
+        {
+            return from_ts <= ts && ts < to_ts;
+        }
+        inline bool bounded() const
+        {
+            return from_ts != 0 || to_ts != std::numeric_limits<uint64_t>::max();
+        }
+    };
+    struct FileProgress
+    {
+        uint64_t offset;
+        uint64_t last_ts;
+        uint64_t rows;
+    };
+    // Rows of one parse task in file order, with the byte range they were read from
+    struct ReadyChunk
+    {
+        std::vector<ParserData> data;
+        std::string file;
+        // Start offset of the task that produced the chunk and the line start after its last line
+        uint64_t task_begin = 0;
+        uint64_t end = 0;
+    };
     std::optional<std::vector<ParserData>> get_ready_data();
+    std::optional<ReadyChunk> get_ready_chunk();
+    // The same chunks for a coroutine stage; closed once wait_task_done has seen every task end
+    inline coro::Channel<ReadyChunk>& ready_chunks()
+    {
+        return *m_ready_data_queue;
+    }
     void wait_task_done();
+    // Workers stop at their next chunk and the queued chunks are dropped
+    void cancel();
+    // An unterminated last line may still be being written, so leave it for the next run
+    inline void set_complete_lines_only(bool value)
+    {
+        m_complete_lines_only = value;
+    }
+    // Rows outside the window are dropped before they are parsed. With sorted input a file also stops at the first
+    // row past to_ts. Set it before adding files
+    inline void set_time_range(TimeRange range, bool sorted_input)
+    {
+        m_time_range = range;
+        m_sorted_input = sorted_input;
+    }
+    // Rejected rows go to this writer instead of the log, set it before adding files
+    inline void set_reject_writer(std::shared_ptr<RejectWriter> writer)
+    {
+        m_reject_writer = std::move(writer);
+    }
+    // Chunks are taken from the pool; their consumer hands them back once the rows are copied out. Set it before
+    // adding files
+    inline void set_buffer_pool(std::shared_ptr<BufferPool<ParserData>> pool)
+    {
+        m_buffers = std::move(pool);
+    }
+    // Inputs are level.csv book updates: a task rebuilds the book of its file and yields the derived price of every
+    // event instead of the rows, so each file needs one task from its beginning. The time range then applies to the
+    // derived prices. Set it before adding files
+    inline void set_book(BookBuilder::Options options)
+    {
+        m_book = options;
+    }
+    // True once a task hit a read or decompression error; its rows were cut short and it recorded no progress
+    inline bool failed() const
+    {
+        return m_failed.load(std::memory_order_acquire);
+    }
+    // Offset after the last consumed line of every parsed file; complete after wait_task_done and draining the data
+    std::map<std::string, FileProgress> get_file_progress() const;
+    // False when columns are missing, throws std::invalid_argument or std::out_of_range on bad numbers
+    static bool parse_line(const std::string& line, ParserData& record);
+    // receive_ts of a line without splitting it, nullopt when the first column is not a number
+    static std::optional<uint64_t> parse_ts(std::string_view line);
     inline uint32_t get_max_elements() const
     {
         return m_max_elements;
     }
 private:
-    void parse_csv_data(const std::string& file_name);
+    void parse_csv_data(const std::string& file_name, uint64_t start_offset, uint64_t end_offset);
     bool check_empty_file(const std::string& file_path) const;
     void notify_task(const std::string& file_name);
+    void reserve_chunk(std::vector<ParserData>& data) const;
 
-    std::unique_ptr<ThreadQueue<std::vector<ParserData>>> m_ready_data_queue;
+    std::unique_ptr<coro::Channel<ReadyChunk>> m_ready_data_queue;
     std::unique_ptr<ThreadPoolQueue> m_queue;
     std::thread m_task_wait_thread;
+    mutable std::mutex m_progress_mutex;
+    std::map<std::string, FileProgress> m_progress;
+    std::shared_ptr<RejectWriter> m_reject_writer;
+    std::shared_ptr<BufferPool<ParserData>> m_buffers;
     uint64_t m_vec_size {};
     uint64_t m_max_elements {};
     std::atomic<uint32_t> m_total_task;
+    std::atomic<bool> m_failed {false};
     uint32_t m_max_threads {};
     bool is_task_counter_called = false;
+    bool m_complete_lines_only = false;
+    TimeRange m_time_range;
+    bool m_sorted_input = false;
+    std::optional<BookBuilder::Options> m_book;
 };
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "file_scheduler.hpp"
+#include "csv_parser.hpp"
+#include "compressed_input.hpp"
+#include "../logger/logger.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    // First line start after the start of the first frame at or after offset, so finding a cut decompresses only
+    // one line. The line running over the frame start stays with the task before the cut
+    uint64_t frame_line_start(const std::string& file, const std::vector<compressed_input::Frame>& frames, uint64_t offset)
+    {
+        const uint64_t content_end = frames.back().content_offset + frames.back().content_size;
+        auto frame = std::lower_bound(frames.begin(), frames.end(), offset, [](const compressed_input::Frame& frame, uint64_t value)
+        {
+            return frame.content_offset < value;
+        });
+        if (frame == frames.end())
+        {
+            return content_end;
+        }
+        auto in = compressed_input::open(file, frame->content_offset);
+        std::string rest;
+        if (!std::getline(*in, rest) || in->eof())
+        {
+            return content_end;
+        }
+        return frame->content_offset + rest.size() + 1;
+    }
+} //anonymous namespace
+
+std::vector<FileScheduler::Task> FileScheduler::plan(const std::vector<Input>& inputs, uint32_t threads, uint64_t min_split)
+{
+    struct Sized
+    {
+        const Input* input;
+        uint64_t size;
+        bool splittable;
+        std::vector<compressed_input::Frame> frames;
+    };
+    std::vector<Sized> sized;
+    uint64_t total = 0;
+    for (const auto& input : inputs)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(input.file, ec);
+        const bool compressed = compressed_input::codec(input.file) != compressed_input::Codec::none;
+        auto frames = compressed_input::frames(input.file);
+        if (!frames.empty())
+        {
+            size = frames.back().content_offset + frames.back().content_size;
+        }
+        // A gzip file or a zstd file without frame sizes is read by one task, its compressed size only weighs it
+        const bool splittable = !compressed || frames.size() > 1;
+        size = std::min(size, input.end);
+        // Unreadable files still get a task, the parser reports them
+        const uint64_t remaining = ec || size < input.offset ? 0 : size - input.offset;
+        sized.push_back({&input, remaining, splittable, std::move(frames)});
+        total += remaining;
+    }
+
+    const uint64_t share = std::max<uint64_t>(min_split, total / std::max<uint32_t>(threads, 1));
+    std::vector<Task> tasks;
+    for (const auto& [input, size, splittable, frames] : sized)
+    {
+        const uint64_t end = input->offset + size;
+        uint64_t begin = input->offset;
+        if (size > share && splittable)
+        {
+            const uint64_t pieces = (size + share - 1) / share;
+            const uint64_t piece = size / pieces;
+            for (uint64_t i = 1; i < pieces; ++i)
+            {
+                // The first piece starts with the header when the file is parsed from the beginning
+                const uint64_t target = std::max(input->offset + i * piece, begin + 1);
+                // Compressed files are cut where a frame starts, each task decompresses its own frames
+                const uint64_t cut = frames.empty() ? next_line_start(input->file, target) : frame_line_start(input->file, frames, target);
+                if (cut >= end)
+                {
+                    break;
+                }
+                tasks.push_back(Task{input->file, begin, cut, cut - begin});
+                begin = cut;
+            }
+            SPDLOG_DEBUG("File {} of {} bytes is split for parsing", input->file, size);
+        }
+        tasks.push_back(Task{input->file, begin, input->end, end - begin});
+    }
+
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b)
+    {
+        return a.bytes > b.bytes;
+    });
+    return tasks;
+}
+
+uint64_t FileScheduler::next_line_start(const std::string& file, uint64_t offset)
+{
+    if (offset == 0)
+    {
+        return 0;
+    }
+    // Reading from the byte before offset also covers offset already being a line start
+    std::ifstream in(file, std::ios::binary);
+    in.seekg(offset - 1);
+    std::string rest;
+    if (!std::getline(in, rest) || in.eof())
+    {
+        return std::filesystem::file_size(file);
+    }
+    return offset + rest.size();
+}
+
+
+uint64_t FileScheduler::lower_bound_ts(const std::string& file, uint64_t ts, uint64_t begin, uint64_t end)
+{
+    std::ifstream in(file, std::ios::binary);
+    std::string line;
+    // receive_ts of the line starting at offset and the start of the next line. Lines without a readable
+    // receive_ts count as earlier than ts, the parser rejects them
+    auto read_line = [&](uint64_t offset)
+    {
+        in.clear();
+        in.seekg(offset);
+        std::getline(in, line);
+        const auto line_ts = CsvParser::parse_ts(line);
+        return std::pair{line_ts && *line_ts >= ts, offset + line.size() + 1};
+    };
+
+    // Every line starting before lo is earlier than ts, every line starting at or after hi is not
+    uint64_t lo = begin;
+    uint64_t hi = end;
+    while (lo < hi)
+    {
+        const uint64_t mid = next_line_start(file, lo + (hi - lo) / 2);
+        // No line starts in the upper half, so step over the line at lo
+        const uint64_t probe = mid < hi ? mid : lo;
+        auto [not_earlier, next] = read_line(probe);
+        if (not_earlier)
+        {
+            hi = probe;
+        }
+        else
+        {
+            lo = std::min(next, hi);
+        }
+    }
+    return hi;
+}
+
+FileScheduler::Input FileScheduler::seek_time_range(const Input& input, uint64_t from_ts, uint64_t to_ts)
+{
+    if (compressed_input::codec(input.file) != compressed_input::Codec::none)
+    {
+        // No cheap random reads; the parser still drops the rows outside the window and stops after it
+        return input;
+    }
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(input.file, ec);
+    if (ec)
+    {
+        return input;
+    }
+    // The header line is not a row, a file parsed from its beginning is searched after it
+    const uint64_t first_row = input.offset == 0 ? next_line_start(input.file, 1) : input.offset;
+    const uint64_t limit = std::min(size, input.end);
+    Input res = input;
+    const uint64_t begin = from_ts == 0 ? first_row : lower_bound_ts(input.file, from_ts, first_row, limit);
+    if (begin != first_row)
+    {
+        res.offset = begin;
+    }
+    if (to_ts != std::numeric_limits<uint64_t>::max())
+    {
+        const uint64_t end = lower_bound_ts(input.file, to_ts, begin, limit);
+        if (end < size)
+        {
+            res.end = end;
+        }
+    }
+    SPDLOG_DEBUG("File {} window starts at {} and ends at {}", input.file, res.offset, res.end);
+    return res;
+}
+
+std::optional<std::pair<uint64_t, uint64_t>> FileScheduler::sorted_bounds(const std::string& file)
+{
+    if (compressed_input::codec(file) != compressed_input::Codec::none)
+    {
+        return std::nullopt;
+    }
+    constexpr uint64_t tail_bytes = 64 * 1024;
+    std::ifstream in(file, std::ios::binary);
+    std::string line;
+    // Header, then the first row
+    if (!std::getline(in, line) || !std::getline(in, line))
+    {
+        return std::nullopt;
+    }
+    const auto first = CsvParser::parse_ts(line);
+    std::error_code ec;
+    const uint64_t size = std::filesystem::file_size(file, ec);
+    if (!first || ec)
+    {
+        return std::nullopt;
+    }
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(size - std::min(size, tail_bytes)));
+    std::optional<uint64_t> last;
+    while (std::getline(in, line))
+    {
+        if (auto ts = CsvParser::parse_ts(line))
+        {
+            last = ts;
+        }
+    }
+    if (!last)
+    {
+        return std::nullopt;
+    }
+    return std::make_pair(*first, *last);
+}
+
+std::vector<uint64_t> FileScheduler::sample_ts(const std::vector<Input>& inputs, size_t count)
+{
+    struct Range
+    {
+        const Input* input;
+        uint64_t begin;
+        uint64_t end;
+    };
+    std::vector<Range> ranges;
+    uint64_t total = 0;
+    for (const auto& input : inputs)
+    {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(input.file, ec);
+        if (ec || compressed_input::codec(input.file) != compressed_input::Codec::none)
+        {
+            continue;
+        }
+        const uint64_t end = std::min(size, input.end);
+        if (end > input.offset)
+        {
+            ranges.push_back({&input, input.offset, end});
+            total += end - input.offset;
+        }
+    }
+    std::vector<uint64_t> res;
+    if (total == 0 || count == 0)
+    {
+        return res;
+    }
+    res.reserve(count);
+    const uint64_t step = std::max<uint64_t>(total / count, 1);
+    std::string line;
+    for (const auto& range : ranges)
+    {
+        std::ifstream in(range.input->file, std::ios::binary);
+        // One seek per step of the combined size, the line cut by the seek is skipped. The header of a file read from
+        // its beginning does not parse and drops out the same way
+        for (uint64_t offset = range.begin; offset < range.end; offset += step)
+        {
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(offset));
+            if (offset != 0 && !std::getline(in, line))
+            {
+                break;
+            }
+            if (!std::getline(in, line))
+            {
+                break;
+            }
+            if (auto ts = CsvParser::parse_ts(line))
+            {
+                res.push_back(*ts);
+            }
+        }
+    }
+    SPDLOG_DEBUG("Sampled {} receive_ts values of {} files", res.size(), ranges.size());
+    return res;
+}
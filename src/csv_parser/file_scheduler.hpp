@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Orders parse tasks longest first (LPT), so one big file queued last cannot dictate the runtime.
+// A file larger than its fair share of the bytes (total / threads) is cut at line starts into pieces of about
+// that share, never smaller than min_split. Offsets into a compressed input count decompressed bytes; a zstd file
+// is cut at frame starts, a gzip file is one task
+class FileScheduler
+{
+public:
+    struct Input
+    {
+        std::string file;
+        // Where parsing starts, e.g. a checkpoint offset
+        uint64_t offset = 0;
+        // Line start where parsing stops, max for the end of the file
+        uint64_t end = std::numeric_limits<uint64_t>::max();
+    };
+
+    struct Task
+    {
+        std::string file;
+        uint64_t begin;
+        uint64_t end = std::numeric_limits<uint64_t>::max();
+        uint64_t bytes;
+    };
+
+    static constexpr uint64_t default_min_split = 64ull << 20;
+
+    static std::vector<Task> plan(const std::vector<Input>& inputs, uint32_t threads, uint64_t min_split = default_min_split);
+    // First line start at or after offset, the file size when there is none
+    static uint64_t next_line_start(const std::string& file, uint64_t offset);
+    // First line start in [begin, end) whose receive_ts is at least ts, end when there is none. Binary search over
+    // byte offsets, so the lines of the range must be ordered by receive_ts and begin must be a line start
+    static uint64_t lower_bound_ts(const std::string& file, uint64_t ts, uint64_t begin, uint64_t end);
+    // Narrows an input to the lines of the half-open window [from_ts, to_ts) of a sorted file; compressed files
+    // are returned as they are
+    static Input seek_time_range(const Input& input, uint64_t from_ts, uint64_t to_ts);
+    // receive_ts of the first and the last row of a file sorted by receive_ts; nothing for a compressed file, whose
+    // last rows would take decompressing all of it
+    static std::optional<std::pair<uint64_t, uint64_t>> sorted_bounds(const std::string& file);
+    // receive_ts of about count rows at evenly spaced offsets of the inputs, the larger ones sampled more, e.g. to
+    // choose sort splitters from. Compressed inputs are left out
+    static std::vector<uint64_t> sample_ts(const std::vector<Input>& inputs, size_t count);
+};
@@ -0,0 +1,44 @@
+#include "reject_writer.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+RejectWriter::RejectWriter(const std::string& file_name)
+{
+    std::filesystem::path path(file_name);
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path());
+    }
+    m_out.open(file_name, std::ios::binary | std::ios::trunc);
+    if (!m_out.is_open())
+    {
+        throw std::runtime_error("Cannot open reject file: " + file_name);
+    }
+    m_out << "file;offset;reason;row\n";
+}
+
+void RejectWriter::add(std::string& batch, const std::string& file_name, uint64_t offset, std::string_view reason, std::string_view row)
+{
+    batch += file_name;
+    batch += ';';
+    batch += std::to_string(offset);
+    batch += ';';
+    batch += reason;
+    batch += ';';
+    batch += row;
+    batch += '\n';
+}
+
+void RejectWriter::write(const std::string& batch)
+{
+    if (batch.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_out.write(batch.data(), batch.size());
+    m_out.flush();
+    m_rows += std::count(batch.begin(), batch.end(), '\n');
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Collects rejected input rows in one file: file;offset;reason;row, offset being the byte where the row starts in
+// the (decompressed) file. Parser threads fill their own batch and hand it over in one write, so the shared stream
+// is locked once per batch rather than per row
+class RejectWriter
+{
+public:
+    explicit RejectWriter(const std::string& file_name);
+    static void add(std::string& batch, const std::string& file_name, uint64_t offset, std::string_view reason, std::string_view row);
+    void write(const std::string& batch);
+    inline uint64_t rows() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rows;
+    }
+private:
+    std::ofstream m_out;
+    mutable std::mutex m_mutex;
+    uint64_t m_rows = 0;
+};
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "../trace/trace.hpp"
+
+#include <string>
 #include <vector>
 #include <thread>
 #include <queue>
@@ -12,11 +15,13 @@ class ThreadPoolQueue {
 public:
     ThreadPoolQueue() : m_pending_tasks(0), m_is_running(true) {};
 
-    void start_async(unsigned int max_threads)
+    // The name labels the worker threads and their tasks in the trace, so it must be a string literal
+    void start_async(unsigned int max_threads, const char* name = "pool")
     {
         for (int i = 0; i < max_threads; ++i)
         {
-            m_threads_vec.emplace_back([this]{
+            m_threads_vec.emplace_back([this, name, i]{
+                trace::set_thread_name(std::string(name) + " " + std::to_string(i));
                 while (m_is_running.load(std::memory_order_acquire))
                 {
                     std::function<void()> task;
@@ -35,6 +40,7 @@ public:
                     }
                     try
                     {
+                        trace::ScopedEvent event(name);
                         task();
                     }
                     catch (const std::exception& err)
@@ -42,7 +48,6 @@ public:
 
                     }
                     m_pending_tasks.fetch_sub(1, std::memory_order_release);
-                    if (m_pending_tasks.load(std::memory_order_acquire) == 0)
                     {
                         std::lock_guard<std::mutex> lock(m_wait_task_mutex);
                         m_wait_task_cv.notify_all();
@@ -88,10 +93,16 @@ public:
     }
 
     void wait_for_pending()
+    {
+        wait_for_pending_below(1);
+    }
+
+    // Blocks while limit or more tasks are queued or running, so a producer cannot run ahead of the workers
+    void wait_for_pending_below(uint64_t limit)
     {
         std::unique_lock lock(m_wait_task_mutex);
-        m_wait_task_cv.wait(lock, [this] {
-            return m_pending_tasks.load(std::memory_order_acquire) == 0;
+        m_wait_task_cv.wait(lock, [this, limit] {
+            return m_pending_tasks.load(std::memory_order_acquire) < limit;
         });
     }
 private:
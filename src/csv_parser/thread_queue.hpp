@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -35,6 +36,7 @@ public:
             return;
         }
         m_queue.push(std::move(value));
+        m_high_water = std::max(m_high_water, m_queue.size());
         m_cv.notify_one();
     }
 
@@ -73,10 +75,18 @@ public:
         return m_queue.size();
     }
 
+    // Largest number of queued items seen so far
+    size_t high_water() const
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_high_water;
+    }
+
 private:
     std::queue<T> m_queue;
     mutable std::mutex m_mutex;
     std::condition_variable m_cv;
+    size_t m_high_water = 0;
     std::atomic<bool> m_finished{ false };
     std::atomic<bool> m_stop_flag{ false };
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "directory_watcher.hpp"
+#include "../logger/logger.hpp"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <stdexcept>
+
+DirectoryWatcher::DirectoryWatcher(const std::filesystem::path& directory) : m_directory(directory)
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0)
+    {
+        throw std::runtime_error("Cannot initialize inotify");
+    }
+    m_watch = inotify_add_watch(m_fd, directory.c_str(), IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE);
+    if (m_watch < 0)
+    {
+        ::close(m_fd);
+        throw std::runtime_error("Cannot watch directory: " + directory.string());
+    }
+    SPDLOG_DEBUG("Watching directory {}", directory.string());
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    ::close(m_fd);
+}
+
+std::vector<std::filesystem::path> DirectoryWatcher::wait(std::chrono::milliseconds timeout)
+{
+    std::vector<std::filesystem::path> changed;
+    pollfd pfd {m_fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ready <= 0)
+    {
+        return changed;
+    }
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true)
+    {
+        ssize_t len = ::read(m_fd, buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            if (len < 0 && errno != EAGAIN)
+            {
+                spdlog::warn("Error while reading inotify events for {}", m_directory.string());
+            }
+            break;
+        }
+        for (char* pos = buffer; pos < buffer + len;)
+        {
+            auto* event = reinterpret_cast<inotify_event*>(pos);
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Events were lost, let the caller rescan every file it knows
+                changed.emplace_back();
+            }
+            else if (event->len != 0 && !(event->mask & IN_ISDIR))
+            {
+                changed.push_back(m_directory / event->name);
+            }
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
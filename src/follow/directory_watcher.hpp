@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// inotify watch on one directory, reports names of files that were created, appended to or moved in
+class DirectoryWatcher
+{
+public:
+    explicit DirectoryWatcher(const std::filesystem::path& directory);
+    ~DirectoryWatcher();
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Waits up to timeout for events, returns changed file names (may repeat)
+    std::vector<std::filesystem::path> wait(std::chrono::milliseconds timeout);
+private:
+    std::filesystem::path m_directory;
+    int m_fd = -1;
+    int m_watch = -1;
+};
@@ -0,0 +1,78 @@
+#include "file_tailer.hpp"
+#include "../logger/logger.hpp"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+FileTailer::FileTailer(const std::filesystem::path& file_path) : m_file_path(file_path), m_buffer(1 << 16)
+{
+
+}
+
+uint64_t FileTailer::read_new(std::vector<CsvParser::ParserData>& out)
+{
+    int fd = ::open(m_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    uint64_t rejected = 0;
+    while (true)
+    {
+        ssize_t len = ::pread(fd, m_buffer.data(), m_buffer.size(), static_cast<off_t>(m_offset));
+        if (len <= 0)
+        {
+            break;
+        }
+        m_offset += len;
+
+        const char* begin = m_buffer.data();
+        const char* end = begin + len;
+        for (const char* pos = begin; pos < end;)
+        {
+            const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if (newline == nullptr)
+            {
+                // The writer has not finished this line yet
+                m_partial.append(pos, end);
+                break;
+            }
+            m_partial.append(pos, newline);
+            pos = newline + 1;
+
+            if (!m_header_read)
+            {
+                m_header_read = true;
+            }
+            else
+            {
+                try
+                {
+                    CsvParser::ParserData record;
+                    if (CsvParser::parse_line(m_partial, record))
+                    {
+                        out.push_back(record);
+                    }
+                    else
+                    {
+                        ++rejected;
+                    }
+                }
+                catch (const std::exception&)
+                {
+                    ++rejected;
+                }
+            }
+            m_partial.clear();
+        }
+    }
+    ::close(fd);
+    if (rejected != 0)
+    {
+        spdlog::warn("File {} has {} incorrect new lines", m_file_path.string(), rejected);
+    }
+    return rejected;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../csv_parser/csv_parser.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Reads the complete lines appended to a CSV file since the previous call
+class FileTailer
+{
+public:
+    explicit FileTailer(const std::filesystem::path& file_path);
+    // Appends parsed rows to out, returns the number of rejected lines
+    uint64_t read_new(std::vector<CsvParser::ParserData>& out);
+    inline uint64_t offset() const
+    {
+        return m_offset;
+    }
+private:
+    std::filesystem::path m_file_path;
+    std::string m_partial;
+    std::vector<char> m_buffer;
+    uint64_t m_offset = 0;
+    bool m_header_read = false;
+};
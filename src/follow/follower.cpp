@@ -0,0 +1,154 @@
+#include "follower.hpp"
+#include "directory_watcher.hpp"
+#include "file_tailer.hpp"
+#include "reorder_buffer.hpp"
+#include "../stream/median_stream.hpp"
+#include "../logger/logger.hpp"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+Follower::Follower(Options options) : m_options(std::move(options))
+{
+
+}
+
+void Follower::run(const std::atomic<bool>& stop)
+{
+    using Clock = ReorderBuffer::Clock;
+    constexpr std::chrono::seconds report_interval(10);
+
+    DirectoryWatcher watcher(m_options.input);
+    std::map<std::filesystem::path, FileTailer> tailers;
+    auto track = [&](const std::filesystem::path& file)
+    {
+        if (tailers.count(file) == 0 && (!m_options.filter || m_options.filter(file)))
+        {
+            spdlog::info("Following file {}", file.string());
+            tailers.emplace(file, FileTailer(file));
+        }
+    };
+    // Files that exist before the watch are followed from the beginning
+    for (const auto& entry : std::filesystem::directory_iterator(m_options.input))
+    {
+        if (entry.is_regular_file())
+        {
+            track(entry.path());
+        }
+    }
+
+    auto sink = make_output_sink(m_options.format, m_options.output_file);
+    ReorderBuffer reorder(m_options.lateness, m_options.max_delay, m_options.reorder_capacity);
+    MedianStream median;
+
+    std::vector<CsvParser::ParserData> rows;
+    std::vector<Clock::time_point> pending;
+    auto emit = [&](const ReorderBuffer::Entry& entry)
+    {
+        if (median.push(entry.receive_ts, entry.price))
+        {
+            sink->write(entry.receive_ts, median.median());
+            ++m_stats.emitted;
+        }
+        pending.push_back(entry.arrival);
+    };
+    auto publish = [&]()
+    {
+        if (pending.empty())
+        {
+            return;
+        }
+        sink->flush();
+        const auto now = Clock::now();
+        for (const auto& arrival : pending)
+        {
+            m_latency.record(now - arrival);
+        }
+        pending.clear();
+    };
+    auto ingest = [&](FileTailer& tailer)
+    {
+        rows.clear();
+        m_stats.rejected += tailer.read_new(rows);
+        const auto now = Clock::now();
+        for (const auto& row : rows)
+        {
+            if (!reorder.push({row.receive_ts, row.price, now}))
+            {
+                spdlog::warn("Row at {} is older than the last emitted one, dropped", row.receive_ts);
+            }
+        }
+        m_stats.rows += rows.size();
+    };
+
+    auto next_report = Clock::now() + report_interval;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        const auto now = Clock::now();
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(std::min(now + m_options.poll_interval, reorder.next_deadline()) - now);
+        auto changed = watcher.wait(std::max(timeout, std::chrono::milliseconds(0)));
+
+        bool rescan = changed.empty();
+        for (const auto& file : changed)
+        {
+            if (file.empty())
+            {
+                rescan = true;
+                continue;
+            }
+            if (std::filesystem::is_regular_file(file))
+            {
+                track(file);
+            }
+        }
+        if (rescan)
+        {
+            for (auto& [file, tailer] : tailers)
+            {
+                ingest(tailer);
+            }
+        }
+        else
+        {
+            for (const auto& file : changed)
+            {
+                auto tailer = tailers.find(file);
+                if (tailer != tailers.end())
+                {
+                    ingest(tailer->second);
+                }
+            }
+        }
+
+        reorder.release(Clock::now(), emit);
+        publish();
+
+        if (Clock::now() >= next_report)
+        {
+            log_latency();
+            next_report = Clock::now() + report_interval;
+        }
+    }
+
+    for (auto& [file, tailer] : tailers)
+    {
+        ingest(tailer);
+    }
+    reorder.drain(emit);
+    publish();
+    sink->close();
+    m_stats.dropped = reorder.dropped();
+    log_latency();
+}
+
+void Follower::log_latency() const
+{
+    auto us = [](std::chrono::nanoseconds value)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+    };
+    spdlog::info("Follow: rows {}, rejected {}, emitted {}, latency us p50 {} p90 {} p99 {} p99.9 {} max {}",
+        m_stats.rows, m_stats.rejected, m_stats.emitted,
+        us(m_latency.percentile(0.5)), us(m_latency.percentile(0.9)), us(m_latency.percentile(0.99)), us(m_latency.percentile(0.999)), us(m_latency.max()));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "latency_histogram.hpp"
+#include "../out_writer/output_sink.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+// Tails CSV files of a directory and appends median changes to the output as rows arrive
+class Follower
+{
+public:
+    struct Options
+    {
+        std::filesystem::path input;
+        std::function<bool(const std::filesystem::path&)> filter;
+        std::string output_file;
+        OutputFormat format = OutputFormat::csv;
+        // In receive_ts units: how far a row may lag behind the newest one and still be ordered
+        uint64_t lateness = 0;
+        // Upper bound on how long a row is held back waiting for older ones
+        std::chrono::milliseconds max_delay {100};
+        size_t reorder_capacity = 1 << 20;
+        std::chrono::milliseconds poll_interval {50};
+    };
+
+    struct Stats
+    {
+        uint64_t rows = 0;
+        uint64_t rejected = 0;
+        uint64_t dropped = 0;
+        uint64_t emitted = 0;
+    };
+
+    explicit Follower(Options options);
+    // Runs until stop is set, then emits everything still buffered
+    void run(const std::atomic<bool>& stop);
+    inline const LatencyHistogram& latency() const
+    {
+        return m_latency;
+    }
+    inline const Stats& stats() const
+    {
+        return m_stats;
+    }
+private:
+    void log_latency() const;
+    Options m_options;
+    LatencyHistogram m_latency;
+    Stats m_stats;
+};
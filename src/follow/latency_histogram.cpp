@@ -0,0 +1,54 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+size_t LatencyHistogram::bucket_index(uint64_t value)
+{
+    if (value < m_sub_buckets)
+    {
+        return value;
+    }
+    const unsigned exponent = std::bit_width(value) - 1;
+    const unsigned shift = exponent - m_sub_bits;
+    return m_sub_buckets + shift * m_sub_buckets + ((value >> shift) & (m_sub_buckets - 1));
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t index)
+{
+    if (index < m_sub_buckets)
+    {
+        return index;
+    }
+    const unsigned shift = (index - m_sub_buckets) / m_sub_buckets;
+    const uint64_t sub = (index - m_sub_buckets) % m_sub_buckets;
+    return ((m_sub_buckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency)
+{
+    const uint64_t value = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    ++m_buckets[bucket_index(value)];
+    ++m_count;
+    m_max = std::max(m_max, value);
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double q) const
+{
+    if (m_count == 0)
+    {
+        return std::chrono::nanoseconds(0);
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * m_count)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < m_buckets.size(); ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+        {
+            return std::chrono::nanoseconds(std::min(bucket_upper(i), m_max));
+        }
+    }
+    return std::chrono::nanoseconds(m_max);
+}
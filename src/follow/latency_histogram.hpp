@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Log-linear histogram of latencies in nanoseconds: 16 sub-buckets per power of two, so percentiles are within ~6%
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::nanoseconds latency);
+    // q in [0, 1], upper bound of the bucket containing the q-th value
+    std::chrono::nanoseconds percentile(double q) const;
+    inline std::chrono::nanoseconds max() const
+    {
+        return std::chrono::nanoseconds(m_max);
+    }
+    inline uint64_t count() const
+    {
+        return m_count;
+    }
+private:
+    inline static constexpr unsigned m_sub_bits = 4;
+    inline static constexpr unsigned m_sub_buckets = 1u << m_sub_bits;
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_upper(size_t index);
+
+    std::array<uint64_t, m_sub_buckets + (64 - m_sub_bits) * m_sub_buckets> m_buckets {};
+    uint64_t m_count = 0;
+    uint64_t m_max = 0;
+};
@@ -0,0 +1,34 @@
+#include "reorder_buffer.hpp"
+
+#include <algorithm>
+
+ReorderBuffer::ReorderBuffer(uint64_t lateness, std::chrono::milliseconds max_delay, size_t capacity)
+    : m_lateness(lateness), m_max_delay(max_delay), m_capacity(std::max<size_t>(capacity, 1))
+{
+
+}
+
+bool ReorderBuffer::push(const Entry& entry)
+{
+    if (m_released_any && entry.receive_ts < m_last_released)
+    {
+        ++m_dropped;
+        return false;
+    }
+    m_max_seen = std::max(m_max_seen, entry.receive_ts);
+    m_heap.push(entry);
+    if (!m_arrivals.empty() && m_arrivals.back().arrival == entry.arrival)
+    {
+        m_arrivals.back().receive_ts = std::max(m_arrivals.back().receive_ts, entry.receive_ts);
+    }
+    else
+    {
+        m_arrivals.push_back({entry.arrival, entry.receive_ts});
+    }
+    return true;
+}
+
+ReorderBuffer::Clock::time_point ReorderBuffer::next_deadline() const
+{
+    return m_arrivals.empty() ? Clock::time_point::max() : m_arrivals.front().arrival + m_max_delay;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <vector>
+
+// Bounded min-heap on receive_ts that holds rows back until they can no longer be overtaken:
+// a row is released once a row lateness newer has been seen, once it waited max_delay, or when the buffer is full.
+// Rows older than the last released one are dropped.
+class ReorderBuffer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        uint64_t receive_ts;
+        double price;
+        Clock::time_point arrival;
+    };
+
+    ReorderBuffer(uint64_t lateness, std::chrono::milliseconds max_delay, size_t capacity);
+    // Returns false if the row is too late to be ordered and was dropped
+    bool push(const Entry& entry);
+
+    template<typename Emit>
+    void release(Clock::time_point now, Emit&& emit)
+    {
+        // A row that waited max_delay is released together with every buffered row older than it
+        while (!m_arrivals.empty() && now - m_arrivals.front().arrival >= m_max_delay)
+        {
+            m_due_ts = std::max(m_due_ts, m_arrivals.front().receive_ts);
+            m_arrivals.pop_front();
+        }
+        while (!m_heap.empty())
+        {
+            const uint64_t ts = m_heap.top().receive_ts;
+            const bool overtaken = m_max_seen >= m_lateness && ts <= m_max_seen - m_lateness;
+            if (!overtaken && ts > m_due_ts && m_heap.size() <= m_capacity)
+            {
+                break;
+            }
+            pop(emit);
+        }
+    }
+
+    template<typename Emit>
+    void drain(Emit&& emit)
+    {
+        while (!m_heap.empty())
+        {
+            pop(emit);
+        }
+    }
+
+    // Earliest moment a buffered row may become due by max_delay
+    Clock::time_point next_deadline() const;
+    inline size_t size() const
+    {
+        return m_heap.size();
+    }
+    inline uint64_t dropped() const
+    {
+        return m_dropped;
+    }
+private:
+    struct Later
+    {
+        inline bool operator()(const Entry& a, const Entry& b) const
+        {
+            return a.receive_ts > b.receive_ts;
+        }
+    };
+
+    template<typename Emit>
+    void pop(Emit& emit)
+    {
+        Entry entry = m_heap.top();
+        m_heap.pop();
+        m_last_released = entry.receive_ts;
+        m_released_any = true;
+        emit(entry);
+    }
+
+    struct Arrival
+    {
+        Clock::time_point arrival;
+        uint64_t receive_ts;
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, Later> m_heap;
+    // Newest receive_ts per arrival time, rows of one batch share an entry
+    std::deque<Arrival> m_arrivals;
+    uint64_t m_lateness;
+    std::chrono::milliseconds m_max_delay;
+    size_t m_capacity;
+    uint64_t m_max_seen = 0;
+    uint64_t m_last_released = 0;
+    uint64_t m_due_ts = 0;
+    uint64_t m_dropped = 0;
+    bool m_released_any = false;
+};
@@ -0,0 +1,374 @@
+#include "market_data_generator.hpp"
+#include "../csv_parser/thread_pool_queue.hpp"
+#include "../logger/logger.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <numbers>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+    constexpr uint32_t book_depth = 5;
+    constexpr double rebuild_probability = 0.001;
+
+    inline uint64_t splitmix64(uint64_t& state)
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    inline uint64_t mix_seed(uint64_t seed, uint64_t a, uint64_t b)
+    {
+        uint64_t state = seed;
+        uint64_t mixed = splitmix64(state) ^ a;
+        state = mixed;
+        mixed = splitmix64(state) ^ b;
+        state = mixed;
+        return splitmix64(state);
+    }
+
+    // xoshiro256**, with its own uniform and normal draws so the output does not depend on the standard library
+    class Random
+    {
+    public:
+        explicit Random(uint64_t seed)
+        {
+            for (auto& word : m_state)
+            {
+                word = splitmix64(seed);
+            }
+        }
+
+        inline uint64_t next()
+        {
+            const uint64_t result = std::rotl(m_state[1] * 5, 7) * 9;
+            const uint64_t t = m_state[1] << 17;
+            m_state[2] ^= m_state[0];
+            m_state[3] ^= m_state[1];
+            m_state[1] ^= m_state[2];
+            m_state[0] ^= m_state[3];
+            m_state[2] ^= t;
+            m_state[3] = std::rotl(m_state[3], 45);
+            return result;
+        }
+
+        // [0, 1)
+        inline double uniform()
+        {
+            return (next() >> 11) * 0x1.0p-53;
+        }
+
+        // [0, n)
+        inline uint64_t below(uint64_t n)
+        {
+            return n == 0 ? 0 : next() % n;
+        }
+
+        inline double normal()
+        {
+            const double u1 = std::max(uniform(), 0x1.0p-53);
+            const double u2 = uniform();
+            return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * std::numbers::pi * u2);
+        }
+    private:
+        uint64_t m_state[4];
+    };
+
+    class LineWriter
+    {
+    public:
+        explicit LineWriter(std::string& text) : m_text(text) {}
+
+        inline LineWriter& number(uint64_t value)
+        {
+            char buffer[24];
+            m_text.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+            return *this;
+        }
+
+        inline LineWriter& fixed(double value)
+        {
+            char buffer[64];
+            m_text.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 8).ptr);
+            return *this;
+        }
+
+        inline LineWriter& text(std::string_view value)
+        {
+            m_text.append(value);
+            return *this;
+        }
+
+        inline LineWriter& sep()
+        {
+            m_text.push_back(';');
+            return *this;
+        }
+
+        inline void end()
+        {
+            m_text.push_back('\n');
+        }
+    private:
+        std::string& m_text;
+    };
+} //anonymous namespace
+
+MarketDataGenerator::MarketDataGenerator(Options options) : m_options(std::move(options))
+{
+    if (m_options.files == 0 || m_options.tick_size <= 0.0 || m_options.threads == 0)
+    {
+        throw std::invalid_argument("Generator needs at least one file and one thread and a positive tick size");
+    }
+    if (m_options.prefix.empty())
+    {
+        m_options.prefix = m_options.kind == Kind::trades ? "trades" : "level";
+    }
+    m_options.overlap = std::clamp(m_options.overlap, 0.0, 1.0);
+}
+
+std::vector<uint64_t> MarketDataGenerator::file_rows() const
+{
+    std::vector<double> weights(m_options.files);
+    double sum = 0.0;
+    for (uint32_t i = 0; i < m_options.files; ++i)
+    {
+        weights[i] = 1.0 / std::pow(i + 1.0, m_options.size_skew);
+        sum += weights[i];
+    }
+    std::vector<uint64_t> rows(m_options.files);
+    uint64_t assigned = 0;
+    for (uint32_t i = 0; i < m_options.files; ++i)
+    {
+        rows[i] = static_cast<uint64_t>(m_options.rows * (weights[i] / sum));
+        assigned += rows[i];
+    }
+    rows[0] += m_options.rows - assigned;
+    return rows;
+}
+
+std::vector<MarketDataGenerator::Segment> MarketDataGenerator::plan_segments(const std::vector<uint64_t>& rows) const
+{
+    // Only the segment boundaries of the price walk are drawn up front, each segment bridges between its two
+    std::vector<Segment> segments;
+    for (uint32_t file = 0; file < rows.size(); ++file)
+    {
+        Random random(mix_seed(m_options.seed, file, ~0ull));
+        double ticks = m_options.start_price / m_options.tick_size;
+        const uint64_t count = std::max<uint64_t>(1, (rows[file] + m_segment_rows - 1) / m_segment_rows);
+        for (uint64_t index = 0; index < count; ++index)
+        {
+            const uint64_t first = index * m_segment_rows;
+            const uint64_t len = std::min(m_segment_rows, rows[file] - std::min(rows[file], first));
+            const double end = ticks + random.normal() * m_options.volatility * std::sqrt(static_cast<double>(len));
+            segments.push_back({file, index, first, len, ticks, end});
+            ticks = end;
+        }
+    }
+    return segments;
+}
+
+MarketDataGenerator::SegmentData MarketDataGenerator::generate(const Segment& segment, uint64_t total_rows) const
+{
+    SegmentData data;
+    data.text.reserve(segment.rows * 72 + 64);
+    LineWriter line(data.text);
+    const bool level = m_options.kind == Kind::level;
+    if (segment.index == 0)
+    {
+        line.text(level ? "receive_ts;exchange_ts;price;quantity;side;rebuild" : "receive_ts;exchange_ts;price;quantity;side").end();
+    }
+    if (segment.rows == 0)
+    {
+        return data;
+    }
+
+    Random walk_random(mix_seed(m_options.seed, segment.file, segment.index * 2));
+    Random random(mix_seed(m_options.seed, segment.file, segment.index * 2 + 1));
+
+    // Brownian bridge: the walk is bent so it ends where the next segment starts
+    std::vector<double> walk(segment.rows);
+    double position = 0.0;
+    for (auto& value : walk)
+    {
+        position += walk_random.normal() * m_options.volatility;
+        value = position;
+    }
+    const double correction = walk.back() - (segment.end_ticks - segment.start_ticks);
+
+    const double total = static_cast<double>(m_options.duration);
+    const double files = m_options.files;
+    const double span = total / files + m_options.overlap * (total - total / files);
+    const double file_start = m_options.files > 1 ? segment.file * (total - span) / (files - 1) : 0.0;
+    const double step = span / static_cast<double>(std::max<uint64_t>(total_rows, 1));
+    const uint64_t jitter = static_cast<uint64_t>(step);
+
+    uint32_t event_left = 0;
+    bool rebuild = false;
+    uint64_t event_ts = 0;
+    int64_t best_bid = 0;
+    for (uint64_t k = 0; k < segment.rows; ++k)
+    {
+        const uint64_t row = segment.first_row + k;
+        const double bridge = walk[k] - correction * (k + 1) / static_cast<double>(segment.rows);
+        const int64_t ticks = std::max<int64_t>(1, std::llround(segment.start_ticks + bridge));
+
+        uint64_t ts = m_options.start_ts + static_cast<uint64_t>(file_start + std::floor(row * step)) + random.below(jitter);
+        if (m_options.disorder > 0.0 && random.uniform() < m_options.disorder)
+        {
+            ts -= std::min(ts, random.below(m_options.disorder_window + 1));
+        }
+
+        // Level rows come in events sharing one receive_ts: a full book on rebuild or a few level updates
+        uint32_t event_pos = 0;
+        if (level)
+        {
+            if (event_left == 0)
+            {
+                rebuild = row == 0 || random.uniform() < rebuild_probability;
+                event_left = rebuild ? 2 * book_depth : 1 + random.below(3);
+                event_ts = ts;
+                best_bid = ticks;
+            }
+            event_pos = (rebuild ? 2 * book_depth : event_left) - event_left;
+            --event_left;
+            ts = event_ts;
+        }
+        const uint64_t exchange_ts = ts - std::min(ts, 500 + random.below(4500));
+
+        if (m_options.malformed_rate > 0.0 && random.uniform() < m_options.malformed_rate)
+        {
+            switch (random.below(3))
+            {
+            case 0:
+                line.number(ts).sep().number(exchange_ts).end();
+                break;
+            case 1:
+                line.number(ts).sep().number(exchange_ts).sep().text("bad").sep().fixed(1.0).sep().text("buy").end();
+                break;
+            default:
+                line.text("t").number(ts).sep().number(exchange_ts).sep().fixed(ticks * m_options.tick_size).sep().fixed(1.0).sep().text("sell").end();
+                break;
+            }
+            ++data.malformed;
+            continue;
+        }
+
+        if (!level)
+        {
+            const double quantity = (1 + random.below(1000000000)) * 1e-8;
+            line.number(ts).sep().number(exchange_ts).sep().fixed(ticks * m_options.tick_size).sep().fixed(quantity).sep().text(random.below(2) == 0 ? "buy" : "sell").end();
+        }
+        else
+        {
+            bool bid;
+            int64_t price_ticks;
+            double quantity;
+            if (rebuild)
+            {
+                bid = event_pos < book_depth;
+                const int64_t depth = event_pos % book_depth;
+                price_ticks = bid ? best_bid - depth : best_bid + 1 + depth;
+                quantity = (1 + random.below(2000000000)) * 1e-8;
+            }
+            else
+            {
+                bid = random.below(2) == 0;
+                const int64_t depth = random.below(book_depth);
+                price_ticks = bid ? best_bid - depth : best_bid + 1 + depth;
+                quantity = random.uniform() < 0.2 ? 0.0 : (1 + random.below(2000000000)) * 1e-8;
+            }
+            line.number(ts).sep().number(exchange_ts).sep().fixed(std::max<int64_t>(1, price_ticks) * m_options.tick_size).sep().fixed(quantity)
+                .sep().text(bid ? "bid" : "ask").sep().number(rebuild ? 1 : 0).end();
+        }
+        ++data.rows;
+    }
+    return data;
+}
+
+std::vector<MarketDataGenerator::FileStats> MarketDataGenerator::run()
+{
+    const auto rows = file_rows();
+    const auto segments = plan_segments(rows);
+    std::filesystem::create_directories(m_options.output_dir);
+
+    std::vector<FileStats> stats(m_options.files);
+    for (uint32_t file = 0; file < m_options.files; ++file)
+    {
+        stats[file].path = m_options.output_dir / (m_options.prefix + "_" + std::to_string(file) + ".csv");
+    }
+
+    ThreadPoolQueue pool;
+    pool.start_async(m_options.threads, "generate");
+    // Segments are formatted out of order on the pool and written in order, with a bounded number in flight
+    std::deque<std::future<SegmentData>> in_flight;
+    size_t next = 0;
+    auto submit = [&]()
+    {
+        auto promise = std::make_shared<std::promise<SegmentData>>();
+        in_flight.push_back(promise->get_future());
+        pool.push([this, promise, segment = segments[next], total = rows[segments[next].file]]()
+        {
+            try
+            {
+                promise->set_value(generate(segment, total));
+            }
+            catch (...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        ++next;
+    };
+
+    std::ofstream out;
+    for (size_t written = 0; written < segments.size(); ++written)
+    {
+        while (next < segments.size() && in_flight.size() < 2 * m_options.threads)
+        {
+            submit();
+        }
+        SegmentData data = in_flight.front().get();
+        in_flight.pop_front();
+
+        const Segment& segment = segments[written];
+        FileStats& file = stats[segment.file];
+        if (segment.index == 0)
+        {
+            out = std::ofstream(file.path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Cannot create file: " + file.path.string());
+            }
+            spdlog::info("Writing {} rows to {}", rows[segment.file], file.path.string());
+        }
+        out.write(data.text.data(), data.text.size());
+        if (!out)
+        {
+            throw std::runtime_error("Write error in file: " + file.path.string());
+        }
+        file.rows += data.rows;
+        file.malformed += data.malformed;
+        file.bytes += data.text.size();
+    }
+    out.close();
+    return stats;
+}
+
+uint64_t MarketDataGenerator::rows_for_size(uint64_t bytes) const
+{
+    constexpr uint64_t sample_rows = 4096;
+    const double ticks = m_options.start_price / m_options.tick_size;
+    const SegmentData sample = generate({0, 1, 0, sample_rows, ticks, ticks}, sample_rows);
+    return static_cast<uint64_t>(bytes / (static_cast<double>(sample.text.size()) / sample_rows));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Writes synthetic trades.csv or level.csv files. The output depends only on the options (threads included
+// or not), every segment of every file is generated from its own seed so segments are formatted in parallel
+class MarketDataGenerator
+{
+public:
+    enum class Kind
+    {
+        trades,
+        level
+    };
+
+    struct Options
+    {
+        std::filesystem::path output_dir;
+        Kind kind = Kind::trades;
+        // File names are <prefix>_<index>.csv, the kind name when empty
+        std::string prefix;
+        uint32_t files = 1;
+        // Lines over all files, malformed ones included
+        uint64_t rows = 1000000;
+        uint64_t seed = 1;
+        // Share of rows whose receive_ts is pushed back by up to disorder_window
+        double disorder = 0.0;
+        uint64_t disorder_window = 1000;
+        // 1: every file spans the whole time range, 0: the files follow each other without overlap
+        double overlap = 1.0;
+        // Standard deviation of one price step, in ticks
+        double volatility = 1.0;
+        double tick_size = 0.1;
+        double start_price = 68480.0;
+        // Share of lines with missing columns or a broken number
+        double malformed_rate = 0.0;
+        // File i gets a share of rows proportional to 1 / (i + 1)^size_skew
+        double size_skew = 0.0;
+        uint64_t start_ts = 1716810808000000;
+        // Time range of all files in receive_ts units
+        uint64_t duration = 3600000000;
+        uint32_t threads = 4;
+    };
+
+    struct FileStats
+    {
+        std::filesystem::path path;
+        uint64_t rows = 0;
+        uint64_t malformed = 0;
+        uint64_t bytes = 0;
+    };
+
+    explicit MarketDataGenerator(Options options);
+    // Throws std::runtime_error when a file cannot be written
+    std::vector<FileStats> run();
+    // Number of rows that makes the files about `bytes` long in total
+    uint64_t rows_for_size(uint64_t bytes) const;
+private:
+    struct Segment
+    {
+        uint32_t file;
+        uint64_t index;
+        uint64_t first_row;
+        uint64_t rows;
+        // Price in ticks at the first and after the last row, consecutive segments share the boundary
+        double start_ticks;
+        double end_ticks;
+    };
+
+    struct SegmentData
+    {
+        std::string text;
+        uint64_t rows = 0;
+        uint64_t malformed = 0;
+    };
+
+    std::vector<uint64_t> file_rows() const;
+    std::vector<Segment> plan_segments(const std::vector<uint64_t>& rows) const;
+    SegmentData generate(const Segment& segment, uint64_t total_rows) const;
+
+    inline static constexpr uint64_t m_segment_rows = 1 << 18;
+    Options m_options;
+};
@@ -1,15 +1,75 @@
 #include "logger.hpp"
 
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/sinks/rotating_file_sink.h>
 
+#include <algorithm>
 #include <mutex>
 #include <memory>
 #include <vector>
 #include <string>
 
+namespace
+{
+    struct LimiterRegistry
+    {
+        std::mutex mutex;
+        std::vector<logger_helper::RateLimiter*> limiters;
+    };
+
+    LimiterRegistry& limiter_registry()
+    {
+        static LimiterRegistry registry;
+        return registry;
+    }
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+} //anonymous namespace
+
 namespace logger_helper
 {
+    RateLimiter::RateLimiter(const char* file, int line, uint32_t burst, std::chrono::milliseconds interval)
+        : m_file(file), m_line(line), m_burst(burst), m_interval_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count())
+    {
+        auto& registry = limiter_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.limiters.push_back(this);
+    }
+
+    RateLimiter::~RateLimiter()
+    {
+        auto& registry = limiter_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::erase(registry.limiters, this);
+    }
+
+    bool RateLimiter::allow(uint64_t& suppressed)
+    {
+        const int64_t now = now_ns();
+        int64_t start = m_window_start.load(std::memory_order_relaxed);
+        if ((start == std::numeric_limits<int64_t>::min() || now - start >= m_interval_ns)
+            && m_window_start.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        {
+            m_count.store(0, std::memory_order_relaxed);
+        }
+        if (m_count.fetch_add(1, std::memory_order_relaxed) < m_burst)
+        {
+            suppressed = take_suppressed();
+            return true;
+        }
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t RateLimiter::take_suppressed()
+    {
+        return m_suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
     void init_logger(const std::string& log_name, const int log_max_size, const int log_max_files_cnt, const std::chrono::milliseconds flushing_interval_ms)
     {
         auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(log_name, log_max_size, log_max_files_cnt);
@@ -47,6 +107,36 @@ namespace logger_helper
         spdlog::flush_every(flushing_interval_ms);
     }
 
+    void make_async(const AsyncOptions& options)
+    {
+        auto current = spdlog::default_logger();
+        spdlog::init_thread_pool(options.queue_size, 1);
+        auto logger = std::make_shared<spdlog::async_logger>(current->name(), current->sinks().begin(), current->sinks().end(), spdlog::thread_pool(),
+            options.block ? spdlog::async_overflow_policy::block : spdlog::async_overflow_policy::overrun_oldest);
+        logger->set_level(current->level());
+        spdlog::set_default_logger(logger);
+    }
+
+    void report_suppressed()
+    {
+        auto& registry = limiter_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto* limiter : registry.limiters)
+        {
+            if (uint64_t suppressed = limiter->take_suppressed())
+            {
+                spdlog::warn("{} similar messages suppressed at {}:{}", suppressed, limiter->file(), limiter->line());
+            }
+        }
+    }
+
+    void shutdown_logger()
+    {
+        report_suppressed();
+        spdlog::default_logger()->flush();
+        spdlog::shutdown();
+    }
+
     void create_log_dir()
     {
 	    std::filesystem::path logs_path = "logs";
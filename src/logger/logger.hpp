@@ -2,7 +2,10 @@
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/dist_sink.h>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <limits>
 #include <unordered_set>
 
 namespace logger_helper
@@ -25,6 +28,80 @@ namespace logger_helper
         std::unordered_set<spdlog::level::level_enum> m_allowed_levels;
     };
 
+    struct AsyncOptions
+    {
+        size_t queue_size = 8192;
+        // Block the caller when the queue is full, otherwise the oldest queued message is dropped
+        bool block = false;
+    };
+
+    // Lets through at most burst messages per interval from one call site and counts the rest
+    class RateLimiter
+    {
+    public:
+        RateLimiter(const char* file, int line, uint32_t burst = 10, std::chrono::milliseconds interval = std::chrono::seconds(1));
+        ~RateLimiter();
+        RateLimiter(const RateLimiter&) = delete;
+        RateLimiter& operator=(const RateLimiter&) = delete;
+
+        // suppressed gets the number of messages dropped since the last one let through
+        bool allow(uint64_t& suppressed);
+        uint64_t take_suppressed();
+        inline const char* file() const
+        {
+            return m_file;
+        }
+        inline int line() const
+        {
+            return m_line;
+        }
+    private:
+        const char* m_file;
+        int m_line;
+        uint32_t m_burst;
+        int64_t m_interval_ns;
+        std::atomic<int64_t> m_window_start {std::numeric_limits<int64_t>::min()};
+        std::atomic<uint32_t> m_count {0};
+        std::atomic<uint64_t> m_suppressed {0};
+    };
+
     void init_logger(const std::string& log_name, const int log_max_size, const int log_max_files_cnt, const std::chrono::milliseconds flushing_interval_ms);
+    // Moves the default logger's sinks behind a bounded queue drained by a background thread
+    void make_async(const AsyncOptions& options);
+    // Logs the messages still held back by rate limiters
+    void report_suppressed();
+    // Reports suppressed messages and drains the async queue, call before main returns
+    void shutdown_logger();
     void create_log_dir();
-} //namespace logger
\ No newline at end of file
+
+    class ScopedShutdown
+    {
+    public:
+        ScopedShutdown() = default;
+        ~ScopedShutdown()
+        {
+            shutdown_logger();
+        }
+        ScopedShutdown(const ScopedShutdown&) = delete;
+        ScopedShutdown& operator=(const ScopedShutdown&) = delete;
+    };
+} //namespace logger
+
+// Per call site rate limited logging for messages that can repeat once per input row
+#define LOG_RATE_LIMITED(level, ...) \
+    do \
+    { \
+        if (spdlog::default_logger_raw()->should_log(level)) \
+        { \
+            static logger_helper::RateLimiter log_limiter_(__FILE__, __LINE__); \
+            uint64_t log_suppressed_ = 0; \
+            if (log_limiter_.allow(log_suppressed_)) \
+            { \
+                if (log_suppressed_ != 0) \
+                { \
+                    spdlog::log(level, "{} similar messages suppressed at {}:{}", log_suppressed_, __FILE__, __LINE__); \
+                } \
+                spdlog::log(level, __VA_ARGS__); \
+            } \
+        } \
+    } while (false)
@@ -1,34 +1,114 @@
 #include "./logger/logger.hpp"
-#include "./csv_parser/csv_parser.hpp"
-#include "./out_writer/out_writer.hpp"
-#include "./out_writer/algorithm_median.hpp"
-#include "./out_writer/custom_serializer.hpp"
 #include "./config_reader/config_reader.hpp"
+#include "./pipeline/batch_runner.hpp"
+#include "./pipeline/median_pipeline.hpp"
+#include "./pipeline/shard_coordinator.hpp"
+#include "./system/system_resources.hpp"
+#include "./system/bulk_memory.hpp"
+#include "./system/read_ahead.hpp"
+#include "./follow/follower.hpp"
+#include "./metrics/metrics.hpp"
+#include "./trace/trace.hpp"
 
 #include <boost/program_options.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <set>
 #include <cstdlib>
+#include <csignal>
 
 namespace po = boost::program_options;
 
+namespace
+{
+    std::atomic<bool> stop_requested {false};
+
+    void request_stop(int signal)
+    {
+        stop_requested.store(true);
+        std::signal(signal, SIG_DFL);
+    }
+
+    // Shard workers log to their own files; the logger starts before the options are parsed
+    std::string log_name(int argc, char* argv[])
+    {
+        const std::string flag = "--shard-index";
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == flag && i + 1 < argc)
+            {
+                return "logs/csv_parser_shard" + std::string(argv[i + 1]);
+            }
+            if (arg.rfind(flag + "=", 0) == 0)
+            {
+                return "logs/csv_parser_shard" + arg.substr(flag.size() + 1);
+            }
+        }
+        return "logs/csv_parser";
+    }
+
+    std::optional<BookBuilder::Options> book_options(const ConfigReader::Config& cfg)
+    {
+        if (cfg.book_price.empty())
+        {
+            return std::nullopt;
+        }
+        return BookBuilder::Options{cfg.tick_size, cfg.book_price == "mid" ? BookBuilder::Price::mid : BookBuilder::Price::microprice};
+    }
+} //anonymous namespace
+
 int main(int argc, char* argv[])
 {
     constexpr std::chrono::milliseconds flushing_interval_ms(1000); 
     logger_helper::create_log_dir();
-    logger_helper::init_logger("logs/csv_parser", 1024 * 1024, 3, flushing_interval_ms);
-    spdlog::set_level(spdlog::level::level_enum::trace);
-
-    constexpr size_t DEFAULT_MAX_MEMORY = 524288000;
-    constexpr unsigned DEFAULT_MAX_THREAD = 4;
+    logger_helper::init_logger(log_name(argc, argv), 1024 * 1024, 3, flushing_interval_ms);
+    logger_helper::ScopedShutdown logger_shutdown;
 
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "Show help")
         ("config", po::value<std::string>(), "Path to config file (TOML)")
         ("cfg", po::value<std::string>(), "Alternative to --config")
-        ("max-memory", po::value<size_t>(), "Maximum memory buffer size in bytes (default: 524288000)")
-        ("max-thread", po::value<unsigned>(), "Maximum number of threads for parsing (default: 4)");
+        ("max-memory", po::value<size_t>(), "Maximum memory buffer size in bytes (default: half of the physical memory or the cgroup memory.max)")
+        ("max-thread", po::value<unsigned>(), "Maximum number of threads for parsing (default: usable CPUs from affinity and the cgroup cpu.max)")
+        ("no-huge-pages", "Do not ask for transparent huge pages for the record buffers")
+        ("prefault", "Fault the pages of the sort buffer in on a background thread before ingest reaches them")
+        ("io-backend", po::value<std::string>(), "Read-ahead of input and temporary files: auto, uring or threads (default: auto, io_uring when the kernel allows it)")
+        ("read-ahead-blocks", po::value<unsigned>(), "Blocks in flight per file being read, at least 2 (default: 4)")
+        ("read-ahead-block-size", po::value<size_t>(), "Bytes per read-ahead block (default: 1048576)")
+        ("median-mode", po::value<std::string>(), "In memory median engine: heaps, parallel or offline (default: heaps)")
+        ("incremental", "Continue from the checkpoint in the output directory and parse only appended rows")
+        ("resumable", "Record spill runs in a manifest, so a rerun after a crash keeps them and parses only the rest")
+        ("queue-depth", po::value<unsigned>(), "Parsed chunks waiting for the sort stage before the parser threads wait (default: one per parser thread)")
+        ("spill-threads", po::value<unsigned>(), "Threads writing sorted runs to temporary files (default: --max-thread)")
+        ("max-pending-spills", po::value<unsigned>(), "Sorted runs waiting for a spill thread before the sort stage waits, 0 for no limit (default: 2)")
+        ("partitioned-sort", "Sort by sending rows to receive_ts ranges and sorting each range, instead of merging sorted runs")
+        ("partitions", po::value<unsigned>(), "Partitioned sort: receive_ts ranges to start with (default: max(16, 4 * --max-thread))")
+        ("workers", po::value<unsigned>(), "Split the batch run over this many worker processes, each with its share of --max-memory and --max-thread")
+        ("shard-by", po::value<std::string>(), "With --workers: files or time (equal receive_ts windows, needs a time window or sorted input) (default: files)")
+        ("shard-index", po::value<unsigned>(), "Set by the coordinator: run as the worker of this shard")
+        ("shard-count", po::value<unsigned>(), "Set by the coordinator: number of workers the input was split for")
+        ("shard-dir", po::value<std::string>(), "Set by the coordinator: directory for the shard runs")
+        ("batch", po::value<std::vector<std::string>>()->multitoken(), "Run the jobs of these configs in this process: each [[jobs]] table, or [main] when there is none")
+        ("batch-jobs", po::value<unsigned>(), "Batch: jobs running at the same time (default: one per thread while each keeps 64 MB)")
+        ("batch-report", po::value<std::string>(), "Batch: write per-job timings to this CSV file")
+        ("follow", "Watch the input directory and append median changes as rows are written, until SIGINT/SIGTERM")
+        ("lateness", po::value<uint64_t>(), "Follow mode: how far in receive_ts units a row may lag behind the newest one (default: 0)")
+        ("max-delay-ms", po::value<unsigned>(), "Follow mode: maximum time a row is held back for reordering (default: 100)")
+        ("reorder-capacity", po::value<size_t>(), "Follow mode: maximum number of rows held back for reordering (default: 1048576)")
+        ("metrics-json", po::value<std::string>(), "Write run metrics as JSON to this file at exit")
+        ("metrics-prom", po::value<std::string>(), "Write run metrics as a Prometheus textfile (node_exporter) at exit")
+        ("trace", po::value<std::string>(), "Record a timeline of worker tasks, sorts, spills, the merge and the median pass in Chrome trace-event format")
+        ("log-level", po::value<std::string>(), "trace, debug, info, warn, error, critical or off (default: info); debug and trace are compiled out of release builds")
+        ("log-async", "Log through a bounded queue drained by a background thread")
+        ("log-queue-size", po::value<size_t>(), "Async logging: queue capacity in messages (default: 8192)")
+        ("log-overflow", po::value<std::string>(), "Async logging: block or drop (the oldest message) when the queue is full (default: drop)")
+        ("reject-file", po::value<std::string>(), "Write rejected rows to this file instead of the log");
 
     po::variables_map vm;
     try 
@@ -52,6 +132,48 @@ int main(int argc, char* argv[])
         return EXIT_SUCCESS;
     }
 
+    spdlog::level::level_enum log_level = spdlog::level::info;
+    if (vm.count("log-level"))
+    {
+        const std::string level = vm["log-level"].as<std::string>();
+        log_level = spdlog::level::from_str(level);
+        if (log_level == spdlog::level::off && level != "off")
+        {
+            spdlog::error("log-level must be trace, debug, info, warn, error, critical or off, got {}", level);
+            return EXIT_FAILURE;
+        }
+    }
+    spdlog::set_level(log_level);
+
+    if (vm.count("log-async"))
+    {
+        logger_helper::AsyncOptions options;
+        if (vm.count("log-queue-size"))
+        {
+            options.queue_size = vm["log-queue-size"].as<size_t>();
+            if (options.queue_size == 0)
+            {
+                spdlog::error("log-queue-size must be > 0");
+                return EXIT_FAILURE;
+            }
+        }
+        if (vm.count("log-overflow"))
+        {
+            const std::string overflow = vm["log-overflow"].as<std::string>();
+            if (overflow != "block" && overflow != "drop")
+            {
+                spdlog::error("log-overflow must be block or drop, got {}", overflow);
+                return EXIT_FAILURE;
+            }
+            options.block = overflow == "block";
+        }
+        logger_helper::make_async(options);
+    }
+
+    metrics::ScopedExport metrics_export(vm.count("metrics-json") ? vm["metrics-json"].as<std::string>() : std::string(),
+        vm.count("metrics-prom") ? vm["metrics-prom"].as<std::string>() : std::string());
+    trace::ScopedSession trace_session(vm.count("trace") ? vm["trace"].as<std::string>() : std::string());
+
     std::string config_path = "./config.toml";
     if (vm.count("config")) 
     {
@@ -62,9 +184,24 @@ int main(int argc, char* argv[])
         config_path = vm["cfg"].as<std::string>();
     }
 
-    size_t max_memory = DEFAULT_MAX_MEMORY;
-    unsigned max_thread = DEFAULT_MAX_THREAD;
+    const auto resources = system_resources::detect();
+    unsigned max_thread = system_resources::default_threads(resources);
+
+    if (vm.count("max-thread"))
+    {
+        max_thread = vm["max-thread"].as<unsigned>();
+        if (max_thread == 0)
+        {
+            spdlog::error("max-thread must be > 0");
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        spdlog::info("max-thread derived from {} usable CPUs{}", resources.cpus, resources.cpu_limited ? " (cgroup cpu.max)" : "");
+    }
 
+    size_t max_memory = 0;
     if (vm.count("max-memory"))
     {
         max_memory = vm["max-memory"].as<size_t>();
@@ -74,25 +211,220 @@ int main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
     }
+    else
+    {
+        // Every buffer is sized by max-memory, so the default is the usable memory over how many of them a run holds
+        const MedianPipeline::Options defaults;
+        const double multiplier = system_resources::memory_multiplier(max_thread,
+            vm.count("queue-depth") ? vm["queue-depth"].as<unsigned>() : defaults.queue_depth,
+            vm.count("max-pending-spills") ? vm["max-pending-spills"].as<unsigned>() : defaults.max_pending_spills);
+        max_memory = system_resources::default_memory(resources, multiplier);
+        spdlog::info("max-memory derived from {} of {} bytes over {} buffers of that size", resources.memory_limited ? "cgroup memory.max" : "physical memory",
+            resources.memory, multiplier);
+    }
 
-    if (vm.count("max-thread"))
+    bulk_memory::configure(bulk_memory::Options{vm.count("no-huge-pages") == 0, vm.count("prefault") != 0});
+
+    read_ahead::Options read_options;
+    try
     {
-        max_thread = vm["max-thread"].as<unsigned>();
-        if (max_thread == 0)
+        if (vm.count("io-backend"))
         {
-            spdlog::error("max-thread must be > 0");
+            read_options.backend = read_ahead::parse_backend(vm["io-backend"].as<std::string>());
+        }
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("{}", err.what());
+        return EXIT_FAILURE;
+    }
+    if (vm.count("read-ahead-blocks"))
+    {
+        read_options.depth = vm["read-ahead-blocks"].as<unsigned>();
+        if (read_options.depth < 2)
+        {
+            spdlog::error("read-ahead-blocks must be >= 2");
+            return EXIT_FAILURE;
+        }
+    }
+    if (vm.count("read-ahead-block-size"))
+    {
+        read_options.block_size = vm["read-ahead-block-size"].as<size_t>();
+    }
+    read_ahead::configure(read_options);
+
+    MedianAlgorithm::Mode median_mode = MedianAlgorithm::Mode::heaps;
+    if (vm.count("median-mode"))
+    {
+        const std::string mode = vm["median-mode"].as<std::string>();
+        if (mode == "parallel")
+        {
+            median_mode = MedianAlgorithm::Mode::parallel;
+        }
+        else if (mode == "offline")
+        {
+            median_mode = MedianAlgorithm::Mode::offline;
+        }
+        else if (mode != "heaps")
+        {
+            spdlog::error("median-mode must be heaps, parallel or offline, got {}", mode);
             return EXIT_FAILURE;
         }
     }
 
+    const bool incremental = vm.count("incremental") != 0;
+
+    ShardCoordinator::By shard_by = ShardCoordinator::By::files;
+    if (vm.count("shard-by"))
+    {
+        const std::string by = vm["shard-by"].as<std::string>();
+        if (by == "time")
+        {
+            shard_by = ShardCoordinator::By::time;
+        }
+        else if (by != "files")
+        {
+            spdlog::error("shard-by must be files or time, got {}", by);
+            return EXIT_FAILURE;
+        }
+    }
+    const bool shard_worker = vm.count("shard-index") != 0;
+    if (shard_worker && (!vm.count("shard-count") || !vm.count("shard-dir")))
+    {
+        spdlog::error("shard-index needs shard-count and shard-dir");
+        return EXIT_FAILURE;
+    }
+    const unsigned workers = vm.count("workers") ? vm["workers"].as<unsigned>() : 1;
+    if (workers == 0)
+    {
+        spdlog::error("workers must be > 0");
+        return EXIT_FAILURE;
+    }
+    if (workers > 1 && (incremental || vm.count("resumable") || vm.count("follow")))
+    {
+        spdlog::error("workers cannot be combined with incremental, resumable or follow mode");
+        return EXIT_FAILURE;
+    }
+
+    // Settings shared by every run of this process
+    MedianPipeline::Options run_options;
+    run_options.max_memory = max_memory;
+    run_options.max_threads = max_thread;
+    run_options.median_mode = median_mode;
+    run_options.incremental = incremental;
+    run_options.resumable = vm.count("resumable") != 0;
+    if (vm.count("queue-depth"))
+    {
+        run_options.queue_depth = vm["queue-depth"].as<unsigned>();
+    }
+    if (vm.count("spill-threads"))
+    {
+        run_options.spill_threads = vm["spill-threads"].as<unsigned>();
+    }
+    if (vm.count("max-pending-spills"))
+    {
+        run_options.max_pending_spills = vm["max-pending-spills"].as<unsigned>();
+    }
+    run_options.partitioned_sort = vm.count("partitioned-sort") != 0;
+    if (vm.count("partitions"))
+    {
+        run_options.partitions = vm["partitions"].as<unsigned>();
+    }
+    // The first signal stops the run at the next parsed chunk, a second one ends the process
+    run_options.stop = &stop_requested;
+
     spdlog::info("CSV Parser started! max_memory={}, max_thread={}", max_memory, max_thread);
 
+    if (vm.count("batch"))
+    {
+        if (workers > 1 || shard_worker || vm.count("follow"))
+        {
+            spdlog::error("batch cannot be combined with workers or follow mode");
+            return EXIT_FAILURE;
+        }
+        std::vector<BatchRunner::Job> jobs;
+        std::set<std::string> outputs;
+        try
+        {
+            for (const auto& path : vm["batch"].as<std::vector<std::string>>())
+            {
+                const auto configs = ConfigReader::load_jobs(path);
+                for (size_t i = 0; i < configs.size(); ++i)
+                {
+                    const auto& job_cfg = configs[i];
+                    BatchRunner::Job job;
+                    job.name = !job_cfg.name.empty() ? job_cfg.name
+                        : std::filesystem::path(path).stem().string() + (configs.size() > 1 ? "#" + std::to_string(i + 1) : "");
+                    const OutputFormat format = parse_output_format(job_cfg.output_format);
+                    job.options = run_options;
+                    job.options.files = ConfigReader::find_files(job_cfg);
+                    job.options.output_file = job_cfg.output.string() + "/output" + output_extension(format);
+                    job.options.format = format;
+                    job.options.checkpoint_file = job_cfg.output / "checkpoint.bin";
+                    job.options.time_range = CsvParser::TimeRange{job_cfg.from_ts, job_cfg.to_ts};
+                    job.options.sorted_input = job_cfg.sorted_input;
+                    job.options.book = book_options(job_cfg);
+                    if (vm.count("reject-file"))
+                    {
+                        job.options.reject_file = vm["reject-file"].as<std::string>() + "." + job.name;
+                    }
+                    if (!outputs.insert(job.options.output_file).second)
+                    {
+                        throw std::runtime_error("Jobs " + job.name + " and another one write the same output " + job.options.output_file);
+                    }
+                    jobs.push_back(std::move(job));
+                }
+            }
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while reading batch configs: {}", err.what());
+            return EXIT_FAILURE;
+        }
+
+        BatchRunner::Options options;
+        options.max_memory = max_memory;
+        options.max_threads = max_thread;
+        if (vm.count("batch-jobs"))
+        {
+            options.concurrency = vm["batch-jobs"].as<unsigned>();
+        }
+        options.stop = &stop_requested;
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+        const auto results = BatchRunner(std::move(jobs), options).run();
+        if (vm.count("batch-report"))
+        {
+            try
+            {
+                BatchRunner::write_report(vm["batch-report"].as<std::string>(), results);
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Error while writing batch report: {}", err.what());
+                return EXIT_FAILURE;
+            }
+        }
+        const bool ok = std::all_of(results.begin(), results.end(), [](const BatchRunner::Result& result) { return result.ok; });
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     ConfigReader::Config cfg;
+    OutputFormat output_format = OutputFormat::csv;
     std::vector<std::filesystem::path> files{};
     try 
     {
         cfg = ConfigReader::load_from_file(config_path);
-        spdlog::info("Configuration : input directory {}, output directory {}", cfg.input.string(), cfg.output.string());
+        output_format = parse_output_format(cfg.output_format);
+        spdlog::info("Configuration : input directory {}, output directory {}, output format {}", cfg.input.string(), cfg.output.string(), cfg.output_format);
+        if (cfg.from_ts != 0 || cfg.to_ts != std::numeric_limits<uint64_t>::max())
+        {
+            spdlog::info("Time window [{}, {}){}", cfg.from_ts, cfg.to_ts, cfg.sorted_input ? ", input sorted by receive_ts" : "");
+        }
+        if (!cfg.book_price.empty())
+        {
+            spdlog::info("Order book input, median of the {} price on a {} tick", cfg.book_price, cfg.tick_size);
+        }
         spdlog::info("Masks:");
         for (const auto& masks: cfg.filename_mask)
         {
@@ -111,35 +443,136 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    auto comp = [](const CsvParser::ParserData& a, const CsvParser::ParserData& b)
-    {
-        return a.receive_ts < b.receive_ts;
-    };
+    const std::string output_file = cfg.output.string() + "/output" + output_extension(output_format);
 
-    auto parser = std::make_unique<CsvParser>(max_memory, max_thread);
+    if (vm.count("follow"))
+    {
+        if (!cfg.book_price.empty())
+        {
+            spdlog::error("Follow mode reads trades, book_price is not supported there");
+            return EXIT_FAILURE;
+        }
+        Follower::Options options;
+        options.input = cfg.input;
+        options.filter = [&cfg](const std::filesystem::path& file)
+        {
+            return ConfigReader::matches_mask(cfg, file);
+        };
+        options.output_file = output_file;
+        options.format = output_format;
+        if (vm.count("lateness"))
+        {
+            options.lateness = vm["lateness"].as<uint64_t>();
+        }
+        if (vm.count("max-delay-ms"))
+        {
+            options.max_delay = std::chrono::milliseconds(vm["max-delay-ms"].as<unsigned>());
+        }
+        if (vm.count("reorder-capacity"))
+        {
+            options.reorder_capacity = vm["reorder-capacity"].as<size_t>();
+        }
 
-    auto algo = std::make_shared<MedianAlgorithm>();
-    auto ser = std::make_shared<ParserDataSerializer>();
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+        try
+        {
+            std::filesystem::create_directories(cfg.output);
+            Follower follower(std::move(options));
+            follower.run(stop_requested);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error in follow mode: {}", err.what());
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 
-    auto out_writer = std::make_unique<OutWriter<CsvParser::ParserData, decltype(comp)>>(parser->get_max_elements(), ser, algo, comp, max_thread);
-    for (const auto& data : files)
+    if (workers > 1 && !shard_worker)
     {
-        parser->add_file_to_parse(data);
-        spdlog::info("Added file to parse {}", data.string());
+        ShardCoordinator::Options options;
+        // Workers read the same config and get the settings of the parse and sort stages
+        options.worker_command = {"/proc/self/exe", "--config", config_path};
+        for (const char* flag : {"log-level", "log-overflow", "reject-file", "io-backend"})
+        {
+            if (vm.count(flag))
+            {
+                options.worker_command.insert(options.worker_command.end(), {std::string("--") + flag, vm[flag].as<std::string>()});
+            }
+        }
+        for (const char* flag : {"queue-depth", "spill-threads", "max-pending-spills", "read-ahead-blocks", "partitions"})
+        {
+            if (vm.count(flag))
+            {
+                options.worker_command.insert(options.worker_command.end(), {std::string("--") + flag, std::to_string(vm[flag].as<unsigned>())});
+            }
+        }
+        for (const char* flag : {"log-queue-size", "read-ahead-block-size"})
+        {
+            if (vm.count(flag))
+            {
+                options.worker_command.insert(options.worker_command.end(), {std::string("--") + flag, std::to_string(vm[flag].as<size_t>())});
+            }
+        }
+        for (const char* flag : {"no-huge-pages", "prefault", "log-async", "partitioned-sort"})
+        {
+            if (vm.count(flag))
+            {
+                options.worker_command.push_back(std::string("--") + flag);
+            }
+        }
+        options.files = std::move(files);
+        options.workers = workers;
+        options.by = shard_by;
+        options.time_range = CsvParser::TimeRange{cfg.from_ts, cfg.to_ts};
+        options.sorted_input = cfg.sorted_input;
+        options.shard_dir = output_file + ".shards";
+        options.output_file = output_file;
+        options.format = output_format;
+        options.median_mode = median_mode;
+        options.max_memory = max_memory;
+        options.max_threads = max_thread;
+        options.stop = &stop_requested;
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+        ShardCoordinator coordinator(std::move(options));
+        return coordinator.run() ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-    parser->wait_task_done();
-    while(true)
+
+    MedianPipeline::Options options = run_options;
+    if (shard_worker)
     {
-        std::optional<std::vector<CsvParser::ParserData>> data = parser->get_ready_data();
-        if (data != std::nullopt)
+        const unsigned index = vm["shard-index"].as<unsigned>();
+        const auto shards = ShardCoordinator::plan(files, vm["shard-count"].as<unsigned>(), shard_by, CsvParser::TimeRange{cfg.from_ts, cfg.to_ts}, cfg.sorted_input);
+        if (index >= shards.size())
         {
-            out_writer->collect_data(std::move(*data));
+            spdlog::error("shard-index {} is out of the {} shards", index, shards.size());
+            return EXIT_FAILURE;
         }
-        else 
+        files = shards[index].files;
+        cfg.from_ts = shards[index].time_range.from_ts;
+        cfg.to_ts = shards[index].time_range.to_ts;
+        options.shard_run = true;
+        spdlog::info("Shard {} worker: {} files, receive_ts [{}, {})", index, files.size(), cfg.from_ts, cfg.to_ts);
+    }
+    options.files = std::move(files);
+    options.output_file = shard_worker ? ShardCoordinator::run_path(vm["shard-dir"].as<std::string>(), vm["shard-index"].as<unsigned>()).string() : output_file;
+    options.format = output_format;
+    options.checkpoint_file = cfg.output / "checkpoint.bin";
+    options.time_range = CsvParser::TimeRange{cfg.from_ts, cfg.to_ts};
+    options.sorted_input = cfg.sorted_input;
+    options.book = book_options(cfg);
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    if (vm.count("reject-file"))
+    {
+        options.reject_file = vm["reject-file"].as<std::string>();
+        if (shard_worker)
         {
-            break;
+            options.reject_file += ".shard" + std::to_string(vm["shard-index"].as<unsigned>());
         }
     }
-    out_writer->write_data(cfg.output.string() + "/output.csv");
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    MedianPipeline pipeline(std::move(options));
+    return pipeline.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
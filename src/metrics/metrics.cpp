@@ -0,0 +1,203 @@
+#include "metrics.hpp"
+#include "../logger/logger.hpp"
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+
+namespace
+{
+    std::string escape(std::string_view value)
+    {
+        std::string res;
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                res.push_back('\\');
+                res.push_back(c);
+            }
+            else if (c == '\n')
+            {
+                res += "\\n";
+            }
+            else
+            {
+                res.push_back(c);
+            }
+        }
+        return res;
+    }
+
+    std::string format_number(double value)
+    {
+        char buffer[32];
+        return std::string(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+    }
+
+    void write_atomic(const std::filesystem::path& file, const std::string& text)
+    {
+        if (file.has_parent_path())
+        {
+            std::filesystem::create_directories(file.parent_path());
+        }
+        std::filesystem::path tmp = file;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out << text;
+            if (!out)
+            {
+                throw std::runtime_error("Cannot write metrics file: " + tmp.string());
+            }
+        }
+        std::filesystem::rename(tmp, file);
+    }
+} //anonymous namespace
+
+namespace metrics
+{
+    Registry& Registry::instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    void Registry::update(Type type, std::string_view name, double value, std::string_view label_name, std::string_view label_value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto [it, inserted] = m_values.try_emplace(Key{std::string(name), std::string(label_name), std::string(label_value)}, Value{type, value});
+        if (inserted)
+        {
+            return;
+        }
+        if (type == Type::counter)
+        {
+            it->second.value += value;
+        }
+        else
+        {
+            it->second.value = std::max(it->second.value, value);
+        }
+    }
+
+    void Registry::add(std::string_view name, double value, std::string_view label_name, std::string_view label_value)
+    {
+        update(Type::counter, name, value, label_name, label_value);
+    }
+
+    void Registry::max(std::string_view name, double value, std::string_view label_name, std::string_view label_value)
+    {
+        update(Type::gauge, name, value, label_name, label_value);
+    }
+
+    void Registry::reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_values.clear();
+    }
+
+    std::string Registry::to_json() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string res = "{\n  \"metrics\": [";
+        bool first = true;
+        for (const auto& [key, value] : m_values)
+        {
+            res += first ? "\n" : ",\n";
+            first = false;
+            res += "    {\"name\": \"" + escape(key.name) + "\", \"type\": \"" + (value.type == Type::counter ? "counter" : "gauge") + "\"";
+            if (!key.label_name.empty())
+            {
+                res += ", \"labels\": {\"" + escape(key.label_name) + "\": \"" + escape(key.label_value) + "\"}";
+            }
+            res += ", \"value\": " + format_number(value.value) + "}";
+        }
+        res += "\n  ]\n}\n";
+        return res;
+    }
+
+    std::string Registry::to_prometheus() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string res;
+        std::string_view last_name;
+        for (const auto& [key, value] : m_values)
+        {
+            if (key.name != last_name)
+            {
+                res += "# TYPE " + key.name + (value.type == Type::counter ? " counter\n" : " gauge\n");
+                last_name = key.name;
+            }
+            res += key.name;
+            if (!key.label_name.empty())
+            {
+                res += "{" + key.label_name + "=\"" + escape(key.label_value) + "\"}";
+            }
+            res += " " + format_number(value.value) + "\n";
+        }
+        return res;
+    }
+
+    void Registry::write(const std::filesystem::path& json_file, const std::filesystem::path& prometheus_file) const
+    {
+        if (!json_file.empty())
+        {
+            write_atomic(json_file, to_json());
+        }
+        if (!prometheus_file.empty())
+        {
+            write_atomic(prometheus_file, to_prometheus());
+        }
+    }
+
+    uint32_t thread_index()
+    {
+        static std::atomic<uint32_t> next {0};
+        thread_local const uint32_t index = next.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    uint64_t peak_rss()
+    {
+        rusage usage {};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+        // Linux reports kilobytes
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+    }
+
+    ScopedExport::ScopedExport(std::filesystem::path json_file, std::filesystem::path prometheus_file)
+        : m_json_file(std::move(json_file)), m_prometheus_file(std::move(prometheus_file)), m_start(std::chrono::steady_clock::now())
+    {
+        if (!enabled && (!m_json_file.empty() || !m_prometheus_file.empty()))
+        {
+            spdlog::warn("Built without metrics (ENABLE_METRICS=OFF), metrics files will only hold the run summary");
+        }
+    }
+
+    ScopedExport::~ScopedExport()
+    {
+        if (m_json_file.empty() && m_prometheus_file.empty())
+        {
+            return;
+        }
+        auto& registry = Registry::instance();
+        registry.max("csv_parser_peak_rss_bytes", static_cast<double>(peak_rss()));
+        registry.max("csv_parser_run_seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count());
+        try
+        {
+            registry.write(m_json_file, m_prometheus_file);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while writing metrics: {}", err.what());
+        }
+    }
+} //namespace metrics
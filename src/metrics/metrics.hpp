@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+// Run-wide counters and gauges, exported as JSON and as a Prometheus textfile. Hooks are called per file,
+// chunk, sort or spill, never per row. Without CSV_PARSER_METRICS they are empty inline functions
+namespace metrics
+{
+#ifdef CSV_PARSER_METRICS
+    inline constexpr bool enabled = true;
+#else
+    inline constexpr bool enabled = false;
+#endif
+
+    enum class Type
+    {
+        counter,
+        gauge
+    };
+
+    class Registry
+    {
+    public:
+        static Registry& instance();
+
+        void add(std::string_view name, double value, std::string_view label_name = {}, std::string_view label_value = {});
+        // Keeps the largest value seen
+        void max(std::string_view name, double value, std::string_view label_name = {}, std::string_view label_value = {});
+        void reset();
+
+        std::string to_json() const;
+        std::string to_prometheus() const;
+        // Empty paths are skipped, files are replaced atomically so node_exporter never reads half a file
+        void write(const std::filesystem::path& json_file, const std::filesystem::path& prometheus_file) const;
+    private:
+        struct Key
+        {
+            std::string name;
+            std::string label_name;
+            std::string label_value;
+            inline bool operator<(const Key& other) const
+            {
+                return std::tie(name, label_name, label_value) < std::tie(other.name, other.label_name, other.label_value);
+            }
+        };
+
+        struct Value
+        {
+            Type type;
+            double value;
+        };
+
+        void update(Type type, std::string_view name, double value, std::string_view label_name, std::string_view label_value);
+
+        mutable std::mutex m_mutex;
+        std::map<Key, Value> m_values;
+    };
+
+    // Small stable index of the calling thread, for per-thread labels
+    uint32_t thread_index();
+    // Peak resident set size of the process in bytes
+    uint64_t peak_rss();
+
+    inline void count(std::string_view name, double value = 1.0)
+    {
+        if constexpr (enabled)
+        {
+            Registry::instance().add(name, value);
+        }
+    }
+
+    inline void count(std::string_view name, double value, std::string_view label_name, std::string_view label_value)
+    {
+        if constexpr (enabled)
+        {
+            Registry::instance().add(name, value, label_name, label_value);
+        }
+    }
+
+    inline void high_water(std::string_view name, double value)
+    {
+        if constexpr (enabled)
+        {
+            Registry::instance().max(name, value);
+        }
+    }
+
+#ifdef CSV_PARSER_METRICS
+    // Adds the seconds between construction and destruction to a counter
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(std::string_view name, bool per_thread = false) : m_name(name), m_per_thread(per_thread), m_start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer()
+        {
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            if (m_per_thread)
+            {
+                Registry::instance().add(m_name, seconds, "thread", std::to_string(thread_index()));
+            }
+            else
+            {
+                Registry::instance().add(m_name, seconds);
+            }
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+    private:
+        std::string_view m_name;
+        bool m_per_thread;
+        std::chrono::steady_clock::time_point m_start;
+    };
+#else
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(std::string_view, bool = false) {}
+    };
+#endif
+
+    // Writes the registry with the peak RSS when the run ends, whichever way main returns
+    class ScopedExport
+    {
+    public:
+        ScopedExport(std::filesystem::path json_file, std::filesystem::path prometheus_file);
+        ~ScopedExport();
+        ScopedExport(const ScopedExport&) = delete;
+        ScopedExport& operator=(const ScopedExport&) = delete;
+    private:
+        std::filesystem::path m_json_file;
+        std::filesystem::path m_prometheus_file;
+        std::chrono::steady_clock::time_point m_start;
+    };
+} //namespace metrics
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "serializer.hpp"
+#include "record_packing.hpp"
 
 #include <vector>
 #include <string>
@@ -13,4 +14,23 @@ public:
     virtual ~IAlgorithm() = default;
     virtual void process_in_memory(std::vector<T>&& sorted_data, const std::string& output_file) = 0;
     virtual void process_file(const std::shared_ptr<ISerializer<T>> serializer, const std::string& sorted_input_file, const std::string& output_file) = 0;
+    // True when the algorithm needs every record in one vector. The writer then keeps the records unpacked, since
+    // unpacking them would hold the packed records and a full copy at once
+    virtual bool random_access() const
+    {
+        return false;
+    }
+    // Sorted records that stayed in memory in a packed form or in partitions. By default they are unpacked into
+    // one vector
+    virtual void process_sorted(IRecordCursor<T>& sorted_data, const std::string& output_file)
+    {
+        std::vector<T> data;
+        data.reserve(sorted_data.size());
+        T value;
+        while (sorted_data.next(value))
+        {
+            data.push_back(std::move(value));
+        }
+        process_in_memory(std::move(data), output_file);
+    }
 };
\ No newline at end of file
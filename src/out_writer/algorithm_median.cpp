@@ -1,80 +1,565 @@
 #include "algorithm_median.hpp"
+#include "running_median.hpp"
 #include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+#include "../trace/trace.hpp"
+#include "../csv_parser/thread_pool_queue.hpp"
+#include "../stream/median_stream.hpp"
+#include "../system/read_ahead.hpp"
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 
+#include <algorithm>
+#include <bit>
 #include <fstream>
-#include <iomanip>
 #include <cmath>
-#include <queue>
+#include <limits>
+#include <map>
 #include <vector>
 
+namespace
+{
+    // Below this many rows per block the thread start-up and prefix histograms cost more than the heaps save
+    constexpr size_t min_parallel_block = 1 << 16;
+
+    // Counts per distinct price, ordered by value. Rank selection walks the tree top-down in O(log D)
+    class FenwickTree
+    {
+    public:
+        explicit FenwickTree(const std::vector<uint64_t>& counts) : m_tree(counts.size() + 1, 0), m_top_bit(std::bit_floor(counts.size()))
+        {
+            for (size_t i = 1; i < m_tree.size(); ++i)
+            {
+                m_tree[i] += counts[i - 1];
+                size_t parent = i + (i & (~i + 1));
+                if (parent < m_tree.size())
+                {
+                    m_tree[parent] += m_tree[i];
+                }
+            }
+        }
+
+        void add(size_t index)
+        {
+            for (size_t i = index + 1; i < m_tree.size(); i += i & (~i + 1))
+            {
+                ++m_tree[i];
+            }
+        }
+
+        // Index of the value with the given 1-based rank
+        size_t select(uint64_t rank) const
+        {
+            size_t pos = 0;
+            for (size_t step = m_top_bit; step != 0; step >>= 1)
+            {
+                if (pos + step < m_tree.size() && m_tree[pos + step] < rank)
+                {
+                    pos += step;
+                    rank -= m_tree[pos];
+                }
+            }
+            return pos;
+        }
+
+    private:
+        std::vector<uint64_t> m_tree;
+        size_t m_top_bit;
+    };
+
+    // Same arithmetic as the two heaps: lower middle plus upper middle halved, so both paths emit identical values
+    inline double select_median(const FenwickTree& tree, const std::vector<double>& values, uint64_t total)
+    {
+        double lower = values[tree.select((total + 1) / 2)];
+        if (total % 2 == 1)
+        {
+            return lower;
+        }
+        return (lower + values[tree.select(total / 2 + 1)]) / 2.0;
+    }
+
+    inline size_t value_index(const std::vector<double>& values, double price)
+    {
+        return std::lower_bound(values.begin(), values.end(), price) - values.begin();
+    }
+
+    // A resumed run continues from the saved histogram in O(distinct prices), where the heaps would be refilled with
+    // every row seen so far. next fills the next record, false at the end
+    template<typename Next>
+    MedianState resume_median(const MedianState& state, double eps, IOutputSink& sink, Next&& next)
+    {
+        HistogramMedian median(state.histogram);
+        bool first = !state.has_median;
+        double last_median = state.last_median;
+        CsvParser::ParserData data;
+        while (next(data))
+        {
+            const double current = median.push(data.price);
+            if (first || std::fabs(current - last_median) > eps)
+            {
+                sink.write(data.receive_ts, current);
+                last_median = current;
+                first = false;
+            }
+        }
+        return MedianState{median.histogram(), median.size(), !first, last_median};
+    }
+} //anonymous namespace
+
+MedianAlgorithm::MedianAlgorithm(Mode mode, uint32_t max_threads, OutputFormat format) : m_mode(mode), m_format(format), m_max_threads(std::max<uint32_t>(1, max_threads))
+{
+
+}
+
+void MedianAlgorithm::enable_state_tracking(MedianState initial)
+{
+    m_state = std::move(initial);
+    m_track_state = true;
+    m_final_state.reset();
+}
+
 void MedianAlgorithm::process_in_memory(std::vector<CsvParser::ParserData>&& sorted_data, const std::string& output_file)
 {
+    trace::ScopedEvent event("median");
+    metrics::ScopedTimer timer("csv_parser_median_seconds_total");
     std::filesystem::path out_path(output_file);
-    std::filesystem::create_directories(out_path.parent_path());
+    if (out_path.has_parent_path())
+    {
+        std::filesystem::create_directories(out_path.parent_path());
+    }
 
-    std::ofstream out(output_file);
-    if (!out.is_open()) 
+    std::unique_ptr<IOutputSink> sink = make_output_sink(m_format, output_file, m_state.count != 0);
+    const bool done = (m_mode == Mode::parallel && median_parallel(sorted_data, *sink))
+        || (m_mode == Mode::offline && median_offline(sorted_data, *sink));
+    if (!done)
     {
-        throw std::runtime_error("Cannot create output file: " + output_file);
+        median_heaps(sorted_data, *sink);
     }
+    sink->close();
+    spdlog::info("Results are written to a file {}", output_file);
+}
 
-    out << "receive_ts;price_median\n"; 
-    out << std::fixed << std::setprecision(8);
+void MedianAlgorithm::process_sorted(IRecordCursor<CsvParser::ParserData>& sorted_data, const std::string& output_file)
+{
+    // The parallel and offline engines need random access to the whole input. Packing is off for them, so this is
+    // the partitioned sort, whose cursor frees every partition once it is copied out
+    if (random_access())
+    {
+        IAlgorithm::process_sorted(sorted_data, output_file);
+        return;
+    }
+    trace::ScopedEvent event("median");
+    metrics::ScopedTimer timer("csv_parser_median_seconds_total");
+    std::filesystem::path out_path(output_file);
+    if (out_path.has_parent_path())
+    {
+        std::filesystem::create_directories(out_path.parent_path());
+    }
 
-    std::priority_queue<double> max_heap;
-    std::priority_queue<double, std::vector<double>, std::greater<double>> min_heap;
+    std::unique_ptr<IOutputSink> sink = make_output_sink(m_format, output_file, m_state.count != 0);
+    if (m_state.count != 0)
+    {
+        spdlog::info("Started finding median(in memory, packed, resumed)");
+        auto state = resume_median(m_state, m_eps, *sink, [&sorted_data](CsvParser::ParserData& data) { return sorted_data.next(data); });
+        if (m_track_state)
+        {
+            m_final_state = std::move(state);
+        }
+        sink->close();
+        spdlog::info("Results are written to a file {}", output_file);
+        return;
+    }
+    MedianStream stream(MedianStream::Options{sorted_data.size(), m_eps}, m_state);
+    spdlog::info("Started finding median(in memory, packed)");
+    CsvParser::ParserData data;
+    while (sorted_data.next(data))
+    {
+        if (stream.push(data.receive_ts, data.price))
+        {
+            sink->write(data.receive_ts, stream.median());
+        }
+    }
+    if (m_track_state)
+    {
+        m_final_state = stream.state();
+    }
+    sink->close();
+    spdlog::info("Results are written to a file {}", output_file);
+}
 
-    bool first = true;
-    double last_median = 0;
+void MedianAlgorithm::median_heaps(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink)
+{
+    if (m_state.count != 0)
+    {
+        spdlog::info("Started finding median(in memory, resumed)");
+        size_t next = 0;
+        auto state = resume_median(m_state, m_eps, sink, [&sorted_data, &next](CsvParser::ParserData& data)
+        {
+            if (next == sorted_data.size())
+            {
+                return false;
+            }
+            data = sorted_data[next++];
+            return true;
+        });
+        if (m_track_state)
+        {
+            m_final_state = std::move(state);
+        }
+        return;
+    }
+    MedianStream stream(MedianStream::Options{sorted_data.size(), m_eps}, m_state);
     spdlog::info("Started finding median(in memory)");
 
     for (const auto& data : sorted_data)
     {
-        if (max_heap.empty() || data.price <= max_heap.top())
+        if (stream.push(data.receive_ts, data.price))
         {
-            max_heap.push(data.price);
+            sink.write(data.receive_ts, stream.median());
         }
-        else
+    }
+
+    if (m_track_state)
+    {
+        m_final_state = stream.state();
+    }
+}
+
+bool MedianAlgorithm::median_parallel(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink)
+{
+    const size_t total = sorted_data.size();
+    const size_t blocks = std::min<size_t>(m_max_threads, total / min_parallel_block);
+    if (blocks < 2)
+    {
+        SPDLOG_DEBUG("Too few rows for the parallel median ({}), falling back to heaps", total);
+        return false;
+    }
+    const size_t block_len = (total + blocks - 1) / blocks;
+    auto block_begin = [&](size_t block)
+    {
+        return std::min(total, block * block_len);
+    };
+
+    ThreadPoolQueue pool;
+    pool.start_async(blocks, "median block");
+    auto for_each_block = [&](auto&& fn)
+    {
+        for (size_t block = 0; block < blocks; ++block)
         {
-            min_heap.push(data.price);
+            pool.push([&fn, block] { fn(block); });
         }
+        pool.wait_for_pending();
+    };
 
-        if (max_heap.size() > min_heap.size() + 1) 
+    // Per-block sorted summary: distinct prices of the block with their counts
+    std::vector<std::vector<double>> block_values(blocks);
+    std::vector<std::vector<uint64_t>> block_counts(blocks);
+    for_each_block([&](size_t block)
+    {
+        std::vector<double> prices;
+        prices.reserve(block_begin(block + 1) - block_begin(block));
+        for (size_t i = block_begin(block); i < block_begin(block + 1); ++i)
         {
-            min_heap.push(max_heap.top());
-            max_heap.pop();
-        } 
-        else if (min_heap.size() > max_heap.size()) 
+            prices.push_back(sorted_data[i].price);
+        }
+        std::sort(prices.begin(), prices.end());
+        for (double price : prices)
         {
-            max_heap.push(min_heap.top());
-            min_heap.pop();
+            if (block_values[block].empty() || block_values[block].back() != price)
+            {
+                block_values[block].push_back(price);
+                block_counts[block].push_back(0);
+            }
+            ++block_counts[block].back();
         }
+    });
 
-        double current_median;
-        if (max_heap.size() == min_heap.size())
+    std::vector<double> values;
+    for (const auto& [price, count] : m_state.histogram)
+    {
+        values.push_back(price);
+    }
+    for (const auto& block : block_values)
+    {
+        values.insert(values.end(), block.begin(), block.end());
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    // Every block keeps a dense tree over all distinct prices, which only pays off while prices repeat (tick grid)
+    if (values.size() * blocks > total + m_state.count)
+    {
+        SPDLOG_DEBUG("Too many distinct prices for the parallel median ({}), falling back to heaps", values.size());
+        return false;
+    }
+    spdlog::info("Started finding median(in memory, parallel): {} blocks, {} distinct prices", blocks, values.size());
+
+    // Counts of every row that precedes the block: the resumed state plus the summaries of earlier blocks
+    auto prefix_counts = [&](size_t block)
+    {
+        std::vector<uint64_t> counts(values.size(), 0);
+        size_t index = 0;
+        for (const auto& [price, count] : m_state.histogram)
         {
-            current_median = (max_heap.top() + min_heap.top()) / 2.0;
+            while (values[index] != price)
+            {
+                ++index;
+            }
+            counts[index] += count;
         }
-        else
+        for (size_t prev = 0; prev < block; ++prev)
         {
-            current_median = max_heap.top();
+            size_t index = 0;
+            for (size_t i = 0; i < block_values[prev].size(); ++i)
+            {
+                while (values[index] != block_values[prev][i])
+                {
+                    ++index;
+                }
+                counts[index] += block_counts[prev][i];
+            }
         }
+        return counts;
+    };
 
-        if (first || std::fabs(current_median - last_median) > m_eps) 
+    // Each block filters against the median of the row just before it. The real filter state may be older
+    // than that row, which is reconciled while stitching
+    std::vector<std::vector<MedianRow>> block_rows(blocks);
+    std::vector<double> assumed_last(blocks, 0.0);
+    for_each_block([&](size_t block)
+    {
+        FenwickTree tree(prefix_counts(block));
+        uint64_t seen = m_state.count + block_begin(block);
+        bool first = block == 0 ? !m_state.has_median : false;
+        double last_median = block == 0 ? m_state.last_median : select_median(tree, values, seen);
+        assumed_last[block] = last_median;
+
+        for (size_t i = block_begin(block); i < block_begin(block + 1); ++i)
         {
-            out << data.receive_ts << ";" << current_median << "\n";
-            last_median = current_median;
+            tree.add(value_index(values, sorted_data[i].price));
+            double current_median = select_median(tree, values, ++seen);
+            if (first || std::fabs(current_median - last_median) > m_eps)
+            {
+                block_rows[block].push_back({i, sorted_data[i].receive_ts, current_median});
+                last_median = current_median;
+                first = false;
+            }
+        }
+    });
+
+    auto write_rows = [&sink](auto begin, auto end)
+    {
+        for (auto it = begin; it != end; ++it)
+        {
+            sink.write(it->receive_ts, it->median);
+        }
+    };
+
+    double last_median = m_state.last_median;
+    for (size_t block = 0; block < blocks; ++block)
+    {
+        const auto& rows = block_rows[block];
+        if (block == 0 || last_median == assumed_last[block])
+        {
+            write_rows(rows.begin(), rows.end());
+            if (!rows.empty())
+            {
+                last_median = rows.back().median;
+            }
+            continue;
+        }
+
+        // Replay the block with the real filter state until both filters emit the same row, from there on they agree
+        FenwickTree tree(prefix_counts(block));
+        uint64_t seen = m_state.count + block_begin(block);
+        auto local = rows.begin();
+        for (size_t i = block_begin(block); i < block_begin(block + 1); ++i)
+        {
+            tree.add(value_index(values, sorted_data[i].price));
+            double current_median = select_median(tree, values, ++seen);
+            bool local_emitted = local != rows.end() && local->row == i;
+            if (local_emitted)
+            {
+                ++local;
+            }
+            if (std::fabs(current_median - last_median) > m_eps)
+            {
+                sink.write(sorted_data[i].receive_ts, current_median);
+                last_median = current_median;
+                if (local_emitted)
+                {
+                    write_rows(local, rows.end());
+                    if (local != rows.end())
+                    {
+                        last_median = rows.back().median;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    if (m_track_state)
+    {
+        std::vector<uint64_t> counts = prefix_counts(blocks);
+        MedianState state{{}, m_state.count + total, true, last_median};
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            state.histogram.emplace_back(values[i], counts[i]);
+        }
+        m_final_state = std::move(state);
+    }
+    return true;
+}
+
+bool MedianAlgorithm::median_offline(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink)
+{
+    const size_t total = sorted_data.size();
+    // A resumed state holds counts, not rows that can be linked, and the links are 32-bit
+    if (m_state.count != 0 || total == 0 || total >= std::numeric_limits<uint32_t>::max())
+    {
+        SPDLOG_DEBUG("Offline median needs a full run with fewer than 2^32 rows, falling back to heaps");
+        return false;
+    }
+    spdlog::info("Started finding median(in memory, offline)");
+
+    // Prices sorted once by value; rank[row] is the position of the row's price
+    struct ValueRow
+    {
+        double price;
+        uint32_t row;
+    };
+    std::vector<ValueRow> by_value(total);
+    for (size_t i = 0; i < total; ++i)
+    {
+        by_value[i] = ValueRow{sorted_data[i].price, static_cast<uint32_t>(i)};
+    }
+    // Equal prices may take their ranks in any order, the medians only read the values
+    auto value_less = [](const ValueRow& a, const ValueRow& b)
+    {
+        return a.price < b.price;
+    };
+    const size_t blocks = std::min<size_t>(m_max_threads, total / min_parallel_block);
+    if (blocks < 2)
+    {
+        std::sort(by_value.begin(), by_value.end(), value_less);
+    }
+    else
+    {
+        // Blocks sorted on the pool, then merged pairwise
+        std::vector<size_t> bounds(blocks + 1);
+        for (size_t block = 0; block <= blocks; ++block)
+        {
+            bounds[block] = total * block / blocks;
+        }
+        ThreadPoolQueue pool;
+        pool.start_async(blocks, "median block");
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            pool.push([&, block] { std::sort(by_value.begin() + bounds[block], by_value.begin() + bounds[block + 1], value_less); });
+        }
+        pool.wait_for_pending();
+        for (size_t width = 1; width < blocks; width *= 2)
+        {
+            for (size_t block = 0; block + width < blocks; block += 2 * width)
+            {
+                pool.push([&, block, width]
+                {
+                    std::inplace_merge(by_value.begin() + bounds[block], by_value.begin() + bounds[block + width],
+                        by_value.begin() + bounds[std::min(block + 2 * width, blocks)], value_less);
+                });
+            }
+            pool.wait_for_pending();
+        }
+    }
+
+    std::vector<uint32_t> rank(total);
+    std::vector<double> values(total);
+    for (size_t pos = 0; pos < total; ++pos)
+    {
+        rank[by_value[pos].row] = static_cast<uint32_t>(pos);
+        values[pos] = by_value[pos].price;
+    }
+    if (m_track_state)
+    {
+        MedianState state{{}, total, true, 0.0};
+        for (double price : values)
+        {
+            if (state.histogram.empty() || state.histogram.back().first != price)
+            {
+                state.histogram.emplace_back(price, 0);
+            }
+            ++state.histogram.back().second;
+        }
+        m_final_state = std::move(state);
+    }
+    by_value = {};
+
+    // Doubly linked list of ranks still present. Deleting rows from the last one backwards moves the lower
+    // median by at most one neighbour, so every prefix median costs O(1)
+    std::vector<uint32_t> prev(total);
+    std::vector<uint32_t> next(total);
+    for (size_t pos = 0; pos < total; ++pos)
+    {
+        prev[pos] = static_cast<uint32_t>(pos - 1);
+        next[pos] = static_cast<uint32_t>(pos + 1);
+    }
+    std::vector<double> medians(total);
+    uint32_t lower = static_cast<uint32_t>((total - 1) / 2);
+    for (size_t count = total; count > 0; --count)
+    {
+        // Same arithmetic as the two heaps: the lower middle, or both middles halved
+        medians[count - 1] = count % 2 == 1 ? values[lower] : (values[lower] + values[next[lower]]) / 2.0;
+        if (count == 1)
+        {
+            break;
+        }
+        // The lower median of count - 1 rows is the (count / 2)-th smallest
+        const uint32_t removed = rank[count - 1];
+        if (count % 2 == 1)
+        {
+            if (removed >= lower)
+            {
+                lower = prev[lower];
+            }
+        }
+        else if (removed <= lower)
+        {
+            lower = next[lower];
+        }
+        if (prev[removed] != std::numeric_limits<uint32_t>::max())
+        {
+            next[prev[removed]] = next[removed];
+        }
+        if (next[removed] != total)
+        {
+            prev[next[removed]] = prev[removed];
+        }
+    }
+
+    bool first = true;
+    double last_median = 0.0;
+    for (size_t i = 0; i < total; ++i)
+    {
+        if (first || std::fabs(medians[i] - last_median) > m_eps)
+        {
+            sink.write(sorted_data[i].receive_ts, medians[i]);
+            last_median = medians[i];
             first = false;
         }
     }
-    spdlog::info("Results are written to a file {}", output_file);
+    if (m_track_state)
+    {
+        m_final_state->last_median = last_median;
+    }
+    return true;
 }
 
 void MedianAlgorithm::process_file(const std::shared_ptr<ISerializer<CsvParser::ParserData>> serializer, const std::string& sorted_input_file, const std::string& output_file)
 {
+    trace::ScopedEvent event("median");
+    metrics::ScopedTimer timer("csv_parser_median_seconds_total");
     using namespace boost::accumulators;
 
     accumulator_set<double, stats<tag::median>> acc;
@@ -82,7 +567,7 @@ void MedianAlgorithm::process_file(const std::shared_ptr<ISerializer<CsvParser::
     constexpr size_t buffer_size = 5;
     buffer.reserve(buffer_size);
 
-    std::ifstream in(sorted_input_file, std::ios::binary);
+    read_ahead::Stream in(sorted_input_file);
     if (!in.is_open())
     {
         delete_process_file(sorted_input_file);
@@ -99,28 +584,42 @@ void MedianAlgorithm::process_file(const std::shared_ptr<ISerializer<CsvParser::
     }
     
     std::filesystem::path out_path(output_file);
-    std::filesystem::create_directories(out_path.parent_path());
-    std::ofstream out(output_file);
-    if (!out.is_open())
+    if (out_path.has_parent_path())
+    {
+        std::filesystem::create_directories(out_path.parent_path());
+    }
+    std::unique_ptr<IOutputSink> sink;
+    try
+    {
+        sink = make_output_sink(m_format, output_file, m_state.count != 0);
+    }
+    catch (const std::exception& err)
     {
         delete_process_file(sorted_input_file);
-        throw std::runtime_error("Cannot create output file: " + output_file);
+        throw;
     }
 
-    out << "receive_ts;price_median\n" << std::fixed << std::setprecision(8);
-
-    bool first = true;
-    double last_median = 0.0;
+    bool first = !m_state.has_median;
+    double last_median = m_state.last_median;
     spdlog::info("Started finding median for file {}", sorted_input_file);
 
+    // An incremental run keeps the exact histogram for its checkpoint anyway, so its median is exact too: a resumed
+    // run restores the histogram in one pass over the saved prices and matches a full recompute. Other runs use P^2
+    std::optional<HistogramMedian> exact;
+    if (m_track_state)
+    {
+        exact.emplace(m_state.histogram);
+    }
+    uint64_t count = m_state.count;
+
     CsvParser::ParserData record;
 
-    for (size_t i = 0; i < buffer_size; ++i)
+    while (!in.eof())
     {
         serializer->read(in, record);
         if (!in)
         {
-            if (in.eof())
+            if (in.eof()) 
             {
                 break;
             }
@@ -129,58 +628,39 @@ void MedianAlgorithm::process_file(const std::shared_ptr<ISerializer<CsvParser::
             delete_process_file(sorted_input_file);
             throw std::runtime_error("Read error at position: " + pos);
         }
+        ++count;
 
-        acc(record.price);
-        buffer.push_back(record.price);
-        std::sort(buffer.begin(), buffer.end());
-
-        size_t n = buffer.size();
         double current_median;
-        if (n % 2 == 1)
+        if (exact)
         {
-            current_median = buffer[n / 2];
+            current_median = exact->push(record.price);
+        }
+        else if (buffer.size() < buffer_size)
+        {
+            // P^2 needs its first buffer_size values before it gives a median
+            acc(record.price);
+            buffer.push_back(record.price);
+            std::sort(buffer.begin(), buffer.end());
+            const size_t n = buffer.size();
+            current_median = n % 2 == 1 ? buffer[n / 2] : (buffer[n / 2 - 1] + buffer[n / 2]) / 2.0;
         }
         else
         {
-            current_median = (buffer[n / 2 - 1] + buffer[n / 2]) / 2.0;
+            acc(record.price);
+            current_median = median(acc);
         }
 
         if (first || std::fabs(current_median - last_median) > m_eps)
         {
-            out << record.receive_ts << ";" << current_median << "\n";
+            sink->write(record.receive_ts, current_median);
             last_median = current_median;
             first = false;
         }
     }
-
-    if (in.eof() && buffer.size() <= buffer_size)
-    {
-        return;
-    }
-
-    while (true)
+    sink->close();
+    if (exact)
     {
-        serializer->read(in, record);
-        if (!in)
-        {
-            if (in.eof()) 
-            {
-                break;
-            }
-            std::streamoff pos = in.tellg();
-            spdlog::info("Results are written to a file {}", output_file);
-            delete_process_file(sorted_input_file);
-            throw std::runtime_error("Read error at position: " + pos);
-        }
-
-        acc(record.price);
-        double current_median = median(acc);
-
-        if (std::fabs(current_median - last_median) > m_eps)
-        {
-            out << record.receive_ts << ";" << current_median << "\n";
-            last_median = current_median;
-        }
+        m_final_state = MedianState{exact->histogram(), count, !first, last_median};
     }
     delete_process_file(sorted_input_file);
     spdlog::info("Results are written to a file {}", output_file);
@@ -191,7 +671,7 @@ void MedianAlgorithm::delete_process_file(const std::string& file_name)
     try 
     {
         std::filesystem::remove(file_name);
-        spdlog::debug("Temporary file removed {}", file_name);
+        SPDLOG_DEBUG("Temporary file removed {}", file_name);
     }
     catch(const std::exception& err)
     {
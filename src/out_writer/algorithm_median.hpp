@@ -2,13 +2,54 @@
 
 #include "algorithm.hpp"
 #include "../csv_parser/csv_parser.hpp"
+#include "output_sink.hpp"
+#include "median_state.hpp"
+
+#include <cstdint>
+#include <optional>
 
 class MedianAlgorithm : public IAlgorithm<CsvParser::ParserData>
 {
 public:
+    enum class Mode
+    {
+        heaps,
+        parallel,
+        offline
+    };
+
+    explicit MedianAlgorithm(Mode mode = Mode::heaps, uint32_t max_threads = 1, OutputFormat format = OutputFormat::csv);
     void process_in_memory(std::vector<CsvParser::ParserData>&& sorted_data, const std::string& output_file) override;
     void process_file(const std::shared_ptr<ISerializer<CsvParser::ParserData>> serializer, const std::string& sorted_input_file, const std::string& output_file) override;
+    void process_sorted(IRecordCursor<CsvParser::ParserData>& sorted_data, const std::string& output_file) override;
+    // The parallel and offline engines index the whole input
+    inline bool random_access() const override
+    {
+        return m_mode != Mode::heaps;
+    }
+    // Continue from a saved state (appending to the output) and keep the state of the run for the next checkpoint
+    void enable_state_tracking(MedianState initial = {});
+    inline const std::optional<MedianState>& final_state() const
+    {
+        return m_final_state;
+    }
 private:
+    struct MedianRow
+    {
+        uint64_t row;
+        uint64_t receive_ts;
+        double median;
+    };
+
+    void median_heaps(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink);
+    bool median_parallel(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink);
+    bool median_offline(const std::vector<CsvParser::ParserData>& sorted_data, IOutputSink& sink);
     void delete_process_file(const std::string& file_name);
     inline static double m_eps = 1e-8;
-};
\ No newline at end of file
+    Mode m_mode;
+    OutputFormat m_format;
+    MedianState m_state;
+    std::optional<MedianState> m_final_state;
+    bool m_track_state = false;
+    uint32_t m_max_threads;
+};
@@ -0,0 +1,93 @@
+#include "async_file_writer.hpp"
+#include "../logger/logger.hpp"
+
+#include <stdexcept>
+
+AsyncFileWriter::AsyncFileWriter(const std::string& file_name, size_t buffer_size, bool append, size_t buffer_count) : m_out(file_name, std::ios::binary | (append ? std::ios::app : std::ios::trunc)),
+m_file_name(file_name), m_ready_queue(std::make_unique<ThreadQueue<std::vector<char>>>()),
+m_free_queue(std::make_unique<ThreadQueue<std::vector<char>>>()), m_buffer_size(buffer_size)
+{
+    if (!m_out.is_open())
+    {
+        throw std::runtime_error("Cannot create output file: " + file_name);
+    }
+    for (size_t i = 0; i < buffer_count; ++i)
+    {
+        std::vector<char> buffer;
+        buffer.reserve(m_buffer_size);
+        m_free_queue->push(std::move(buffer));
+    }
+    m_writer_thread = std::thread(&AsyncFileWriter::write_loop, this);
+    SPDLOG_DEBUG("AsyncFileWriter created for {}", file_name);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while closing output file {}: {}", m_file_name, err.what());
+    }
+}
+
+std::vector<char> AsyncFileWriter::acquire_buffer()
+{
+    std::vector<char> buffer;
+    if (!m_free_queue->front(buffer))
+    {
+        throw std::runtime_error("Output file " + m_file_name + " is already closed");
+    }
+    return buffer;
+}
+
+void AsyncFileWriter::submit(std::vector<char>&& buffer)
+{
+    if (m_failed.load(std::memory_order_acquire))
+    {
+        throw std::runtime_error("Write error in output file: " + m_file_name);
+    }
+    m_ready_queue->push(std::move(buffer));
+}
+
+void AsyncFileWriter::close()
+{
+    if (!m_writer_thread.joinable())
+    {
+        return;
+    }
+    m_ready_queue->stop();
+    m_writer_thread.join();
+    m_free_queue->stop();
+    m_out.close();
+    if (m_failed.load(std::memory_order_acquire) || m_out.fail())
+    {
+        throw std::runtime_error("Write error in output file: " + m_file_name);
+    }
+}
+
+void AsyncFileWriter::write_loop()
+{
+    std::vector<char> buffer;
+    while (m_ready_queue->front(buffer))
+    {
+        if (!m_failed.load(std::memory_order_relaxed))
+        {
+            m_out.write(buffer.data(), buffer.size());
+            // Nothing queued behind this buffer, so don't leave it sitting in the stream buffer
+            if (m_ready_queue->empty())
+            {
+                m_out.flush();
+            }
+            if (!m_out)
+            {
+                spdlog::error("Write error in output file {}", m_file_name);
+                m_failed.store(true, std::memory_order_release);
+            }
+        }
+        buffer.clear();
+        m_free_queue->push(std::move(buffer));
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../csv_parser/thread_queue.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes filled buffers to a file on a background thread. A fixed set of buffers circulates between
+// the producer and the writer, so memory stays bounded and the producer only waits when disk falls behind
+class AsyncFileWriter
+{
+public:
+    AsyncFileWriter(const std::string& file_name, size_t buffer_size, bool append = false, size_t buffer_count = 4);
+    ~AsyncFileWriter();
+    std::vector<char> acquire_buffer();
+    void submit(std::vector<char>&& buffer);
+    void close();
+    inline size_t buffer_size() const
+    {
+        return m_buffer_size;
+    }
+private:
+    void write_loop();
+
+    std::ofstream m_out;
+    std::string m_file_name;
+    std::unique_ptr<ThreadQueue<std::vector<char>>> m_ready_queue;
+    std::unique_ptr<ThreadQueue<std::vector<char>>> m_free_queue;
+    std::thread m_writer_thread;
+    size_t m_buffer_size;
+    std::atomic<bool> m_failed{ false };
+};
@@ -0,0 +1,90 @@
+#include "binary_median_sink.hpp"
+#include "median_file_reader.hpp"
+#include "../logger/logger.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+BinaryMedianSink::BinaryMedianSink(const std::string& file_name, bool append, size_t buffer_size) : m_file_name(file_name),
+m_rows(existing_rows(file_name, append)), m_append(append && std::filesystem::exists(file_name)),
+m_writer(file_name, std::max(buffer_size, median_format::binary_header_size + median_format::binary_record_size), m_append)
+{
+    next_buffer();
+    if (!m_append)
+    {
+        // The row count is patched in on close
+        std::copy(std::begin(median_format::binary_magic), std::end(median_format::binary_magic), m_buffer.data());
+        median_format::store_le<uint64_t>(m_buffer.data() + 8, 0);
+        m_used = median_format::binary_header_size;
+    }
+}
+
+uint64_t BinaryMedianSink::existing_rows(const std::string& file_name, bool append)
+{
+    if (!append || !std::filesystem::exists(file_name))
+    {
+        return 0;
+    }
+    // Drop a partially written tail record so appended rows stay aligned
+    uint64_t rows = BinaryMedianReader(file_name).size();
+    std::filesystem::resize_file(file_name, median_format::binary_header_size + rows * median_format::binary_record_size);
+    return rows;
+}
+
+BinaryMedianSink::~BinaryMedianSink()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while closing median output: {}", err.what());
+    }
+}
+
+void BinaryMedianSink::next_buffer()
+{
+    m_buffer = m_writer.acquire_buffer();
+    m_buffer.resize(m_writer.buffer_size());
+    m_used = 0;
+}
+
+void BinaryMedianSink::flush_buffer()
+{
+    m_buffer.resize(m_used);
+    m_writer.submit(std::move(m_buffer));
+    next_buffer();
+}
+
+void BinaryMedianSink::flush()
+{
+    if (m_used != 0)
+    {
+        flush_buffer();
+    }
+}
+
+void BinaryMedianSink::close()
+{
+    if (m_closed)
+    {
+        return;
+    }
+    m_closed = true;
+    m_buffer.resize(m_used);
+    m_writer.submit(std::move(m_buffer));
+    m_writer.close();
+
+    std::fstream out(m_file_name, std::ios::binary | std::ios::in | std::ios::out);
+    char count[8];
+    median_format::store_le(count, m_rows);
+    out.seekp(8);
+    out.write(count, sizeof(count));
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write header of output file: " + m_file_name);
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "output_sink.hpp"
+#include "async_file_writer.hpp"
+#include "median_file_format.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw little-endian {ts, median} records behind a header holding the row count, so readers can mmap the file
+class BinaryMedianSink : public IOutputSink
+{
+public:
+    explicit BinaryMedianSink(const std::string& file_name, bool append = false, size_t buffer_size = 1 << 20);
+    ~BinaryMedianSink() override;
+
+    inline void write(uint64_t receive_ts, double median) override
+    {
+        if (m_used + median_format::binary_record_size > m_buffer.size())
+        {
+            flush_buffer();
+        }
+        median_format::store_le(m_buffer.data() + m_used, receive_ts);
+        median_format::store_le(m_buffer.data() + m_used + 8, median);
+        m_used += median_format::binary_record_size;
+        ++m_rows;
+    }
+
+    void flush() override;
+    void close() override;
+private:
+    static uint64_t existing_rows(const std::string& file_name, bool append);
+    void flush_buffer();
+    void next_buffer();
+
+    std::string m_file_name;
+    uint64_t m_rows;
+    bool m_append;
+    AsyncFileWriter m_writer;
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+    bool m_closed = false;
+};
@@ -0,0 +1,127 @@
+#include "columnar_median_sink.hpp"
+#include "median_file_reader.hpp"
+#include "../logger/logger.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+    constexpr size_t max_varint_size = 10;
+} //anonymous namespace
+
+ColumnarMedianSink::ColumnarMedianSink(const std::string& file_name, bool append, uint32_t block_rows) : m_block_rows(std::max<uint32_t>(block_rows, 1)),
+m_append(append && reopen(file_name)), m_writer(file_name, 4 + 2 * max_varint_size * m_block_rows, m_append)
+{
+    m_ts.reserve(m_block_rows);
+    m_medians.reserve(m_block_rows);
+    if (m_append)
+    {
+        return;
+    }
+
+    std::vector<char> header = m_writer.acquire_buffer();
+    header.resize(median_format::columnar_header_size);
+    std::copy(std::begin(median_format::columnar_magic), std::end(median_format::columnar_magic), header.data());
+    median_format::store_le(header.data() + 8, m_block_rows);
+    median_format::store_le<uint32_t>(header.data() + 12, 0);
+    m_offset = header.size();
+    m_writer.submit(std::move(header));
+}
+
+ColumnarMedianSink::~ColumnarMedianSink()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while closing median output: {}", err.what());
+    }
+}
+
+bool ColumnarMedianSink::reopen(const std::string& file_name)
+{
+    if (!std::filesystem::exists(file_name))
+    {
+        return false;
+    }
+    {
+        ColumnarMedianReader reader(file_name);
+        m_index = reader.blocks();
+    }
+    m_offset = m_index.empty() ? median_format::columnar_header_size : m_index.back().offset + m_index.back().size;
+    std::filesystem::resize_file(file_name, m_offset);
+    return true;
+}
+
+void ColumnarMedianSink::flush_block()
+{
+    if (m_ts.empty())
+    {
+        return;
+    }
+    // Encoding runs here and the writer thread only does the I/O
+    std::vector<char> block = m_writer.acquire_buffer();
+    block.resize(4 + 2 * max_varint_size * m_ts.size());
+    char* pos = block.data() + 4;
+
+    uint64_t prev_ts = 0;
+    for (uint64_t ts : m_ts)
+    {
+        pos = median_format::put_varint(pos, median_format::zigzag(static_cast<int64_t>(ts - prev_ts)));
+        prev_ts = ts;
+    }
+    median_format::store_le(block.data(), static_cast<uint32_t>(pos - block.data() - 4));
+
+    uint64_t prev_bits = 0;
+    for (double median : m_medians)
+    {
+        uint64_t bits = std::bit_cast<uint64_t>(median);
+        pos = median_format::put_varint(pos, median_format::zigzag(static_cast<int64_t>(bits - prev_bits)));
+        prev_bits = bits;
+    }
+    block.resize(pos - block.data());
+
+    auto [min_ts, max_ts] = std::minmax_element(m_ts.begin(), m_ts.end());
+    m_index.push_back({m_offset, *min_ts, *max_ts, static_cast<uint32_t>(m_ts.size()), static_cast<uint32_t>(block.size())});
+    m_offset += block.size();
+    m_writer.submit(std::move(block));
+    m_ts.clear();
+    m_medians.clear();
+}
+
+void ColumnarMedianSink::flush()
+{
+    // Readers only see rows once the index is written on close, a flush just closes the current block early
+    flush_block();
+}
+
+void ColumnarMedianSink::close()
+{
+    if (m_closed)
+    {
+        return;
+    }
+    m_closed = true;
+    flush_block();
+
+    std::vector<char> footer;
+    footer.resize(m_index.size() * median_format::columnar_index_entry_size + median_format::columnar_trailer_size);
+    char* pos = footer.data();
+    for (const auto& block : m_index)
+    {
+        median_format::store_le(pos, block.offset);
+        median_format::store_le(pos + 8, block.min_ts);
+        median_format::store_le(pos + 16, block.max_ts);
+        median_format::store_le(pos + 24, block.rows);
+        median_format::store_le(pos + 28, block.size);
+        pos += median_format::columnar_index_entry_size;
+    }
+    median_format::store_le(pos, m_offset);
+    median_format::store_le<uint64_t>(pos + 8, m_index.size());
+    std::copy(std::begin(median_format::columnar_magic), std::end(median_format::columnar_magic), pos + 16);
+    m_writer.submit(std::move(footer));
+    m_writer.close();
+}
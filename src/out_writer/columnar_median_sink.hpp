@@ -0,0 +1,43 @@
+#pragma once
+
+#include "output_sink.hpp"
+#include "async_file_writer.hpp"
+#include "median_file_format.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Delta-compressed column blocks with a min/max timestamp index at the end of the file
+class ColumnarMedianSink : public IOutputSink
+{
+public:
+    explicit ColumnarMedianSink(const std::string& file_name, bool append = false, uint32_t block_rows = median_format::default_block_rows);
+    ~ColumnarMedianSink() override;
+
+    inline void write(uint64_t receive_ts, double median) override
+    {
+        m_ts.push_back(receive_ts);
+        m_medians.push_back(median);
+        if (m_ts.size() == m_block_rows)
+        {
+            flush_block();
+        }
+    }
+
+    void flush() override;
+    void close() override;
+private:
+    // Loads the index of an existing file and cuts it off, new blocks are written where it started
+    bool reopen(const std::string& file_name);
+    void flush_block();
+
+    std::vector<median_format::BlockInfo> m_index;
+    uint64_t m_offset = 0;
+    uint32_t m_block_rows;
+    bool m_append;
+    AsyncFileWriter m_writer;
+    std::vector<uint64_t> m_ts;
+    std::vector<double> m_medians;
+    bool m_closed = false;
+};
@@ -0,0 +1,72 @@
+#include "csv_median_sink.hpp"
+#include "../logger/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+namespace
+{
+    inline bool has_content(const std::string& file_name)
+    {
+        std::error_code err;
+        return std::filesystem::file_size(file_name, err) != 0 && !err;
+    }
+} //anonymous namespace
+
+CsvMedianSink::CsvMedianSink(const std::string& file_name, bool append, size_t buffer_size) : m_writer(file_name, std::max(buffer_size, 2 * max_row_size), append && has_content(file_name))
+{
+    next_buffer();
+    if (!(append && has_content(file_name)))
+    {
+        constexpr std::string_view header = "receive_ts;price_median\n";
+        std::memcpy(m_buffer.data(), header.data(), header.size());
+        m_used = header.size();
+    }
+}
+
+CsvMedianSink::~CsvMedianSink()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while closing median output: {}", err.what());
+    }
+}
+
+void CsvMedianSink::next_buffer()
+{
+    m_buffer = m_writer.acquire_buffer();
+    m_buffer.resize(m_writer.buffer_size());
+    m_used = 0;
+}
+
+void CsvMedianSink::flush_buffer()
+{
+    m_buffer.resize(m_used);
+    m_writer.submit(std::move(m_buffer));
+    next_buffer();
+}
+
+void CsvMedianSink::flush()
+{
+    if (m_used != 0)
+    {
+        flush_buffer();
+    }
+}
+
+void CsvMedianSink::close()
+{
+    if (m_used != 0)
+    {
+        m_buffer.resize(m_used);
+        m_writer.submit(std::move(m_buffer));
+        m_used = 0;
+    }
+    m_writer.close();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "output_sink.hpp"
+#include "async_file_writer.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Formats median rows with std::to_chars straight into large buffers, which produces the same text as
+// std::fixed << std::setprecision(8) without the locale-aware stream machinery
+class CsvMedianSink : public IOutputSink
+{
+public:
+    explicit CsvMedianSink(const std::string& file_name, bool append = false, size_t buffer_size = 1 << 20);
+    ~CsvMedianSink() override;
+
+    inline void write(uint64_t receive_ts, double median) override
+    {
+        if (m_used + max_row_size > m_buffer.size())
+        {
+            flush_buffer();
+        }
+        char* pos = m_buffer.data() + m_used;
+        char* end = m_buffer.data() + m_buffer.size();
+        pos = std::to_chars(pos, end, receive_ts).ptr;
+        *pos++ = ';';
+        pos = std::to_chars(pos, end, median, std::chars_format::fixed, precision).ptr;
+        *pos++ = '\n';
+        m_used = pos - m_buffer.data();
+    }
+
+    void flush() override;
+    void close() override;
+private:
+    // uint64 digits, the longest fixed-notation double with 8 decimals and the separators
+    static constexpr size_t max_row_size = 20 + 1 + 309 + 1 + 8 + 2;
+    static constexpr int precision = 8;
+
+    void flush_buffer();
+    void next_buffer();
+
+    AsyncFileWriter m_writer;
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+};
@@ -0,0 +1,43 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+MappedFile::MappedFile(const std::string& file_name)
+{
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open file: " + file_name);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat file: " + file_name);
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size != 0)
+    {
+        void* addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot map file: " + file_name);
+        }
+        m_data = static_cast<const char*>(addr);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data != nullptr)
+    {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// On-disk layouts shared by the binary/columnar sinks and their memory-mapped readers. Everything is little-endian
+namespace median_format
+{
+    struct MedianRecord
+    {
+        uint64_t receive_ts;
+        double median;
+    };
+
+    // Binary file: header followed by row_count fixed 16-byte {ts, median} records
+    constexpr char binary_magic[8] = {'M', 'E', 'D', 'B', 'I', 'N', '0', '1'};
+    constexpr size_t binary_header_size = 16;
+    constexpr size_t binary_record_size = 16;
+
+    // Columnar file: header, compressed blocks, block index, trailer. A block stores zigzag varint deltas of
+    // the timestamps and of the median bit patterns, which stay small because consecutive medians are close
+    constexpr char columnar_magic[8] = {'M', 'E', 'D', 'C', 'O', 'L', '0', '1'};
+    constexpr size_t columnar_header_size = 16;
+    constexpr size_t columnar_index_entry_size = 32;
+    constexpr size_t columnar_trailer_size = 24;
+    constexpr uint32_t default_block_rows = 65536;
+
+    struct BlockInfo
+    {
+        uint64_t offset;
+        uint64_t min_ts;
+        uint64_t max_ts;
+        uint32_t rows;
+        uint32_t size;
+    };
+
+    template<typename T>
+    inline void store_le(char* dst, T value)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+        using U = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+        U bits = std::bit_cast<U>(value);
+        for (size_t i = 0; i < sizeof(U); ++i)
+        {
+            dst[i] = static_cast<char>(bits >> (8 * i));
+        }
+    }
+
+    template<typename T>
+    inline T load_le(const char* src)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+        using U = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+        U bits = 0;
+        for (size_t i = 0; i < sizeof(U); ++i)
+        {
+            bits |= static_cast<U>(static_cast<unsigned char>(src[i])) << (8 * i);
+        }
+        return std::bit_cast<T>(bits);
+    }
+
+    inline uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Returns the position after the encoded value, needs up to 10 bytes of room
+    inline char* put_varint(char* dst, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            *dst++ = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        *dst++ = static_cast<char>(value);
+        return dst;
+    }
+
+    // Returns nullptr when the value runs past end
+    inline const char* get_varint(const char* src, const char* end, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; src != end && shift < 64; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*src++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return src;
+            }
+        }
+        return nullptr;
+    }
+} //namespace median_format
@@ -0,0 +1,103 @@
+#include "median_file_reader.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+BinaryMedianReader::BinaryMedianReader(const std::string& file_name) : m_file(file_name)
+{
+    if (m_file.size() < median_format::binary_header_size || !std::equal(std::begin(median_format::binary_magic), std::end(median_format::binary_magic), m_file.data()))
+    {
+        throw std::runtime_error("Not a binary median file: " + file_name);
+    }
+    m_rows = median_format::load_le<uint64_t>(m_file.data() + 8);
+    if ((m_file.size() - median_format::binary_header_size) / median_format::binary_record_size < m_rows)
+    {
+        throw std::runtime_error("Binary median file is truncated: " + file_name);
+    }
+}
+
+ColumnarMedianReader::ColumnarMedianReader(const std::string& file_name) : m_file(file_name)
+{
+    const size_t size = m_file.size();
+    const char* data = m_file.data();
+    if (size < median_format::columnar_header_size + median_format::columnar_trailer_size 
+        || !std::equal(std::begin(median_format::columnar_magic), std::end(median_format::columnar_magic), data)
+        || !std::equal(std::begin(median_format::columnar_magic), std::end(median_format::columnar_magic), data + size - 8))
+    {
+        throw std::runtime_error("Not a columnar median file: " + file_name);
+    }
+
+    const char* trailer = data + size - median_format::columnar_trailer_size;
+    uint64_t index_offset = median_format::load_le<uint64_t>(trailer);
+    uint64_t block_count = median_format::load_le<uint64_t>(trailer + 8);
+    if (index_offset > size - median_format::columnar_trailer_size
+        || (size - median_format::columnar_trailer_size - index_offset) / median_format::columnar_index_entry_size != block_count)
+    {
+        throw std::runtime_error("Corrupted block index in columnar median file: " + file_name);
+    }
+
+    m_blocks.reserve(block_count);
+    for (const char* entry = data + index_offset; entry < trailer; entry += median_format::columnar_index_entry_size)
+    {
+        median_format::BlockInfo block {
+            median_format::load_le<uint64_t>(entry),
+            median_format::load_le<uint64_t>(entry + 8),
+            median_format::load_le<uint64_t>(entry + 16),
+            median_format::load_le<uint32_t>(entry + 24),
+            median_format::load_le<uint32_t>(entry + 28)
+        };
+        if (block.offset + block.size > index_offset || block.size < 4)
+        {
+            throw std::runtime_error("Corrupted block index in columnar median file: " + file_name);
+        }
+        m_blocks.push_back(block);
+    }
+}
+
+void ColumnarMedianReader::read_block(size_t block, std::vector<median_format::MedianRecord>& out) const
+{
+    const auto& info = m_blocks.at(block);
+    const char* begin = m_file.data() + info.offset;
+    const char* end = begin + info.size;
+    uint32_t ts_bytes = median_format::load_le<uint32_t>(begin);
+    if (ts_bytes > info.size - 4)
+    {
+        throw std::runtime_error("Corrupted columnar block " + std::to_string(block));
+    }
+
+    const size_t first = out.size();
+    out.resize(first + info.rows);
+
+    const char* ts_pos = begin + 4;
+    const char* median_pos = ts_pos + ts_bytes;
+    uint64_t ts = 0;
+    uint64_t bits = 0;
+    for (uint32_t row = 0; row < info.rows; ++row)
+    {
+        uint64_t delta = 0;
+        ts_pos = median_format::get_varint(ts_pos, begin + 4 + ts_bytes, delta);
+        if (ts_pos == nullptr)
+        {
+            throw std::runtime_error("Corrupted columnar block " + std::to_string(block));
+        }
+        ts += static_cast<uint64_t>(median_format::unzigzag(delta));
+
+        median_pos = median_format::get_varint(median_pos, end, delta);
+        if (median_pos == nullptr)
+        {
+            throw std::runtime_error("Corrupted columnar block " + std::to_string(block));
+        }
+        bits += static_cast<uint64_t>(median_format::unzigzag(delta));
+        out[first + row] = {ts, std::bit_cast<double>(bits)};
+    }
+}
+
+std::vector<median_format::MedianRecord> ColumnarMedianReader::read_all() const
+{
+    std::vector<median_format::MedianRecord> out;
+    for (size_t block = 0; block < m_blocks.size(); ++block)
+    {
+        read_block(block, out);
+    }
+    return out;
+}
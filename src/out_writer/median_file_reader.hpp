@@ -0,0 +1,46 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "median_file_format.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BinaryMedianReader
+{
+public:
+    explicit BinaryMedianReader(const std::string& file_name);
+
+    inline uint64_t size() const
+    {
+        return m_rows;
+    }
+
+    inline median_format::MedianRecord at(uint64_t row) const
+    {
+        const char* record = m_file.data() + median_format::binary_header_size + row * median_format::binary_record_size;
+        return {median_format::load_le<uint64_t>(record), median_format::load_le<double>(record + 8)};
+    }
+private:
+    MappedFile m_file;
+    uint64_t m_rows = 0;
+};
+
+class ColumnarMedianReader
+{
+public:
+    explicit ColumnarMedianReader(const std::string& file_name);
+
+    inline const std::vector<median_format::BlockInfo>& blocks() const
+    {
+        return m_blocks;
+    }
+
+    // Appends the decoded rows of one block to out
+    void read_block(size_t block, std::vector<median_format::MedianRecord>& out) const;
+    std::vector<median_format::MedianRecord> read_all() const;
+private:
+    MappedFile m_file;
+    std::vector<median_format::BlockInfo> m_blocks;
+};
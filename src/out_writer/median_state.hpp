@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Everything needed to continue a running median: every price seen so far as a value histogram
+// and the filter state of the output
+struct MedianState
+{
+    std::vector<std::pair<double, uint64_t>> histogram;
+    uint64_t count = 0;
+    bool has_median = false;
+    double last_median = 0.0;
+};
@@ -1,33 +1,165 @@
 #pragma once
 
 #include "../csv_parser/thread_pool_queue.hpp"
+#include "../system/bulk_memory.hpp"
+#include "../system/read_ahead.hpp"
+#include "../system/buffer_pool.hpp"
 #include "serializer.hpp"
 #include "algorithm.hpp"
+#include "packed_chunk.hpp"
+#include "run_journal.hpp"
 
+#include <algorithm>
 #include <vector>
+#include <concepts>
+#include <filesystem>
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <fstream>
 #include <mutex>
+#include <utility>
+
+// A comparator that orders records by one integer key can expose it as a static key(record). Wide records are
+// then sorted as compact (key, index) pairs instead of calling the comparator through the index
+template<typename Compare, typename T>
+concept KeyedCompare = requires(const T& value)
+{
+    { Compare::key(value) } -> std::convertible_to<uint64_t>;
+};
 
 template<typename T, typename Compare = std::less<>>
 class OutWriter
 {
 public:
+    // Sample-sort ingest: records go into disjoint key ranges as they arrive, every range is sorted on its own and
+    // the ranges follow each other in key order, so nothing is merged
+    struct Partitioning
+    {
+        // Ranges to start with. One holding twice its share of the memory budget is split at its median key, up to
+        // four times as many ranges
+        uint32_t partitions = 64;
+        // Keys sampled from the input, e.g. by a pass over the files, to take the splitters from
+        std::vector<uint64_t> sample;
+        // Without a sample: equal ranges between the smallest and the largest key, when they are known
+        std::optional<std::pair<uint64_t, uint64_t>> key_range;
+        // Without either: the splitters come from this many first records
+        uint64_t sample_size = 1 << 16;
+    };
+
     OutWriter(uint64_t max_elements, std::shared_ptr<ISerializer<T>> serializer, std::shared_ptr<IAlgorithm<T>> algorithm, Compare comp = Compare(), uint32_t max_threads = 4);
     ~OutWriter();
     void collect_data(std::vector<T>&& data);
     void write_data(const std::string& file_name);
-private:
+    // Spill runs go to the journal's directory and are listed in its manifest once durable. Buffers are then
+    // spilled only between two collect_data calls, so every run ends at a chunk boundary, and packing is off
+    void set_run_journal(std::shared_ptr<RunJournal> journal);
+    // Continue with the runs, or the merged run, of a recovered manifest
+    void adopt(const RunJournal::Manifest& manifest);
+    // A spill waits while this many are still being written, so buffers handed to spills stay bounded (0: no limit)
+    inline void set_max_pending_spills(uint32_t value)
+    {
+        m_max_pending_spills = value;
+    }
+    // Sort buffers come from the pool and go back to it once spilled or when the writer is destroyed
+    void set_buffer_pool(std::shared_ptr<BufferPool<T>> pool);
+    // Switches to the partitioned strategy before the first collect_data, instead of packing and merged runs. Over
+    // the budget, the range holding the most records is spilled unsorted to a file of its own. At the end ranges are
+    // sorted in parallel, or read back and sorted one at a time once they spilled; a range too large for the budget
+    // is first split on disk. Not with a run journal
+    void set_partitioning(Partitioning partitioning) requires KeyedCompare<Compare, T>;
+protected:
+    // Spill and merge stages stay reachable for benchmarks that drive them one at a time
     struct FileStream 
     {
-        std::ifstream stream;
+        read_ahead::Stream stream;
         uint64_t remaining;
         T current;
     };
 
+    void sort_buffer();
+    // Records wider than this are sorted through an index permutation and moved once into place
+    inline static constexpr size_t index_sort_min_record = 32;
+    void sort_by_index(std::vector<T>& records);
     void write_to_temporary(std::vector<T>&& data);
     std::string merge_sort();
+    // Records with a RecordPacking specialization are staged in small batches and kept as packed sorted chunks
+    // until those fill the memory budget, then they are merged into one temporary file and the writer continues unpacked.
+    // Not for an algorithm that needs random access
+    void collect_packed(std::vector<T>&& data);
+    void pack_buffer();
+    void spill_packed();
+    // Fresh reservation of the full buffer after it was handed to a spill
+    void reserve_buffer();
+    // Writes a run on a spill thread, after waiting for a free one when spills are limited
+    void queue_spill(std::string file_name, std::vector<T>&& data, uint64_t run_id);
+    void sort_records(std::vector<T>& records);
+
+    struct Partition
+    {
+        std::vector<T> records;
+        // Unsorted spills of the range, in the run file format
+        std::vector<std::string> files;
+        uint64_t spilled = 0;
+    };
+
+    // The sorted partitions one after the other, each freed once it is read
+    class PartitionCursor : public IRecordCursor<T>
+    {
+    public:
+        PartitionCursor(std::vector<Partition>& partitions, uint64_t size) : m_partitions(partitions), m_size(size)
+        {
+
+        }
+        bool next(T& value) override
+        {
+            while (m_index < m_partitions.size() && m_pos == m_partitions[m_index].records.size())
+            {
+                m_partitions[m_index++].records = std::vector<T>();
+                m_pos = 0;
+            }
+            if (m_index == m_partitions.size())
+            {
+                return false;
+            }
+            value = std::move(m_partitions[m_index].records[m_pos++]);
+            return true;
+        }
+        inline uint64_t size() const override
+        {
+            return m_size;
+        }
+    private:
+        std::vector<Partition>& m_partitions;
+        uint64_t m_size;
+        size_t m_index = 0;
+        size_t m_pos = 0;
+    };
+
+    // Ranges from the quantiles of the sampled keys
+    void start_partitions(std::vector<uint64_t> keys);
+    inline size_t partition_of(uint64_t key) const
+    {
+        return std::upper_bound(m_first_keys.begin(), m_first_keys.end(), key) - m_first_keys.begin() - 1;
+    }
+    void collect_partitioned(std::vector<T>&& data);
+    void partition_records(std::vector<T>& data);
+    // Called when a partition is full: splits it or grows it, spilling the largest partitions to stay in the budget
+    void make_room(size_t index);
+    // False when the partition holds a single key
+    bool split_partition(size_t index);
+    // Spills the partition from index on holding the most records, false when they are all empty
+    bool spill_largest(size_t from);
+    void spill_partition(size_t index);
+    void finish_partitioned(const std::string& file_name);
+    // Writes the partitions in key order to one sorted file for process_file
+    std::string concatenate_partitions();
+    // Replaces a spilled partition too large for the budget by narrower ones, in two passes over its files. False
+    // when it holds a single key and so is sorted already
+    bool redistribute(size_t index);
+    // Calls f with every record of a run file
+    template<typename F>
+    void read_run(const std::string& file_name, F&& f);
 
     std::shared_ptr<ISerializer<T>>  m_serializer;
     std::shared_ptr<IAlgorithm<T>> m_algorithm;
@@ -36,6 +168,25 @@ private:
     Compare m_comp;
     std::vector<T> m_buff;
     uint64_t m_max_elements;
+    std::vector<typename RecordPacking<T>::Chunk> m_packed;
+    uint64_t m_packed_bytes = 0;
+    uint64_t m_stage_elements;
+    bool m_pack = RecordPacking<T>::enabled;
+    std::shared_ptr<RunJournal> m_journal;
+    std::filesystem::path m_spill_dir;
+    std::string m_adopted_merged;
+    uint32_t m_max_pending_spills = 0;
+    std::shared_ptr<BufferPool<T>> m_buffers;
+    std::optional<Partitioning> m_partitioning;
+    std::vector<Partition> m_partitions;
+    // Smallest key of every partition, the first one 0
+    std::vector<uint64_t> m_first_keys;
+    // Reserved records of all partitions, kept within m_max_elements
+    uint64_t m_partition_capacity = 0;
+    uint64_t m_min_partition_capacity = 0;
+    size_t m_max_partitions = 0;
+    // Prefaults m_buff, declared after it so it is stopped first
+    std::jthread m_prefault;
 };
 
 #include "out_writer_impl.hpp"
\ No newline at end of file
@@ -1,47 +1,145 @@
 #include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+#include "../trace/trace.hpp"
 
 #include <algorithm>
+#include <limits>
+#include <numeric>
 #include <queue>
+#include <stdexcept>
 #include <string_view>
 #include <atomic>
 
+#include <unistd.h>
+
 namespace
 {
     constexpr uint64_t binary_hash = 0x12345678;
+    // Staging batch for packing, as a fraction of the memory budget
+    constexpr uint64_t pack_stage_divisor = 16;
+    // Smallest read-ahead block of a merge input, below it a wide merge turns into small random reads
+    constexpr uint64_t merge_min_block_size = 64 << 10;
 
-    inline std::string generate_file_name() 
+    // The pid keeps runs adopted from a crashed process apart from new ones
+    inline std::string generate_file_name(const std::filesystem::path& dir = {})
     {
         static std::string base_name = "binary_data";
         static std::atomic<int> counter{0};
-        return base_name + "_" + std::to_string(binary_hash) + "_" + std::to_string(counter++) + ".bin";
+        std::filesystem::path file;
+        do
+        {
+            file = dir / (base_name + "_" + std::to_string(binary_hash) + "_" + std::to_string(::getpid()) + "_" + std::to_string(counter++) + ".bin");
+        }
+        while (std::filesystem::exists(file));
+        return file.string();
     }
 } //anonymous namespace
 
 template <typename T, typename Compare>
 OutWriter<T, Compare>::OutWriter(uint64_t max_elements, std::shared_ptr<ISerializer<T>> serializer, std::shared_ptr<IAlgorithm<T>> algorithm, Compare comp, uint32_t max_threads) : 
-m_serializer(serializer), m_algorithm(std::move(algorithm)), m_queue(std::make_unique<ThreadPoolQueue>()), m_comp(comp), m_max_elements(max_elements) 
+m_serializer(serializer), m_algorithm(std::move(algorithm)), m_queue(std::make_unique<ThreadPoolQueue>()), m_comp(comp), m_max_elements(max_elements),
+m_stage_elements(std::max<uint64_t>(1, max_elements / pack_stage_divisor))
 {
-    m_buff.reserve(m_max_elements);
-    m_queue->start_async(max_threads);
-    spdlog::debug("OutWriter created");
+    if (m_algorithm && m_algorithm->random_access())
+    {
+        m_pack = false;
+    }
+    m_buff.reserve(m_pack ? m_stage_elements : m_max_elements);
+    m_prefault = bulk_memory::prepare(m_buff);
+    m_queue->start_async(max_threads, "spill");
+    SPDLOG_DEBUG("OutWriter created");
 }
 
 template <typename T, typename Compare>
 OutWriter<T, Compare>::~OutWriter()
 {
     m_queue->stop();
-    spdlog::debug("OutWriter destroyed");
+    if (m_buffers)
+    {
+        m_prefault = std::jthread();
+        m_buffers->release(std::move(m_buff));
+    }
+    SPDLOG_DEBUG("OutWriter destroyed");
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::set_buffer_pool(std::shared_ptr<BufferPool<T>> pool)
+{
+    m_buffers = std::move(pool);
+    if (m_buffers && m_buff.empty())
+    {
+        // The reservation made by the constructor has not been touched yet, a pooled buffer replaces it
+        const size_t capacity = m_buff.capacity();
+        m_prefault = std::jthread();
+        m_buff = m_buffers->acquire(capacity);
+        m_prefault = bulk_memory::prepare(m_buff);
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::set_run_journal(std::shared_ptr<RunJournal> journal)
+{
+    m_journal = std::move(journal);
+    m_spill_dir = m_journal ? m_journal->dir() : std::filesystem::path();
+    if (m_pack && m_journal)
+    {
+        m_pack = false;
+        reserve_buffer();
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::adopt(const RunJournal::Manifest& manifest)
+{
+    if (!manifest.merged.empty())
+    {
+        m_adopted_merged = manifest.merged;
+        return;
+    }
+    for (const auto& run : manifest.runs)
+    {
+        m_file_to_merge.push_back(run.file);
+    }
 }
 
 template<typename T, typename Compare>
 void OutWriter<T, Compare>::collect_data(std::vector<T>&& data)
 {
+    if constexpr (KeyedCompare<Compare, T>)
+    {
+        if (m_partitioning)
+        {
+            collect_partitioned(std::move(data));
+            return;
+        }
+    }
+    if (m_pack)
+    {
+        collect_packed(std::move(data));
+        return;
+    }
+    if (m_journal)
+    {
+        // A run must hold whole chunks, the coverage it is listed with counts rows by chunk. A chunk larger
+        // than the buffer is kept whole and spilled with the next one
+        if (!m_buff.empty() && m_buff.size() + data.size() > m_max_elements)
+        {
+            sort_buffer();
+            m_prefault = std::jthread();
+            write_to_temporary(std::move(m_buff));
+            reserve_buffer();
+        }
+        m_buff.insert(m_buff.end(), std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
+        return;
+    }
     if (m_buff.size() + data.size() > m_max_elements)
     {
         u_int64_t offset = m_max_elements - m_buff.size();
         m_buff.insert(m_buff.end(), std::make_move_iterator(data.begin()), std::make_move_iterator(data.begin() + offset));
-        std::ranges::sort(m_buff, m_comp);
+        sort_buffer();
+        m_prefault = std::jthread();
         write_to_temporary(std::move(m_buff));
+        reserve_buffer();
         m_buff.insert(m_buff.end(), std::make_move_iterator(data.begin() + offset), std::make_move_iterator(data.end()));
         return;
     }
@@ -51,12 +149,44 @@ void OutWriter<T, Compare>::collect_data(std::vector<T>&& data)
 template<typename T, typename Compare>
 void OutWriter<T, Compare>::write_data(const std::string& file_name)
 {
-    if (m_file_to_merge.empty())
+    m_prefault = std::jthread();
+    if constexpr (KeyedCompare<Compare, T>)
+    {
+        if (m_partitioning)
+        {
+            finish_partitioned(file_name);
+            return;
+        }
+    }
+    if constexpr (RecordPacking<T>::enabled)
+    {
+        // The last batch may still push the packed chunks over the budget
+        if (m_pack && !m_packed.empty() && !m_buff.empty())
+        {
+            pack_buffer();
+        }
+        if (m_pack && !m_packed.empty())
+        {
+            spdlog::info("In memory model was chosen ({} packed chunks, {} bytes)", m_packed.size(), m_packed_bytes);
+            typename RecordPacking<T>::template Merge<Compare> merge(m_packed, m_comp);
+            try
+            {
+                m_algorithm->process_sorted(merge, file_name);
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Error occurred while running the algorithm: {}", err.what());
+            }
+            m_packed.clear();
+            return;
+        }
+    }
+    if (m_file_to_merge.empty() && m_adopted_merged.empty())
     {
         if (!m_buff.empty())
         {
             spdlog::info("In memory model was chosen");
-            std::ranges::sort(m_buff, m_comp);
+            sort_buffer();
             try
             {
                 m_algorithm->process_in_memory(std::move(m_buff), file_name);
@@ -75,11 +205,14 @@ void OutWriter<T, Compare>::write_data(const std::string& file_name)
     else
     {
         spdlog::info("File model was chosen");
-        std::ranges::sort(m_buff, m_comp);
-        write_to_temporary(std::move(m_buff));
-        m_buff.clear();
+        if (!m_buff.empty())
+        {
+            sort_buffer();
+            write_to_temporary(std::move(m_buff));
+            m_buff.clear();
+        }
         m_queue->wait_for_pending();
-        std::string out_put_file = merge_sort();
+        std::string out_put_file = m_adopted_merged.empty() ? merge_sort() : m_adopted_merged;
         if (out_put_file.empty())
         {
             return;
@@ -93,18 +226,197 @@ void OutWriter<T, Compare>::write_data(const std::string& file_name)
             spdlog::error("Error occurred while running the algorithm: {}", err.what());
         }
     }
+    if (m_journal)
+    {
+        m_journal->finish();
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::collect_packed(std::vector<T>&& data)
+{
+    auto it = data.begin();
+    while (it != data.end())
+    {
+        const uint64_t take = std::min<uint64_t>(m_stage_elements - m_buff.size(), data.end() - it);
+        m_buff.insert(m_buff.end(), std::make_move_iterator(it), std::make_move_iterator(it + take));
+        it += take;
+        if (m_buff.size() == m_stage_elements)
+        {
+            pack_buffer();
+        }
+        if (!m_pack)
+        {
+            std::vector<T> rest(std::make_move_iterator(it), std::make_move_iterator(data.end()));
+            collect_data(std::move(rest));
+            return;
+        }
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::pack_buffer()
+{
+    if constexpr (RecordPacking<T>::enabled)
+    {
+        trace::ScopedEvent event("sort");
+        metrics::ScopedTimer timer("csv_parser_sort_seconds_total");
+        metrics::count("csv_parser_sorts_total");
+        metrics::count("csv_parser_sorted_rows_total", m_buff.size());
+        metrics::count("csv_parser_packed_chunks_total");
+        m_packed.push_back(RecordPacking<T>::Chunk::pack(m_buff, m_comp));
+        m_packed_bytes += m_packed.back().bytes();
+        m_buff.clear();
+        metrics::high_water("csv_parser_packed_bytes_high_water", m_packed_bytes);
+        if (m_packed_bytes + m_stage_elements * sizeof(T) > m_max_elements * sizeof(T))
+        {
+            spill_packed();
+        }
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::spill_packed()
+{
+    if constexpr (RecordPacking<T>::enabled)
+    {
+        trace::ScopedEvent event("write spill file");
+        metrics::ScopedTimer timer("csv_parser_spill_seconds_total");
+        spdlog::info("Packed chunks reached {} bytes, switching to the file model", m_packed_bytes);
+        std::string file_name = generate_file_name(m_spill_dir);
+        {
+            typename RecordPacking<T>::template Merge<Compare> merge(m_packed, m_comp);
+            std::ofstream ofs(file_name, std::ios::binary);
+            uint64_t size = merge.size();
+            ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            T value;
+            while (merge.next(value))
+            {
+                m_serializer->write(ofs, value);
+            }
+            metrics::count("csv_parser_spills_total");
+            metrics::count("csv_parser_spill_bytes_total", static_cast<double>(ofs.tellp()));
+        }
+        m_file_to_merge.push_back(std::move(file_name));
+        m_packed.clear();
+        m_packed.shrink_to_fit();
+        m_packed_bytes = 0;
+        m_pack = false;
+        reserve_buffer();
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::reserve_buffer()
+{
+    m_prefault = std::jthread();
+    if (m_buffers)
+    {
+        m_buff = m_buffers->acquire(m_max_elements);
+    }
+    else
+    {
+        m_buff = std::vector<T>();
+        m_buff.reserve(m_max_elements);
+    }
+    m_prefault = bulk_memory::prepare(m_buff);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::sort_buffer()
+{
+    sort_records(m_buff);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::sort_records(std::vector<T>& records)
+{
+    trace::ScopedEvent event("sort");
+    metrics::ScopedTimer timer("csv_parser_sort_seconds_total");
+    metrics::count("csv_parser_sorts_total");
+    metrics::count("csv_parser_sorted_rows_total", records.size());
+    if constexpr (sizeof(T) >= index_sort_min_record)
+    {
+        if (records.size() <= UINT32_MAX)
+        {
+            sort_by_index(records);
+            return;
+        }
+    }
+    std::ranges::sort(records, m_comp);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::sort_by_index(std::vector<T>& records)
+{
+    std::vector<uint32_t> order(records.size());
+    if constexpr (KeyedCompare<Compare, T>)
+    {
+        struct KeyIndex
+        {
+            uint64_t key;
+            uint32_t index;
+        };
+        std::vector<KeyIndex> keys(records.size());
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            keys[i] = KeyIndex{static_cast<uint64_t>(Compare::key(records[i])), static_cast<uint32_t>(i)};
+        }
+        std::sort(keys.begin(), keys.end(), [](const KeyIndex& a, const KeyIndex& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.index < b.index;
+        });
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            order[i] = keys[i].index;
+        }
+    }
+    else
+    {
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [this, &records](uint32_t a, uint32_t b)
+        {
+            return m_comp(records[a], records[b]);
+        });
+    }
+
+    // Slot i takes record order[i]; following each cycle moves every record once, without a second buffer
+    for (size_t start = 0; start < order.size(); ++start)
+    {
+        if (order[start] == start)
+        {
+            continue;
+        }
+        T value = std::move(records[start]);
+        size_t slot = start;
+        while (order[slot] != start)
+        {
+            const size_t from = order[slot];
+            records[slot] = std::move(records[from]);
+            order[slot] = static_cast<uint32_t>(slot);
+            slot = from;
+        }
+        records[slot] = std::move(value);
+        order[slot] = static_cast<uint32_t>(slot);
+    }
 }
 
 template<typename T, typename Compare>
 std::string OutWriter<T, Compare>::merge_sort()
 {
-    spdlog::debug("Stated to merge files");
+    trace::ScopedEvent event("merge");
+    metrics::ScopedTimer timer("csv_parser_merge_seconds_total");
+    SPDLOG_DEBUG("Stated to merge files");
     std::vector<FileStream> streams;
     streams.reserve(m_file_to_merge.size());
+    // The runs share a quarter of the memory budget for their blocks in flight
+    const read_ahead::Options read_options = read_ahead::options();
+    const size_t block_size = std::clamp<uint64_t>(m_max_elements * sizeof(T) / 4 / std::max<size_t>(1, m_file_to_merge.size() * read_options.depth),
+        merge_min_block_size, read_options.block_size);
 
     for (const auto& file_name : m_file_to_merge)
     {
-        std::ifstream ifs(file_name, std::ios::binary);
+        read_ahead::Stream ifs(file_name, 0, std::numeric_limits<uint64_t>::max(), block_size);
         if (!ifs.is_open())
         {
             spdlog::error("Cannot open temporary file {}", file_name);
@@ -115,6 +427,10 @@ std::string OutWriter<T, Compare>::merge_sort()
         if (total_elements == 0) continue;
         T first;
         m_serializer->read(ifs, first);
+        if (!ifs)
+        {
+            throw std::runtime_error("Cannot read temporary file " + file_name);
+        }
         streams.push_back(FileStream{std::move(ifs), total_elements - 1, std::move(first)});
     }
 
@@ -124,6 +440,8 @@ std::string OutWriter<T, Compare>::merge_sort()
         return std::string();
     }
 
+    metrics::high_water("csv_parser_merge_fan_in", streams.size());
+
     auto heap_cmp = [this](const FileStream* a, const FileStream* b) 
     {
         return m_comp(b->current, a->current);
@@ -136,7 +454,7 @@ std::string OutWriter<T, Compare>::merge_sort()
         prior_queue.push(&fs);
     }
 
-    std::string file_name = generate_file_name();
+    std::string file_name = generate_file_name(m_spill_dir);
     std::ofstream out(file_name, std::ios::binary);
     uint64_t total = 0;
     out.write(reinterpret_cast<const char*>(&total), sizeof(total));
@@ -153,6 +471,13 @@ std::string OutWriter<T, Compare>::merge_sort()
         {
             T next;
             m_serializer->read(top->stream, next);
+            if (!top->stream)
+            {
+                // The runs stay for a resumed merge, only the partial output goes
+                out.close();
+                std::filesystem::remove(file_name);
+                throw std::runtime_error("Temporary file is unreadable or truncated while merging into " + file_name);
+            }
             --top->remaining;
             top->current = std::move(next);
             prior_queue.push(top);
@@ -161,13 +486,20 @@ std::string OutWriter<T, Compare>::merge_sort()
 
     out.seekp(0);
     out.write(reinterpret_cast<const char*>(&total), sizeof(total));
+    metrics::count("csv_parser_merged_rows_total", total);
+    if (m_journal)
+    {
+        // The merged run replaces the runs in the manifest before they are removed
+        out.close();
+        m_journal->merged(file_name);
+    }
 
     for (const auto& file_name : m_file_to_merge) 
     {
         try 
         {
             std::filesystem::remove(file_name);
-            spdlog::debug("Temporary file removed {}", file_name);
+            SPDLOG_DEBUG("Temporary file removed {}", file_name);
         }
         catch(const std::exception& err)
         {
@@ -186,18 +518,539 @@ void OutWriter<T, Compare>::write_to_temporary(std::vector<T>&& data)
         spdlog::error("Writing empty data is not allowed");
         return;
     }
-    std::string file_name = generate_file_name();
-    
+    std::string file_name = generate_file_name(m_spill_dir);
+    const uint64_t run_id = m_journal ? m_journal->seal() : 0;
     m_file_to_merge.push_back(file_name);
-    m_queue->push([file_name = std::move(file_name), data = std::move(data), ser = m_serializer]()
+    queue_spill(std::move(file_name), std::move(data), run_id);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::queue_spill(std::string file_name, std::vector<T>&& data, uint64_t run_id)
+{
+    if (m_max_pending_spills != 0)
     {
-        std::ofstream ofs(file_name, std::ios::binary);
-        uint64_t size = data.size();
-        ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
-        for (const auto& item : data) 
+        metrics::ScopedTimer timer("csv_parser_spill_wait_seconds_total");
+        m_queue->wait_for_pending_below(m_max_pending_spills);
+    }
+    m_queue->push([file_name = std::move(file_name), data = std::move(data), ser = m_serializer, journal = m_journal, buffers = m_buffers, run_id]() mutable
+    {
+        trace::ScopedEvent event("write spill file");
+        metrics::ScopedTimer timer("csv_parser_spill_seconds_total");
         {
-            ser->write(ofs, item);
+            std::ofstream ofs(file_name, std::ios::binary);
+            uint64_t size = data.size();
+            ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            for (const auto& item : data) 
+            {
+                ser->write(ofs, item);
+            }
+            metrics::count("csv_parser_spills_total");
+            metrics::count("csv_parser_spill_bytes_total", static_cast<double>(ofs.tellp()));
+        }
+        SPDLOG_DEBUG("Created temporary file: {}", file_name);
+        if (journal)
+        {
+            try
+            {
+                RunJournal::sync(file_name);
+                RunJournal::Run run{file_name, data.size(), 0, 0, RunJournal::checksum(file_name)};
+                if constexpr (KeyedCompare<Compare, T>)
+                {
+                    run.min_key = Compare::key(data.front());
+                    run.max_key = Compare::key(data.back());
+                }
+                journal->durable(run_id, std::move(run));
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Run {} is not recorded in the manifest: {}", file_name, err.what());
+            }
+        }
+        if (buffers)
+        {
+            buffers->release(std::move(data));
         }
-        spdlog::debug("Created temporary file: {}", file_name);
     });
-}
\ No newline at end of file
+}
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::set_partitioning(Partitioning partitioning) requires KeyedCompare<Compare, T>
+{
+    partitioning.partitions = std::max<uint32_t>(1, partitioning.partitions);
+    m_max_partitions = static_cast<size_t>(partitioning.partitions) * 4;
+    m_min_partition_capacity = std::clamp<uint64_t>(m_max_elements / (partitioning.partitions * 4ull), 16, 4096);
+    m_pack = false;
+    // The sort buffer only stages the first records until the splitters are known
+    m_prefault = std::jthread();
+    if (m_buffers)
+    {
+        m_buffers->release(std::move(m_buff));
+    }
+    m_buff = std::vector<T>();
+    m_partitioning = std::move(partitioning);
+    if (!m_partitioning->sample.empty())
+    {
+        start_partitions(std::move(m_partitioning->sample));
+    }
+    else if (m_partitioning->key_range && m_partitioning->key_range->first < m_partitioning->key_range->second)
+    {
+        const auto [first, last] = *m_partitioning->key_range;
+        std::vector<uint64_t> keys;
+        for (uint64_t i = 0; i < m_partitioning->partitions; ++i)
+        {
+            keys.push_back(first + static_cast<uint64_t>(static_cast<unsigned __int128>(last - first) * i / m_partitioning->partitions));
+        }
+        start_partitions(std::move(keys));
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::start_partitions(std::vector<uint64_t> keys)
+{
+    std::sort(keys.begin(), keys.end());
+    m_first_keys = {0};
+    const size_t count = m_partitioning->partitions;
+    for (size_t i = 1; i < count && !keys.empty(); ++i)
+    {
+        const uint64_t key = keys[keys.size() * i / count];
+        if (key > m_first_keys.back())
+        {
+            m_first_keys.push_back(key);
+        }
+    }
+    m_partitions.resize(m_first_keys.size());
+    SPDLOG_DEBUG("Records are split into {} key ranges", m_partitions.size());
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::collect_partitioned(std::vector<T>&& data)
+{
+    if (m_partitions.empty())
+    {
+        m_buff.insert(m_buff.end(), std::make_move_iterator(data.begin()), std::make_move_iterator(data.end()));
+        if (m_buff.size() < m_partitioning->sample_size)
+        {
+            return;
+        }
+        std::vector<uint64_t> keys;
+        keys.reserve(m_buff.size());
+        for (const auto& record : m_buff)
+        {
+            keys.push_back(Compare::key(record));
+        }
+        start_partitions(std::move(keys));
+        std::vector<T> staged = std::move(m_buff);
+        m_buff = std::vector<T>();
+        partition_records(staged);
+        return;
+    }
+    partition_records(data);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::partition_records(std::vector<T>& data)
+{
+    for (auto& record : data)
+    {
+        const uint64_t key = Compare::key(record);
+        size_t index = partition_of(key);
+        while (m_partitions[index].records.size() == m_partitions[index].records.capacity())
+        {
+            make_room(index);
+            index = partition_of(key);
+        }
+        m_partitions[index].records.push_back(std::move(record));
+    }
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::make_room(size_t index)
+{
+    // Spilled records already cover the whole range, so only a range that never spilled is split
+    const uint64_t share = std::max<uint64_t>(1, m_max_elements / m_partitioning->partitions);
+    if (m_partitions[index].files.empty() && m_partitions[index].records.size() >= 2 * share && m_partitions.size() < m_max_partitions
+        && split_partition(index))
+    {
+        return;
+    }
+    while (true)
+    {
+        auto& records = m_partitions[index].records;
+        const uint64_t capacity = records.capacity();
+        const uint64_t others = m_partition_capacity - capacity;
+        uint64_t grown = std::max(m_min_partition_capacity, capacity * 2);
+        if (others + grown > m_max_elements)
+        {
+            // The rest of the budget, if it still makes room for a record
+            grown = others + capacity < m_max_elements ? m_max_elements - others : 0;
+        }
+        if (grown == 0)
+        {
+            if (spill_largest(0))
+            {
+                continue;
+            }
+            // Nothing left to spill, the budget is overrun by one small step
+            grown = capacity + m_min_partition_capacity;
+        }
+        records.reserve(grown);
+        m_partition_capacity = others + records.capacity();
+        return;
+    }
+}
+
+template<typename T, typename Compare>
+bool OutWriter<T, Compare>::split_partition(size_t index)
+{
+    auto& records = m_partitions[index].records;
+    std::vector<uint64_t> keys(records.size());
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        keys[i] = Compare::key(records[i]);
+    }
+    const uint64_t min_key = *std::min_element(keys.begin(), keys.end());
+    auto mid = keys.begin() + keys.size() / 2;
+    std::nth_element(keys.begin(), mid, keys.end());
+    uint64_t split = *mid;
+    if (split == min_key)
+    {
+        // Half the records or more share the smallest key, the split goes right above it
+        bool found = false;
+        for (uint64_t key : keys)
+        {
+            if (key > min_key && (!found || key < split))
+            {
+                split = key;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    const size_t high_count = std::ranges::count_if(keys, [split](uint64_t key) { return key >= split; });
+    std::vector<T> low;
+    std::vector<T> high;
+    low.reserve(records.size() - high_count);
+    high.reserve(high_count);
+    for (auto& record : records)
+    {
+        (Compare::key(record) < split ? low : high).push_back(std::move(record));
+    }
+    m_partition_capacity += low.capacity() + high.capacity() - records.capacity();
+    records = std::move(low);
+    m_partitions.insert(m_partitions.begin() + index + 1, Partition{std::move(high), {}, 0});
+    m_first_keys.insert(m_first_keys.begin() + index + 1, split);
+    metrics::count("csv_parser_partition_splits_total");
+    return true;
+}
+
+template<typename T, typename Compare>
+bool OutWriter<T, Compare>::spill_largest(size_t from)
+{
+    size_t largest = from;
+    for (size_t i = from; i < m_partitions.size(); ++i)
+    {
+        if (m_partitions[i].records.size() > m_partitions[largest].records.size())
+        {
+            largest = i;
+        }
+    }
+    if (largest >= m_partitions.size() || m_partitions[largest].records.empty())
+    {
+        return false;
+    }
+    spill_partition(largest);
+    return true;
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::spill_partition(size_t index)
+{
+    Partition& partition = m_partitions[index];
+    std::vector<T> records = std::move(partition.records);
+    partition.records = std::vector<T>();
+    m_partition_capacity -= records.capacity();
+    std::string file_name = generate_file_name(m_spill_dir);
+    partition.files.push_back(file_name);
+    partition.spilled += records.size();
+    metrics::count("csv_parser_partition_spills_total");
+    queue_spill(std::move(file_name), std::move(records), 0);
+}
+
+template<typename T, typename Compare>
+void OutWriter<T, Compare>::finish_partitioned(const std::string& file_name)
+{
+    if (m_partitions.empty())
+    {
+        // Fewer records than the sample, they are still split for a parallel sort
+        std::vector<uint64_t> keys;
+        keys.reserve(m_buff.size());
+        for (const auto& record : m_buff)
+        {
+            keys.push_back(Compare::key(record));
+        }
+        start_partitions(std::move(keys));
+        std::vector<T> staged = std::move(m_buff);
+        m_buff = std::vector<T>();
+        partition_records(staged);
+    }
+    // Spills still being written
+    m_queue->wait_for_pending();
+    uint64_t total = 0;
+    bool spilled = false;
+    for (const auto& partition : m_partitions)
+    {
+        total += partition.records.size() + partition.spilled;
+        spilled = spilled || !partition.files.empty();
+    }
+    if (total == 0)
+    {
+        spdlog::error("Empty data, can't find median");
+        return;
+    }
+    metrics::high_water("csv_parser_partitions", m_partitions.size());
+    // Ranges still whole in memory are sorted side by side on the spill threads
+    for (auto& partition : m_partitions)
+    {
+        if (partition.files.empty() && partition.records.size() > 1)
+        {
+            m_queue->push([this, &partition]()
+            {
+                sort_records(partition.records);
+            });
+        }
+    }
+    m_queue->wait_for_pending();
+
+    if (!spilled)
+    {
+        spdlog::info("In memory model was chosen ({} partitions)", m_partitions.size());
+        PartitionCursor cursor(m_partitions, total);
+        try
+        {
+            m_algorithm->process_sorted(cursor, file_name);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error occurred while running the algorithm: {}", err.what());
+        }
+    }
+    else
+    {
+        spdlog::info("File model was chosen ({} partitions)", m_partitions.size());
+        std::string sorted_file;
+        try
+        {
+            sorted_file = concatenate_partitions();
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while writing the partitions: {}", err.what());
+            return;
+        }
+        try
+        {
+            m_algorithm->process_file(m_serializer, sorted_file, file_name);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error occurred while running the algorithm: {}", err.what());
+        }
+    }
+    m_partitions.clear();
+    m_first_keys.clear();
+    m_partition_capacity = 0;
+}
+
+template<typename T, typename Compare>
+std::string OutWriter<T, Compare>::concatenate_partitions()
+{
+    trace::ScopedEvent event("concatenate partitions");
+    metrics::ScopedTimer timer("csv_parser_partition_seconds_total");
+    std::string file_name = generate_file_name(m_spill_dir);
+    std::ofstream out(file_name, std::ios::binary);
+    uint64_t total = 0;
+    out.write(reinterpret_cast<const char*>(&total), sizeof(total));
+    for (size_t i = 0; i < m_partitions.size();)
+    {
+        Partition& partition = m_partitions[i];
+        if (!partition.files.empty())
+        {
+            const uint64_t size = partition.records.size() + partition.spilled;
+            if (size > m_max_elements && redistribute(i))
+            {
+                continue;
+            }
+            if (size > m_max_elements)
+            {
+                // One key throughout: in order as it is
+                for (const auto& file : partition.files)
+                {
+                    read_run(file, [&](const T& record)
+                    {
+                        m_serializer->write(out, record);
+                    });
+                    std::filesystem::remove(file);
+                }
+                total += partition.spilled;
+                partition.files.clear();
+                partition.spilled = 0;
+            }
+            else
+            {
+                // Room for the whole range next to the later ones still in memory
+                while (m_partition_capacity - partition.records.capacity() + size > m_max_elements && spill_largest(i + 1))
+                {
+                }
+                m_queue->wait_for_pending();
+                m_partition_capacity -= partition.records.capacity();
+                partition.records.reserve(size);
+                m_partition_capacity += partition.records.capacity();
+                for (const auto& file : partition.files)
+                {
+                    read_run(file, [&](const T& record)
+                    {
+                        partition.records.push_back(record);
+                    });
+                    std::filesystem::remove(file);
+                }
+                partition.files.clear();
+                partition.spilled = 0;
+                sort_records(partition.records);
+            }
+        }
+        for (const auto& record : partition.records)
+        {
+            m_serializer->write(out, record);
+        }
+        total += partition.records.size();
+        m_partition_capacity -= partition.records.capacity();
+        partition.records = std::vector<T>();
+        ++i;
+    }
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&total), sizeof(total));
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write " + file_name);
+    }
+    return file_name;
+}
+
+template<typename T, typename Compare>
+bool OutWriter<T, Compare>::redistribute(size_t index)
+{
+    trace::ScopedEvent event("split partition");
+    // Records still in memory go to a file too, so both passes only read files
+    if (!m_partitions[index].records.empty())
+    {
+        spill_partition(index);
+        m_queue->wait_for_pending();
+    }
+    const std::vector<std::string> files = m_partitions[index].files;
+    const uint64_t count = m_partitions[index].spilled;
+
+    // Key bounds and an evenly spaced sample
+    const uint64_t step = std::max<uint64_t>(1, count / m_partitioning->sample_size);
+    std::vector<uint64_t> sample;
+    uint64_t min_key = std::numeric_limits<uint64_t>::max();
+    uint64_t max_key = 0;
+    uint64_t seen = 0;
+    for (const auto& file : files)
+    {
+        read_run(file, [&](const T& record)
+        {
+            const uint64_t key = Compare::key(record);
+            min_key = std::min(min_key, key);
+            max_key = std::max(max_key, key);
+            if (seen++ % step == 0)
+            {
+                sample.push_back(key);
+            }
+        });
+    }
+    if (min_key >= max_key)
+    {
+        return false;
+    }
+    // Pieces of half the budget leave room for the ranges kept in memory
+    std::sort(sample.begin(), sample.end());
+    const uint64_t pieces = std::max<uint64_t>(2, count / std::max<uint64_t>(1, m_max_elements / 2) + 1);
+    std::vector<uint64_t> splitters;
+    for (uint64_t i = 1; i < pieces; ++i)
+    {
+        const uint64_t key = sample[sample.size() * i / pieces];
+        if (key > (splitters.empty() ? min_key : splitters.back()))
+        {
+            splitters.push_back(key);
+        }
+    }
+    if (splitters.empty())
+    {
+        // Most of the sample is the smallest key, which keeps a piece of its own
+        splitters.push_back(min_key + 1);
+    }
+
+    std::vector<Partition> parts(splitters.size() + 1);
+    std::vector<std::ofstream> outs;
+    for (auto& part : parts)
+    {
+        part.files.push_back(generate_file_name(m_spill_dir));
+        outs.emplace_back(part.files.back(), std::ios::binary);
+        outs.back().write(reinterpret_cast<const char*>(&part.spilled), sizeof(part.spilled));
+    }
+    for (const auto& file : files)
+    {
+        read_run(file, [&](const T& record)
+        {
+            const size_t piece = std::upper_bound(splitters.begin(), splitters.end(), Compare::key(record)) - splitters.begin();
+            m_serializer->write(outs[piece], record);
+            ++parts[piece].spilled;
+        });
+    }
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        outs[i].seekp(0);
+        outs[i].write(reinterpret_cast<const char*>(&parts[i].spilled), sizeof(parts[i].spilled));
+        outs[i].close();
+        if (!outs[i])
+        {
+            throw std::runtime_error("Cannot write " + parts[i].files.front());
+        }
+    }
+    for (const auto& file : files)
+    {
+        std::filesystem::remove(file);
+    }
+    m_partitions.erase(m_partitions.begin() + index);
+    m_partitions.insert(m_partitions.begin() + index, std::make_move_iterator(parts.begin()), std::make_move_iterator(parts.end()));
+    m_first_keys.insert(m_first_keys.begin() + index + 1, splitters.begin(), splitters.end());
+    metrics::count("csv_parser_partition_splits_total", static_cast<double>(splitters.size()));
+    SPDLOG_DEBUG("Partition of {} records split on disk into {}", count, parts.size());
+    return true;
+}
+
+template<typename T, typename Compare>
+template<typename F>
+void OutWriter<T, Compare>::read_run(const std::string& file_name, F&& f)
+{
+    read_ahead::Stream in(file_name);
+    uint64_t size = 0;
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!in)
+    {
+        throw std::runtime_error("Cannot read temporary file " + file_name);
+    }
+    T record;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        m_serializer->read(in, record);
+        if (!in)
+        {
+            throw std::runtime_error("Temporary file " + file_name + " is truncated");
+        }
+        f(record);
+    }
+}
@@ -0,0 +1,101 @@
+#include "output_sink.hpp"
+#include "csv_median_sink.hpp"
+#include "binary_median_sink.hpp"
+#include "columnar_median_sink.hpp"
+#include "../metrics/metrics.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+    // Counts emitted median rows, only put in front of the real sink when metrics are compiled in
+    class CountingSink : public IOutputSink
+    {
+    public:
+        explicit CountingSink(std::unique_ptr<IOutputSink> sink) : m_sink(std::move(sink)) {}
+        ~CountingSink() override
+        {
+            report();
+        }
+
+        void write(uint64_t receive_ts, double median) override
+        {
+            ++m_rows;
+            m_sink->write(receive_ts, median);
+        }
+
+        void flush() override
+        {
+            m_sink->flush();
+        }
+
+        void close() override
+        {
+            m_sink->close();
+            report();
+        }
+    private:
+        void report()
+        {
+            metrics::count("csv_parser_median_updates_total", m_rows);
+            m_rows = 0;
+        }
+
+        std::unique_ptr<IOutputSink> m_sink;
+        uint64_t m_rows = 0;
+    };
+
+    std::unique_ptr<IOutputSink> make_format_sink(OutputFormat format, const std::string& file_name, bool append)
+    {
+        switch (format)
+        {
+        case OutputFormat::binary:
+            return std::make_unique<BinaryMedianSink>(file_name, append);
+        case OutputFormat::columnar:
+            return std::make_unique<ColumnarMedianSink>(file_name, append);
+        case OutputFormat::csv:
+        default:
+            return std::make_unique<CsvMedianSink>(file_name, append);
+        }
+    }
+} //anonymous namespace
+
+std::unique_ptr<IOutputSink> make_output_sink(OutputFormat format, const std::string& file_name, bool append)
+{
+    if constexpr (metrics::enabled)
+    {
+        return std::make_unique<CountingSink>(make_format_sink(format, file_name, append));
+    }
+    return make_format_sink(format, file_name, append);
+}
+
+OutputFormat parse_output_format(const std::string& name)
+{
+    if (name == "csv")
+    {
+        return OutputFormat::csv;
+    }
+    if (name == "binary")
+    {
+        return OutputFormat::binary;
+    }
+    if (name == "columnar")
+    {
+        return OutputFormat::columnar;
+    }
+    throw std::runtime_error("Unknown output format: " + name + " (expected csv, binary or columnar)");
+}
+
+std::string output_extension(OutputFormat format)
+{
+    switch (format)
+    {
+    case OutputFormat::binary:
+        return ".bin";
+    case OutputFormat::columnar:
+        return ".col";
+    case OutputFormat::csv:
+    default:
+        return ".csv";
+    }
+}
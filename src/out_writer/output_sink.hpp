@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class OutputFormat
+{
+    csv,
+    binary,
+    columnar
+};
+
+class IOutputSink {
+public:
+    virtual ~IOutputSink() = default;
+    virtual void write(uint64_t receive_ts, double median) = 0;
+    // Hands buffered rows to the writer thread without waiting for a full buffer
+    virtual void flush() = 0;
+    virtual void close() = 0;
+};
+
+// Append continues an existing file of the same format, or starts a new one when there is none
+std::unique_ptr<IOutputSink> make_output_sink(OutputFormat format, const std::string& file_name, bool append = false);
+OutputFormat parse_output_format(const std::string& name);
+std::string output_extension(OutputFormat format);
@@ -0,0 +1,175 @@
+#include "packed_chunk.hpp"
+
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint64_t max_block_records = 1ull << 32;
+
+    template<typename T>
+    inline void write_value(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    inline void read_value(std::istream& is, T& value)
+    {
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        if (!is)
+        {
+            throw std::runtime_error("Packed block is truncated");
+        }
+    }
+
+    template<typename Record>
+    inline void read_records(std::istream& is, std::vector<Record>& records, size_t size)
+    {
+        records.resize(size);
+        is.read(reinterpret_cast<char*>(records.data()), size * sizeof(Record));
+        if (!is)
+        {
+            throw std::runtime_error("Packed block is truncated");
+        }
+    }
+} //anonymous namespace
+
+PackedChunk PackedChunk::pack_sorted(const std::vector<CsvParser::ParserData>& data)
+{
+    PackedChunk chunk;
+    chunk.m_size = data.size();
+    std::vector<uint32_t> ticks;
+    if (data.empty() || !chunk.encode_prices(data, ticks))
+    {
+        chunk.m_raw = data;
+        return chunk;
+    }
+
+    auto [min_ts, max_ts] = std::minmax_element(data.begin(), data.end(), [](const auto& a, const auto& b)
+    {
+        return a.receive_ts < b.receive_ts;
+    });
+    chunk.m_base_ts = min_ts->receive_ts;
+    if (max_ts->receive_ts - chunk.m_base_ts <= UINT32_MAX)
+    {
+        chunk.m_layout = Layout::narrow;
+        chunk.m_narrow.resize(data.size());
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            chunk.m_narrow[i] = Narrow{static_cast<uint32_t>(data[i].receive_ts - chunk.m_base_ts), ticks[i]};
+        }
+    }
+    else
+    {
+        chunk.m_layout = Layout::wide;
+        chunk.m_wide.resize(data.size());
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            chunk.m_wide[i] = Wide{data[i].receive_ts - chunk.m_base_ts, ticks[i]};
+        }
+    }
+    return chunk;
+}
+
+void PackedChunk::write(std::ostream& os) const
+{
+    write_value(os, static_cast<uint8_t>(m_layout));
+    write_value<uint64_t>(os, m_size);
+    write_value(os, m_base_ts);
+    write_value(os, m_base_price);
+    write_value(os, m_tick);
+    switch (m_layout)
+    {
+    case Layout::narrow:
+        os.write(reinterpret_cast<const char*>(m_narrow.data()), m_narrow.size() * sizeof(Narrow));
+        break;
+    case Layout::wide:
+        os.write(reinterpret_cast<const char*>(m_wide.data()), m_wide.size() * sizeof(Wide));
+        break;
+    default:
+        os.write(reinterpret_cast<const char*>(m_raw.data()), m_raw.size() * sizeof(CsvParser::ParserData));
+    }
+}
+
+bool PackedChunk::read(std::istream& is, PackedChunk& chunk)
+{
+    uint8_t layout = 0;
+    if (!is.read(reinterpret_cast<char*>(&layout), sizeof(layout)))
+    {
+        return false;
+    }
+    uint64_t size = 0;
+    read_value(is, size);
+    if (layout > static_cast<uint8_t>(Layout::raw) || size > max_block_records)
+    {
+        throw std::runtime_error("Packed block header is damaged");
+    }
+    chunk = PackedChunk();
+    chunk.m_layout = static_cast<Layout>(layout);
+    chunk.m_size = size;
+    read_value(is, chunk.m_base_ts);
+    read_value(is, chunk.m_base_price);
+    read_value(is, chunk.m_tick);
+    switch (chunk.m_layout)
+    {
+    case Layout::narrow:
+        read_records(is, chunk.m_narrow, size);
+        break;
+    case Layout::wide:
+        read_records(is, chunk.m_wide, size);
+        break;
+    default:
+        read_records(is, chunk.m_raw, size);
+    }
+    return true;
+}
+
+size_t PackedChunk::bytes() const
+{
+    return m_narrow.capacity() * sizeof(Narrow) + m_wide.capacity() * sizeof(Wide) + m_raw.capacity() * sizeof(CsvParser::ParserData);
+}
+
+bool PackedChunk::encode_prices(const std::vector<CsvParser::ParserData>& data, std::vector<uint32_t>& ticks)
+{
+    // Beyond 2^53 / 1e8 the fixed point value is no longer exact in a double
+    constexpr double max_price = 9e7;
+    std::vector<int64_t> fixed(data.size());
+    int64_t min_fixed = INT64_MAX;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        const double price = data[i].price;
+        if (!(std::fabs(price) < max_price))
+        {
+            return false;
+        }
+        fixed[i] = std::llround(price * price_scale);
+        if (static_cast<double>(fixed[i]) / price_scale != price)
+        {
+            return false;
+        }
+        min_fixed = std::min(min_fixed, fixed[i]);
+    }
+
+    int64_t tick = 0;
+    for (int64_t value : fixed)
+    {
+        tick = std::gcd(tick, value - min_fixed);
+    }
+    tick = std::max<int64_t>(tick, 1);
+
+    ticks.resize(data.size());
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        const int64_t steps = (fixed[i] - min_fixed) / tick;
+        if (steps > UINT32_MAX)
+        {
+            return false;
+        }
+        ticks[i] = static_cast<uint32_t>(steps);
+    }
+    m_base_price = min_fixed;
+    m_tick = tick;
+    return true;
+}
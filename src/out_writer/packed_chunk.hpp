@@ -0,0 +1,198 @@
+#pragma once
+
+#include "record_packing.hpp"
+#include "../csv_parser/csv_parser.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <queue>
+#include <vector>
+
+// Sorted run of parser records relative to a per-chunk base. Prices on the 1e-8 grid of the input are stored as
+// 32-bit multiples of the chunk's tick above its lowest price. Timestamps are 32-bit offsets from the earliest one
+// when the chunk spans less than 2^32 units (narrow, 8 bytes per record), 64-bit offsets otherwise (wide, 12 bytes).
+// Prices that do not round-trip exactly or spread over more than 2^32 ticks keep the plain 16 byte records
+class PackedChunk
+{
+public:
+    enum class Layout : uint8_t
+    {
+        narrow,
+        wide,
+        raw
+    };
+
+    template<typename Compare>
+    static PackedChunk pack(const std::vector<CsvParser::ParserData>& data, Compare comp);
+    // Keeps the order of data, which is already sorted
+    static PackedChunk pack_sorted(const std::vector<CsvParser::ParserData>& data);
+
+    // Block of a compressed run file: header and the packed records as they are in memory
+    void write(std::ostream& os) const;
+    // False at the end of the stream, throws on a damaged block
+    static bool read(std::istream& is, PackedChunk& chunk);
+
+    inline size_t size() const
+    {
+        return m_size;
+    }
+    inline Layout layout() const
+    {
+        return m_layout;
+    }
+    size_t bytes() const;
+
+    inline CsvParser::ParserData at(size_t index) const
+    {
+        switch (m_layout)
+        {
+        case Layout::narrow:
+            return {m_base_ts + m_narrow[index].ts, decode_price(m_narrow[index].price)};
+        case Layout::wide:
+            return {m_base_ts + m_wide[index].ts, decode_price(m_wide[index].price)};
+        default:
+            return m_raw[index];
+        }
+    }
+private:
+#pragma pack(push, 4)
+    struct Narrow
+    {
+        uint32_t ts;
+        uint32_t price;
+    };
+    struct Wide
+    {
+        uint64_t ts;
+        uint32_t price;
+    };
+#pragma pack(pop)
+    static_assert(sizeof(Narrow) == 8 && sizeof(Wide) == 12);
+
+    inline static constexpr double price_scale = 1e8;
+
+    // Same division as the check in encode_prices, so a packed price decodes to the parsed double bit for bit
+    inline double decode_price(uint32_t ticks) const
+    {
+        return static_cast<double>(m_base_price + static_cast<int64_t>(ticks) * m_tick) / price_scale;
+    }
+
+    // Fills m_base_price and m_tick; false when the prices cannot be packed
+    bool encode_prices(const std::vector<CsvParser::ParserData>& data, std::vector<uint32_t>& ticks);
+
+    template<typename Record, typename Compare>
+    void sort_records(std::vector<Record>& records, Compare comp);
+
+    uint64_t m_base_ts = 0;
+    int64_t m_base_price = 0;
+    int64_t m_tick = 1;
+    size_t m_size = 0;
+    Layout m_layout = Layout::raw;
+    std::vector<Narrow> m_narrow;
+    std::vector<Wide> m_wide;
+    std::vector<CsvParser::ParserData> m_raw;
+};
+
+template<typename Compare>
+PackedChunk PackedChunk::pack(const std::vector<CsvParser::ParserData>& data, Compare comp)
+{
+    PackedChunk chunk = pack_sorted(data);
+    switch (chunk.m_layout)
+    {
+    case Layout::narrow:
+        chunk.sort_records(chunk.m_narrow, comp);
+        break;
+    case Layout::wide:
+        chunk.sort_records(chunk.m_wide, comp);
+        break;
+    default:
+        std::sort(chunk.m_raw.begin(), chunk.m_raw.end(), comp);
+    }
+    return chunk;
+}
+
+template<typename Record, typename Compare>
+void PackedChunk::sort_records(std::vector<Record>& records, Compare comp)
+{
+    // The packed records are sorted in place, the comparator sees them decoded
+    std::sort(records.begin(), records.end(), [this, &comp](const Record& a, const Record& b)
+    {
+        return comp(CsvParser::ParserData{m_base_ts + a.ts, decode_price(a.price)}, CsvParser::ParserData{m_base_ts + b.ts, decode_price(b.price)});
+    });
+}
+
+// k-way merge over packed chunks; equal records keep chunk order, so the output does not depend on heap internals
+template<typename Compare>
+class PackedMerge : public IRecordCursor<CsvParser::ParserData>
+{
+public:
+    PackedMerge(const std::vector<PackedChunk>& chunks, Compare comp) : m_chunks(chunks), m_comp(comp), m_heap(HeapCompare{this})
+    {
+        for (size_t i = 0; i < m_chunks.size(); ++i)
+        {
+            m_total += m_chunks[i].size();
+            if (m_chunks[i].size() != 0)
+            {
+                m_heap.push(Head{m_chunks[i].at(0), i, 0});
+            }
+        }
+    }
+
+    bool next(CsvParser::ParserData& value) override
+    {
+        if (m_heap.empty())
+        {
+            return false;
+        }
+        Head head = m_heap.top();
+        m_heap.pop();
+        value = head.record;
+        if (++head.index < m_chunks[head.chunk].size())
+        {
+            head.record = m_chunks[head.chunk].at(head.index);
+            m_heap.push(head);
+        }
+        return true;
+    }
+
+    uint64_t size() const override
+    {
+        return m_total;
+    }
+private:
+    struct Head
+    {
+        CsvParser::ParserData record;
+        size_t chunk;
+        size_t index;
+    };
+
+    struct HeapCompare
+    {
+        const PackedMerge* merge;
+        bool operator()(const Head& a, const Head& b) const
+        {
+            if (merge->m_comp(b.record, a.record))
+            {
+                return true;
+            }
+            return !merge->m_comp(a.record, b.record) && b.chunk < a.chunk;
+        }
+    };
+
+    const std::vector<PackedChunk>& m_chunks;
+    Compare m_comp;
+    std::priority_queue<Head, std::vector<Head>, HeapCompare> m_heap;
+    uint64_t m_total = 0;
+};
+
+template<>
+struct RecordPacking<CsvParser::ParserData>
+{
+    static constexpr bool enabled = true;
+    using Chunk = PackedChunk;
+    template<typename Compare>
+    using Merge = PackedMerge<Compare>;
+};
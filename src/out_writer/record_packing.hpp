@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// Opt-in compact in-memory form of a record type for OutWriter. A specialization provides Chunk, a sorted run
+// built from a buffer of records, and Merge, a cursor over several chunks in sorted order
+template<typename T>
+struct RecordPacking
+{
+    static constexpr bool enabled = false;
+    struct Chunk {};
+};
+
+// Sorted records handed to an algorithm one at a time, without materializing them
+template<typename T>
+class IRecordCursor
+{
+public:
+    virtual ~IRecordCursor() = default;
+    virtual bool next(T& value) = 0;
+    virtual uint64_t size() const = 0;
+};
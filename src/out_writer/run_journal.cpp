@@ -0,0 +1,343 @@
+#include "run_journal.hpp"
+#include "../logger/logger.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint64_t manifest_magic = 0x31464e4d4e555243; // "CRUNMNF1"
+    constexpr uint64_t fnv_offset = 0xcbf29ce484222325;
+    constexpr uint64_t fnv_prime = 0x100000001b3;
+
+    template<typename T>
+    inline void write_value(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    inline T read_value(std::istream& is)
+    {
+        T value {};
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        if (!is)
+        {
+            throw std::runtime_error("Run manifest is truncated");
+        }
+        return value;
+    }
+
+    inline void write_string(std::ostream& os, const std::string& value)
+    {
+        write_value<uint64_t>(os, value.size());
+        os.write(value.data(), value.size());
+    }
+
+    inline std::string read_string(std::istream& is)
+    {
+        std::string value(read_value<uint64_t>(is), '\0');
+        is.read(value.data(), value.size());
+        if (!is)
+        {
+            throw std::runtime_error("Run manifest is truncated");
+        }
+        return value;
+    }
+} //anonymous namespace
+
+RunJournal::RunJournal(std::filesystem::path dir, uint64_t job) : m_dir(std::move(dir)), m_job(job)
+{
+    std::filesystem::create_directories(m_dir);
+    m_base.job = m_job;
+}
+
+std::filesystem::path RunJournal::manifest_path() const
+{
+    return m_dir / "manifest.bin";
+}
+
+std::optional<RunJournal::Manifest> RunJournal::recover()
+{
+    std::optional<Manifest> manifest;
+    try
+    {
+        if (std::filesystem::exists(manifest_path()))
+        {
+            manifest = load(manifest_path());
+        }
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::warn("Ignoring run manifest {}: {}", manifest_path().string(), err.what());
+    }
+
+    auto intact = [](const Manifest& found)
+    {
+        for (const auto& run : found.runs)
+        {
+            if (!std::filesystem::exists(run.file) || checksum(run.file) != run.checksum)
+            {
+                spdlog::warn("Run {} is missing or damaged", run.file);
+                return false;
+            }
+        }
+        std::error_code ec;
+        if (!found.merged.empty() && std::filesystem::file_size(found.merged, ec) != found.merged_bytes)
+        {
+            spdlog::warn("Merged run {} is missing or incomplete", found.merged);
+            return false;
+        }
+        return true;
+    };
+    if (manifest && manifest->job != m_job)
+    {
+        spdlog::info("Run manifest {} belongs to other inputs or settings", manifest_path().string());
+        manifest.reset();
+    }
+    if (manifest && !intact(*manifest))
+    {
+        manifest.reset();
+    }
+
+    std::set<std::filesystem::path> keep {manifest_path()};
+    if (manifest)
+    {
+        for (const auto& run : manifest->runs)
+        {
+            keep.insert(run.file);
+        }
+        if (!manifest->merged.empty())
+        {
+            keep.insert(manifest->merged);
+        }
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(m_dir))
+    {
+        if (entry.is_regular_file() && !keep.count(entry.path()))
+        {
+            std::filesystem::remove(entry.path());
+            SPDLOG_DEBUG("Removed stale spill file {}", entry.path().string());
+        }
+    }
+    if (!manifest)
+    {
+        std::filesystem::remove(manifest_path());
+        return std::nullopt;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_base = *manifest;
+    m_coverage = manifest->coverage;
+    return manifest;
+}
+
+void RunJournal::cover(const std::string& file, uint64_t task_begin, uint64_t end)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t& covered = m_coverage[{file, task_begin}];
+    covered = std::max(covered, end);
+}
+
+uint64_t RunJournal::seal()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sealed.push_back(m_coverage);
+    m_runs.emplace_back();
+    return m_runs.size() - 1;
+}
+
+void RunJournal::durable(uint64_t id, Run run)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_runs[id] = std::move(run);
+    const size_t before = m_durable;
+    while (m_durable < m_runs.size() && m_runs[m_durable])
+    {
+        ++m_durable;
+    }
+    if (m_durable != before)
+    {
+        save_locked();
+    }
+}
+
+void RunJournal::save_locked()
+{
+    Manifest manifest = m_base;
+    for (size_t i = 0; i < m_durable; ++i)
+    {
+        manifest.runs.push_back(*m_runs[i]);
+    }
+    if (m_durable != 0)
+    {
+        manifest.coverage = m_sealed[m_durable - 1];
+    }
+    try
+    {
+        save(manifest_path(), manifest);
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while saving run manifest: {}", err.what());
+    }
+}
+
+void RunJournal::merged(const std::string& file)
+{
+    RunJournal::sync(file);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Manifest manifest;
+    manifest.job = m_job;
+    manifest.coverage = m_durable != 0 ? m_sealed[m_durable - 1] : m_base.coverage;
+    manifest.merged = file;
+    manifest.merged_bytes = std::filesystem::file_size(file);
+    try
+    {
+        save(manifest_path(), manifest);
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while saving run manifest: {}", err.what());
+    }
+}
+
+void RunJournal::finish()
+{
+    std::error_code ec;
+    std::filesystem::remove(manifest_path(), ec);
+    // Only succeeds once no run is left
+    std::filesystem::remove(m_dir, ec);
+}
+
+uint64_t RunJournal::fingerprint(std::string_view description)
+{
+    uint64_t hash = fnv_offset;
+    for (char c : description)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * fnv_prime;
+    }
+    return hash;
+}
+
+uint64_t RunJournal::checksum(const std::filesystem::path& file)
+{
+    // FNV-1a over 8-byte words, the tail byte by byte
+    std::ifstream in(file, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = fnv_offset;
+    while (in)
+    {
+        in.read(buffer.data(), buffer.size());
+        const size_t size = static_cast<size_t>(in.gcount());
+        size_t pos = 0;
+        for (; pos + sizeof(uint64_t) <= size; pos += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + pos, sizeof(word));
+            hash = (hash ^ word) * fnv_prime;
+        }
+        for (; pos < size; ++pos)
+        {
+            hash = (hash ^ static_cast<unsigned char>(buffer[pos])) * fnv_prime;
+        }
+    }
+    return hash;
+}
+
+void RunJournal::sync(const std::filesystem::path& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open for sync: " + path.string());
+    }
+    const int res = ::fsync(fd);
+    ::close(fd);
+    if (res != 0)
+    {
+        throw std::runtime_error("Cannot sync: " + path.string());
+    }
+}
+
+void RunJournal::save(const std::filesystem::path& file_path, const Manifest& manifest)
+{
+    std::filesystem::path tmp_path = file_path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            throw std::runtime_error("Cannot create run manifest: " + tmp_path.string());
+        }
+        write_value(out, manifest_magic);
+        write_value(out, manifest.job);
+        write_value<uint64_t>(out, manifest.runs.size());
+        for (const auto& run : manifest.runs)
+        {
+            write_string(out, run.file);
+            write_value(out, run.records);
+            write_value(out, run.min_key);
+            write_value(out, run.max_key);
+            write_value(out, run.checksum);
+        }
+        write_value<uint64_t>(out, manifest.coverage.size());
+        for (const auto& [task, end] : manifest.coverage)
+        {
+            write_string(out, task.first);
+            write_value(out, task.second);
+            write_value(out, end);
+        }
+        write_string(out, manifest.merged);
+        write_value(out, manifest.merged_bytes);
+        out.flush();
+        if (!out)
+        {
+            throw std::runtime_error("Cannot write run manifest: " + tmp_path.string());
+        }
+    }
+    sync(tmp_path);
+    std::filesystem::rename(tmp_path, file_path);
+    sync(file_path.has_parent_path() ? file_path.parent_path() : std::filesystem::path("."));
+}
+
+RunJournal::Manifest RunJournal::load(const std::filesystem::path& file_path)
+{
+    std::ifstream in(file_path, std::ios::binary);
+    if (!in.is_open())
+    {
+        throw std::runtime_error("Cannot open run manifest: " + file_path.string());
+    }
+    if (read_value<uint64_t>(in) != manifest_magic)
+    {
+        throw std::runtime_error("Not a run manifest: " + file_path.string());
+    }
+    Manifest manifest;
+    manifest.job = read_value<uint64_t>(in);
+    const uint64_t runs = read_value<uint64_t>(in);
+    for (uint64_t i = 0; i < runs; ++i)
+    {
+        Run run;
+        run.file = read_string(in);
+        run.records = read_value<uint64_t>(in);
+        run.min_key = read_value<uint64_t>(in);
+        run.max_key = read_value<uint64_t>(in);
+        run.checksum = read_value<uint64_t>(in);
+        manifest.runs.push_back(std::move(run));
+    }
+    const uint64_t tasks = read_value<uint64_t>(in);
+    for (uint64_t i = 0; i < tasks; ++i)
+    {
+        std::string file = read_string(in);
+        const uint64_t begin = read_value<uint64_t>(in);
+        manifest.coverage[{std::move(file), begin}] = read_value<uint64_t>(in);
+    }
+    manifest.merged = read_string(in);
+    manifest.merged_bytes = read_value<uint64_t>(in);
+    return manifest;
+}
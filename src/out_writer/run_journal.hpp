@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Durable manifest of the spill runs of a file-mode sort, so a restarted job with the same inputs adopts the runs
+// it already wrote and parses only the rest. A run is listed once it and every run sealed before it are on disk,
+// together with how far each parse task had been ingested when it was sealed
+class RunJournal
+{
+public:
+    struct Run
+    {
+        std::string file;
+        uint64_t records = 0;
+        // Key range of the run when the comparator exposes a key, otherwise both 0
+        uint64_t min_key = 0;
+        uint64_t max_key = 0;
+        uint64_t checksum = 0;
+    };
+
+    // (file, first byte of the parse task) -> end of the last line of that task inside the listed runs
+    using Coverage = std::map<std::pair<std::string, uint64_t>, uint64_t>;
+
+    struct Manifest
+    {
+        uint64_t job = 0;
+        std::vector<Run> runs;
+        Coverage coverage;
+        // Set once the runs are merged into this file, which replaces them
+        std::string merged;
+        uint64_t merged_bytes = 0;
+    };
+
+    // Runs and the manifest live in dir; job identifies the inputs and settings, see fingerprint
+    RunJournal(std::filesystem::path dir, uint64_t job);
+
+    // The manifest of the same job with every file intact, or nullopt. Files of the directory that the
+    // adopted manifest does not list are removed, so nothing of a crashed run is left behind
+    std::optional<Manifest> recover();
+    inline const std::filesystem::path& dir() const
+    {
+        return m_dir;
+    }
+
+    // Ingest thread: the rows of a task up to end were handed to the writer
+    void cover(const std::string& file, uint64_t task_begin, uint64_t end);
+    // Ingest thread, when a buffer goes to a spill: id of the run, which covers everything covered so far
+    uint64_t seal();
+    // Spill thread, once the run file is synced
+    void durable(uint64_t id, Run run);
+    // After the runs are merged and before they are removed
+    void merged(const std::string& file);
+    // The job is done, the manifest and the emptied directory are removed
+    void finish();
+
+    static uint64_t fingerprint(std::string_view description);
+    static uint64_t checksum(const std::filesystem::path& file);
+    // fsync of a written file, or of a directory after a rename in it
+    static void sync(const std::filesystem::path& path);
+    // Written to a temporary file, synced and renamed
+    static void save(const std::filesystem::path& file_path, const Manifest& manifest);
+    // Throws when the manifest is unreadable
+    static Manifest load(const std::filesystem::path& file_path);
+private:
+    std::filesystem::path manifest_path() const;
+    void save_locked();
+
+    std::mutex m_mutex;
+    std::filesystem::path m_dir;
+    uint64_t m_job;
+    Manifest m_base;
+    Coverage m_coverage;
+    std::vector<Coverage> m_sealed;
+    std::vector<std::optional<Run>> m_runs;
+    size_t m_durable = 0;
+};
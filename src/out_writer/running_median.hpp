@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Exact running median over two heaps kept in plain vectors, so the contents can be exported as a histogram
+class RunningMedian
+{
+public:
+    inline double push(double price)
+    {
+        if (m_lower.empty() || price <= m_lower.front())
+        {
+            push_lower(price);
+        }
+        else
+        {
+            push_upper(price);
+        }
+
+        if (m_lower.size() > m_upper.size() + 1)
+        {
+            double top = m_lower.front();
+            std::pop_heap(m_lower.begin(), m_lower.end());
+            m_lower.pop_back();
+            push_upper(top);
+        }
+        else if (m_upper.size() > m_lower.size())
+        {
+            double top = m_upper.front();
+            std::pop_heap(m_upper.begin(), m_upper.end(), std::greater<double>());
+            m_upper.pop_back();
+            push_lower(top);
+        }
+        return median();
+    }
+
+    inline double median() const
+    {
+        if (m_lower.size() == m_upper.size())
+        {
+            return (m_lower.front() + m_upper.front()) / 2.0;
+        }
+        return m_lower.front();
+    }
+
+    inline uint64_t size() const
+    {
+        return m_lower.size() + m_upper.size();
+    }
+
+    void reserve(size_t count)
+    {
+        m_lower.reserve(count / 2 + 2);
+        m_upper.reserve(count / 2 + 2);
+    }
+
+    // Values that fit without reallocating either heap; a push may hold one extra value in a heap before rebalancing
+    inline size_t capacity() const
+    {
+        return 2 * std::max<size_t>(std::min(m_lower.capacity(), m_upper.capacity()), 1) - 2;
+    }
+
+    std::vector<std::pair<double, uint64_t>> histogram() const
+    {
+        std::vector<double> prices(m_lower);
+        prices.insert(prices.end(), m_upper.begin(), m_upper.end());
+        std::sort(prices.begin(), prices.end());
+
+        std::vector<std::pair<double, uint64_t>> result;
+        for (double price : prices)
+        {
+            if (result.empty() || result.back().first != price)
+            {
+                result.emplace_back(price, 0);
+            }
+            ++result.back().second;
+        }
+        return result;
+    }
+
+    // Histogram must be sorted by price
+    void assign(const std::vector<std::pair<double, uint64_t>>& histogram)
+    {
+        std::vector<double> prices;
+        for (const auto& [price, count] : histogram)
+        {
+            prices.insert(prices.end(), count, price);
+        }
+        const size_t lower_size = (prices.size() + 1) / 2;
+        m_lower.assign(prices.begin(), prices.begin() + lower_size);
+        m_upper.assign(prices.begin() + lower_size, prices.end());
+        std::make_heap(m_lower.begin(), m_lower.end());
+        std::make_heap(m_upper.begin(), m_upper.end(), std::greater<double>());
+    }
+private:
+    inline void push_lower(double price)
+    {
+        m_lower.push_back(price);
+        std::push_heap(m_lower.begin(), m_lower.end());
+    }
+
+    inline void push_upper(double price)
+    {
+        m_upper.push_back(price);
+        std::push_heap(m_upper.begin(), m_upper.end(), std::greater<double>());
+    }
+
+    std::vector<double> m_lower;
+    std::vector<double> m_upper;
+};
+
+// Exact running median over a price histogram, for the file mode where the rows do not fit in heaps but their
+// distinct prices do. A saved histogram is restored in one pass over its prices, not one push per row
+class HistogramMedian
+{
+public:
+    // Histogram must be sorted by price
+    explicit HistogramMedian(const std::vector<std::pair<double, uint64_t>>& histogram = {})
+    {
+        for (const auto& [price, count] : histogram)
+        {
+            m_prices.emplace_hint(m_prices.end(), price, count);
+            m_count += count;
+        }
+        m_lower = m_prices.begin();
+        settle();
+    }
+
+    inline double push(double price)
+    {
+        auto [it, inserted] = m_prices.try_emplace(price, 0);
+        ++it->second;
+        if (m_count == 0)
+        {
+            m_lower = it;
+        }
+        else if (price < m_lower->first)
+        {
+            m_before += 1;
+        }
+        ++m_count;
+        settle();
+        return median();
+    }
+
+    inline double median() const
+    {
+        if (m_count % 2 == 1)
+        {
+            return m_lower->first;
+        }
+        // The upper middle value is the next one in the same price or the next price
+        const uint64_t upper_rank = m_count / 2;
+        const double upper = upper_rank < m_before + m_lower->second ? m_lower->first : std::next(m_lower)->first;
+        return (m_lower->first + upper) / 2.0;
+    }
+
+    inline uint64_t size() const
+    {
+        return m_count;
+    }
+
+    std::vector<std::pair<double, uint64_t>> histogram() const
+    {
+        return {m_prices.begin(), m_prices.end()};
+    }
+private:
+    // Moves m_lower to the price holding the lower middle value
+    inline void settle()
+    {
+        if (m_count == 0)
+        {
+            return;
+        }
+        const uint64_t rank = (m_count - 1) / 2;
+        while (rank < m_before)
+        {
+            --m_lower;
+            m_before -= m_lower->second;
+        }
+        while (rank >= m_before + m_lower->second)
+        {
+            m_before += m_lower->second;
+            ++m_lower;
+        }
+    }
+
+    std::map<double, uint64_t> m_prices;
+    // Price of the lower middle value and the number of values at lower prices
+    std::map<double, uint64_t>::iterator m_lower;
+    uint64_t m_before = 0;
+    uint64_t m_count = 0;
+};
@@ -0,0 +1,308 @@
+#include "shard_run.hpp"
+#include "../logger/logger.hpp"
+#include "../trace/trace.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+    constexpr uint64_t run_magic = 0x314e555244524853ull; // "SHRDRUN1"
+    constexpr uint64_t summary_magic = 0x31594d5344524853ull; // "SHRDSMY1"
+
+    template<typename T>
+    inline void write_value(std::ostream& os, const T& value)
+    {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    inline T read_value(std::istream& is)
+    {
+        T value {};
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+        if (!is)
+        {
+            throw std::runtime_error("Shard file is truncated");
+        }
+        return value;
+    }
+} //anonymous namespace
+
+namespace shard_run
+{
+    void Summary::merge(const Summary& other)
+    {
+        count += other.count;
+        min_ts = std::min(min_ts, other.min_ts);
+        max_ts = std::max(max_ts, other.max_ts);
+        std::vector<std::pair<double, uint64_t>> merged;
+        merged.reserve(histogram.size() + other.histogram.size());
+        auto a = histogram.begin();
+        auto b = other.histogram.begin();
+        while (a != histogram.end() || b != other.histogram.end())
+        {
+            if (b == other.histogram.end() || (a != histogram.end() && a->first < b->first))
+            {
+                merged.push_back(*a++);
+            }
+            else if (a == histogram.end() || b->first < a->first)
+            {
+                merged.push_back(*b++);
+            }
+            else
+            {
+                merged.emplace_back(a->first, a->second + b->second);
+                ++a;
+                ++b;
+            }
+        }
+        histogram = std::move(merged);
+    }
+
+    double Summary::median() const
+    {
+        if (count == 0)
+        {
+            throw std::runtime_error("Median of an empty summary");
+        }
+        // Prices at the lower and upper middle rank, the same for an odd count
+        const uint64_t lower = (count - 1) / 2;
+        const uint64_t upper = count / 2;
+        double lower_price = 0.0;
+        uint64_t seen = 0;
+        for (const auto& [price, rows] : histogram)
+        {
+            if (seen <= lower && lower < seen + rows)
+            {
+                lower_price = price;
+            }
+            if (upper < seen + rows)
+            {
+                return lower == upper ? price : (lower_price + price) / 2.0;
+            }
+            seen += rows;
+        }
+        throw std::runtime_error("Summary histogram does not match its row count");
+    }
+
+    std::filesystem::path summary_path(const std::filesystem::path& run_file)
+    {
+        std::filesystem::path path = run_file;
+        path += ".summary";
+        return path;
+    }
+
+    void save(const std::filesystem::path& file_path, const Summary& summary)
+    {
+        std::filesystem::path tmp_path = file_path;
+        tmp_path += ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Cannot create shard summary: " + tmp_path.string());
+            }
+            write_value(out, summary_magic);
+            write_value(out, summary.count);
+            write_value(out, summary.min_ts);
+            write_value(out, summary.max_ts);
+            write_value<uint64_t>(out, summary.histogram.size());
+            for (const auto& [price, rows] : summary.histogram)
+            {
+                write_value(out, price);
+                write_value(out, rows);
+            }
+            out.flush();
+            if (!out)
+            {
+                throw std::runtime_error("Cannot write shard summary: " + tmp_path.string());
+            }
+        }
+        std::filesystem::rename(tmp_path, file_path);
+    }
+
+    Summary load(const std::filesystem::path& file_path)
+    {
+        std::ifstream in(file_path, std::ios::binary);
+        if (!in.is_open())
+        {
+            throw std::runtime_error("Cannot open shard summary: " + file_path.string());
+        }
+        if (read_value<uint64_t>(in) != summary_magic)
+        {
+            throw std::runtime_error("Not a shard summary: " + file_path.string());
+        }
+        Summary summary;
+        summary.count = read_value<uint64_t>(in);
+        summary.min_ts = read_value<uint64_t>(in);
+        summary.max_ts = read_value<uint64_t>(in);
+        const uint64_t prices = read_value<uint64_t>(in);
+        uint64_t rows = 0;
+        for (uint64_t i = 0; i < prices; ++i)
+        {
+            const double price = read_value<double>(in);
+            summary.histogram.emplace_back(price, read_value<uint64_t>(in));
+            rows += summary.histogram.back().second;
+        }
+        if (rows != summary.count)
+        {
+            throw std::runtime_error("Shard summary histogram does not match its row count: " + file_path.string());
+        }
+        return summary;
+    }
+
+    Writer::Writer(const std::filesystem::path& file) : m_file(file), m_out(file, std::ios::binary | std::ios::trunc)
+    {
+        if (!m_out.is_open())
+        {
+            throw std::runtime_error("Cannot create shard run: " + file.string());
+        }
+        write_value(m_out, run_magic);
+        m_block.reserve(block_records);
+    }
+
+    void Writer::add(const CsvParser::ParserData& record)
+    {
+        m_block.push_back(record);
+        ++m_summary.count;
+        m_summary.min_ts = std::min(m_summary.min_ts, record.receive_ts);
+        m_summary.max_ts = std::max(m_summary.max_ts, record.receive_ts);
+        ++m_histogram[record.price];
+        if (m_block.size() == block_records)
+        {
+            flush_block();
+        }
+    }
+
+    void Writer::flush_block()
+    {
+        if (!m_block.empty())
+        {
+            PackedChunk::pack_sorted(m_block).write(m_out);
+            m_block.clear();
+        }
+    }
+
+    void Writer::finish()
+    {
+        flush_block();
+        m_out.close();
+        if (!m_out)
+        {
+            throw std::runtime_error("Cannot write shard run: " + m_file.string());
+        }
+        m_summary.histogram.assign(m_histogram.begin(), m_histogram.end());
+        save(summary_path(m_file), m_summary);
+        spdlog::info("Shard run {} holds {} rows", m_file.string(), m_summary.count);
+    }
+
+    Reader::Reader(const std::filesystem::path& file, uint64_t size) : m_in(file.string()), m_total(size)
+    {
+        if (!m_in.is_open())
+        {
+            throw std::runtime_error("Cannot open shard run: " + file.string());
+        }
+        if (read_value<uint64_t>(m_in) != run_magic)
+        {
+            throw std::runtime_error("Not a shard run: " + file.string());
+        }
+    }
+
+    bool Reader::next(CsvParser::ParserData& value)
+    {
+        while (m_index == m_chunk.size())
+        {
+            if (!PackedChunk::read(m_in, m_chunk))
+            {
+                if (m_read != m_total)
+                {
+                    throw std::runtime_error("Shard run holds " + std::to_string(m_read) + " rows, its summary " + std::to_string(m_total));
+                }
+                return false;
+            }
+            m_index = 0;
+        }
+        value = m_chunk.at(m_index++);
+        ++m_read;
+        return true;
+    }
+
+    Merge::Merge(std::vector<std::unique_ptr<Reader>> readers) : m_readers(std::move(readers))
+    {
+        for (size_t i = 0; i < m_readers.size(); ++i)
+        {
+            m_total += m_readers[i]->size();
+            CsvParser::ParserData record;
+            if (m_readers[i]->next(record))
+            {
+                m_heap.push(Head{record, i});
+            }
+        }
+    }
+
+    bool Merge::next(CsvParser::ParserData& value)
+    {
+        if (m_heap.empty())
+        {
+            return false;
+        }
+        Head head = m_heap.top();
+        m_heap.pop();
+        value = head.record;
+        if (m_readers[head.run]->next(head.record))
+        {
+            m_heap.push(head);
+        }
+        return true;
+    }
+
+    void Algorithm::process_in_memory(std::vector<CsvParser::ParserData>&& sorted_data, const std::string& output_file)
+    {
+        trace::ScopedEvent event("shard run");
+        Writer writer(output_file);
+        for (const auto& record : sorted_data)
+        {
+            writer.add(record);
+        }
+        writer.finish();
+    }
+
+    void Algorithm::process_sorted(IRecordCursor<CsvParser::ParserData>& sorted_data, const std::string& output_file)
+    {
+        trace::ScopedEvent event("shard run");
+        Writer writer(output_file);
+        CsvParser::ParserData record;
+        while (sorted_data.next(record))
+        {
+            writer.add(record);
+        }
+        writer.finish();
+    }
+
+    void Algorithm::process_file(const std::shared_ptr<ISerializer<CsvParser::ParserData>> serializer, const std::string& sorted_input_file, const std::string& output_file)
+    {
+        trace::ScopedEvent event("shard run");
+        {
+            read_ahead::Stream in(sorted_input_file);
+            if (!in.is_open())
+            {
+                throw std::runtime_error("Cannot open input file: " + sorted_input_file);
+            }
+            const uint64_t total = read_value<uint64_t>(in);
+            Writer writer(output_file);
+            CsvParser::ParserData record;
+            for (uint64_t i = 0; i < total; ++i)
+            {
+                serializer->read(in, record);
+                if (!in)
+                {
+                    throw std::runtime_error("Sorted file " + sorted_input_file + " is truncated");
+                }
+                writer.add(record);
+            }
+            writer.finish();
+        }
+        std::error_code ec;
+        std::filesystem::remove(sorted_input_file, ec);
+    }
+} //namespace shard_run
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "algorithm.hpp"
+#include "packed_chunk.hpp"
+#include "../csv_parser/csv_parser.hpp"
+#include "../system/read_ahead.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Output of a shard worker: its rows sorted by receive_ts in a compressed run file (packed blocks, see PackedChunk)
+// and next to it a summary that merges with the summaries of the other shards
+namespace shard_run
+{
+    struct Summary
+    {
+        uint64_t count = 0;
+        uint64_t min_ts = std::numeric_limits<uint64_t>::max();
+        uint64_t max_ts = 0;
+        // Every price of the shard with its number of rows, ordered by price like MedianState::histogram
+        std::vector<std::pair<double, uint64_t>> histogram;
+
+        void merge(const Summary& other);
+        // Median of every row of the summary, the last value of the running median over them
+        double median() const;
+    };
+
+    std::filesystem::path summary_path(const std::filesystem::path& run_file);
+    // Written to a temporary file and renamed, so a summary only exists once its run is complete
+    void save(const std::filesystem::path& file_path, const Summary& summary);
+    // Throws when the summary is missing or unreadable
+    Summary load(const std::filesystem::path& file_path);
+
+    // Streams sorted records into a run file, block by block
+    class Writer
+    {
+    public:
+        inline static constexpr size_t block_records = 1 << 16;
+
+        explicit Writer(const std::filesystem::path& file);
+        void add(const CsvParser::ParserData& record);
+        // Writes the last block and the summary
+        void finish();
+        inline const Summary& summary() const
+        {
+            return m_summary;
+        }
+    private:
+        void flush_block();
+
+        std::filesystem::path m_file;
+        std::ofstream m_out;
+        std::vector<CsvParser::ParserData> m_block;
+        Summary m_summary;
+        std::map<double, uint64_t> m_histogram;
+    };
+
+    class Reader : public IRecordCursor<CsvParser::ParserData>
+    {
+    public:
+        // size is the row count of the run's summary
+        Reader(const std::filesystem::path& file, uint64_t size);
+        bool next(CsvParser::ParserData& value) override;
+        inline uint64_t size() const override
+        {
+            return m_total;
+        }
+    private:
+        read_ahead::Stream m_in;
+        PackedChunk m_chunk;
+        size_t m_index = 0;
+        uint64_t m_read = 0;
+        uint64_t m_total;
+    };
+
+    // k-way merge of the runs by receive_ts; equal timestamps keep shard order
+    class Merge : public IRecordCursor<CsvParser::ParserData>
+    {
+    public:
+        explicit Merge(std::vector<std::unique_ptr<Reader>> readers);
+        bool next(CsvParser::ParserData& value) override;
+        inline uint64_t size() const override
+        {
+            return m_total;
+        }
+    private:
+        struct Head
+        {
+            CsvParser::ParserData record;
+            size_t run;
+        };
+        struct HeapCompare
+        {
+            inline bool operator()(const Head& a, const Head& b) const
+            {
+                return a.record.receive_ts != b.record.receive_ts ? a.record.receive_ts > b.record.receive_ts : a.run > b.run;
+            }
+        };
+
+        std::vector<std::unique_ptr<Reader>> m_readers;
+        std::priority_queue<Head, std::vector<Head>, HeapCompare> m_heap;
+        uint64_t m_total = 0;
+    };
+
+    // Algorithm of a shard worker: writes the sorted rows it is given to output_file instead of a median
+    class Algorithm : public IAlgorithm<CsvParser::ParserData>
+    {
+    public:
+        void process_in_memory(std::vector<CsvParser::ParserData>&& sorted_data, const std::string& output_file) override;
+        void process_file(const std::shared_ptr<ISerializer<CsvParser::ParserData>> serializer, const std::string& sorted_input_file, const std::string& output_file) override;
+        void process_sorted(IRecordCursor<CsvParser::ParserData>& sorted_data, const std::string& output_file) override;
+    };
+} //namespace shard_run
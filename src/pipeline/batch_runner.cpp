@@ -0,0 +1,145 @@
+#include "batch_runner.hpp"
+#include "coro.hpp"
+#include "../csv_parser/thread_pool_queue.hpp"
+#include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+namespace
+{
+    uint64_t input_bytes(const std::vector<std::filesystem::path>& files)
+    {
+        uint64_t total = 0;
+        for (const auto& file : files)
+        {
+            std::error_code ec;
+            const uint64_t size = std::filesystem::file_size(file, ec);
+            total += ec ? 0 : size;
+        }
+        return total;
+    }
+} //anonymous namespace
+
+uint32_t BatchRunner::concurrency(size_t jobs, uint64_t max_memory, uint32_t max_threads)
+{
+    const uint64_t by_memory = std::max<uint64_t>(max_memory / min_job_memory, 1);
+    return static_cast<uint32_t>(std::max<uint64_t>(std::min<uint64_t>({jobs, max_threads, by_memory}), 1));
+}
+
+BatchRunner::BatchRunner(std::vector<Job> jobs, Options options) : m_jobs(std::move(jobs)), m_options(options)
+{
+
+}
+
+std::vector<BatchRunner::Result> BatchRunner::run()
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<Result> results(m_jobs.size());
+    if (m_jobs.empty())
+    {
+        return results;
+    }
+
+    // Idle pooled buffers count against the budget, the jobs split what is left
+    const uint64_t idle_memory = BufferPool<CsvParser::ParserData>::idle_budget(m_options.max_memory);
+    const uint64_t job_memory = m_options.max_memory - idle_memory;
+    const uint32_t slots = m_options.concurrency != 0 ? std::min<uint32_t>(m_options.concurrency, m_jobs.size())
+        : concurrency(m_jobs.size(), job_memory, m_options.max_threads);
+    const uint64_t share = job_memory / slots;
+    const uint32_t threads = std::max<uint32_t>(m_options.max_threads / slots, 1);
+
+    // Longest first, so the big jobs do not start last and leave the other slots idle at the end
+    std::vector<size_t> order(m_jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        results[i].name = m_jobs[i].name;
+        results[i].input_bytes = input_bytes(m_jobs[i].options.files);
+        // The records take less room than their CSV lines, so a small job fits in memory with its input size
+        results[i].memory = std::min(share, std::max(results[i].input_bytes, min_job_memory));
+        results[i].threads = threads;
+    }
+    std::stable_sort(order.begin(), order.end(), [&results](size_t a, size_t b)
+    {
+        return results[a].input_bytes > results[b].input_bytes;
+    });
+    spdlog::info("Batch of {} jobs on {} slots, up to {} bytes and {} threads each", m_jobs.size(), slots, share, threads);
+
+    auto buffers = std::make_shared<BufferPool<CsvParser::ParserData>>(idle_memory);
+    coro::Executor executor(slots, "stage");
+    const auto start = clock::now();
+    {
+        ThreadPoolQueue pool;
+        pool.start_async(slots, "job");
+        for (size_t index : order)
+        {
+            pool.push([this, index, &results, &buffers, &executor, start]()
+            {
+                Result& result = results[index];
+                const auto job_start = clock::now();
+                result.wait_seconds = std::chrono::duration<double>(job_start - start).count();
+                if (m_options.stop && m_options.stop->load())
+                {
+                    spdlog::warn("Job {} is skipped, the batch is stopped", result.name);
+                    return;
+                }
+                auto options = m_jobs[index].options;
+                options.max_memory = result.memory;
+                options.max_threads = result.threads;
+                options.buffers = buffers;
+                options.executor = &executor;
+                options.stop = m_options.stop;
+                spdlog::info("Job {} started: {} bytes of input, {} bytes of memory", result.name, result.input_bytes, result.memory);
+                try
+                {
+                    result.ok = MedianPipeline(std::move(options)).run();
+                }
+                catch (const std::exception& err)
+                {
+                    spdlog::error("Job {} failed: {}", result.name, err.what());
+                }
+                result.run_seconds = std::chrono::duration<double>(clock::now() - job_start).count();
+                metrics::count("csv_parser_batch_jobs_total", 1.0, "status", result.ok ? "ok" : "failed");
+                spdlog::info("Job {} {} in {:.3f} s", result.name, result.ok ? "finished" : "failed", result.run_seconds);
+            });
+        }
+        pool.wait_for_pending();
+        pool.stop();
+    }
+
+    const size_t failed = std::count_if(results.begin(), results.end(), [](const Result& result) { return !result.ok; });
+    double job_seconds = 0.0;
+    for (const auto& result : results)
+    {
+        job_seconds += result.run_seconds;
+    }
+    spdlog::info("Batch finished in {:.3f} s, {:.3f} s of job time, {} of {} jobs failed",
+        std::chrono::duration<double>(clock::now() - start).count(), job_seconds, failed, results.size());
+    return results;
+}
+
+void BatchRunner::write_report(const std::filesystem::path& file, const std::vector<Result>& results)
+{
+    std::ofstream out(file, std::ios::trunc);
+    if (!out.is_open())
+    {
+        throw std::runtime_error("Cannot create batch report: " + file.string());
+    }
+    out << "job;status;input_bytes;memory_bytes;threads;wait_seconds;run_seconds\n";
+    out.precision(6);
+    out << std::fixed;
+    for (const auto& result : results)
+    {
+        out << result.name << ';' << (result.ok ? "ok" : "failed") << ';' << result.input_bytes << ';' << result.memory << ';'
+            << result.threads << ';' << result.wait_seconds << ';' << result.run_seconds << '\n';
+    }
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write batch report: " + file.string());
+    }
+}
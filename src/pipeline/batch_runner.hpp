@@ -0,0 +1,61 @@
+#pragma once
+
+#include "median_pipeline.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Many batch jobs, e.g. one per symbol config, in one process. Jobs run side by side on a fixed number of slots,
+// largest input first, and share the stage threads and a pool of record buffers, so a job reuses the sort buffer
+// and chunks of the jobs before it. A quarter of the memory budget is kept for idle pooled buffers, the rest and the
+// thread budget are split between the slots
+class BatchRunner
+{
+public:
+    struct Job
+    {
+        std::string name;
+        // Budgets, buffers, executor and stop flag are set by the runner
+        MedianPipeline::Options options;
+    };
+
+    struct Options
+    {
+        uint64_t max_memory = 524288000;
+        uint32_t max_threads = 4;
+        // Jobs running at the same time, 0 to derive it from the budgets
+        uint32_t concurrency = 0;
+        // Jobs that have not started yet are skipped once it is set
+        const std::atomic<bool>* stop = nullptr;
+    };
+
+    struct Result
+    {
+        std::string name;
+        bool ok = false;
+        uint64_t input_bytes = 0;
+        uint64_t memory = 0;
+        uint32_t threads = 0;
+        // From the start of the batch to the start of the job
+        double wait_seconds = 0.0;
+        double run_seconds = 0.0;
+    };
+
+    // A job never gets less memory than this unless the concurrency is set explicitly
+    inline static constexpr uint64_t min_job_memory = 64ull << 20;
+
+    // One slot per thread, as long as every slot keeps min_job_memory
+    static uint32_t concurrency(size_t jobs, uint64_t max_memory, uint32_t max_threads);
+
+    BatchRunner(std::vector<Job> jobs, Options options);
+    // Results in the order of the jobs
+    std::vector<Result> run();
+    // One line per job: name, status, input bytes, memory, threads, wait and run seconds
+    static void write_report(const std::filesystem::path& file, const std::vector<Result>& results);
+private:
+    std::vector<Job> m_jobs;
+    Options m_options;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "coro.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+
+namespace coro
+{
+    // Bounded MPMC channel between two pipeline stages. Coroutines co_await send() and receive() and continue on
+    // their executor, plain threads such as the parser workers block in push() and pop(). A full channel holds the
+    // senders back, so a slow stage throttles every stage before it
+    template<typename T>
+    class Channel
+    {
+        struct Waiter
+        {
+            std::coroutine_handle<> handle;
+            Executor* executor = nullptr;
+            std::binary_semaphore* semaphore = nullptr;
+            // Value of a sender, or the one handed to a receiver
+            std::optional<T> value;
+            bool ok = false;
+
+            inline void wake()
+            {
+                if (handle)
+                {
+                    executor->post(handle);
+                }
+                else
+                {
+                    semaphore->release();
+                }
+            }
+        };
+
+        class SendAwaiter
+        {
+        public:
+            SendAwaiter(Channel& channel, T&& value) : m_channel(channel)
+            {
+                m_waiter.value.emplace(std::move(value));
+            }
+            inline bool await_ready() const noexcept
+            {
+                return false;
+            }
+            template<typename Promise>
+            bool await_suspend(std::coroutine_handle<Promise> handle)
+            {
+                std::lock_guard<std::mutex> lock(m_channel.m_mutex);
+                if (m_channel.try_send(m_waiter))
+                {
+                    return false;
+                }
+                m_waiter.handle = handle;
+                m_waiter.executor = handle.promise().executor;
+                m_channel.m_senders.push_back(&m_waiter);
+                return true;
+            }
+            inline bool await_resume() const noexcept
+            {
+                return m_waiter.ok;
+            }
+        private:
+            Channel& m_channel;
+            Waiter m_waiter;
+        };
+
+        class ReceiveAwaiter
+        {
+        public:
+            explicit ReceiveAwaiter(Channel& channel) : m_channel(channel)
+            {
+
+            }
+            inline bool await_ready() const noexcept
+            {
+                return false;
+            }
+            template<typename Promise>
+            bool await_suspend(std::coroutine_handle<Promise> handle)
+            {
+                std::lock_guard<std::mutex> lock(m_channel.m_mutex);
+                if (m_channel.try_receive(m_waiter))
+                {
+                    return false;
+                }
+                m_waiter.handle = handle;
+                m_waiter.executor = handle.promise().executor;
+                m_channel.m_receivers.push_back(&m_waiter);
+                return true;
+            }
+            inline std::optional<T> await_resume()
+            {
+                return m_waiter.ok ? std::move(m_waiter.value) : std::nullopt;
+            }
+        private:
+            Channel& m_channel;
+            Waiter m_waiter;
+        };
+    public:
+        explicit Channel(size_t capacity) : m_capacity(std::max<size_t>(capacity, 1))
+        {
+
+        }
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        // co_await: false when the channel is closed or cancelled and the value was dropped
+        inline SendAwaiter send(T value)
+        {
+            return SendAwaiter(*this, std::move(value));
+        }
+        // co_await: nullopt once the channel is closed and drained, or cancelled
+        inline ReceiveAwaiter receive()
+        {
+            return ReceiveAwaiter(*this);
+        }
+
+        bool push(T value)
+        {
+            std::binary_semaphore semaphore(0);
+            Waiter waiter;
+            waiter.value.emplace(std::move(value));
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (try_send(waiter))
+                {
+                    return waiter.ok;
+                }
+                waiter.semaphore = &semaphore;
+                m_senders.push_back(&waiter);
+            }
+            semaphore.acquire();
+            // The waker releases under the lock, so once it is ours the semaphore is no longer touched
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return waiter.ok;
+        }
+
+        std::optional<T> pop()
+        {
+            std::binary_semaphore semaphore(0);
+            Waiter waiter;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!try_receive(waiter))
+                {
+                    waiter.semaphore = &semaphore;
+                    m_receivers.push_back(&waiter);
+                }
+                else
+                {
+                    return waiter.ok ? std::move(waiter.value) : std::nullopt;
+                }
+            }
+            semaphore.acquire();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return waiter.ok ? std::move(waiter.value) : std::nullopt;
+        }
+
+        // No more values; receivers still get the queued ones
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            fail_waiters();
+        }
+
+        // Queued values are dropped and every waiting or later call fails
+        void cancel()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cancelled = true;
+            m_queue.clear();
+            fail_waiters();
+        }
+
+        // Largest number of queued values seen so far
+        size_t high_water() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_high_water;
+        }
+    private:
+        // Under the lock: true when the send is done, ok tells whether the value was taken
+        bool try_send(Waiter& sender)
+        {
+            if (m_closed || m_cancelled)
+            {
+                sender.ok = false;
+                return true;
+            }
+            if (!m_receivers.empty())
+            {
+                Waiter* receiver = m_receivers.front();
+                m_receivers.pop_front();
+                receiver->value = std::move(sender.value);
+                receiver->ok = true;
+                receiver->wake();
+                sender.ok = true;
+                return true;
+            }
+            if (m_queue.size() < m_capacity)
+            {
+                m_queue.push_back(std::move(*sender.value));
+                m_high_water = std::max(m_high_water, m_queue.size());
+                sender.ok = true;
+                return true;
+            }
+            return false;
+        }
+
+        // Under the lock: true when the receive is done, ok tells whether a value was taken
+        bool try_receive(Waiter& receiver)
+        {
+            if (!m_queue.empty())
+            {
+                receiver.value = std::move(m_queue.front());
+                receiver.ok = true;
+                m_queue.pop_front();
+                if (!m_senders.empty())
+                {
+                    Waiter* sender = m_senders.front();
+                    m_senders.pop_front();
+                    m_queue.push_back(std::move(*sender->value));
+                    sender->ok = true;
+                    sender->wake();
+                }
+                return true;
+            }
+            if (m_closed || m_cancelled)
+            {
+                receiver.ok = false;
+                return true;
+            }
+            return false;
+        }
+
+        // Receivers only wait on an empty queue, so none of them misses a value
+        void fail_waiters()
+        {
+            for (auto* waiters : {&m_senders, &m_receivers})
+            {
+                for (Waiter* waiter : *waiters)
+                {
+                    waiter->ok = false;
+                    waiter->wake();
+                }
+                waiters->clear();
+            }
+        }
+
+        mutable std::mutex m_mutex;
+        std::deque<T> m_queue;
+        std::deque<Waiter*> m_senders;
+        std::deque<Waiter*> m_receivers;
+        size_t m_capacity;
+        size_t m_high_water = 0;
+        bool m_closed = false;
+        bool m_cancelled = false;
+    };
+} //namespace coro
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "../csv_parser/thread_pool_queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Minimal C++20 coroutine runtime for the pipeline stages: an executor on top of ThreadPoolQueue, a fire-and-forget
+// task type and a scope that joins the tasks, keeps the first failure and cancels the rest
+namespace coro
+{
+    // Thrown by a stage that stops because the run was cancelled from outside
+    class Cancelled : public std::exception
+    {
+    public:
+        inline const char* what() const noexcept override
+        {
+            return "Run is cancelled";
+        }
+    };
+
+    class Executor
+    {
+    public:
+        // The name labels the threads in the trace, so it must be a string literal
+        explicit Executor(uint32_t threads, const char* name = "stage")
+        {
+            m_pool.start_async(threads, name);
+        }
+
+        // A suspended coroutine continues on one of the threads
+        inline void post(std::coroutine_handle<> handle)
+        {
+            m_pool.push([handle]() { handle.resume(); });
+        }
+    private:
+        ThreadPoolQueue m_pool;
+    };
+
+    class Scope;
+
+    // Starts suspended and only runs once spawned in a scope; the frame is freed when the body ends
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            Scope* scope = nullptr;
+            Executor* executor = nullptr;
+            std::exception_ptr error;
+
+            inline Task get_return_object()
+            {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            inline std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+            struct FinalAwaiter
+            {
+                inline bool await_ready() const noexcept
+                {
+                    return false;
+                }
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+                inline void await_resume() const noexcept
+                {
+
+                }
+            };
+            inline FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+            inline void return_void() noexcept
+            {
+
+            }
+            inline void unhandled_exception() noexcept
+            {
+                error = std::current_exception();
+            }
+        };
+
+        Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {}))
+        {
+
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+        }
+    private:
+        friend class Scope;
+        explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle)
+        {
+
+        }
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    class Scope
+    {
+    public:
+        Scope() = default;
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope()
+        {
+            wait();
+        }
+
+        void spawn(Executor& executor, Task task)
+        {
+            auto handle = std::exchange(task.m_handle, {});
+            handle.promise().scope = this;
+            handle.promise().executor = &executor;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_running;
+            }
+            executor.post(handle);
+        }
+
+        // Runs once, on cancel() or the first failed task; stages cancel their channels here so blocked
+        // producers and consumers return
+        void on_cancel(std::function<void()> callback)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_on_cancel.push_back(std::move(callback));
+        }
+
+        void cancel()
+        {
+            std::vector<std::function<void()>> callbacks;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_cancelled.exchange(true))
+                {
+                    return;
+                }
+                callbacks.swap(m_on_cancel);
+            }
+            for (auto& callback : callbacks)
+            {
+                callback();
+            }
+        }
+
+        inline bool cancelled() const
+        {
+            return m_cancelled.load(std::memory_order_acquire);
+        }
+
+        // Blocks until every spawned task has ended
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_running == 0; });
+        }
+
+        // wait(), then rethrows the first failure
+        void join()
+        {
+            wait();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_error)
+            {
+                std::rethrow_exception(std::exchange(m_error, nullptr));
+            }
+        }
+    private:
+        friend struct Task::promise_type::FinalAwaiter;
+        void finished(std::exception_ptr error)
+        {
+            if (error)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_error)
+                    {
+                        m_error = error;
+                    }
+                }
+                cancel();
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_running == 0)
+            {
+                m_cv.notify_all();
+            }
+        }
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        size_t m_running = 0;
+        std::exception_ptr m_error;
+        std::vector<std::function<void()>> m_on_cancel;
+        std::atomic<bool> m_cancelled{false};
+    };
+
+    inline void Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+    {
+        // The frame goes first: once the scope hears about it, the objects the task referenced may be gone
+        Scope* scope = handle.promise().scope;
+        std::exception_ptr error = std::move(handle.promise().error);
+        handle.destroy();
+        scope->finished(std::move(error));
+    }
+} //namespace coro
@@ -0,0 +1,457 @@
+#include "median_pipeline.hpp"
+#include "../csv_parser/csv_parser.hpp"
+#include "../csv_parser/file_scheduler.hpp"
+#include "../csv_parser/compressed_input.hpp"
+#include "../out_writer/out_writer.hpp"
+#include "../out_writer/custom_serializer.hpp"
+#include "../out_writer/run_journal.hpp"
+#include "../out_writer/shard_run.hpp"
+#include "../checkpoint/checkpoint_store.hpp"
+#include "../logger/logger.hpp"
+#include "channel.hpp"
+#include "coro.hpp"
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+
+namespace
+{
+    // A checkpoint only continues the same output, and only while every file still contains the bytes it consumed
+    bool checkpoint_usable(const CheckpointStore::Checkpoint& checkpoint, const std::string& output_file, const std::vector<std::filesystem::path>& files)
+    {
+        if (checkpoint.output_file != output_file || !std::filesystem::exists(output_file))
+        {
+            spdlog::warn("Checkpoint was written for output {}, which is missing or differs from {}", checkpoint.output_file, output_file);
+            return false;
+        }
+        for (const auto& file : files)
+        {
+            auto entry = checkpoint.files.find(file.string());
+            // Offsets into a compressed file count decompressed bytes, a gzip file has no size to compare with
+            const auto size = compressed_input::content_size(file.string());
+            if (entry != checkpoint.files.end() && size && *size < entry->second.offset)
+            {
+                spdlog::warn("File {} is shorter than its checkpoint offset {}", file.string(), entry->second.offset);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct ByReceiveTs
+    {
+        static inline uint64_t key(const CsvParser::ParserData& record)
+        {
+            return record.receive_ts;
+        }
+        inline bool operator()(const CsvParser::ParserData& a, const CsvParser::ParserData& b) const
+        {
+            return a.receive_ts < b.receive_ts;
+        }
+    };
+
+    // Everything the spill runs depend on: a changed input file or setting starts the sort over
+    uint64_t job_fingerprint(const MedianPipeline::Options& options)
+    {
+        std::string description = options.output_file + ";" + std::to_string(options.max_memory) + ";" + std::to_string(options.max_threads)
+            + ";" + std::to_string(options.time_range.from_ts) + ";" + std::to_string(options.time_range.to_ts) + ";" + std::to_string(options.sorted_input);
+        for (const auto& file : options.files)
+        {
+            std::error_code ec;
+            const auto mtime = std::filesystem::last_write_time(file, ec).time_since_epoch().count();
+            description += ";" + file.string() + ";" + std::to_string(std::filesystem::file_size(file, ec)) + ";" + std::to_string(mtime);
+        }
+        return RunJournal::fingerprint(description);
+    }
+
+    using Writer = OutWriter<CsvParser::ParserData, ByReceiveTs>;
+    // Actual start of a resumed task -> its planned start, which keys the coverage
+    using TaskBegins = std::map<std::pair<std::string, uint64_t>, uint64_t>;
+
+    struct Ingest
+    {
+        uint64_t rows = 0;
+        uint64_t min_ts = std::numeric_limits<uint64_t>::max();
+    };
+
+    // Collect stage: parsed chunks go into the writer's sort buffer, full buffers are sorted into runs and queued
+    // for the spill writers, which hold this stage back once max_pending_spills runs wait
+    coro::Task collect_stage(coro::Channel<CsvParser::ReadyChunk>& chunks, Writer& writer, RunJournal* journal, const TaskBegins& task_begins,
+        const std::atomic<bool>* stop, bool track_min_ts, BufferPool<CsvParser::ParserData>& buffers, Ingest& ingest)
+    {
+        while (auto chunk = co_await chunks.receive())
+        {
+            if (stop && stop->load())
+            {
+                throw coro::Cancelled();
+            }
+            ingest.rows += chunk->data.size();
+            if (track_min_ts)
+            {
+                for (const auto& record : chunk->data)
+                {
+                    ingest.min_ts = std::min(ingest.min_ts, record.receive_ts);
+                }
+            }
+            writer.collect_data(std::move(chunk->data));
+            if (journal)
+            {
+                journal->cover(chunk->file, task_begins.at({chunk->file, chunk->task_begin}), chunk->end);
+            }
+            // The rows were copied into the sort buffer, the chunk goes back to the parser workers
+            buffers.release(std::move(chunk->data));
+        }
+    }
+
+    // Splitters for the partitioned sort: the receive_ts range of sorted inputs, otherwise rows sampled across the
+    // plain files. Left empty when neither works, the writer then takes them from the first records it gets
+    Writer::Partitioning make_partitioning(const MedianPipeline::Options& options, const std::vector<FileScheduler::Input>& inputs)
+    {
+        Writer::Partitioning res;
+        res.partitions = options.partitions != 0 ? options.partitions : std::max<uint32_t>(16, options.max_threads * 4);
+        const auto& window = options.time_range;
+        if (options.sorted_input)
+        {
+            uint64_t first = std::numeric_limits<uint64_t>::max();
+            uint64_t last = 0;
+            for (const auto& input : inputs)
+            {
+                if (auto bounds = FileScheduler::sorted_bounds(input.file))
+                {
+                    first = std::min(first, bounds->first);
+                    last = std::max(last, bounds->second);
+                }
+            }
+            first = std::max(first, window.from_ts);
+            last = std::min(last, window.to_ts);
+            if (first < last)
+            {
+                res.key_range = std::make_pair(first, last);
+                return res;
+            }
+        }
+        for (uint64_t ts : FileScheduler::sample_ts(inputs, static_cast<size_t>(res.partitions) * 32))
+        {
+            if (window.contains(ts))
+            {
+                res.sample.push_back(ts);
+            }
+        }
+        return res;
+    }
+
+    // Last stage: merge the runs, compute the median and format it
+    coro::Task finish_stage(Writer& writer, const std::string& output_file)
+    {
+        writer.write_data(output_file);
+        co_return;
+    }
+} //anonymous namespace
+
+MedianPipeline::MedianPipeline(Options options) : m_options(std::move(options))
+{
+
+}
+
+bool MedianPipeline::run()
+{
+    ByReceiveTs comp;
+
+    const auto& files = m_options.files;
+    const auto& output_file = m_options.output_file;
+    const auto& checkpoint_path = m_options.checkpoint_file;
+    const bool incremental = m_options.incremental;
+
+    if (m_options.shard_run)
+    {
+        if (incremental)
+        {
+            spdlog::error("Incremental mode cannot run as a shard worker");
+            return false;
+        }
+        std::error_code ec;
+        std::filesystem::remove(shard_run::summary_path(output_file), ec);
+    }
+
+    if (m_options.book && incremental)
+    {
+        spdlog::error("Book reconstruction cannot run incrementally, the book state is not checkpointed");
+        return false;
+    }
+
+    std::shared_ptr<RunJournal> journal;
+    std::optional<RunJournal::Manifest> recovered;
+    if (m_options.resumable && incremental)
+    {
+        spdlog::warn("Resumable sort is ignored in incremental mode, the checkpoint already resumes it");
+    }
+    else if (m_options.resumable && m_options.book)
+    {
+        spdlog::warn("Resumable sort is ignored with book reconstruction, a file cannot continue without its book");
+    }
+    else if (m_options.resumable)
+    {
+        try
+        {
+            journal = std::make_shared<RunJournal>(std::filesystem::path(output_file + ".spill"), job_fingerprint(m_options));
+            recovered = journal->recover();
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while opening spill directory: {}", err.what());
+            return false;
+        }
+        if (recovered)
+        {
+            spdlog::info("Adopting {} spill runs{}", recovered->runs.size(), recovered->merged.empty() ? "" : " already merged");
+        }
+    }
+
+    if (m_options.partitioned_sort && journal)
+    {
+        spdlog::warn("Partitioned sort is ignored in a resumable run, its spill runs are sorted runs");
+    }
+
+    std::optional<CheckpointStore::Checkpoint> checkpoint;
+    if (incremental)
+    {
+        try
+        {
+            checkpoint = CheckpointStore::load(checkpoint_path);
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::warn("Ignoring checkpoint {}: {}", checkpoint_path.string(), err.what());
+        }
+        if (checkpoint && !checkpoint_usable(*checkpoint, output_file, files))
+        {
+            checkpoint.reset();
+        }
+        if (checkpoint)
+        {
+            spdlog::info("Resuming from checkpoint {}", checkpoint_path.string());
+        }
+        else
+        {
+            spdlog::info("No usable checkpoint {}, full run", checkpoint_path.string());
+        }
+    }
+
+    // Runs the collect and finish stages; parsing and spills have their own worker pools
+    std::optional<coro::Executor> own_executor;
+    coro::Executor& executor = m_options.executor ? *m_options.executor : own_executor.emplace(1, "stage");
+    auto buffers = m_options.buffers ? m_options.buffers : std::make_shared<BufferPool<CsvParser::ParserData>>(
+        BufferPool<CsvParser::ParserData>::idle_budget(m_options.max_memory));
+    const uint32_t spill_threads = m_options.spill_threads != 0 ? m_options.spill_threads : m_options.max_threads;
+    while (true)
+    {
+        const bool resume = checkpoint.has_value();
+        auto parser = std::make_unique<CsvParser>(m_options.max_memory, m_options.max_threads, m_options.queue_depth);
+        parser->set_complete_lines_only(incremental);
+        parser->set_time_range(m_options.time_range, m_options.sorted_input);
+        if (m_options.book)
+        {
+            parser->set_book(*m_options.book);
+        }
+        parser->set_buffer_pool(buffers);
+        if (!m_options.reject_file.empty())
+        {
+            try
+            {
+                parser->set_reject_writer(std::make_shared<RejectWriter>(m_options.reject_file));
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Error while opening reject file: {}", err.what());
+                return false;
+            }
+        }
+
+        auto algo = std::make_shared<MedianAlgorithm>(m_options.median_mode, m_options.max_threads, m_options.format);
+        if (incremental)
+        {
+            algo->enable_state_tracking(resume ? checkpoint->median : MedianState{});
+        }
+        std::shared_ptr<IAlgorithm<CsvParser::ParserData>> sink = algo;
+        if (m_options.shard_run)
+        {
+            sink = std::make_shared<shard_run::Algorithm>();
+        }
+        auto ser = std::make_shared<ParserDataSerializer>();
+
+        auto out_writer = std::make_unique<Writer>(parser->get_max_elements(), ser, sink, comp, spill_threads);
+        out_writer->set_max_pending_spills(m_options.max_pending_spills);
+        out_writer->set_buffer_pool(buffers);
+        if (journal)
+        {
+            out_writer->set_run_journal(journal);
+            if (recovered)
+            {
+                out_writer->adopt(*recovered);
+            }
+        }
+        std::vector<FileScheduler::Input> inputs;
+        for (const auto& data : files)
+        {
+            uint64_t offset = 0;
+            if (resume)
+            {
+                auto entry = checkpoint->files.find(data.string());
+                offset = entry != checkpoint->files.end() ? entry->second.offset : 0;
+            }
+            FileScheduler::Input input{data.string(), offset};
+            // The book needs every update before the window too
+            if (m_options.sorted_input && m_options.time_range.bounded() && !m_options.book)
+            {
+                input = FileScheduler::seek_time_range(input, m_options.time_range.from_ts, m_options.time_range.to_ts);
+            }
+            inputs.push_back(std::move(input));
+        }
+        if (m_options.partitioned_sort && !journal)
+        {
+            out_writer->set_partitioning(make_partitioning(m_options, inputs));
+        }
+        TaskBegins task_begins;
+        const bool merged = recovered && !recovered->merged.empty();
+        // A book is rebuilt from the start of its file, so book inputs are never split
+        const uint64_t min_split = m_options.book ? std::numeric_limits<uint64_t>::max() : FileScheduler::default_min_split;
+        for (const auto& task : merged ? std::vector<FileScheduler::Task>() : FileScheduler::plan(inputs, m_options.max_threads, min_split))
+        {
+            uint64_t begin = task.begin;
+            if (recovered)
+            {
+                auto covered = recovered->coverage.find({task.file, task.begin});
+                if (covered != recovered->coverage.end() && covered->second > begin)
+                {
+                    begin = covered->second;
+                }
+                const uint64_t size = compressed_input::content_size(task.file).value_or(std::numeric_limits<uint64_t>::max());
+                if (begin >= std::min(task.end, size))
+                {
+                    SPDLOG_DEBUG("Task {} from offset {} is already in the spill runs", task.file, task.begin);
+                    continue;
+                }
+            }
+            task_begins[{task.file, begin}] = task.begin;
+            parser->add_file_to_parse(task.file, begin, task.end);
+            spdlog::info("Added file to parse {} from offset {}, {} bytes", task.file, begin, task.bytes - std::min(task.bytes, begin - task.begin));
+        }
+        parser->wait_task_done();
+
+        Ingest ingest;
+        try
+        {
+            coro::Scope scope;
+            scope.on_cancel([&parser]() { parser->cancel(); });
+            scope.spawn(executor, collect_stage(parser->ready_chunks(), *out_writer, journal.get(), task_begins, m_options.stop, resume, *buffers, ingest));
+            scope.join();
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Ingest stopped: {}", err.what());
+            return false;
+        }
+        if (parser->failed())
+        {
+            spdlog::error("Input was not read completely, no output is written");
+            return false;
+        }
+        const uint64_t rows = ingest.rows;
+        const uint64_t min_ts = ingest.min_ts;
+
+        if (resume && rows != 0 && min_ts < checkpoint->watermark)
+        {
+            spdlog::warn("New data at {} is older than checkpoint watermark {}, recomputing from scratch", min_ts, checkpoint->watermark);
+            checkpoint.reset();
+            continue;
+        }
+
+        if (m_options.shard_run && rows == 0)
+        {
+            // The coordinator expects a run from every shard, even an empty one
+            try
+            {
+                shard_run::Writer(output_file).finish();
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Error while writing shard run: {}", err.what());
+                return false;
+            }
+        }
+        else if (rows != 0 || !resume)
+        {
+            try
+            {
+                coro::Scope scope;
+                scope.spawn(executor, finish_stage(*out_writer, output_file));
+                scope.join();
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Median stage stopped: {}", err.what());
+                return false;
+            }
+        }
+        else
+        {
+            spdlog::info("No new rows since the last checkpoint");
+        }
+
+        if (m_options.shard_run && !std::filesystem::exists(shard_run::summary_path(output_file)))
+        {
+            spdlog::error("Shard run {} was not written", output_file);
+            return false;
+        }
+        if (!incremental)
+        {
+            return true;
+        }
+        if (rows != 0 && !algo->final_state())
+        {
+            spdlog::error("Median was not computed, checkpoint {} is not updated", checkpoint_path.string());
+            return false;
+        }
+
+        CheckpointStore::Checkpoint next;
+        next.output_file = output_file;
+        if (resume)
+        {
+            next.watermark = checkpoint->watermark;
+            next.median = checkpoint->median;
+            for (const auto& file : files)
+            {
+                auto entry = checkpoint->files.find(file.string());
+                if (entry != checkpoint->files.end())
+                {
+                    next.files.insert(*entry);
+                }
+            }
+        }
+        for (const auto& [file, progress] : parser->get_file_progress())
+        {
+            auto& entry = next.files[file];
+            entry.offset = progress.offset;
+            entry.last_ts = std::max(entry.last_ts, progress.last_ts);
+            next.watermark = std::max(next.watermark, progress.last_ts);
+        }
+        if (rows != 0)
+        {
+            next.median = *algo->final_state();
+        }
+
+        try
+        {
+            CheckpointStore::save(checkpoint_path, next);
+            spdlog::info("Checkpoint saved to {}", checkpoint_path.string());
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while saving checkpoint: {}", err.what());
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../out_writer/algorithm_median.hpp"
+#include "../out_writer/output_sink.hpp"
+#include "../csv_parser/csv_parser.hpp"
+#include "../system/buffer_pool.hpp"
+#include "coro.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Batch run over a set of CSV files: parse, sort in memory or spill and merge, compute the median and,
+// in incremental mode, continue from and update the checkpoint
+class MedianPipeline
+{
+public:
+    struct Options
+    {
+        std::vector<std::filesystem::path> files;
+        std::string output_file;
+        OutputFormat format = OutputFormat::csv;
+        uint64_t max_memory = 524288000;
+        uint32_t max_threads = 4;
+        MedianAlgorithm::Mode median_mode = MedianAlgorithm::Mode::heaps;
+        bool incremental = false;
+        std::filesystem::path checkpoint_file;
+        // Empty keeps rejected rows in the log
+        std::string reject_file;
+        CsvParser::TimeRange time_range;
+        // Files ordered by receive_ts are narrowed to the window by binary search instead of being scanned
+        bool sorted_input = false;
+        // Inputs are level.csv book updates and the median is taken over the mid-price or microprice of the
+        // rebuilt book after every event. Each file is parsed whole by one task; not for incremental runs
+        std::optional<BookBuilder::Options> book;
+        // File-mode spill runs are listed in <output>.spill/manifest.bin, so a rerun after a crash with the same
+        // inputs and settings keeps them and parses only the rows they do not hold
+        bool resumable = false;
+        // Stages: parse on max_threads workers, collect into sorted runs, write spills on spill_threads, then merge,
+        // median and format. Parsed chunks waiting for the collect stage, 0 for one per parse thread
+        uint32_t queue_depth = 0;
+        // 0 for max_threads
+        uint32_t spill_threads = 0;
+        // Sorted runs waiting for a spill writer before the collect stage, and so the parser, is held back
+        uint32_t max_pending_spills = 2;
+        // Records go to receive_ts ranges as they arrive, each range is sorted on its own and the ranges are read in
+        // order, instead of sorting runs and merging them. Splitters come from the bounds of sorted inputs or from
+        // rows sampled across the files. Not for resumable runs
+        bool partitioned_sort = false;
+        // Ranges to start with, 0 for max(16, 4 * max_threads)
+        uint32_t partitions = 0;
+        // Set e.g. by a signal handler to cancel the run at the next parsed chunk
+        const std::atomic<bool>* stop = nullptr;
+        // Worker of a sharded run (see ShardCoordinator): output_file gets the sorted rows as a shard run and its
+        // summary instead of the median
+        bool shard_run = false;
+        // Shared by the jobs of a batch (see BatchRunner): record buffers, and the threads running the collect and
+        // finish stages. Left empty, the run makes its own
+        std::shared_ptr<BufferPool<CsvParser::ParserData>> buffers;
+        coro::Executor* executor = nullptr;
+    };
+
+    explicit MedianPipeline(Options options);
+    // False when the run failed, the reason is logged
+    bool run();
+private:
+    Options m_options;
+};
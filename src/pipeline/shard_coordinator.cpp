@@ -0,0 +1,262 @@
+#include "shard_coordinator.hpp"
+#include "../csv_parser/file_scheduler.hpp"
+#include "../out_writer/shard_run.hpp"
+#include "../logger/logger.hpp"
+#include "../trace/trace.hpp"
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+
+extern char** environ;
+
+namespace
+{
+    std::vector<ShardCoordinator::Shard> plan_files(const std::vector<std::filesystem::path>& files, uint32_t workers, const CsvParser::TimeRange& time_range)
+    {
+        std::vector<std::pair<uint64_t, size_t>> sizes;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            std::error_code ec;
+            const uint64_t size = std::filesystem::file_size(files[i], ec);
+            sizes.emplace_back(ec ? 0 : size, i);
+        }
+        // Largest first into the lightest shard; ties by position keep the plan stable
+        std::sort(sizes.begin(), sizes.end(), [](const auto& a, const auto& b)
+        {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        const size_t count = std::min<size_t>(workers, files.size());
+        std::vector<ShardCoordinator::Shard> shards(count);
+        std::vector<uint64_t> load(count, 0);
+        std::vector<std::vector<size_t>> members(count);
+        for (const auto& [size, index] : sizes)
+        {
+            const size_t lightest = std::min_element(load.begin(), load.end()) - load.begin();
+            load[lightest] += size;
+            members[lightest].push_back(index);
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::sort(members[i].begin(), members[i].end());
+            for (size_t index : members[i])
+            {
+                shards[i].files.push_back(files[index]);
+            }
+            shards[i].time_range = time_range;
+        }
+        return shards;
+    }
+
+    std::string by_name(ShardCoordinator::By by)
+    {
+        return by == ShardCoordinator::By::time ? "time" : "files";
+    }
+} //anonymous namespace
+
+std::vector<ShardCoordinator::Shard> ShardCoordinator::plan(const std::vector<std::filesystem::path>& files, uint32_t workers, By by,
+    const CsvParser::TimeRange& time_range, bool sorted_input)
+{
+    workers = std::max<uint32_t>(workers, 1);
+    if (by == By::files || files.empty())
+    {
+        return plan_files(files, workers, time_range);
+    }
+
+    uint64_t lo = time_range.from_ts;
+    uint64_t hi = time_range.to_ts;
+    if (time_range.from_ts == 0 || time_range.to_ts == std::numeric_limits<uint64_t>::max())
+    {
+        if (!sorted_input)
+        {
+            spdlog::warn("Splitting by time needs a bounded time window or sorted input, splitting by files");
+            return plan_files(files, workers, time_range);
+        }
+        uint64_t first = std::numeric_limits<uint64_t>::max();
+        uint64_t last = 0;
+        for (const auto& file : files)
+        {
+            if (auto bounds = FileScheduler::sorted_bounds(file.string()))
+            {
+                first = std::min(first, bounds->first);
+                last = std::max(last, bounds->second);
+            }
+        }
+        lo = std::max(lo, first);
+        hi = last < std::numeric_limits<uint64_t>::max() ? std::min(hi, last + 1) : hi;
+    }
+    if (lo >= hi)
+    {
+        return plan_files(files, 1, time_range);
+    }
+
+    const uint64_t span = hi - lo;
+    const uint64_t count = std::min<uint64_t>(workers, span);
+    std::vector<Shard> shards(count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        shards[i].files = files;
+        shards[i].time_range.from_ts = lo + span / count * i + std::min(i, span % count);
+        shards[i].time_range.to_ts = lo + span / count * (i + 1) + std::min(i + 1, span % count);
+    }
+    // Rows outside the bounds found in the sorted files still belong to the first and the last shard
+    shards.front().time_range.from_ts = time_range.from_ts;
+    shards.back().time_range.to_ts = time_range.to_ts;
+    return shards;
+}
+
+std::filesystem::path ShardCoordinator::run_path(const std::filesystem::path& shard_dir, uint32_t index)
+{
+    return shard_dir / ("shard" + std::to_string(index) + ".run");
+}
+
+bool ShardCoordinator::merge(const std::filesystem::path& shard_dir, uint32_t shard_count, const std::string& output_file,
+    MedianAlgorithm::Mode median_mode, uint32_t max_threads, OutputFormat format)
+{
+    trace::ScopedEvent event("shard merge");
+    try
+    {
+        shard_run::Summary total;
+        std::vector<std::unique_ptr<shard_run::Reader>> readers;
+        for (uint32_t i = 0; i < shard_count; ++i)
+        {
+            const auto run = run_path(shard_dir, i);
+            const auto summary = shard_run::load(shard_run::summary_path(run));
+            total.merge(summary);
+            readers.push_back(std::make_unique<shard_run::Reader>(run, summary.count));
+        }
+        shard_run::Merge cursor(std::move(readers));
+        {
+            // The sink flushes when the algorithm goes away
+            MedianAlgorithm algo(median_mode, max_threads, format);
+            algo.process_sorted(cursor, output_file);
+        }
+        if (total.count != 0)
+        {
+            spdlog::info("Merged {} shard runs, {} rows from {} to {}, final median {}", shard_count, total.count, total.min_ts, total.max_ts, total.median());
+        }
+        else
+        {
+            spdlog::info("Merged {} shard runs without rows", shard_count);
+        }
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while merging shard runs: {}", err.what());
+        return false;
+    }
+    return true;
+}
+
+ShardCoordinator::ShardCoordinator(Options options) : m_options(std::move(options))
+{
+
+}
+
+bool ShardCoordinator::run()
+{
+    const auto shards = plan(m_options.files, m_options.workers, m_options.by, m_options.time_range, m_options.sorted_input);
+    const uint32_t shard_count = static_cast<uint32_t>(shards.size());
+    const uint64_t worker_memory = std::max<uint64_t>(m_options.max_memory / std::max<uint32_t>(shard_count, 1), 1);
+    const uint32_t worker_threads = std::max<uint32_t>(m_options.max_threads / std::max<uint32_t>(shard_count, 1), 1);
+    try
+    {
+        std::filesystem::remove_all(m_options.shard_dir);
+        std::filesystem::create_directories(m_options.shard_dir);
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while preparing shard directory: {}", err.what());
+        return false;
+    }
+
+    std::vector<pid_t> pids;
+    bool ok = true;
+    for (uint32_t i = 0; i < shard_count; ++i)
+    {
+        std::vector<std::string> args = m_options.worker_command;
+        args.insert(args.end(), {"--shard-index", std::to_string(i), "--shard-count", std::to_string(m_options.workers),
+            "--shard-by", by_name(m_options.by), "--shard-dir", m_options.shard_dir.string(),
+            "--max-memory", std::to_string(worker_memory), "--max-thread", std::to_string(worker_threads)});
+        std::vector<char*> argv;
+        for (auto& arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+        pid_t pid = 0;
+        const int err = ::posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+        if (err != 0)
+        {
+            spdlog::error("Cannot start worker for shard {}: {}", i, std::strerror(err));
+            ok = false;
+            break;
+        }
+        spdlog::info("Shard {} worker {} started: {} files, receive_ts [{}, {})", i, pid, shards[i].files.size(),
+            shards[i].time_range.from_ts, shards[i].time_range.to_ts);
+        pids.push_back(pid);
+    }
+
+    // Polled, so a stop request reaches the workers while they run
+    bool signalled = false;
+    std::vector<bool> done(pids.size(), false);
+    size_t running = pids.size();
+    while (running != 0)
+    {
+        if (!signalled && (!ok || (m_options.stop && m_options.stop->load())))
+        {
+            for (size_t i = 0; i < pids.size(); ++i)
+            {
+                if (!done[i])
+                {
+                    ::kill(pids[i], SIGTERM);
+                }
+            }
+            signalled = true;
+        }
+        bool reaped = false;
+        for (size_t i = 0; i < pids.size(); ++i)
+        {
+            int status = 0;
+            if (done[i] || ::waitpid(pids[i], &status, WNOHANG) == 0)
+            {
+                continue;
+            }
+            done[i] = true;
+            --running;
+            reaped = true;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                spdlog::error("Shard {} worker {} failed with status {}", i, pids[i], status);
+                ok = false;
+            }
+        }
+        if (!reaped && running != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    if (m_options.stop && m_options.stop->load())
+    {
+        spdlog::error("Sharded run is stopped");
+        ok = false;
+    }
+
+    if (ok)
+    {
+        ok = merge(m_options.shard_dir, shard_count, m_options.output_file, m_options.median_mode, m_options.max_threads, m_options.format);
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(m_options.shard_dir, ec);
+    return ok;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../out_writer/algorithm_median.hpp"
+#include "../out_writer/output_sink.hpp"
+#include "../csv_parser/csv_parser.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Multi-process batch run: the input is split into shards, one worker process per shard sorts its rows into a run
+// in a shared directory (see shard_run), and the coordinator merges the runs into the running median output
+class ShardCoordinator
+{
+public:
+    enum class By
+    {
+        // Whole files, balanced by size
+        files,
+        // Equal receive_ts windows over every file
+        time
+    };
+
+    struct Shard
+    {
+        std::vector<std::filesystem::path> files;
+        CsvParser::TimeRange time_range;
+    };
+
+    // Deterministic, so the coordinator and every worker compute the same shards from the same inputs. Splitting
+    // by time needs a bounded window or sorted input to find the bounds, otherwise the files are split
+    static std::vector<Shard> plan(const std::vector<std::filesystem::path>& files, uint32_t workers, By by,
+        const CsvParser::TimeRange& time_range, bool sorted_input);
+    static std::filesystem::path run_path(const std::filesystem::path& shard_dir, uint32_t index);
+
+    // Merges the runs of shards 0..shard_count-1 into the median output; false when a run is missing or damaged
+    static bool merge(const std::filesystem::path& shard_dir, uint32_t shard_count, const std::string& output_file,
+        MedianAlgorithm::Mode median_mode, uint32_t max_threads, OutputFormat format);
+
+    struct Options
+    {
+        // Program and arguments of a worker; the shard flags, --max-memory and --max-thread are added per worker
+        std::vector<std::string> worker_command;
+        std::vector<std::filesystem::path> files;
+        uint32_t workers = 2;
+        By by = By::files;
+        CsvParser::TimeRange time_range;
+        bool sorted_input = false;
+        std::filesystem::path shard_dir;
+        std::string output_file;
+        OutputFormat format = OutputFormat::csv;
+        MedianAlgorithm::Mode median_mode = MedianAlgorithm::Mode::heaps;
+        // Divided between the workers
+        uint64_t max_memory = 524288000;
+        uint32_t max_threads = 4;
+        // Set e.g. by a signal handler, the workers get SIGTERM
+        const std::atomic<bool>* stop = nullptr;
+    };
+
+    explicit ShardCoordinator(Options options);
+    // Starts the workers, waits for all of them and merges their runs; false when a worker or the merge failed
+    bool run();
+private:
+    Options m_options;
+};
@@ -0,0 +1,39 @@
+#include "median_stream.hpp"
+
+MedianStream::MedianStream() : MedianStream(Options{})
+{
+
+}
+
+MedianStream::MedianStream(Options options, const MedianState& state) : m_options(options), m_last_median(state.last_median), m_has_median(state.has_median)
+{
+    m_median.assign(state.histogram);
+    m_median.reserve(m_median.size() + m_options.expected_ticks);
+}
+
+std::span<const MedianStream::Change> MedianStream::push(std::span<const CsvParser::ParserData> ticks)
+{
+    m_changes.clear();
+    if (m_changes.capacity() < ticks.size())
+    {
+        m_changes.reserve(ticks.size());
+    }
+    for (const auto& tick : ticks)
+    {
+        if (push(tick.receive_ts, tick.price))
+        {
+            m_changes.push_back(Change{tick.receive_ts, m_last_median});
+        }
+    }
+    return m_changes;
+}
+
+void MedianStream::reserve(size_t ticks)
+{
+    m_median.reserve(ticks);
+}
+
+MedianState MedianStream::state() const
+{
+    return MedianState{m_median.histogram(), m_median.size(), m_has_median, m_last_median};
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../csv_parser/csv_parser.hpp"
+#include "../out_writer/median_state.hpp"
+#include "../out_writer/running_median.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Exact running median fed one tick at a time, for embedding in a feed handler. A change is reported when
+// the median moves by more than eps, like the output file rows. Heaps are reserved for expected_ticks up front,
+// so push allocates nothing until the stream grows past capacity(), and then only by doubling
+class MedianStream
+{
+public:
+    struct Options
+    {
+        size_t expected_ticks = 1 << 20;
+        double eps = 1e-8;
+    };
+
+    struct Change
+    {
+        uint64_t receive_ts;
+        double median;
+    };
+
+    MedianStream();
+    // Continues from a saved state, e.g. a checkpoint
+    explicit MedianStream(Options options, const MedianState& state = {});
+
+    // True when the median changed, the new value is median()
+    inline bool push(uint64_t receive_ts, double price)
+    {
+        const double current = m_median.push(price);
+        if (m_has_median && std::fabs(current - m_last_median) <= m_options.eps)
+        {
+            return false;
+        }
+        m_last_median = current;
+        m_last_ts = receive_ts;
+        m_has_median = true;
+        return true;
+    }
+
+    template<typename OnChange>
+    inline void push(uint64_t receive_ts, double price, OnChange&& on_change)
+    {
+        if (push(receive_ts, price))
+        {
+            on_change(Change{receive_ts, m_last_median});
+        }
+    }
+
+    // Changes caused by the batch, valid until the next batch; the buffer only grows for a batch larger than any before
+    std::span<const Change> push(std::span<const CsvParser::ParserData> ticks);
+
+    // Last reported median
+    inline double median() const
+    {
+        return m_last_median;
+    }
+    inline bool has_median() const
+    {
+        return m_has_median;
+    }
+    inline uint64_t last_change_ts() const
+    {
+        return m_last_ts;
+    }
+    inline uint64_t size() const
+    {
+        return m_median.size();
+    }
+    inline size_t capacity() const
+    {
+        return m_median.capacity();
+    }
+    void reserve(size_t ticks);
+    // Allocates, meant for checkpoints rather than the tick path
+    MedianState state() const;
+private:
+    Options m_options;
+    RunningMedian m_median;
+    std::vector<Change> m_changes;
+    double m_last_median = 0.0;
+    uint64_t m_last_ts = 0;
+    bool m_has_median = false;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../metrics/metrics.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Reserved record buffers handed back by their last user and lent out again, so the sort buffer and the parser
+// chunks of the next spill or the next job reuse memory whose pages are already faulted in instead of mapping it
+// afresh. Shared between threads and between the jobs of a batch
+template<typename T>
+class BufferPool
+{
+public:
+    // A buffer is lent for a request at most this many times smaller than its capacity, so a small chunk does not
+    // take a whole sort buffer and leave the next sort buffer to be reserved on top of the budget
+    inline static constexpr size_t max_slack = 2;
+
+    // Idle bytes kept for a run or a batch with this memory budget; the rest of the budget is for buffers in use
+    static constexpr size_t idle_budget(size_t max_memory)
+    {
+        return max_memory / 4;
+    }
+
+    // Idle buffers beyond max_idle_bytes are freed on release
+    explicit BufferPool(size_t max_idle_bytes) : m_max_idle_bytes(max_idle_bytes)
+    {
+
+    }
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Empty buffer with room for at least capacity records: the smallest idle one that fits within max_slack, or a
+    // new reservation
+    std::vector<T> acquire(size_t capacity)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t best = m_idle.size();
+            for (size_t i = 0; i < m_idle.size(); ++i)
+            {
+                const size_t idle = m_idle[i].capacity();
+                if (idle >= capacity && idle / max_slack <= capacity && (best == m_idle.size() || m_idle[i].capacity() < m_idle[best].capacity()))
+                {
+                    best = i;
+                }
+            }
+            if (best != m_idle.size())
+            {
+                std::vector<T> buffer = std::move(m_idle[best]);
+                m_idle[best] = std::move(m_idle.back());
+                m_idle.pop_back();
+                m_idle_bytes -= buffer.capacity() * sizeof(T);
+                metrics::count("csv_parser_buffer_reuses_total");
+                return buffer;
+            }
+        }
+        std::vector<T> buffer;
+        buffer.reserve(capacity);
+        return buffer;
+    }
+
+    void release(std::vector<T>&& buffer)
+    {
+        buffer.clear();
+        const size_t bytes = buffer.capacity() * sizeof(T);
+        if (bytes == 0)
+        {
+            return;
+        }
+        std::vector<T> dropped;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle_bytes + bytes > m_max_idle_bytes)
+        {
+            // Freed outside the pool, after the lock
+            dropped = std::move(buffer);
+            return;
+        }
+        m_idle_bytes += bytes;
+        m_idle.push_back(std::move(buffer));
+    }
+
+    size_t idle_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_idle_bytes;
+    }
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::vector<T>> m_idle;
+    size_t m_idle_bytes = 0;
+    size_t m_max_idle_bytes;
+};
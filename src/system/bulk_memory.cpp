@@ -0,0 +1,83 @@
+#include "bulk_memory.hpp"
+#include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+namespace
+{
+    constexpr uintptr_t huge_page_size = 2 << 20;
+    // Populated per madvise call, so a stop request is seen quickly
+    constexpr size_t prefault_step = 64 << 20;
+
+    std::atomic<bool> huge_pages_option {true};
+    std::atomic<bool> prefault_option {false};
+} //anonymous namespace
+
+namespace bulk_memory
+{
+    void configure(const Options& options)
+    {
+        huge_pages_option.store(options.huge_pages, std::memory_order_relaxed);
+        prefault_option.store(options.prefault, std::memory_order_relaxed);
+    }
+
+    Options options()
+    {
+        return Options{huge_pages_option.load(std::memory_order_relaxed), prefault_option.load(std::memory_order_relaxed)};
+    }
+
+    size_t advise_huge_pages(void* data, size_t bytes)
+    {
+        const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + huge_page_size - 1) & ~(huge_page_size - 1);
+        const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(huge_page_size - 1);
+        if (!data || end <= begin)
+        {
+            return 0;
+        }
+        if (::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE) != 0)
+        {
+            SPDLOG_DEBUG("madvise(MADV_HUGEPAGE) failed: {}", std::strerror(errno));
+            return 0;
+        }
+        metrics::count("csv_parser_huge_page_advised_bytes_total", static_cast<double>(end - begin));
+        return end - begin;
+    }
+
+    std::jthread prefault(void* data, size_t bytes)
+    {
+        const uintptr_t page = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+        const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) & ~(page - 1);
+        const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(page - 1);
+        if (!data || end <= begin)
+        {
+            return {};
+        }
+        return std::jthread([begin, end](std::stop_token stop)
+        {
+            metrics::ScopedTimer timer("csv_parser_prefault_seconds_total");
+            for (uintptr_t pos = begin; pos < end && !stop.stop_requested(); pos += prefault_step)
+            {
+                const size_t len = std::min<uintptr_t>(prefault_step, end - pos);
+                if (::madvise(reinterpret_cast<void*>(pos), len, MADV_POPULATE_WRITE) != 0)
+                {
+                    // EINVAL before Linux 5.14, ENOMEM once the owner has freed the buffer
+                    SPDLOG_DEBUG("madvise(MADV_POPULATE_WRITE) stopped: {}", std::strerror(errno));
+                    return;
+                }
+                metrics::count("csv_parser_prefaulted_bytes_total", static_cast<double>(len));
+            }
+        });
+    }
+} //namespace bulk_memory
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Page placement for the bulk record buffers: the OutWriter buffer and the parser chunks. Buffers of this size are
+// served by mmap, so the advice is applied to the existing allocation and the vectors keep the default allocator
+namespace bulk_memory
+{
+    struct Options
+    {
+        // Ask for transparent huge pages (madvise) on the 2 MB aligned part of a buffer
+        bool huge_pages = true;
+        // Fault the pages of the OutWriter buffer in on a background thread before ingest reaches them
+        bool prefault = false;
+    };
+
+    // Process wide, set once at start-up before any buffer is reserved
+    void configure(const Options& options);
+    Options options();
+
+    // Bytes advised, 0 when the buffer has no aligned huge page or madvise failed
+    size_t advise_huge_pages(void* data, size_t bytes);
+
+    // Populates the page tables of the range with MADV_POPULATE_WRITE, which never modifies the contents and may run
+    // while the owner writes. Stopping or destroying the thread ends it after the current step
+    std::jthread prefault(void* data, size_t bytes);
+
+    // Applies the options to the reserved capacity of a buffer. The thread must be stopped before the buffer is
+    // reallocated or freed
+    template<typename T>
+    std::jthread prepare(std::vector<T>& buffer)
+    {
+        const Options current = options();
+        if (current.huge_pages)
+        {
+            advise_huge_pages(buffer.data(), buffer.capacity() * sizeof(T));
+        }
+        if (current.prefault)
+        {
+            return prefault(buffer.data(), buffer.capacity() * sizeof(T));
+        }
+        return {};
+    }
+} //namespace bulk_memory
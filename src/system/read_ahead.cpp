@@ -0,0 +1,504 @@
+#include "read_ahead.hpp"
+#include "../csv_parser/thread_pool_queue.hpp"
+#include "../logger/logger.hpp"
+#include "../metrics/metrics.hpp"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    constexpr size_t min_block_size = 4096;
+
+    std::atomic<int> backend_option {static_cast<int>(read_ahead::Backend::automatic)};
+    std::atomic<uint32_t> depth_option {4};
+    std::atomic<size_t> block_size_option {1 << 20};
+    std::atomic<uint32_t> io_threads_option {2};
+    // Set once io_uring turned out to be missing or forbidden, so later files go straight to the pool
+    std::atomic<bool> uring_unavailable {false};
+
+    ThreadPoolQueue& io_pool()
+    {
+        static ThreadPoolQueue pool;
+        static std::once_flag started;
+        std::call_once(started, []
+        {
+            pool.start_async(std::max<uint32_t>(1, io_threads_option.load(std::memory_order_relaxed)), "io");
+        });
+        return pool;
+    }
+
+    // Reads until size bytes are in or the file ends; errno of the failed pread, 0 otherwise
+    int pread_fully(int fd, char* data, size_t size, uint64_t offset, size_t& done)
+    {
+        while (done < size)
+        {
+            const ssize_t res = ::pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (res < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno;
+            }
+            if (res == 0)
+            {
+                break;
+            }
+            done += static_cast<size_t>(res);
+        }
+        return 0;
+    }
+
+    template<typename T>
+    inline T* ring_field(void* base, uint32_t offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+} //anonymous namespace
+
+namespace read_ahead
+{
+    // One io_uring per file, set up with raw system calls: a submission queue entry per block read and a wait on the
+    // completion queue when the caller reaches a block that is not in yet
+    class File::Ring
+    {
+    public:
+        // nullptr when the kernel refuses a ring
+        static std::unique_ptr<Ring> create(unsigned entries)
+        {
+            io_uring_params params {};
+            const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0)
+            {
+                const int err = errno;
+                // Missing or disabled by a seccomp filter or kernel.io_uring_disabled, not worth asking again
+                if ((err == ENOSYS || err == EPERM || err == EACCES) && !uring_unavailable.exchange(true))
+                {
+                    spdlog::info("io_uring is unavailable ({}), reading ahead with pread threads", std::strerror(err));
+                }
+                SPDLOG_DEBUG("io_uring_setup failed: {}", std::strerror(err));
+                return nullptr;
+            }
+            std::unique_ptr<Ring> ring(new Ring());
+            ring->m_fd = fd;
+            ring->m_sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            ring->m_cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap)
+            {
+                ring->m_sq_bytes = ring->m_cq_bytes = std::max(ring->m_sq_bytes, ring->m_cq_bytes);
+            }
+            ring->m_sq = map(fd, ring->m_sq_bytes, IORING_OFF_SQ_RING);
+            ring->m_cq = single_mmap ? ring->m_sq : map(fd, ring->m_cq_bytes, IORING_OFF_CQ_RING);
+            ring->m_sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+            ring->m_sqes = static_cast<io_uring_sqe*>(map(fd, ring->m_sqes_bytes, IORING_OFF_SQES));
+            if (!ring->m_sq || !ring->m_cq || !ring->m_sqes)
+            {
+                SPDLOG_DEBUG("io_uring mmap failed: {}", std::strerror(errno));
+                return nullptr;
+            }
+            ring->m_sq_tail = ring_field<unsigned>(ring->m_sq, params.sq_off.tail);
+            ring->m_sq_mask = *ring_field<unsigned>(ring->m_sq, params.sq_off.ring_mask);
+            ring->m_sq_array = ring_field<unsigned>(ring->m_sq, params.sq_off.array);
+            ring->m_cq_head = ring_field<unsigned>(ring->m_cq, params.cq_off.head);
+            ring->m_cq_tail = ring_field<unsigned>(ring->m_cq, params.cq_off.tail);
+            ring->m_cq_mask = *ring_field<unsigned>(ring->m_cq, params.cq_off.ring_mask);
+            ring->m_cqes = ring_field<io_uring_cqe>(ring->m_cq, params.cq_off.cqes);
+            return ring;
+        }
+
+        ~Ring()
+        {
+            if (m_sqes)
+            {
+                ::munmap(m_sqes, m_sqes_bytes);
+            }
+            if (m_cq && m_cq != m_sq)
+            {
+                ::munmap(m_cq, m_cq_bytes);
+            }
+            if (m_sq)
+            {
+                ::munmap(m_sq, m_sq_bytes);
+            }
+            ::close(m_fd);
+        }
+
+        // False when the read could not be submitted; it is then not queued at all
+        bool submit(int fd, char* data, size_t size, uint64_t offset, uint64_t user_data)
+        {
+            const unsigned tail = *m_sq_tail;
+            const unsigned index = tail & m_sq_mask;
+            io_uring_sqe& sqe = m_sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(data);
+            sqe.len = static_cast<uint32_t>(size);
+            sqe.off = offset;
+            sqe.user_data = user_data;
+            m_sq_array[index] = index;
+            std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1, std::memory_order_release);
+            int res;
+            do
+            {
+                res = static_cast<int>(::syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, nullptr, 0));
+            }
+            while (res < 0 && errno == EINTR);
+            if (res < 1)
+            {
+                // Without SQPOLL the kernel reads the queue only inside io_uring_enter, so the entry can be taken back
+                SPDLOG_DEBUG("io_uring_enter failed: {}", std::strerror(errno));
+                std::atomic_ref<unsigned>(*m_sq_tail).store(tail, std::memory_order_release);
+                return false;
+            }
+            return true;
+        }
+
+        // Blocks until a read completes
+        io_uring_cqe wait()
+        {
+            for (;;)
+            {
+                const unsigned head = std::atomic_ref<unsigned>(*m_cq_head).load(std::memory_order_relaxed);
+                if (head != std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire))
+                {
+                    const io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+                    std::atomic_ref<unsigned>(*m_cq_head).store(head + 1, std::memory_order_release);
+                    return cqe;
+                }
+                if (::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                {
+                    throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+                }
+            }
+        }
+    private:
+        Ring() = default;
+
+        static void* map(int fd, size_t bytes, off_t offset)
+        {
+            void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return ptr == MAP_FAILED ? nullptr : ptr;
+        }
+
+        int m_fd = -1;
+        void* m_sq = nullptr;
+        void* m_cq = nullptr;
+        size_t m_sq_bytes = 0;
+        size_t m_cq_bytes = 0;
+        size_t m_sqes_bytes = 0;
+        io_uring_sqe* m_sqes = nullptr;
+        unsigned* m_sq_tail = nullptr;
+        unsigned* m_sq_array = nullptr;
+        unsigned m_sq_mask = 0;
+        unsigned* m_cq_head = nullptr;
+        unsigned* m_cq_tail = nullptr;
+        unsigned m_cq_mask = 0;
+        io_uring_cqe* m_cqes = nullptr;
+    };
+
+    void configure(const Options& options)
+    {
+        backend_option.store(static_cast<int>(options.backend), std::memory_order_relaxed);
+        depth_option.store(std::max<uint32_t>(2, options.depth), std::memory_order_relaxed);
+        block_size_option.store(std::max(min_block_size, options.block_size), std::memory_order_relaxed);
+        io_threads_option.store(std::max<uint32_t>(1, options.io_threads), std::memory_order_relaxed);
+    }
+
+    Options options()
+    {
+        return Options{static_cast<Backend>(backend_option.load(std::memory_order_relaxed)), depth_option.load(std::memory_order_relaxed),
+            block_size_option.load(std::memory_order_relaxed), io_threads_option.load(std::memory_order_relaxed)};
+    }
+
+    Backend parse_backend(const std::string& name)
+    {
+        if (name == "auto")
+        {
+            return Backend::automatic;
+        }
+        if (name == "uring")
+        {
+            return Backend::uring;
+        }
+        if (name == "threads")
+        {
+            return Backend::threads;
+        }
+        throw std::invalid_argument("Unknown I/O backend " + name + ", expected auto, uring or threads");
+    }
+
+    const char* backend_name(Backend backend)
+    {
+        switch (backend)
+        {
+        case Backend::uring:
+            return "uring";
+        case Backend::threads:
+            return "threads";
+        default:
+            return "auto";
+        }
+    }
+
+    File::File(const std::string& path, uint64_t offset, uint64_t limit, size_t block_size) : m_path(path), m_limit(limit),
+    m_next_offset(offset), m_position(offset)
+    {
+        const Options current = options();
+        m_block_size = std::max(min_block_size, block_size != 0 ? block_size : current.block_size);
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0)
+        {
+            return;
+        }
+        struct stat st {};
+        if (::fstat(m_fd, &st) == 0)
+        {
+            m_size = static_cast<uint64_t>(st.st_size);
+        }
+        // Doubles the kernel's own read-ahead window for the file
+        ::posix_fadvise(m_fd, static_cast<off_t>(offset), 0, POSIX_FADV_SEQUENTIAL);
+        m_slots.resize(std::max<uint32_t>(2, current.depth));
+        if (current.backend != Backend::threads && !uring_unavailable.load(std::memory_order_relaxed))
+        {
+            m_ring = Ring::create(static_cast<unsigned>(m_slots.size()));
+            if (!m_ring && current.backend == Backend::uring)
+            {
+                LOG_RATE_LIMITED(spdlog::level::warn, "io_uring was requested but cannot be set up, reading {} with pread threads", path);
+            }
+        }
+        while (m_in_flight < m_slots.size() && m_next_offset < std::min(m_limit, m_size))
+        {
+            request(m_in_flight++);
+        }
+    }
+
+    File::~File()
+    {
+        for (size_t i = 0; i < m_in_flight; ++i)
+        {
+            try
+            {
+                // The reads write into the slots, and pool tasks reach this object
+                wait((m_head + i) % m_slots.size());
+            }
+            catch (const std::exception& err)
+            {
+                spdlog::error("Read ahead of {} did not finish: {}", m_path, err.what());
+            }
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+            metrics::count("csv_parser_read_ahead_bytes_total", static_cast<double>(m_bytes), "backend", backend_name(backend()));
+            metrics::count("csv_parser_read_wait_seconds_total", m_wait_seconds);
+        }
+    }
+
+    std::span<const char> File::next()
+    {
+        if (m_fd < 0)
+        {
+            return {};
+        }
+        const auto start = std::chrono::steady_clock::now();
+        // The caller is done with the previous block, so its slot joins the ones in flight
+        while (m_in_flight < m_slots.size() && m_next_offset < std::min(m_limit, m_size))
+        {
+            request((m_head + m_in_flight++) % m_slots.size());
+        }
+        Slot& slot = m_slots[m_head];
+        if (m_in_flight == 0)
+        {
+            // Past the limit, or at the end of the file as it was: one block at a time, taking appended bytes too
+            struct stat st {};
+            if (m_next_offset >= m_size && ::fstat(m_fd, &st) == 0)
+            {
+                m_size = static_cast<uint64_t>(st.st_size);
+            }
+            if (m_next_offset >= m_size)
+            {
+                return {};
+            }
+            read_rest(claim(m_head));
+        }
+        else
+        {
+            wait(m_head);
+            --m_in_flight;
+            if (slot.error != 0 || slot.done < slot.size)
+            {
+                read_rest(slot);
+            }
+        }
+        m_wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        m_head = (m_head + 1) % m_slots.size();
+        if (slot.done == 0)
+        {
+            // The file shrank under the reader
+            return {};
+        }
+        m_position = slot.offset;
+        m_bytes += slot.done;
+        return {slot.data.get(), slot.done};
+    }
+
+    File::Slot& File::claim(size_t index)
+    {
+        Slot& slot = m_slots[index];
+        slot.offset = m_next_offset;
+        slot.size = static_cast<size_t>(std::min<uint64_t>(m_block_size, m_size - m_next_offset));
+        if (slot.capacity < slot.size)
+        {
+            slot.data.reset(new char[slot.size]);
+            slot.capacity = slot.size;
+        }
+        slot.done = 0;
+        slot.error = 0;
+        slot.pending = false;
+        m_next_offset += slot.size;
+        return slot;
+    }
+
+    void File::request(size_t index)
+    {
+        Slot& slot = claim(index);
+        slot.pending = true;
+        if (m_ring)
+        {
+            // Left to read_rest when the ring does not take it
+            slot.pending = m_ring->submit(m_fd, slot.data.get(), slot.size, slot.offset, index);
+            return;
+        }
+        // The kernel starts reading right away, even while every pool thread is busy
+        ::posix_fadvise(m_fd, static_cast<off_t>(slot.offset), static_cast<off_t>(slot.size), POSIX_FADV_WILLNEED);
+        io_pool().push([this, index]
+        {
+            Slot& slot = m_slots[index];
+            size_t done = 0;
+            const int error = pread_fully(m_fd, slot.data.get(), slot.size, slot.offset, done);
+            std::lock_guard lock(m_mutex);
+            slot.done = done;
+            slot.error = error;
+            slot.pending = false;
+            m_cv.notify_all();
+        });
+    }
+
+    void File::wait(size_t index)
+    {
+        Slot& slot = m_slots[index];
+        if (!m_ring)
+        {
+            std::unique_lock lock(m_mutex);
+            m_cv.wait(lock, [&slot] { return !slot.pending; });
+            return;
+        }
+        // Completions come in any order, each one is recorded in its own slot
+        while (slot.pending)
+        {
+            const io_uring_cqe cqe = m_ring->wait();
+            Slot& completed = m_slots[cqe.user_data];
+            completed.pending = false;
+            completed.done = cqe.res < 0 ? 0 : static_cast<size_t>(cqe.res);
+            completed.error = cqe.res < 0 ? -cqe.res : 0;
+        }
+    }
+
+    void File::read_rest(Slot& slot)
+    {
+        // Also the retry of a failed asynchronous read, e.g. IORING_OP_READ on a kernel older than 5.6
+        slot.error = pread_fully(m_fd, slot.data.get(), slot.size, slot.offset, slot.done);
+        if (slot.error != 0)
+        {
+            throw std::runtime_error("Cannot read " + m_path + ": " + std::strerror(slot.error));
+        }
+    }
+
+    class Stream::Buffer : public std::streambuf
+    {
+    public:
+        Buffer(const std::string& path, uint64_t offset, uint64_t limit, size_t block_size) : m_file(path, offset, limit, block_size)
+        {
+
+        }
+        inline const File& file() const
+        {
+            return m_file;
+        }
+    protected:
+        int_type underflow() override
+        {
+            if (gptr() < egptr())
+            {
+                return traits_type::to_int_type(*gptr());
+            }
+            std::span<const char> block;
+            try
+            {
+                block = m_file.next();
+            }
+            catch (const std::exception& err)
+            {
+                // The istream sets badbit like std::filebuf would, so a failed read is not mistaken for the end
+                spdlog::error("{}", err.what());
+                throw;
+            }
+            if (block.empty())
+            {
+                return traits_type::eof();
+            }
+            char* data = const_cast<char*>(block.data());
+            setg(data, data, data + block.size());
+            return traits_type::to_int_type(*gptr());
+        }
+        // Only tellg
+        pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override
+        {
+            if (off != 0 || dir != std::ios::cur || (which & std::ios::in) == 0)
+            {
+                return pos_type(off_type(-1));
+            }
+            return pos_type(static_cast<off_type>(m_file.position() + (gptr() - eback())));
+        }
+    private:
+        File m_file;
+    };
+
+    Stream::Stream(const std::string& path, uint64_t offset, uint64_t limit, size_t block_size) : std::istream(nullptr),
+    m_buffer(std::make_unique<Buffer>(path, offset, limit, block_size))
+    {
+        rdbuf(m_buffer.get());
+        if (!m_buffer->file().is_open())
+        {
+            setstate(std::ios::failbit);
+        }
+    }
+
+    Stream::Stream(Stream&& other) : std::istream(std::move(other)), m_buffer(std::move(other.m_buffer))
+    {
+        set_rdbuf(m_buffer.get());
+        other.set_rdbuf(nullptr);
+    }
+
+    Stream::~Stream() = default;
+
+    bool Stream::is_open() const
+    {
+        return m_buffer && m_buffer->file().is_open();
+    }
+} //namespace read_ahead
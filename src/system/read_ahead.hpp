@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Sequential reads of a file with the next blocks already requested while the reader works on the current one.
+// Blocks go through io_uring when the kernel allows it, otherwise through pread on a small shared I/O pool after a
+// posix_fadvise hint. CSV ingest, the spill runs of a merge and the merged run all read this way
+namespace read_ahead
+{
+    enum class Backend
+    {
+        automatic,
+        uring,
+        threads
+    };
+
+    struct Options
+    {
+        Backend backend = Backend::automatic;
+        // Blocks in flight per file, at least 2: one is consumed while the next is read
+        uint32_t depth = 4;
+        size_t block_size = 1 << 20;
+        // Threads of the pread pool shared by all files of the threads backend
+        uint32_t io_threads = 2;
+    };
+
+    // Process wide, set once at start-up before any file is opened
+    void configure(const Options& options);
+    Options options();
+    // "auto", "uring" or "threads"; throws std::invalid_argument otherwise
+    Backend parse_backend(const std::string& name);
+    const char* backend_name(Backend backend);
+
+    class File
+    {
+    public:
+        // Reads from offset on. Blocks past limit are only read once asked for, so a parse task that ends at limit
+        // does not fetch the rest of the file. block_size 0 takes the configured one
+        explicit File(const std::string& path, uint64_t offset = 0, uint64_t limit = std::numeric_limits<uint64_t>::max(), size_t block_size = 0);
+        ~File();
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        inline bool is_open() const
+        {
+            return m_fd >= 0;
+        }
+        // Backend serving this file, uring only when its ring was set up
+        inline Backend backend() const
+        {
+            return m_ring ? Backend::uring : Backend::threads;
+        }
+        // File offset of the block returned by the last next()
+        inline uint64_t position() const
+        {
+            return m_position;
+        }
+        // The next bytes in file order, valid until the following call; empty at the end of the file. Bytes appended
+        // after the file was opened are read too. Throws std::runtime_error when a read fails
+        std::span<const char> next();
+    private:
+        struct Slot
+        {
+            std::unique_ptr<char[]> data;
+            uint64_t offset = 0;
+            size_t size = 0;
+            size_t capacity = 0;
+            size_t done = 0;
+            int error = 0;
+            bool pending = false;
+        };
+        class Ring;
+
+        // Takes the next block of the file for the slot
+        Slot& claim(size_t index);
+        // Starts the read of the next block into the slot
+        void request(size_t index);
+        void wait(size_t index);
+        // Completes a short or skipped read with blocking preads
+        void read_rest(Slot& slot);
+
+        std::string m_path;
+        int m_fd = -1;
+        uint64_t m_size = 0;
+        uint64_t m_limit;
+        uint64_t m_next_offset;
+        uint64_t m_position;
+        size_t m_block_size;
+        // Slots [m_head, m_head + m_in_flight) hold requested blocks in file order, the one before m_head is the
+        // caller's until the next call
+        std::vector<Slot> m_slots;
+        size_t m_head = 0;
+        size_t m_in_flight = 0;
+        std::unique_ptr<Ring> m_ring;
+        // Completions of the thread backend
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        uint64_t m_bytes = 0;
+        double m_wait_seconds = 0.0;
+    };
+
+    // std::istream over a File, for the code written against std::ifstream. A failed read is logged and sets badbit,
+    // as it does for an ifstream
+    class Stream : public std::istream
+    {
+    public:
+        explicit Stream(const std::string& path, uint64_t offset = 0, uint64_t limit = std::numeric_limits<uint64_t>::max(), size_t block_size = 0);
+        Stream(Stream&& other);
+        ~Stream() override;
+        bool is_open() const;
+    private:
+        class Buffer;
+        std::unique_ptr<Buffer> m_buffer;
+    };
+} //namespace read_ahead
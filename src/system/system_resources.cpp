@@ -0,0 +1,145 @@
+#include "system_resources.hpp"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+    // Directory of the process's cgroup v2 group: the "0::<path>" line of /proc/self/cgroup
+    std::filesystem::path cgroup_dir(const std::filesystem::path& cgroup_root, const std::filesystem::path& proc_self_cgroup)
+    {
+        std::ifstream in(proc_self_cgroup);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.rfind("0::", 0) == 0)
+            {
+                return cgroup_root / std::filesystem::path(line.substr(3)).relative_path();
+            }
+        }
+        return cgroup_root;
+    }
+
+    // Limits of parent groups apply too, so walk up to the root and keep the smallest
+    template<typename Value, typename Reader>
+    std::optional<Value> tightest(const std::filesystem::path& cgroup_root, std::filesystem::path dir, const char* file, Reader reader)
+    {
+        std::optional<Value> res;
+        const auto root = cgroup_root.lexically_normal();
+        while (true)
+        {
+            if (auto value = reader(dir / file))
+            {
+                res = res ? std::min(*res, *value) : *value;
+            }
+            if (dir.lexically_normal() == root || !dir.has_parent_path() || dir.parent_path() == dir)
+            {
+                break;
+            }
+            dir = dir.parent_path();
+        }
+        return res;
+    }
+} //anonymous namespace
+
+namespace system_resources
+{
+    std::optional<uint64_t> read_memory_max(const std::filesystem::path& file)
+    {
+        std::ifstream in(file);
+        std::string value;
+        if (!(in >> value) || value == "max")
+        {
+            return std::nullopt;
+        }
+        try
+        {
+            return std::stoull(value);
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    std::optional<uint32_t> read_cpu_max(const std::filesystem::path& file)
+    {
+        std::ifstream in(file);
+        std::string quota;
+        uint64_t period = 0;
+        if (!(in >> quota >> period) || quota == "max" || period == 0)
+        {
+            return std::nullopt;
+        }
+        try
+        {
+            const uint64_t value = std::stoull(quota);
+            return static_cast<uint32_t>(std::max<uint64_t>(1, (value + period - 1) / period));
+        }
+        catch (const std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    Resources detect(const std::filesystem::path& cgroup_root, const std::filesystem::path& proc_self_cgroup)
+    {
+        Resources res;
+        res.cpus = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            res.cpus = std::min<uint32_t>(res.cpus, std::max(1, CPU_COUNT(&set)));
+        }
+
+        const long pages = sysconf(_SC_PHYS_PAGES);
+        const long page_size = sysconf(_SC_PAGE_SIZE);
+        if (pages > 0 && page_size > 0)
+        {
+            res.memory = static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size);
+        }
+
+        const auto dir = cgroup_dir(cgroup_root, proc_self_cgroup);
+        if (auto cpus = tightest<uint32_t>(cgroup_root, dir, "cpu.max", read_cpu_max); cpus && *cpus < res.cpus)
+        {
+            res.cpus = *cpus;
+            res.cpu_limited = true;
+        }
+        if (auto memory = tightest<uint64_t>(cgroup_root, dir, "memory.max", read_memory_max); memory && (res.memory == 0 || *memory < res.memory))
+        {
+            res.memory = *memory;
+            res.memory_limited = true;
+        }
+        return res;
+    }
+
+    uint32_t default_threads(const Resources& resources)
+    {
+        return std::max<uint32_t>(1, resources.cpus);
+    }
+
+    double memory_multiplier(uint32_t threads, uint32_t queue_depth, uint32_t pending_spills)
+    {
+        threads = std::max<uint32_t>(1, threads);
+        const double queued = queue_depth != 0 ? double(queue_depth) / threads : 1.0;
+        const double spills = pending_spills != 0 ? pending_spills : threads;
+        // Filling chunks, ready queue, sort buffer, pending spills, idle pool
+        return 1.0 + queued + 1.0 + spills + 0.25;
+    }
+
+    uint64_t default_memory(const Resources& resources, double multiplier)
+    {
+        constexpr uint64_t fallback = 524288000;
+        constexpr uint64_t min_memory = 16ull << 20;
+        if (resources.memory == 0)
+        {
+            return fallback;
+        }
+        return std::max(min_memory, static_cast<uint64_t>(resources.memory / std::max(1.0, multiplier)));
+    }
+} //namespace system_resources
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// CPU and memory actually available to the process: hardware threads narrowed by the CPU affinity mask and the
+// cgroup v2 cpu.max quota, physical memory narrowed by the cgroup v2 memory.max of the process's cgroup
+namespace system_resources
+{
+    struct Resources
+    {
+        uint32_t cpus = 1;
+        uint64_t memory = 0;
+        // Set when the value comes from a cgroup limit rather than the machine
+        bool cpu_limited = false;
+        bool memory_limited = false;
+    };
+
+    // cgroup_root and proc_self_cgroup are parameters so tests can point them at a fake tree
+    Resources detect(const std::filesystem::path& cgroup_root = "/sys/fs/cgroup", const std::filesystem::path& proc_self_cgroup = "/proc/self/cgroup");
+
+    // "max" or a byte count, nullopt for no limit or an unreadable file
+    std::optional<uint64_t> read_memory_max(const std::filesystem::path& file);
+    // "<quota> <period>" or "max <period>", the quota rounded up to whole CPUs
+    std::optional<uint32_t> read_cpu_max(const std::filesystem::path& file);
+
+    // How many times --max-memory a batch run holds at its peak, while parsing: the chunks being filled by the
+    // parser threads (1x together), the ready queue of queue_depth chunks of max_memory/threads (0 for one per
+    // thread), the sort buffer (1x), the sorted runs waiting for a spill thread (1x each, 0 for no limit is counted
+    // as one per thread) and the idle buffers of the pool (1/4). The merge and median stages come after the parser
+    // is gone and hold less
+    double memory_multiplier(uint32_t threads, uint32_t queue_depth, uint32_t pending_spills);
+
+    // Defaults for --max-thread and --max-memory: one parser thread per CPU, and the memory divided by the multiplier
+    // above so that the whole process stays within physical memory or the cgroup limit
+    uint32_t default_threads(const Resources& resources);
+    uint64_t default_memory(const Resources& resources, double multiplier);
+} //namespace system_resources
@@ -0,0 +1,193 @@
+#include "trace.hpp"
+#include "../logger/logger.hpp"
+
+#include <unistd.h>
+
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    std::string escape(std::string_view value)
+    {
+        std::string res;
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                res.push_back('\\');
+            }
+            res.push_back(c);
+        }
+        return res;
+    }
+
+    // Trace-event timestamps are microseconds
+    std::string format_us(uint64_t ns)
+    {
+        char buffer[32];
+        return std::string(buffer, std::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(ns) / 1000.0, std::chars_format::fixed, 3).ptr);
+    }
+} //anonymous namespace
+
+namespace trace
+{
+    ThreadBuffer::~ThreadBuffer()
+    {
+        Chunk* chunk = head ? head->next.load(std::memory_order_acquire) : nullptr;
+        while (chunk)
+        {
+            Chunk* next = chunk->next.load(std::memory_order_acquire);
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    Recorder& Recorder::instance()
+    {
+        static Recorder recorder;
+        return recorder;
+    }
+
+    void Recorder::start()
+    {
+        m_start = std::chrono::steady_clock::now();
+        m_enabled.store(true, std::memory_order_release);
+    }
+
+    void Recorder::stop()
+    {
+        m_enabled.store(false, std::memory_order_release);
+    }
+
+    ThreadBuffer& Recorder::local_buffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        thread_local uint64_t generation = 0;
+        const uint64_t current = m_generation.load(std::memory_order_acquire);
+        if (!buffer || generation != current)
+        {
+            auto created = std::make_unique<ThreadBuffer>();
+            created->head = std::make_unique<Chunk>();
+            created->tail = created->head.get();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            created->tid = static_cast<uint32_t>(m_buffers.size());
+            buffer = created.get();
+            generation = current;
+            m_buffers.push_back(std::move(created));
+        }
+        return *buffer;
+    }
+
+    void Recorder::record(const char* name, char phase)
+    {
+        const uint64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+        ThreadBuffer& buffer = local_buffer();
+        Chunk* chunk = buffer.tail;
+        size_t count = chunk->count.load(std::memory_order_relaxed);
+        if (count == Chunk::capacity)
+        {
+            Chunk* next = new Chunk();
+            chunk->next.store(next, std::memory_order_release);
+            buffer.tail = next;
+            chunk = next;
+            count = 0;
+        }
+        chunk->events[count] = Event{name, ts, phase};
+        chunk->count.store(count + 1, std::memory_order_release);
+    }
+
+    void Recorder::set_thread_name(std::string name)
+    {
+        ThreadBuffer& buffer = local_buffer();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer.name = std::move(name);
+    }
+
+    std::string Recorder::to_json() const
+    {
+        const std::string pid = std::to_string(::getpid());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string res = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        auto separator = [&]()
+        {
+            res += first ? "\n" : ",\n";
+            first = false;
+        };
+        for (const auto& buffer : m_buffers)
+        {
+            const std::string tid = std::to_string(buffer->tid);
+            if (!buffer->name.empty())
+            {
+                separator();
+                res += "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " + pid + ", \"tid\": " + tid
+                    + ", \"args\": {\"name\": \"" + escape(buffer->name) + "\"}}";
+            }
+            for (const Chunk* chunk = buffer->head.get(); chunk; chunk = chunk->next.load(std::memory_order_acquire))
+            {
+                const size_t count = chunk->count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const Event& event = chunk->events[i];
+                    separator();
+                    res += "{\"name\": \"" + escape(event.name) + "\", \"ph\": \"" + event.phase + "\", \"ts\": " + format_us(event.ts_ns)
+                        + ", \"pid\": " + pid + ", \"tid\": " + tid + "}";
+                }
+            }
+        }
+        res += "\n]}\n";
+        return res;
+    }
+
+    void Recorder::write(const std::filesystem::path& file) const
+    {
+        if (file.has_parent_path())
+        {
+            std::filesystem::create_directories(file.parent_path());
+        }
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out << to_json();
+        if (!out)
+        {
+            throw std::runtime_error("Cannot write trace file: " + file.string());
+        }
+    }
+
+    void Recorder::reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffers.clear();
+        m_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    ScopedSession::ScopedSession(std::filesystem::path file) : m_file(std::move(file))
+    {
+        if (m_file.empty())
+        {
+            return;
+        }
+        Recorder::instance().start();
+        set_thread_name("main");
+    }
+
+    ScopedSession::~ScopedSession()
+    {
+        if (m_file.empty())
+        {
+            return;
+        }
+        auto& recorder = Recorder::instance();
+        recorder.stop();
+        try
+        {
+            recorder.write(m_file);
+            spdlog::info("Trace written to {}", m_file.string());
+        }
+        catch (const std::exception& err)
+        {
+            spdlog::error("Error while writing trace: {}", err.what());
+        }
+    }
+} //namespace trace
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Begin/end timeline of pool tasks, sorts, spills, the merge and the median pass, written in the Chrome
+// trace-event format (Perfetto, chrome://tracing). Every thread appends to its own chunked buffer without
+// locks; when tracing is off a hook is a single relaxed load
+namespace trace
+{
+    struct Event
+    {
+        const char* name;
+        uint64_t ts_ns;
+        char phase;
+    };
+
+    // Single writer (the owning thread), readers see the events published by count
+    struct Chunk
+    {
+        static constexpr size_t capacity = 4096;
+        Event events[capacity];
+        std::atomic<size_t> count {0};
+        std::atomic<Chunk*> next {nullptr};
+    };
+
+    struct ThreadBuffer
+    {
+        uint32_t tid;
+        std::string name;
+        std::unique_ptr<Chunk> head;
+        Chunk* tail;
+        ~ThreadBuffer();
+    };
+
+    class Recorder
+    {
+    public:
+        static Recorder& instance();
+
+        void start();
+        void stop();
+        inline bool enabled() const
+        {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        // Event names must be string literals or otherwise outlive the recorder
+        void record(const char* name, char phase);
+        void set_thread_name(std::string name);
+
+        // Events recorded so far; call once the traced threads are stopped or joined
+        std::string to_json() const;
+        void write(const std::filesystem::path& file) const;
+        void reset();
+    private:
+        ThreadBuffer& local_buffer();
+
+        std::atomic<bool> m_enabled {false};
+        std::chrono::steady_clock::time_point m_start;
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+        // Bumped by reset so threads drop buffers that belong to an earlier session
+        std::atomic<uint64_t> m_generation {0};
+    };
+
+    inline bool enabled()
+    {
+        return Recorder::instance().enabled();
+    }
+
+    inline void set_thread_name(std::string name)
+    {
+        if (enabled())
+        {
+            Recorder::instance().set_thread_name(std::move(name));
+        }
+    }
+
+    class ScopedEvent
+    {
+    public:
+        explicit ScopedEvent(const char* name) : m_name(enabled() ? name : nullptr)
+        {
+            if (m_name)
+            {
+                Recorder::instance().record(m_name, 'B');
+            }
+        }
+        ~ScopedEvent()
+        {
+            if (m_name)
+            {
+                Recorder::instance().record(m_name, 'E');
+            }
+        }
+        ScopedEvent(const ScopedEvent&) = delete;
+        ScopedEvent& operator=(const ScopedEvent&) = delete;
+    private:
+        const char* m_name;
+    };
+
+    // Records the whole run when a path is given and writes it when main returns
+    class ScopedSession
+    {
+    public:
+        explicit ScopedSession(std::filesystem::path file);
+        ~ScopedSession();
+        ScopedSession(const ScopedSession&) = delete;
+        ScopedSession& operator=(const ScopedSession&) = delete;
+    private:
+        std::filesystem::path m_file;
+    };
+} //namespace trace
@@ -0,0 +1,138 @@
+#include "../src/pipeline/batch_runner.hpp"
+#include "../src/system/buffer_pool.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+class BatchTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("batch_test_" + std::to_string(::getpid()));
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    BatchRunner::Job make_job(const std::string& name, size_t rows)
+    {
+        const auto input = dir / (name + ".csv");
+        std::ofstream out(input);
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        for (size_t i = 0; i < rows; ++i)
+        {
+            out << 2000 - i % 1000 + i * 3 << ";1;" << 50 + (i * 31) % 97 << ".25;1;ask\n";
+        }
+        BatchRunner::Job job;
+        job.name = name;
+        job.options.files = {input};
+        job.options.output_file = (dir / name / "output.csv").string();
+        return job;
+    }
+};
+
+TEST(BufferPoolTest, LendsSmallestFittingBuffer)
+{
+    BufferPool<uint64_t> pool(1000 * sizeof(uint64_t));
+    auto small = pool.acquire(100);
+    auto large = pool.acquire(600);
+    small.push_back(1);
+    const auto* small_data = small.data();
+    const auto* large_data = large.data();
+    pool.release(std::move(large));
+    pool.release(std::move(small));
+    EXPECT_EQ(pool.idle_bytes(), 700 * sizeof(uint64_t));
+
+    auto first = pool.acquire(50);
+    EXPECT_EQ(first.data(), small_data);
+    EXPECT_TRUE(first.empty());
+    // Too large for a small request, which gets a new reservation
+    auto fresh = pool.acquire(50);
+    EXPECT_NE(fresh.data(), large_data);
+    EXPECT_EQ(pool.idle_bytes(), 600 * sizeof(uint64_t));
+    auto second = pool.acquire(300);
+    EXPECT_EQ(second.data(), large_data);
+    EXPECT_EQ(pool.idle_bytes(), 0u);
+
+    // Beyond the idle limit the buffer is freed
+    pool.release(std::move(second));
+    pool.release(pool.acquire(800));
+    EXPECT_EQ(pool.idle_bytes(), 600 * sizeof(uint64_t));
+}
+
+TEST_F(BatchTest, JobsMatchSeparateRuns)
+{
+    std::vector<BatchRunner::Job> jobs;
+    std::vector<std::string> expected;
+    for (const auto& [name, rows] : std::vector<std::pair<std::string, size_t>>{{"small", 300}, {"large", 20000}, {"medium", 5000}})
+    {
+        jobs.push_back(make_job(name, rows));
+        auto options = jobs.back().options;
+        options.output_file = (dir / (name + "_single.csv")).string();
+        ASSERT_TRUE(MedianPipeline(options).run());
+        expected.push_back(test_util::read_file(options.output_file));
+    }
+
+    std::vector<BatchRunner::Result> results;
+    for (uint32_t concurrency : {2u, 1u})
+    {
+        BatchRunner::Options options;
+        options.max_memory = 64 << 20;
+        options.max_threads = 2;
+        options.concurrency = concurrency;
+        results = BatchRunner(jobs, options).run();
+        ASSERT_EQ(results.size(), jobs.size());
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            EXPECT_TRUE(results[i].ok);
+            EXPECT_EQ(results[i].name, jobs[i].name);
+            EXPECT_EQ(results[i].threads, 2u / concurrency);
+            EXPECT_EQ(results[i].memory, (48u << 20) / concurrency);
+            EXPECT_EQ(test_util::read_file(jobs[i].options.output_file), expected[i]);
+            std::filesystem::remove(jobs[i].options.output_file);
+        }
+    }
+    // One slot runs the largest job first and the smallest last
+    EXPECT_LE(results[1].wait_seconds, results[2].wait_seconds);
+    EXPECT_LE(results[2].wait_seconds, results[0].wait_seconds);
+
+    const auto report = dir / "report.csv";
+    BatchRunner::write_report(report, results);
+    std::ifstream in(report);
+    std::string line;
+    std::getline(in, line);
+    EXPECT_EQ(line, "job;status;input_bytes;memory_bytes;threads;wait_seconds;run_seconds");
+    std::getline(in, line);
+    EXPECT_EQ(line.rfind("small;ok;" + std::to_string(results[0].input_bytes) + ";", 0), 0u);
+}
+
+TEST_F(BatchTest, StoppedBatchSkipsJobs)
+{
+    std::vector<BatchRunner::Job> jobs{make_job("a", 100), make_job("b", 100)};
+    std::atomic<bool> stop {true};
+    BatchRunner::Options options;
+    options.stop = &stop;
+    for (const auto& result : BatchRunner(jobs, options).run())
+    {
+        EXPECT_FALSE(result.ok);
+    }
+    EXPECT_FALSE(std::filesystem::exists(jobs[0].options.output_file));
+
+    EXPECT_EQ(BatchRunner::concurrency(10, 1ull << 30, 4), 4u);
+    EXPECT_EQ(BatchRunner::concurrency(10, 128ull << 20, 8), 2u);
+    EXPECT_EQ(BatchRunner::concurrency(1, 1ull << 30, 8), 1u);
+}
@@ -0,0 +1,39 @@
+#include "../src/system/bulk_memory.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+TEST(BulkMemoryTest, AdvisesOnlyWholeHugePages)
+{
+    std::vector<uint64_t> small(1024);
+    EXPECT_EQ(bulk_memory::advise_huge_pages(small.data(), small.size() * sizeof(uint64_t)), 0u);
+    EXPECT_EQ(bulk_memory::advise_huge_pages(nullptr, 1 << 30), 0u);
+
+    std::vector<uint64_t> large;
+    large.reserve(4 << 20);
+    // 0 is allowed on kernels without transparent huge pages
+    const size_t advised = bulk_memory::advise_huge_pages(large.data(), large.capacity() * sizeof(uint64_t));
+    EXPECT_EQ(advised % (2 << 20), 0u);
+    EXPECT_LE(advised, large.capacity() * sizeof(uint64_t));
+}
+
+TEST(BulkMemoryTest, PrefaultKeepsConcurrentWrites)
+{
+    bulk_memory::configure(bulk_memory::Options{true, true});
+    std::vector<uint64_t> buffer;
+    buffer.reserve(16 << 20);
+    std::jthread prefault = bulk_memory::prepare(buffer);
+    for (uint64_t i = 0; i < buffer.capacity(); ++i)
+    {
+        buffer.push_back(i * 3);
+    }
+    prefault.join();
+    bulk_memory::configure(bulk_memory::Options{});
+
+    for (uint64_t i = 0; i < buffer.size(); ++i)
+    {
+        ASSERT_EQ(buffer[i], i * 3);
+    }
+}
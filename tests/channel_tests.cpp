@@ -0,0 +1,141 @@
+#include "../src/pipeline/channel.hpp"
+#include "../src/pipeline/coro.hpp"
+#include "../src/pipeline/median_pipeline.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    coro::Task consume(coro::Channel<int>& in, std::vector<int>& out)
+    {
+        while (auto value = co_await in.receive())
+        {
+            out.push_back(*value);
+        }
+    }
+
+    coro::Task relay(coro::Channel<int>& in, coro::Channel<int>& out)
+    {
+        while (auto value = co_await in.receive())
+        {
+            if (!co_await out.send(*value * 2))
+            {
+                co_return;
+            }
+        }
+        out.close();
+    }
+
+    coro::Task fail_after(coro::Channel<int>& in, int limit)
+    {
+        while (auto value = co_await in.receive())
+        {
+            if (*value == limit)
+            {
+                throw std::runtime_error("stage failed");
+            }
+        }
+    }
+} //anonymous namespace
+
+TEST(ChannelTest, StagesKeepOrderWithinBound)
+{
+    coro::Executor executor(2);
+    coro::Channel<int> first(2);
+    coro::Channel<int> second(1);
+    std::vector<int> out;
+
+    coro::Scope scope;
+    scope.spawn(executor, relay(first, second));
+    scope.spawn(executor, consume(second, out));
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_TRUE(first.push(i));
+    }
+    first.close();
+    scope.join();
+
+    ASSERT_EQ(out.size(), 1000u);
+    for (int i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(out[i], i * 2);
+    }
+    EXPECT_LE(first.high_water(), 2u);
+    EXPECT_LE(second.high_water(), 1u);
+    EXPECT_FALSE(first.push(1));
+}
+
+TEST(ChannelTest, FailedStageCancelsProducers)
+{
+    coro::Executor executor(1);
+    coro::Channel<int> channel(1);
+    std::atomic<int> accepted {0};
+
+    coro::Scope scope;
+    scope.on_cancel([&channel]() { channel.cancel(); });
+    scope.spawn(executor, fail_after(channel, 10));
+    // Blocked on the full channel once the stage is gone, until the cancel releases them
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 3; ++p)
+    {
+        producers.emplace_back([&channel, &accepted, p]()
+        {
+            for (int i = 0; i < 100000; ++i)
+            {
+                if (!channel.push(p == 0 ? i : 0))
+                {
+                    return;
+                }
+                ++accepted;
+            }
+        });
+    }
+    EXPECT_THROW(scope.join(), std::runtime_error);
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    EXPECT_TRUE(scope.cancelled());
+    EXPECT_LT(accepted.load(), 300000);
+    EXPECT_EQ(channel.pop(), std::nullopt);
+}
+
+TEST(ChannelTest, StoppedPipelineFails)
+{
+    const auto dir = std::filesystem::temp_directory_path() / ("channel_test_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    {
+        std::ofstream out(dir / "trades.csv");
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        for (int i = 0; i < 20000; ++i)
+        {
+            out << i + 1 << ';' << i + 1 << ';' << 100 + i % 17 << ".5;1;bid\n";
+        }
+    }
+    std::atomic<bool> stop {false};
+    MedianPipeline::Options options;
+    options.files = {dir / "trades.csv"};
+    options.output_file = (dir / "median.csv").string();
+    options.max_memory = 1 << 16;
+    options.max_threads = 2;
+    options.queue_depth = 1;
+    options.stop = &stop;
+
+    EXPECT_TRUE(MedianPipeline(options).run());
+    EXPECT_TRUE(std::filesystem::exists(options.output_file));
+
+    std::filesystem::remove(options.output_file);
+    stop = true;
+    EXPECT_FALSE(MedianPipeline(options).run());
+    EXPECT_FALSE(std::filesystem::exists(options.output_file));
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,249 @@
+#include "../src/csv_parser/compressed_input.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "../src/csv_parser/file_scheduler.hpp"
+#include "../src/pipeline/median_pipeline.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <zlib.h>
+#ifdef CSV_PARSER_ZSTD
+#include <zstd.h>
+#endif
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    std::string read_all(std::istream& in)
+    {
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    // Every part becomes its own gzip member
+    void write_gzip(const std::filesystem::path& file, const std::vector<std::string>& parts)
+    {
+        std::ofstream out(file, std::ios::binary);
+        for (const auto& part : parts)
+        {
+            z_stream stream {};
+            ASSERT_EQ(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+            std::string compressed(deflateBound(&stream, part.size()), '\0');
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(part.data()));
+            stream.avail_in = part.size();
+            stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+            stream.avail_out = compressed.size();
+            ASSERT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+            out.write(compressed.data(), stream.total_out);
+            deflateEnd(&stream);
+        }
+    }
+
+#ifdef CSV_PARSER_ZSTD
+    uint64_t parsed_rows(const std::vector<FileScheduler::Task>& tasks)
+    {
+        CsvParser parser(1 << 20, 2);
+        for (const auto& task : tasks)
+        {
+            parser.add_file_to_parse(task.file, task.begin, task.end);
+        }
+        parser.wait_task_done();
+        uint64_t rows = 0;
+        while (auto data = parser.get_ready_data())
+        {
+            rows += data->size();
+        }
+        return rows;
+    }
+#endif
+} //anonymous namespace
+
+class CompressedInputTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+    std::string content;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("compressed_test_" + std::to_string(::getpid()));
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        std::ostringstream out;
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        for (size_t i = 0; i < 20000; ++i)
+        {
+            out << 5000 - i % 3000 + i * 2 << ";1;" << 100 + (i * 37) % 211 << ".5;1;bid\n";
+        }
+        content = out.str();
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    // Four pieces of the content cut in the middle of lines
+    std::vector<std::string> parts() const
+    {
+        std::vector<std::string> res;
+        const size_t piece = content.size() / 4 + 7;
+        for (size_t pos = 0; pos < content.size(); pos += piece)
+        {
+            res.push_back(content.substr(pos, piece));
+        }
+        return res;
+    }
+
+    std::string median_output(const std::filesystem::path& input, const std::string& name)
+    {
+        MedianPipeline::Options options;
+        options.files = {input};
+        options.output_file = (dir / name).string();
+        options.max_memory = 64 << 20;
+        options.max_threads = 2;
+        EXPECT_TRUE(MedianPipeline(options).run());
+        return test_util::read_file(options.output_file);
+    }
+};
+
+TEST(CompressedInputNames, MatchesCompressedCsv)
+{
+    EXPECT_TRUE(compressed_input::is_csv("trades.csv"));
+    EXPECT_TRUE(compressed_input::is_csv("trades.csv.gz"));
+    EXPECT_TRUE(compressed_input::is_csv("trades.csv.zst"));
+    EXPECT_FALSE(compressed_input::is_csv("trades.gz"));
+    EXPECT_FALSE(compressed_input::is_csv("trades.csv.bz2"));
+    EXPECT_EQ(compressed_input::codec("a/level.csv.zst"), compressed_input::Codec::zstd);
+    EXPECT_TRUE(compressed_input::frames("a/level.csv.gz").empty());
+}
+
+TEST_F(CompressedInputTest, GzipMembersReadAsOneStream)
+{
+    const auto file = dir / "trades.csv.gz";
+    write_gzip(file, parts());
+    EXPECT_EQ(read_all(*compressed_input::open(file.string())), content);
+    EXPECT_EQ(read_all(*compressed_input::open(file.string(), 12345)), content.substr(12345));
+    EXPECT_FALSE(compressed_input::content_size(file.string()));
+
+    // Not splittable, so one task whatever its size
+    const auto tasks = FileScheduler::plan({FileScheduler::Input{file.string()}}, 4, 1024);
+    EXPECT_EQ(tasks.size(), 1u);
+
+    const auto plain = dir / "trades.csv";
+    std::ofstream(plain, std::ios::binary) << content;
+    EXPECT_EQ(median_output(file, "gzip.csv"), median_output(plain, "plain.csv"));
+}
+
+TEST_F(CompressedInputTest, CorruptGzipFailsTheRun)
+{
+    const auto file = dir / "trades.csv.gz";
+    write_gzip(file, {content});
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) / 2);
+
+    // The stream goes bad instead of ending, and no cut-off line is returned
+    const auto stream = compressed_input::open(file.string());
+    std::string read;
+    std::string line;
+    while (std::getline(*stream, line))
+    {
+        read += line + '\n';
+    }
+    EXPECT_TRUE(stream->bad());
+    EXPECT_LT(read.size(), content.size());
+    EXPECT_EQ(read, content.substr(0, read.size()));
+    EXPECT_FALSE(*compressed_input::open((dir / "missing.csv.gz").string()));
+
+    CsvParser parser(1 << 20, 2);
+    parser.add_file_to_parse(file.string());
+    parser.wait_task_done();
+    while (parser.get_ready_data())
+    {
+    }
+    EXPECT_TRUE(parser.failed());
+    EXPECT_TRUE(parser.get_file_progress().empty());
+
+    MedianPipeline::Options options;
+    options.files = {file};
+    options.output_file = (dir / "corrupt.csv").string();
+    options.max_memory = 64 << 20;
+    options.max_threads = 2;
+    EXPECT_FALSE(MedianPipeline(options).run());
+}
+
+#ifdef CSV_PARSER_ZSTD
+TEST_F(CompressedInputTest, ZstdFramesAreSplitBetweenTasks)
+{
+    const auto file = dir / "trades.csv.zst";
+    std::vector<std::pair<uint64_t, uint64_t>> sizes;
+    {
+        std::ofstream out(file, std::ios::binary);
+        for (const auto& part : parts())
+        {
+            std::string compressed(ZSTD_compressBound(part.size()), '\0');
+            const size_t size = ZSTD_compress(compressed.data(), compressed.size(), part.data(), part.size(), 3);
+            ASSERT_FALSE(ZSTD_isError(size));
+            out.write(compressed.data(), size);
+            sizes.emplace_back(size, part.size());
+        }
+    }
+    const auto frames = compressed_input::frames(file.string());
+    ASSERT_EQ(frames.size(), sizes.size());
+    uint64_t offset = 0;
+    uint64_t content_offset = 0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        EXPECT_EQ(frames[i].offset, offset);
+        EXPECT_EQ(frames[i].content_offset, content_offset);
+        EXPECT_EQ(frames[i].size, sizes[i].first);
+        offset += sizes[i].first;
+        content_offset += sizes[i].second;
+    }
+    EXPECT_EQ(compressed_input::content_size(file.string()), content.size());
+    EXPECT_EQ(read_all(*compressed_input::open(file.string(), content.size() / 2)), content.substr(content.size() / 2));
+
+    // Cuts land on line starts just after the frame starts
+    const auto tasks = FileScheduler::plan({FileScheduler::Input{file.string()}}, 4, 1024);
+    ASSERT_EQ(tasks.size(), frames.size());
+    for (const auto& task : tasks)
+    {
+        EXPECT_TRUE(task.begin == 0 || content[task.begin - 1] == '\n');
+    }
+    EXPECT_EQ(parsed_rows(tasks), 20000u);
+
+    // The seek table of the seekable format lists the same frames
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::app);
+        auto put = [&out](uint64_t value, size_t bytes)
+        {
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                out.put(static_cast<char>(value >> (8 * i)));
+            }
+        };
+        put(0x184D2A5E, 4);
+        put(sizes.size() * 8 + 9, 4);
+        for (const auto& [compressed, decompressed] : sizes)
+        {
+            put(compressed, 4);
+            put(decompressed, 4);
+        }
+        put(sizes.size(), 4);
+        put(0, 1);
+        put(0x8F92EAB1, 4);
+    }
+    const auto listed = compressed_input::frames(file.string());
+    ASSERT_EQ(listed.size(), frames.size());
+    EXPECT_EQ(listed.back().content_offset, frames.back().content_offset);
+    EXPECT_EQ(read_all(*compressed_input::open(file.string())), content);
+
+    const auto plain = dir / "trades.csv";
+    std::ofstream(plain, std::ios::binary) << content;
+    EXPECT_EQ(median_output(file, "zstd.csv"), median_output(plain, "plain.csv"));
+}
+#endif
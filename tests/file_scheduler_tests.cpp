@@ -0,0 +1,243 @@
+#include "../src/csv_parser/file_scheduler.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "../src/pipeline/median_pipeline.hpp"
+#include "../src/system/buffer_pool.hpp"
+#include "../src/system/system_resources.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+class FileSchedulerTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("scheduler_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    std::string write_trades(const std::string& name, size_t rows)
+    {
+        const auto file = dir / name;
+        std::ofstream out(file);
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        for (size_t i = 0; i < rows; ++i)
+        {
+            out << i + 1 << ';' << i + 1 << ';' << 100 + i % 17 << ".5;1;bid\n";
+        }
+        return file.string();
+    }
+};
+
+TEST_F(FileSchedulerTest, LongestFileFirst)
+{
+    const auto small = write_trades("small.csv", 10);
+    const auto big = write_trades("big.csv", 1000);
+    const auto medium = write_trades("medium.csv", 100);
+
+    const auto tasks = FileScheduler::plan({{small}, {big}, {medium}}, 4);
+    ASSERT_EQ(tasks.size(), 3u);
+    EXPECT_EQ(tasks[0].file, big);
+    EXPECT_EQ(tasks[1].file, medium);
+    EXPECT_EQ(tasks[2].file, small);
+    for (const auto& task : tasks)
+    {
+        EXPECT_EQ(task.begin, 0u);
+        EXPECT_EQ(task.end, std::numeric_limits<uint64_t>::max());
+    }
+}
+
+TEST_F(FileSchedulerTest, OutlierIsSplitAtLineStarts)
+{
+    const auto big = write_trades("big.csv", 5000);
+    const auto small = write_trades("small.csv", 50);
+
+    const auto tasks = FileScheduler::plan({{big}, {small}}, 4, 1);
+    const auto pieces = std::count_if(tasks.begin(), tasks.end(), [&](const auto& task) { return task.file == big; });
+    EXPECT_GT(pieces, 1);
+
+    std::ifstream in(big, std::ios::binary);
+    for (const auto& task : tasks)
+    {
+        if (task.begin != 0)
+        {
+            in.seekg(task.begin - 1);
+            EXPECT_EQ(in.get(), '\n');
+        }
+    }
+
+    CsvParser parser(1 << 20, 4);
+    for (const auto& task : tasks)
+    {
+        parser.add_file_to_parse(task.file, task.begin, task.end);
+    }
+    parser.wait_task_done();
+    std::vector<uint64_t> ts;
+    while (auto data = parser.get_ready_data())
+    {
+        for (const auto& record : *data)
+        {
+            ts.push_back(record.receive_ts);
+        }
+    }
+    EXPECT_EQ(ts.size(), 5050u);
+    std::sort(ts.begin(), ts.end());
+    EXPECT_EQ(std::unique(ts.begin(), ts.end()) - ts.begin(), 5000);
+
+    const auto progress = parser.get_file_progress();
+    EXPECT_EQ(progress.at(big).offset, std::filesystem::file_size(big));
+    EXPECT_EQ(progress.at(big).rows, 5000u);
+    EXPECT_EQ(progress.at(big).last_ts, 5000u);
+}
+
+TEST_F(FileSchedulerTest, TimeWindowOfSortedFile)
+{
+    const auto file = write_trades("sorted.csv", 5000);
+    const uint64_t size = std::filesystem::file_size(file);
+
+    const auto window = FileScheduler::seek_time_range({file}, 1000, 2000);
+    std::ifstream in(file, std::ios::binary);
+    std::string line;
+    in.seekg(window.offset);
+    std::getline(in, line);
+    EXPECT_EQ(line.rfind("1000;", 0), 0u);
+    in.seekg(window.end);
+    std::getline(in, line);
+    EXPECT_EQ(line.rfind("2000;", 0), 0u);
+
+    // A window from before the first row keeps the header path, one past the last row is empty
+    EXPECT_EQ(FileScheduler::seek_time_range({file}, 1, 3).offset, 0u);
+    EXPECT_EQ(FileScheduler::seek_time_range({file}, 6000, 7000).offset, size);
+    EXPECT_EQ(FileScheduler::seek_time_range({file}, 1, 7000).end, std::numeric_limits<uint64_t>::max());
+
+    // Seeking and stopping early must keep exactly the rows the plain filter keeps
+    for (bool sorted : {false, true})
+    {
+        CsvParser parser(1 << 20, 2);
+        parser.set_time_range(CsvParser::TimeRange{1000, 2000}, sorted);
+        for (const auto& task : FileScheduler::plan({sorted ? window : FileScheduler::Input{file}}, 2, 1))
+        {
+            parser.add_file_to_parse(task.file, task.begin, task.end);
+        }
+        parser.wait_task_done();
+        std::vector<uint64_t> ts;
+        while (auto data = parser.get_ready_data())
+        {
+            for (const auto& record : *data)
+            {
+                ts.push_back(record.receive_ts);
+            }
+        }
+        std::sort(ts.begin(), ts.end());
+        ASSERT_EQ(ts.size(), 1000u) << sorted;
+        EXPECT_EQ(ts.front(), 1000u);
+        EXPECT_EQ(ts.back(), 1999u);
+    }
+}
+
+TEST_F(FileSchedulerTest, SamplesAndBoundsOfFiles)
+{
+    const auto small = write_trades("small.csv", 1000);
+    const auto large = write_trades("large.csv", 9000);
+    const auto bounds = FileScheduler::sorted_bounds(large);
+    ASSERT_TRUE(bounds);
+    EXPECT_EQ(bounds->first, 1u);
+    EXPECT_EQ(bounds->second, 9000u);
+
+    const auto sample = FileScheduler::sample_ts({{small}, {large, 0, std::filesystem::file_size(large) / 2}}, 100);
+    ASSERT_GE(sample.size(), 90u);
+    ASSERT_LE(sample.size(), 110u);
+    // Spread over both files by their share of the bytes: the 1000 rows of the small file and the first 4500 or so of
+    // the large one, of which the rows past 1000 are most
+    const auto past_small = std::ranges::count_if(sample, [](uint64_t ts) { return ts > 1000; });
+    EXPECT_GT(past_small, static_cast<long>(sample.size() / 2));
+    EXPECT_LT(*std::ranges::max_element(sample), 4600u);
+    EXPECT_TRUE(FileScheduler::sample_ts({{(dir / "missing.csv").string()}}, 10).empty());
+}
+
+TEST_F(FileSchedulerTest, PartitionedSortMatchesMergeSort)
+{
+    // Unique receive_ts, rows of the second file in reverse order
+    write_trades("sorted.csv", 6000);
+    {
+        std::ofstream out(dir / "reversed.csv");
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        for (size_t i = 12000; i > 6000; --i)
+        {
+            out << i << ';' << i << ';' << 100 + i * 7919 % 503 << ".25;1;ask\n";
+        }
+    }
+    auto output = [this](uint64_t max_memory, bool partitioned, bool sorted)
+    {
+        MedianPipeline::Options options;
+        options.files = {dir / "sorted.csv", dir / "reversed.csv"};
+        options.output_file = (dir / "median.csv").string();
+        options.max_memory = max_memory;
+        options.max_threads = 2;
+        options.sorted_input = sorted;
+        options.partitioned_sort = partitioned;
+        options.partitions = 4;
+        EXPECT_TRUE(MedianPipeline(options).run());
+        std::ifstream in(options.output_file, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    };
+    // In memory, then over a budget of a few thousand records with spilled ranges
+    for (uint64_t max_memory : {uint64_t(64) << 20, uint64_t(1) << 16})
+    {
+        const auto expected = output(max_memory, false, false);
+        ASSERT_FALSE(expected.empty());
+        EXPECT_EQ(output(max_memory, true, false), expected) << max_memory;
+        // Splitters from the bounds of the first file only cover half the keys
+        EXPECT_EQ(output(max_memory, true, true), expected) << max_memory;
+    }
+}
+
+TEST_F(FileSchedulerTest, CgroupLimitsNarrowResources)
+{
+    std::filesystem::create_directories(dir / "cgroup" / "app");
+    std::ofstream(dir / "cgroup" / "memory.max") << "max\n";
+    std::ofstream(dir / "cgroup" / "app" / "memory.max") << (256ull << 20) << "\n";
+    std::ofstream(dir / "cgroup" / "app" / "cpu.max") << "150000 100000\n";
+    std::ofstream(dir / "self_cgroup") << "0::/app\n";
+
+    EXPECT_EQ(system_resources::read_cpu_max(dir / "cgroup" / "app" / "cpu.max"), 2u);
+    EXPECT_EQ(system_resources::read_memory_max(dir / "cgroup" / "memory.max"), std::nullopt);
+
+    const auto resources = system_resources::detect(dir / "cgroup", dir / "self_cgroup");
+    EXPECT_TRUE(resources.memory_limited);
+    EXPECT_EQ(resources.memory, 256ull << 20);
+    EXPECT_LE(resources.cpus, 2u);
+    EXPECT_GE(resources.cpus, 1u);
+
+    // Every buffer sized from the default, at their peak during parsing, fits in memory.max
+    const uint32_t threads = 2;
+    const MedianPipeline::Options defaults;
+    const double multiplier = system_resources::memory_multiplier(threads, defaults.queue_depth, defaults.max_pending_spills);
+    EXPECT_DOUBLE_EQ(multiplier, 5.25);
+    const uint64_t max_memory = system_resources::default_memory(resources, multiplier);
+    CsvParser parser(max_memory, threads);
+    const uint64_t chunk = parser.get_max_elements() / threads * sizeof(CsvParser::ParserData);
+    const uint64_t sort_buffer = parser.get_max_elements() * sizeof(CsvParser::ParserData);
+    // Chunks being filled and the ready queue of one per thread, the sort buffer and the runs waiting for a spill
+    const uint64_t peak = 2 * threads * chunk + sort_buffer * (1 + defaults.max_pending_spills) + BufferPool<CsvParser::ParserData>::idle_budget(max_memory);
+    EXPECT_LE(peak, resources.memory);
+    EXPECT_GT(peak, resources.memory * 9 / 10);
+    // A deeper queue and more pending spills leave less for each buffer
+    EXPECT_LT(system_resources::default_memory(resources, system_resources::memory_multiplier(threads, 8, 4)), max_memory);
+    EXPECT_EQ(system_resources::default_memory(system_resources::Resources{}, multiplier), 524288000u);
+}
@@ -0,0 +1,141 @@
+#include "../src/follow/follower.hpp"
+#include "../src/follow/reorder_buffer.hpp"
+#include "../src/out_writer/algorithm_median.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    std::string format_row(const CsvParser::ParserData& row)
+    {
+        std::ostringstream ss;
+        ss << row.receive_ts << ";0;" << std::fixed << row.price << ";1;buy\n";
+        return ss.str();
+    }
+
+    // Child process: appends rows to two files in small pieces, splitting lines between writes
+    void write_files(const std::filesystem::path& dir, const std::vector<CsvParser::ParserData>& data)
+    {
+        std::ofstream files[2] {std::ofstream(dir / "trades_a.csv"), std::ofstream(dir / "trades_b.csv")};
+        for (auto& file : files)
+        {
+            file << "receive_ts;exchange_ts;price;quantity;side\n" << std::flush;
+        }
+        const size_t chunk = 200;
+        for (size_t begin = 0; begin < data.size(); begin += chunk)
+        {
+            for (size_t i = begin; i < std::min(begin + chunk, data.size()); ++i)
+            {
+                files[i % 2] << format_row(data[i]);
+            }
+            for (auto& file : files)
+            {
+                file.flush();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        // Last line is written in two halves to check that partial lines are held back
+        CsvParser::ParserData last {data.back().receive_ts + 1, 70000.0};
+        std::string line = format_row(last);
+        files[0] << line.substr(0, 10) << std::flush;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        files[0] << line.substr(10) << std::flush;
+    }
+} //anonymous namespace
+
+TEST(ReorderBufferTest, OrdersWithinLatenessAndDropsLateRows)
+{
+    using Clock = ReorderBuffer::Clock;
+    ReorderBuffer reorder(10, std::chrono::hours(1), 100);
+    std::vector<uint64_t> released;
+    auto emit = [&](const ReorderBuffer::Entry& entry)
+    {
+        released.push_back(entry.receive_ts);
+    };
+    const auto now = Clock::now();
+
+    for (uint64_t ts : {5, 3, 4, 1})
+    {
+        EXPECT_TRUE(reorder.push({ts, 0.0, now}));
+    }
+    reorder.release(now, emit);
+    EXPECT_TRUE(released.empty());
+
+    EXPECT_TRUE(reorder.push({14, 0.0, now}));
+    reorder.release(now, emit);
+    EXPECT_EQ(released, (std::vector<uint64_t>{1, 3, 4}));
+
+    EXPECT_FALSE(reorder.push({2, 0.0, now}));
+    EXPECT_EQ(reorder.dropped(), 1u);
+
+    // max_delay releases everything up to the overdue row even without newer data
+    reorder.release(now + std::chrono::hours(2), emit);
+    EXPECT_EQ(released, (std::vector<uint64_t>{1, 3, 4, 5, 14}));
+    EXPECT_EQ(reorder.size(), 0u);
+}
+
+TEST(FollowTest, MatchesBatchMedianWhileFilesAreWritten)
+{
+    const auto dir = std::filesystem::temp_directory_path() / ("follow_test_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "in");
+
+    std::vector<CsvParser::ParserData> data;
+    std::srand(11);
+    int64_t ticks = 684800;
+    for (uint64_t i = 0; i < 20000; ++i)
+    {
+        ticks += std::rand() % 5 - 2;
+        data.push_back({1716810808000000 + i * 10, ticks / 10.0});
+    }
+
+    Follower::Options options;
+    options.input = dir / "in";
+    options.filter = [](const std::filesystem::path& file)
+    {
+        return file.extension() == ".csv";
+    };
+    options.output_file = (dir / "follow.csv").string();
+    // Both files are written one chunk at a time, so a row never lags more than a chunk behind
+    options.lateness = 200 * 10;
+    options.max_delay = std::chrono::seconds(30);
+    Follower follower(options);
+    std::atomic<bool> stop {false};
+    std::thread runner([&]()
+    {
+        follower.run(stop);
+    });
+
+    pid_t pid = ::fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0)
+    {
+        write_files(dir / "in", data);
+        ::_exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    stop = true;
+    runner.join();
+
+    data.push_back({data.back().receive_ts + 1, 70000.0});
+    MedianAlgorithm batch;
+    batch.process_in_memory(std::vector<CsvParser::ParserData>(data), (dir / "batch.csv").string());
+
+    EXPECT_EQ(follower.stats().rows, data.size());
+    EXPECT_EQ(follower.stats().dropped, 0u);
+    EXPECT_EQ(follower.latency().count(), data.size());
+    EXPECT_EQ(test_util::read_file(dir / "follow.csv"), test_util::read_file(dir / "batch.csv"));
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,169 @@
+#include "../src/generator/market_data_generator.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    std::vector<CsvParser::ParserData> drain(CsvParser& parser)
+    {
+        std::vector<CsvParser::ParserData> res;
+        parser.wait_task_done();
+        while (auto data = parser.get_ready_data())
+        {
+            res.insert(res.end(), data->begin(), data->end());
+        }
+        return res;
+    }
+
+    std::vector<uint64_t> read_receive_ts(const std::filesystem::path& file)
+    {
+        std::vector<uint64_t> res;
+        std::ifstream in(file);
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line))
+        {
+            CsvParser::ParserData record;
+            try
+            {
+                if (CsvParser::parse_line(line, record))
+                {
+                    res.push_back(record.receive_ts);
+                }
+            }
+            catch (const std::exception&)
+            {
+
+            }
+        }
+        return res;
+    }
+} //anonymous namespace
+
+class GeneratorTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("generator_test_" + std::to_string(::getpid()));
+        std::filesystem::remove_all(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+};
+
+TEST_F(GeneratorTest, OutputDependsOnlyOnSeed)
+{
+    MarketDataGenerator::Options options;
+    options.files = 3;
+    // More than one segment per file, so segments are formatted in parallel and stitched
+    options.rows = 1200000;
+    options.size_skew = 1.0;
+    options.disorder = 0.01;
+    options.malformed_rate = 0.001;
+
+    options.output_dir = dir / "a";
+    options.threads = 4;
+    MarketDataGenerator(options).run();
+    options.output_dir = dir / "b";
+    options.threads = 1;
+    MarketDataGenerator(options).run();
+    options.output_dir = dir / "c";
+    options.seed = 2;
+    MarketDataGenerator(options).run();
+
+    for (const char* name : {"trades_0.csv", "trades_1.csv", "trades_2.csv"})
+    {
+        EXPECT_EQ(test_util::read_file(dir / "a" / name), test_util::read_file(dir / "b" / name)) << name;
+        EXPECT_NE(test_util::read_file(dir / "a" / name), test_util::read_file(dir / "c" / name)) << name;
+    }
+    EXPECT_GT(std::filesystem::file_size(dir / "a" / "trades_0.csv"), std::filesystem::file_size(dir / "a" / "trades_2.csv"));
+}
+
+TEST_F(GeneratorTest, ParserReadsEveryWellFormedRow)
+{
+    MarketDataGenerator::Options options;
+    options.output_dir = dir;
+    options.files = 2;
+    options.rows = 50000;
+    options.malformed_rate = 0.02;
+    options.overlap = 0.0;
+    auto stats = MarketDataGenerator(options).run();
+
+    uint64_t rows = 0;
+    uint64_t malformed = 0;
+    CsvParser parser(1 << 24, 2);
+    for (const auto& file : stats)
+    {
+        rows += file.rows;
+        malformed += file.malformed;
+        EXPECT_EQ(std::filesystem::file_size(file.path), file.bytes);
+        parser.add_file_to_parse(file.path.string());
+    }
+    EXPECT_EQ(rows + malformed, options.rows);
+    EXPECT_GT(malformed, 0u);
+
+    auto data = drain(parser);
+    EXPECT_EQ(data.size(), rows);
+
+    // Without disorder and overlap every file is sorted and the second one starts after the first
+    auto first = read_receive_ts(stats[0].path);
+    auto second = read_receive_ts(stats[1].path);
+    ASSERT_FALSE(first.empty());
+    ASSERT_FALSE(second.empty());
+    EXPECT_TRUE(std::ranges::is_sorted(first));
+    EXPECT_TRUE(std::ranges::is_sorted(second));
+    EXPECT_LT(first.back(), second.front());
+}
+
+TEST_F(GeneratorTest, LevelRebuildWritesFullBook)
+{
+    MarketDataGenerator::Options options;
+    options.output_dir = dir;
+    options.kind = MarketDataGenerator::Kind::level;
+    options.rows = 1000;
+    MarketDataGenerator(options).run();
+
+    std::ifstream in(dir / "level_0.csv");
+    std::string line;
+    std::getline(in, line);
+    EXPECT_EQ(line, "receive_ts;exchange_ts;price;quantity;side;rebuild");
+
+    // The first event is a rebuild: five bids below five asks, all with one receive_ts
+    std::vector<std::string> sides;
+    std::string first_ts;
+    for (int i = 0; i < 10 && std::getline(in, line); ++i)
+    {
+        std::stringstream ss(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (std::getline(ss, token, ';'))
+        {
+            tokens.push_back(token);
+        }
+        ASSERT_EQ(tokens.size(), 6u);
+        EXPECT_EQ(tokens[5], "1");
+        if (first_ts.empty())
+        {
+            first_ts = tokens[0];
+        }
+        EXPECT_EQ(tokens[0], first_ts);
+        sides.push_back(tokens[4]);
+    }
+    EXPECT_EQ(std::count(sides.begin(), sides.end(), "bid"), 5);
+    EXPECT_EQ(std::count(sides.begin(), sides.end(), "ask"), 5);
+}
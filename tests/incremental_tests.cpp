@@ -0,0 +1,228 @@
+#include "../src/out_writer/algorithm_median.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "../src/checkpoint/checkpoint_store.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <cstdlib>
+
+namespace
+{
+    std::vector<CsvParser::ParserData> make_data(size_t rows)
+    {
+        std::vector<CsvParser::ParserData> data;
+        std::srand(7);
+        int64_t ticks = 684800;
+        for (uint64_t i = 0; i < rows; ++i)
+        {
+            ticks += std::rand() % 5 - 2;
+            data.push_back({1716810808000000 + i, ticks / 10.0});
+        }
+        return data;
+    }
+
+    // Sorted run in the layout process_file reads: the record count, then the records
+    std::string write_sorted(const std::string& file_name, std::span<const CsvParser::ParserData> data)
+    {
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        const uint64_t count = data.size();
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        ParserDataSerializer ser;
+        for (const auto& record : data)
+        {
+            ser.write(out, record);
+        }
+        return file_name;
+    }
+
+    class VectorCursor : public IRecordCursor<CsvParser::ParserData>
+    {
+    public:
+        explicit VectorCursor(std::vector<CsvParser::ParserData> data) : m_data(std::move(data))
+        {
+
+        }
+        bool next(CsvParser::ParserData& value) override
+        {
+            if (m_next == m_data.size())
+            {
+                return false;
+            }
+            value = m_data[m_next++];
+            return true;
+        }
+        uint64_t size() const override
+        {
+            return m_data.size();
+        }
+    private:
+        std::vector<CsvParser::ParserData> m_data;
+        size_t m_next = 0;
+    };
+
+    std::vector<CsvParser::ParserData> drain(CsvParser& parser)
+    {
+        std::vector<CsvParser::ParserData> res;
+        parser.wait_task_done();
+        while (auto data = parser.get_ready_data())
+        {
+            res.insert(res.end(), data->begin(), data->end());
+        }
+        return res;
+    }
+} //anonymous namespace
+
+TEST(IncrementalTest, ResumedMedianMatchesFullRun)
+{
+    for (auto mode : {MedianAlgorithm::Mode::heaps, MedianAlgorithm::Mode::parallel})
+    {
+        auto data = make_data(400000);
+        const size_t split = 170001;
+
+        MedianAlgorithm full(mode, 4);
+        full.process_in_memory(std::vector<CsvParser::ParserData>(data), "median_full.csv");
+
+        std::filesystem::remove("median_resumed.csv");
+        MedianAlgorithm first(mode, 4);
+        first.enable_state_tracking();
+        first.process_in_memory(std::vector<CsvParser::ParserData>(data.begin(), data.begin() + split), "median_resumed.csv");
+        ASSERT_TRUE(first.final_state().has_value());
+        EXPECT_EQ(first.final_state()->count, split);
+
+        // Round trip through the checkpoint file like a later run would
+        CheckpointStore::Checkpoint checkpoint;
+        checkpoint.output_file = "median_resumed.csv";
+        checkpoint.files["trades.csv"] = {1234, data[split - 1].receive_ts};
+        checkpoint.watermark = data[split - 1].receive_ts;
+        checkpoint.median = *first.final_state();
+        CheckpointStore::save("checkpoint_test.bin", checkpoint);
+        auto loaded = CheckpointStore::load("checkpoint_test.bin");
+        ASSERT_TRUE(loaded.has_value());
+        EXPECT_EQ(loaded->files["trades.csv"].offset, 1234);
+        EXPECT_EQ(loaded->watermark, checkpoint.watermark);
+        EXPECT_EQ(loaded->median.histogram, checkpoint.median.histogram);
+
+        MedianAlgorithm second(mode, 4);
+        second.enable_state_tracking(loaded->median);
+        second.process_in_memory(std::vector<CsvParser::ParserData>(data.begin() + split, data.end()), "median_resumed.csv");
+        ASSERT_TRUE(second.final_state().has_value());
+        EXPECT_EQ(second.final_state()->count, data.size());
+
+        EXPECT_EQ(test_util::read_file("median_full.csv"), test_util::read_file("median_resumed.csv"));
+        std::filesystem::remove("checkpoint_test.bin");
+    }
+}
+
+TEST(IncrementalTest, ResumedFileMedianMatchesFullRun)
+{
+    const auto data = make_data(200000);
+    const size_t split = 90001;
+    auto ser = std::make_shared<ParserDataSerializer>();
+
+    // An incremental file run is exact, so it matches the heaps from the start and after a resume
+    MedianAlgorithm heaps;
+    heaps.process_in_memory(std::vector<CsvParser::ParserData>(data), "median_full.csv");
+
+    std::filesystem::remove("median_file_full.csv");
+    MedianAlgorithm full;
+    full.enable_state_tracking();
+    full.process_file(ser, write_sorted("sorted_full.bin", data), "median_file_full.csv");
+    ASSERT_TRUE(full.final_state().has_value());
+    EXPECT_EQ(full.final_state()->count, data.size());
+
+    std::filesystem::remove("median_resumed.csv");
+    MedianAlgorithm first;
+    first.enable_state_tracking();
+    first.process_file(ser, write_sorted("sorted_first.bin", std::span(data).first(split)), "median_resumed.csv");
+    ASSERT_TRUE(first.final_state().has_value());
+
+    MedianAlgorithm second;
+    second.enable_state_tracking(*first.final_state());
+    second.process_file(ser, write_sorted("sorted_second.bin", std::span(data).subspan(split)), "median_resumed.csv");
+    ASSERT_TRUE(second.final_state().has_value());
+    EXPECT_EQ(second.final_state()->count, data.size());
+    EXPECT_EQ(second.final_state()->histogram, full.final_state()->histogram);
+
+    EXPECT_EQ(test_util::read_file("median_file_full.csv"), test_util::read_file("median_full.csv"));
+    EXPECT_EQ(test_util::read_file("median_resumed.csv"), test_util::read_file("median_full.csv"));
+    std::filesystem::remove("median_file_full.csv");
+}
+
+TEST(IncrementalTest, ResumeCostsDistinctPricesNotRows)
+{
+    // A billion saved rows over two prices: refilling heaps with them would take 8 GB
+    MedianState saved;
+    saved.histogram = {{100.0, 500000000}, {200.0, 500000000}};
+    saved.count = 1000000000;
+    saved.has_median = true;
+    saved.last_median = 150.0;
+    const std::vector<CsvParser::ParserData> rows {{1, 300.0}, {2, 50.0}, {3, 50.0}};
+    const std::string expected = "receive_ts;price_median\n1;200.00000000\n2;150.00000000\n3;100.00000000\n";
+    const std::vector<std::pair<double, uint64_t>> histogram {{50.0, 2}, {100.0, 500000000}, {200.0, 500000000}, {300.0, 1}};
+
+    std::filesystem::remove("median_resumed.csv");
+    MedianAlgorithm heaps;
+    heaps.enable_state_tracking(saved);
+    heaps.process_in_memory(std::vector<CsvParser::ParserData>(rows), "median_resumed.csv");
+    ASSERT_TRUE(heaps.final_state().has_value());
+    EXPECT_EQ(heaps.final_state()->count, 1000000003u);
+    EXPECT_EQ(heaps.final_state()->histogram, histogram);
+    EXPECT_EQ(test_util::read_file("median_resumed.csv"), expected);
+
+    std::filesystem::remove("median_resumed.csv");
+    MedianAlgorithm packed;
+    packed.enable_state_tracking(saved);
+    VectorCursor cursor(rows);
+    packed.process_sorted(cursor, "median_resumed.csv");
+    ASSERT_TRUE(packed.final_state().has_value());
+    EXPECT_EQ(packed.final_state()->histogram, histogram);
+    EXPECT_EQ(test_util::read_file("median_resumed.csv"), expected);
+    std::filesystem::remove("median_resumed.csv");
+}
+
+TEST(IncrementalTest, ParserContinuesFromOffset)
+{
+    const std::string file_name = "incremental_input.csv";
+    {
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        out << "receive_ts;exchange_ts;price;quantity;side\n"
+            << "1000;900;100.0;1.0;bid\n"
+            << "2000;1900;101.0;2.0;ask\n"
+            << "3000;2900;10";
+    }
+
+    uint64_t offset = 0;
+    {
+        CsvParser parser(1 << 20, 1);
+        parser.set_complete_lines_only(true);
+        parser.add_file_to_parse(file_name);
+        auto rows = drain(parser);
+        ASSERT_EQ(rows.size(), 2);
+        auto progress = parser.get_file_progress();
+        ASSERT_EQ(progress.count(file_name), 1);
+        EXPECT_EQ(progress[file_name].last_ts, 2000);
+        offset = progress[file_name].offset;
+    }
+
+    {
+        std::ofstream out(file_name, std::ios::binary | std::ios::app);
+        out << "2.0;1.5;bid\n4000;3900;103.0;3.0;ask\n";
+    }
+
+    CsvParser parser(1 << 20, 1);
+    parser.set_complete_lines_only(true);
+    parser.add_file_to_parse(file_name, offset);
+    auto rows = drain(parser);
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(rows[0].receive_ts, 3000);
+    EXPECT_DOUBLE_EQ(rows[0].price, 102.0);
+    EXPECT_EQ(rows[1].receive_ts, 4000);
+    EXPECT_EQ(parser.get_file_progress()[file_name].offset, std::filesystem::file_size(file_name));
+    std::filesystem::remove(file_name);
+}
@@ -0,0 +1,69 @@
+#include "../src/logger/logger.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+TEST(RateLimiterTest, SuppressesAboveBurstAndReportsOnNextWindow)
+{
+    logger_helper::RateLimiter limiter(__FILE__, __LINE__, 3, std::chrono::milliseconds(50));
+    uint64_t suppressed = 0;
+    uint32_t allowed = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        allowed += limiter.allow(suppressed);
+        EXPECT_EQ(suppressed, 0u);
+    }
+    EXPECT_EQ(allowed, 3u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    EXPECT_TRUE(limiter.allow(suppressed));
+    EXPECT_EQ(suppressed, 7u);
+    EXPECT_EQ(limiter.take_suppressed(), 0u);
+}
+
+TEST(RejectWriterTest, ParserWritesRejectedRows)
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("reject_test_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    const std::filesystem::path file = dir / "trades.csv";
+    {
+        std::ofstream out(file);
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        out << "1;1;10.5;1;bid\n";
+        out << "2;2;broken;1;bid\n";
+        out << "3;3\n";
+        out << "4;4;11.5;1;ask\n";
+    }
+
+    auto rejects = std::make_shared<RejectWriter>((dir / "rejects.csv").string());
+    uint64_t rows = 0;
+    {
+        CsvParser parser(1 << 20, 1);
+        parser.set_reject_writer(rejects);
+        // Split at the broken row, so the second task starts mid-file and still reports file offsets
+        const uint64_t split = 58;
+        parser.add_file_to_parse(file.string(), 0, split);
+        parser.add_file_to_parse(file.string(), split);
+        parser.wait_task_done();
+        while (auto data = parser.get_ready_data())
+        {
+            rows += data->size();
+        }
+    }
+
+    EXPECT_EQ(rows, 2u);
+    EXPECT_EQ(rejects->rows(), 2u);
+    EXPECT_EQ(test_util::read_file(dir / "rejects.csv"),
+        "file;offset;reason;row\n" +
+        file.string() + ";58;stod;2;2;broken;1;bid\n" +
+        file.string() + ";75;missing columns;3;3\n");
+    std::filesystem::remove_all(dir);
+}
@@ -144,4 +144,57 @@ TEST_F(MedianCalculationTest, CalculatesMedianCorrectlyWithTwoFiles)
     ASSERT_TRUE(std::filesystem::exists("median_res_two.csv")) << "Output file not created";
     bool files_match = compare_csv_files("median_res_two.csv", expected_file);
     EXPECT_TRUE(files_match) << "Generated median file from two parts differs from expected.";
-}
\ No newline at end of file
+}
+
+TEST_F(MedianCalculationTest, ParallelMedianMatchesHeaps) 
+{
+    // Random walk on a 0.1 tick grid so prices repeat, with enough rows to split into several blocks.
+    // Sub-eps jitter makes some median moves fall under the threshold, so block boundaries see a stale filter state
+    std::vector<CsvParser::ParserData> data;
+    std::srand(42);
+    int64_t ticks = 684800;
+    for (uint64_t i = 0; i < 400000; ++i)
+    {
+        ticks += std::rand() % 7 - 3;
+        data.push_back({1716810808000000 + i / 3, ticks / 10.0 + (std::rand() % 3) * 4e-9});
+    }
+
+    MedianAlgorithm heaps(MedianAlgorithm::Mode::heaps);
+    MedianAlgorithm parallel(MedianAlgorithm::Mode::parallel, 4);
+    heaps.process_in_memory(std::vector<CsvParser::ParserData>(data), "median_heaps.csv");
+    parallel.process_in_memory(std::move(data), "median_parallel.csv");
+
+    ASSERT_TRUE(std::filesystem::exists("median_parallel.csv")) << "Output file not created";
+    EXPECT_TRUE(compare_csv_files("median_heaps.csv", "median_parallel.csv")) << "Parallel median differs from heaps.";
+}
+
+TEST_F(MedianCalculationTest, OfflineMedianMatchesHeaps) 
+{
+    // Repeating tick grid prices with sub-eps jitter, enough rows for the block sort on the pool, and a few short inputs
+    std::vector<CsvParser::ParserData> data;
+    std::srand(7);
+    int64_t ticks = 684800;
+    for (uint64_t i = 0; i < 300000; ++i)
+    {
+        ticks += std::rand() % 9 - 4;
+        data.push_back({1716810808000000 + i, ticks / 10.0 + (std::rand() % 3) * 4e-9});
+    }
+
+    for (size_t rows : {size_t(1), size_t(2), size_t(7), data.size()})
+    {
+        std::vector<CsvParser::ParserData> input(data.begin(), data.begin() + rows);
+        MedianAlgorithm heaps(MedianAlgorithm::Mode::heaps);
+        MedianAlgorithm offline(MedianAlgorithm::Mode::offline, 4);
+        heaps.enable_state_tracking();
+        offline.enable_state_tracking();
+        heaps.process_in_memory(std::vector<CsvParser::ParserData>(input), "median_heaps.csv");
+        offline.process_in_memory(std::move(input), "median_offline.csv");
+
+        ASSERT_TRUE(std::filesystem::exists("median_offline.csv")) << "Output file not created";
+        EXPECT_TRUE(compare_csv_files("median_heaps.csv", "median_offline.csv")) << "Offline median differs from heaps for " << rows << " rows.";
+        ASSERT_TRUE(heaps.final_state() && offline.final_state());
+        EXPECT_EQ(offline.final_state()->count, heaps.final_state()->count);
+        EXPECT_EQ(offline.final_state()->last_median, heaps.final_state()->last_median);
+        EXPECT_EQ(offline.final_state()->histogram, heaps.final_state()->histogram);
+    }
+}
@@ -0,0 +1,111 @@
+#include "../src/stream/median_stream.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace
+{
+    std::vector<CsvParser::ParserData> make_ticks(size_t count)
+    {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<int> step(-3, 3);
+        std::vector<CsvParser::ParserData> ticks;
+        double price = 100.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            price += step(rng) * 0.5;
+            ticks.push_back({i + 1, price});
+        }
+        return ticks;
+    }
+} //anonymous namespace
+
+TEST(MedianStreamTest, ReportsOnlyChanges)
+{
+    MedianStream stream;
+    std::vector<MedianStream::Change> changes;
+    auto collect = [&](const MedianStream::Change& change)
+    {
+        changes.push_back(change);
+    };
+    stream.push(1, 100.0, collect);
+    stream.push(2, 102.0, collect);
+    stream.push(3, 99.0, collect);
+    stream.push(4, 100.0, collect);
+    stream.push(5, 100.0, collect);
+
+    ASSERT_EQ(changes.size(), 3u);
+    EXPECT_EQ(changes[0].receive_ts, 1u);
+    EXPECT_DOUBLE_EQ(changes[0].median, 100.0);
+    EXPECT_EQ(changes[1].receive_ts, 2u);
+    EXPECT_DOUBLE_EQ(changes[1].median, 101.0);
+    EXPECT_EQ(changes[2].receive_ts, 3u);
+    EXPECT_DOUBLE_EQ(changes[2].median, 100.0);
+    EXPECT_EQ(stream.size(), 5u);
+}
+
+TEST(MedianStreamTest, BatchMatchesSinglePushesAndKeepsCapacity)
+{
+    const auto ticks = make_ticks(10000);
+    MedianStream single(MedianStream::Options{ticks.size()});
+    MedianStream batch(MedianStream::Options{ticks.size()});
+    const size_t capacity = batch.capacity();
+    ASSERT_GE(capacity, ticks.size());
+
+    std::vector<MedianStream::Change> expected;
+    for (const auto& tick : ticks)
+    {
+        single.push(tick.receive_ts, tick.price, [&](const MedianStream::Change& change) { expected.push_back(change); });
+    }
+
+    std::vector<MedianStream::Change> actual;
+    for (size_t begin = 0; begin < ticks.size(); begin += 1000)
+    {
+        for (const auto& change : batch.push(std::span(ticks).subspan(begin, 1000)))
+        {
+            actual.push_back(change);
+        }
+    }
+
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_EQ(actual[i].receive_ts, expected[i].receive_ts);
+        EXPECT_EQ(actual[i].median, expected[i].median);
+    }
+    // Nothing was reallocated within the reserved capacity
+    EXPECT_EQ(batch.capacity(), capacity);
+}
+
+TEST(MedianStreamTest, ContinuesFromState)
+{
+    const auto ticks = make_ticks(2000);
+    MedianStream full;
+    MedianStream first;
+    std::vector<uint64_t> expected;
+    std::vector<uint64_t> actual;
+    for (size_t i = 0; i < ticks.size(); ++i)
+    {
+        if (full.push(ticks[i].receive_ts, ticks[i].price))
+        {
+            expected.push_back(ticks[i].receive_ts);
+        }
+        if (i < 700 && first.push(ticks[i].receive_ts, ticks[i].price))
+        {
+            actual.push_back(ticks[i].receive_ts);
+        }
+    }
+
+    MedianStream second(MedianStream::Options{}, first.state());
+    for (size_t i = 700; i < ticks.size(); ++i)
+    {
+        if (second.push(ticks[i].receive_ts, ticks[i].price))
+        {
+            actual.push_back(ticks[i].receive_ts);
+        }
+    }
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(second.median(), full.median());
+}
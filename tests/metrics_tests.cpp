@@ -0,0 +1,91 @@
+#include "../src/metrics/metrics.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+class MetricsTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        metrics::Registry::instance().reset();
+        dir = std::filesystem::temp_directory_path() / ("metrics_test_" + std::to_string(::getpid()));
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override
+    {
+        metrics::Registry::instance().reset();
+        std::filesystem::remove_all(dir);
+    }
+};
+
+TEST_F(MetricsTest, RegistryExportsCountersAndGauges)
+{
+    auto& registry = metrics::Registry::instance();
+    registry.add("rows_total", 2, "file", "a.csv");
+    registry.add("rows_total", 3, "file", "a.csv");
+    registry.add("rows_total", 1, "file", "b.csv");
+    registry.max("queue_high_water", 4);
+    registry.max("queue_high_water", 2);
+
+    EXPECT_EQ(registry.to_prometheus(),
+        "# TYPE queue_high_water gauge\n"
+        "queue_high_water 4\n"
+        "# TYPE rows_total counter\n"
+        "rows_total{file=\"a.csv\"} 5\n"
+        "rows_total{file=\"b.csv\"} 1\n");
+
+    const std::string json = registry.to_json();
+    EXPECT_NE(json.find("{\"name\": \"queue_high_water\", \"type\": \"gauge\", \"value\": 4}"), std::string::npos);
+    EXPECT_NE(json.find("{\"name\": \"rows_total\", \"type\": \"counter\", \"labels\": {\"file\": \"a.csv\"}, \"value\": 5}"), std::string::npos);
+
+    registry.write(dir / "metrics.json", dir / "metrics.prom");
+    EXPECT_EQ(test_util::read_file(dir / "metrics.json"), json);
+    EXPECT_EQ(test_util::read_file(dir / "metrics.prom"), registry.to_prometheus());
+    EXPECT_FALSE(std::filesystem::exists(dir / "metrics.prom.tmp"));
+}
+
+TEST_F(MetricsTest, ParserRunIsCounted)
+{
+    if (!metrics::enabled)
+    {
+        GTEST_SKIP() << "Built without CSV_PARSER_METRICS";
+    }
+
+    const std::filesystem::path file = dir / "trades.csv";
+    {
+        std::ofstream out(file);
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        out << "1;1;10.5;1;bid\n";
+        out << "2;2;broken;1;bid\n";
+        out << "3;3;11.5;1;ask\n";
+    }
+
+    {
+        CsvParser parser(1 << 20, 1);
+        parser.add_file_to_parse(file.string());
+        parser.wait_task_done();
+        while (parser.get_ready_data())
+        {
+
+        }
+    }
+
+    const std::string prometheus = metrics::Registry::instance().to_prometheus();
+    const std::string label = "{file=\"" + file.string() + "\"}";
+    EXPECT_NE(prometheus.find("csv_parser_rows_parsed_total" + label + " 2\n"), std::string::npos) << prometheus;
+    EXPECT_NE(prometheus.find("csv_parser_rows_rejected_total" + label + " 1\n"), std::string::npos) << prometheus;
+    EXPECT_NE(prometheus.find("csv_parser_bytes_read_total" + label), std::string::npos) << prometheus;
+    EXPECT_NE(prometheus.find("csv_parser_parse_seconds_total{thread="), std::string::npos) << prometheus;
+    EXPECT_NE(prometheus.find("csv_parser_ready_queue_high_water "), std::string::npos) << prometheus;
+}
@@ -0,0 +1,215 @@
+#include "../src/book/order_book.hpp"
+#include "../src/generator/market_data_generator.hpp"
+#include "../src/pipeline/median_pipeline.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+
+namespace
+{
+    // The same rules on node-based maps: events of rows sharing receive_ts, rebuild clears, a newer level removes
+    // the levels of the other side it crosses
+    struct MapBook
+    {
+        std::map<int64_t, double, std::greater<>> bids;
+        std::map<int64_t, double> asks;
+
+        void update(bool bid, int64_t ticks, double quantity)
+        {
+            if (bid)
+            {
+                quantity == 0.0 ? void(bids.erase(ticks)) : void(bids[ticks] = quantity);
+                while (quantity != 0.0 && !asks.empty() && asks.begin()->first <= ticks)
+                {
+                    asks.erase(asks.begin());
+                }
+            }
+            else
+            {
+                quantity == 0.0 ? void(asks.erase(ticks)) : void(asks[ticks] = quantity);
+                while (quantity != 0.0 && !bids.empty() && bids.begin()->first >= ticks)
+                {
+                    bids.erase(bids.begin());
+                }
+            }
+        }
+    };
+} //anonymous namespace
+
+TEST(PriceLadderTest, KeepsBestLevel)
+{
+    PriceLadder asks(false);
+    EXPECT_TRUE(asks.empty());
+    asks.set(1000, 1.0);
+    asks.set(1200, 2.0);
+    asks.set(990, 3.0);
+    EXPECT_EQ(asks.best_ticks(), 990);
+    EXPECT_EQ(asks.best_quantity(), 3.0);
+    // The next level is several bitmap words away
+    asks.set(990, 0.0);
+    asks.set(1000, 0.0);
+    EXPECT_EQ(asks.best_ticks(), 1200);
+    EXPECT_EQ(asks.levels(), 1u);
+
+    PriceLadder bids(true);
+    bids.set(500, 1.0);
+    bids.set(300, 1.0);
+    bids.set(499, 4.0);
+    EXPECT_EQ(bids.best_ticks(), 500);
+    bids.set(500, 0.0);
+    EXPECT_EQ(bids.best_ticks(), 499);
+    EXPECT_EQ(bids.erase_through(400), 1u);
+    EXPECT_EQ(bids.best_ticks(), 300);
+    bids.clear();
+    EXPECT_TRUE(bids.empty());
+    EXPECT_EQ(bids.quantity(300), 0.0);
+}
+
+TEST(PriceLadderTest, MovesAndGrowsWithThePrice)
+{
+    PriceLadder bids(true, 1 << 14);
+    bids.set(100000, 1.0);
+    // Far below the initial window, the ladder grows and keeps the old level
+    bids.set(100000 - 6000, 2.0);
+    EXPECT_EQ(bids.best_ticks(), 100000);
+    EXPECT_EQ(bids.quantity(94000), 2.0);
+    bids.set(100000, 0.0);
+    EXPECT_EQ(bids.best_ticks(), 94000);
+    // A drifting price moves the ladder instead of growing it past the limit
+    for (int64_t ticks = 94000; ticks < 200000; ticks += 1000)
+    {
+        EXPECT_TRUE(bids.set(ticks + 1000, 1.0));
+        bids.set(ticks, 0.0);
+    }
+    EXPECT_EQ(bids.levels(), 1u);
+    EXPECT_EQ(bids.best_ticks(), 200000);
+    // Beyond max_levels from the occupied levels
+    EXPECT_FALSE(bids.set(200000 + (1 << 14), 1.0));
+    EXPECT_EQ(bids.levels(), 1u);
+}
+
+TEST(OrderBookTest, DerivesPricesFromEvents)
+{
+    BookBuilder builder(BookBuilder::Options{0.5, BookBuilder::Price::mid});
+    EXPECT_FALSE(builder.push("10;9;100.0;1;bid;1"));
+    EXPECT_FALSE(builder.push("10;9;101.0;3;ask;1"));
+    // The event at 10 ends with the first row at 20
+    auto sample = builder.push("20;19;100.5;1;bid;0");
+    ASSERT_TRUE(sample);
+    EXPECT_EQ(sample->receive_ts, 10u);
+    EXPECT_DOUBLE_EQ(sample->price, 100.5);
+    EXPECT_THROW(builder.push("30;29;100.25;1;bid;0"), std::invalid_argument);
+    EXPECT_THROW(builder.push("30;29;100.5;1;bid"), std::invalid_argument);
+    EXPECT_THROW(builder.push("30;29;100.5;1;mid;0"), std::invalid_argument);
+    // A bid through the best ask removes it
+    sample = builder.push("30;29;101.0;2;bid;0");
+    ASSERT_TRUE(sample);
+    EXPECT_DOUBLE_EQ(sample->price, 100.75);
+    EXPECT_FALSE(builder.finish());
+    EXPECT_EQ(builder.book().crossed_levels(), 1u);
+
+    // A rebuild replaces the whole book
+    EXPECT_FALSE(builder.push("40;39;90.0;1;bid;1"));
+    EXPECT_FALSE(builder.push("40;39;91.0;3;ask;1"));
+    sample = builder.finish();
+    ASSERT_TRUE(sample);
+    EXPECT_EQ(sample->receive_ts, 40u);
+    EXPECT_DOUBLE_EQ(sample->price, 90.5);
+    EXPECT_EQ(builder.book().bids().levels(), 1u);
+
+    OrderBook book(0.5);
+    book.update(true, book.ticks(90.0), 1.0);
+    book.update(false, book.ticks(91.0), 3.0);
+    // Leans to the ask, which has more size behind it
+    EXPECT_DOUBLE_EQ(*book.microprice(), (90.0 * 3.0 + 91.0 * 1.0) / 4.0);
+}
+
+TEST(OrderBookTest, PipelineMatchesMapBook)
+{
+    const auto dir = std::filesystem::temp_directory_path() / ("book_test_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(dir);
+    MarketDataGenerator::Options gen;
+    gen.output_dir = dir;
+    gen.kind = MarketDataGenerator::Kind::level;
+    gen.rows = 50000;
+    gen.threads = 2;
+    const auto level = MarketDataGenerator(gen).run().front().path;
+
+    // Mid prices of the map book written as trades
+    const auto trades = dir / "mid.csv";
+    {
+        std::ifstream in(level);
+        std::ofstream out(trades);
+        out.precision(17);
+        out << "receive_ts;exchange_ts;price;quantity;side\n";
+        std::string line;
+        std::getline(in, line);
+        MapBook book;
+        uint64_t event_ts = 0;
+        bool open = false;
+        bool rebuilt = false;
+        auto close = [&]()
+        {
+            if (open && !book.bids.empty() && !book.asks.empty())
+            {
+                out << event_ts << ";0;" << (book.bids.begin()->first + book.asks.begin()->first) * gen.tick_size / 2.0 << ";1;bid\n";
+            }
+        };
+        while (std::getline(in, line))
+        {
+            std::stringstream ss(line);
+            std::string ts, exchange_ts, price, quantity, side, rebuild;
+            std::getline(ss, ts, ';');
+            std::getline(ss, exchange_ts, ';');
+            std::getline(ss, price, ';');
+            std::getline(ss, quantity, ';');
+            std::getline(ss, side, ';');
+            std::getline(ss, rebuild, ';');
+            if (open && std::stoull(ts) != event_ts)
+            {
+                close();
+                rebuilt = false;
+            }
+            open = true;
+            event_ts = std::stoull(ts);
+            if (rebuild == "1" && !rebuilt)
+            {
+                book.bids.clear();
+                book.asks.clear();
+                rebuilt = true;
+            }
+            book.update(side == "bid", std::llround(std::stod(price) / gen.tick_size), std::stod(quantity));
+        }
+        close();
+    }
+
+    MedianPipeline::Options options;
+    options.files = {level};
+    options.output_file = (dir / "book.csv").string();
+    options.max_memory = 64 << 20;
+    options.max_threads = 2;
+    options.book = BookBuilder::Options{gen.tick_size, BookBuilder::Price::mid};
+    ASSERT_TRUE(MedianPipeline(options).run());
+
+    options.files = {trades};
+    options.output_file = (dir / "map.csv").string();
+    options.book.reset();
+    ASSERT_TRUE(MedianPipeline(options).run());
+    const auto expected = test_util::read_file(options.output_file);
+    EXPECT_GT(expected.size(), 1000u);
+    EXPECT_EQ(test_util::read_file(dir / "book.csv"), expected);
+
+    options.incremental = true;
+    options.book = BookBuilder::Options{};
+    EXPECT_FALSE(MedianPipeline(options).run());
+    std::filesystem::remove_all(dir);
+}
@@ -1,6 +1,9 @@
 #include "../src/out_writer/out_writer.hpp"
 #include "../src/out_writer/serializer.hpp"
 #include "../src/out_writer/algorithm.hpp"
+#include "../src/out_writer/csv_median_sink.hpp"
+#include "../src/out_writer/output_sink.hpp"
+#include "../src/out_writer/median_file_reader.hpp"
 
 #include <gtest/gtest.h>
 
@@ -8,6 +11,8 @@
 #include <memory>
 #include <filesystem>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 
 struct TestData 
 {
@@ -206,4 +211,232 @@ TEST_F(OutWriterTest, FileBasedMode)
     ASSERT_EQ(res.size(), 18);
 
     EXPECT_TRUE(is_sorted_by_c(res));
-}
\ No newline at end of file
+}
+
+struct WideTrade
+{
+    uint64_t receive_ts;
+    double price;
+    double quantity;
+    uint64_t exchange_ts;
+    uint32_t side;
+    uint32_t id;
+};
+
+struct WideTradeByTs
+{
+    static uint64_t key(const WideTrade& value)
+    {
+        return value.receive_ts;
+    }
+    bool operator()(const WideTrade& a, const WideTrade& b) const
+    {
+        return a.receive_ts < b.receive_ts;
+    }
+};
+
+class WideTradeCapture : public IAlgorithm<WideTrade>
+{
+public:
+    void process_in_memory(std::vector<WideTrade>&& sorted_data, const std::string&) override
+    {
+        m_sorted_data = std::move(sorted_data);
+    }
+    void process_file(const std::shared_ptr<ISerializer<WideTrade>>, const std::string&, const std::string&) override
+    {
+    }
+    std::vector<WideTrade> m_sorted_data;
+};
+
+template<typename Compare>
+void check_wide_sort(Compare comp)
+{
+    static_assert(sizeof(WideTrade) >= 32);
+    std::vector<WideTrade> data;
+    for (uint32_t i = 0; i < 5000; ++i)
+    {
+        data.push_back({i * 7919 % 1000, i * 0.5, i * 2.0, i * 3ull, i % 2, i});
+    }
+    auto algorithm = std::make_shared<WideTradeCapture>();
+    OutWriter<WideTrade, Compare> writer(data.size(), nullptr, algorithm, comp);
+    writer.collect_data(std::vector<WideTrade>(data));
+    writer.write_data("dummy_output.txt");
+
+    const auto& res = algorithm->m_sorted_data;
+    ASSERT_EQ(res.size(), data.size());
+    std::vector<bool> seen(data.size(), false);
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        if (i != 0)
+        {
+            ASSERT_LE(res[i - 1].receive_ts, res[i].receive_ts);
+        }
+        // Every record moved as a whole
+        const WideTrade& source = data[res[i].id];
+        EXPECT_EQ(res[i].receive_ts, source.receive_ts);
+        EXPECT_EQ(res[i].quantity, source.quantity);
+        EXPECT_EQ(res[i].exchange_ts, source.exchange_ts);
+        EXPECT_FALSE(seen[res[i].id]);
+        seen[res[i].id] = true;
+    }
+}
+
+TEST_F(OutWriterTest, WideRecordsSortByKeyIndex)
+{
+    static_assert(KeyedCompare<WideTradeByTs, WideTrade>);
+    check_wide_sort(WideTradeByTs{});
+}
+
+TEST_F(OutWriterTest, WideRecordsSortByIndexWithComparator)
+{
+    auto comp = [](const WideTrade& a, const WideTrade& b)
+    {
+        return a.receive_ts < b.receive_ts;
+    };
+    static_assert(!KeyedCompare<decltype(comp), WideTrade>);
+    check_wide_sort(comp);
+}
+
+struct TestDataByC
+{
+    static uint64_t key(const TestData& value)
+    {
+        return static_cast<uint64_t>(value.c);
+    }
+    bool operator()(const TestData& a, const TestData& b) const
+    {
+        return a.c < b.c;
+    }
+};
+
+// Sorted by c and each record of data once, a holding its index
+void expect_sorted_permutation(const std::vector<TestData>& res, const std::vector<TestData>& data)
+{
+    ASSERT_EQ(res.size(), data.size());
+    EXPECT_TRUE(is_sorted_by_c(res));
+    std::vector<bool> seen(data.size(), false);
+    for (const auto& record : res)
+    {
+        ASSERT_LT(static_cast<size_t>(record.a), data.size());
+        EXPECT_EQ(record.c, data[record.a].c);
+        EXPECT_FALSE(seen[record.a]);
+        seen[record.a] = true;
+    }
+}
+
+TEST_F(OutWriterTest, PartitionedSortInMemory)
+{
+    std::vector<TestData> data;
+    for (int i = 0; i < 3000; ++i)
+    {
+        data.push_back({i, 0, i * 7919 % 1000});
+    }
+    auto algorithm = std::make_shared<TestAlgorithmImMemory>();
+    OutWriter<TestData, TestDataByC> writer(10000, std::make_shared<TestDataSerializer>(), algorithm);
+    OutWriter<TestData, TestDataByC>::Partitioning partitioning;
+    partitioning.partitions = 8;
+    // Splitters from the first chunk
+    partitioning.sample_size = 500;
+    writer.set_partitioning(partitioning);
+    for (size_t i = 0; i < data.size(); i += 400)
+    {
+        writer.collect_data(std::vector<TestData>(data.begin() + i, data.begin() + std::min(data.size(), i + 400)));
+    }
+    writer.write_data("dummy_output.txt");
+    expect_sorted_permutation(algorithm->get_sorted_data(), data);
+}
+
+TEST_F(OutWriterTest, PartitionedSortSpillsAndSplitsSkewedRanges)
+{
+    std::vector<TestData> data;
+    for (int i = 0; i < 4000; ++i)
+    {
+        // A quarter of the records share one key, more than the whole budget
+        data.push_back({i, 0, i % 4 == 0 ? 5000 : 100 + i * 7919 % 20000});
+    }
+    auto algorithm = std::make_shared<TestAlgorithmFile>();
+    OutWriter<TestData, TestDataByC> writer(256, std::make_shared<TestDataSerializer>(), algorithm, TestDataByC(), 2);
+    OutWriter<TestData, TestDataByC>::Partitioning partitioning;
+    partitioning.partitions = 4;
+    // Far too narrow, nearly everything lands in the last range until it is split
+    partitioning.key_range = std::make_pair(0, 400);
+    writer.set_partitioning(partitioning);
+    for (size_t i = 0; i < data.size(); i += 300)
+    {
+        writer.collect_data(std::vector<TestData>(data.begin() + i, data.begin() + std::min(data.size(), i + 300)));
+    }
+    writer.write_data("dummy_output.txt");
+    expect_sorted_permutation(algorithm->get_sorted_data(), data);
+}
+
+TEST(CsvMedianSinkTest, MatchesStreamFormatting)
+{
+    std::ostringstream expected;
+    expected << "receive_ts;price_median\n" << std::fixed << std::setprecision(8);
+    {
+        // Small buffers so rows cross many buffer hand-offs to the writer thread
+        CsvMedianSink sink("sink_output.csv", 1024);
+        for (uint64_t i = 0; i < 10000; ++i)
+        {
+            double median = 68480.0 + (i % 977) * 0.05 - (i % 3) * 0.000000005;
+            sink.write(1716810808663260 + i, median);
+            expected << 1716810808663260 + i << ";" << median << "\n";
+        }
+        sink.close();
+    }
+
+    std::ifstream in("sink_output.csv", std::ios::binary);
+    std::stringstream actual;
+    actual << in.rdbuf();
+    EXPECT_EQ(actual.str(), expected.str());
+    std::filesystem::remove("sink_output.csv");
+}
+
+
+TEST(MedianFileFormatTest, BinaryAndColumnarRoundTrip)
+{
+    std::vector<median_format::MedianRecord> rows;
+    for (uint64_t i = 0; i < 200000; ++i)
+    {
+        rows.push_back({1716810808663260 + i * 37 % 1000 + i, 68480.0 + (i % 977) * 0.05 - (i % 3) * 0.000000005});
+    }
+
+    for (OutputFormat format : {OutputFormat::binary, OutputFormat::columnar})
+    {
+        std::string file_name = "median_output" + output_extension(format);
+        {
+            auto sink = make_output_sink(format, file_name);
+            for (const auto& row : rows)
+            {
+                sink->write(row.receive_ts, row.median);
+            }
+            sink->close();
+        }
+
+        std::vector<median_format::MedianRecord> res;
+        if (format == OutputFormat::binary)
+        {
+            BinaryMedianReader reader(file_name);
+            for (uint64_t i = 0; i < reader.size(); ++i)
+            {
+                res.push_back(reader.at(i));
+            }
+        }
+        else
+        {
+            ColumnarMedianReader reader(file_name);
+            ASSERT_EQ(reader.blocks().size(), (rows.size() + median_format::default_block_rows - 1) / median_format::default_block_rows);
+            EXPECT_EQ(reader.blocks().front().min_ts, rows.front().receive_ts);
+            res = reader.read_all();
+            EXPECT_LT(std::filesystem::file_size(file_name), rows.size() * median_format::binary_record_size / 2);
+        }
+
+        ASSERT_EQ(res.size(), rows.size()) << file_name;
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            ASSERT_EQ(res[i].receive_ts, rows[i].receive_ts) << file_name << " row " << i;
+            ASSERT_EQ(res[i].median, rows[i].median) << file_name << " row " << i;
+        }
+        std::filesystem::remove(file_name);
+    }
+}
@@ -0,0 +1,223 @@
+#include "../src/out_writer/out_writer.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+#include "../src/out_writer/algorithm_median.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    auto by_ts = [](const CsvParser::ParserData& a, const CsvParser::ParserData& b)
+    {
+        return a.receive_ts < b.receive_ts;
+    };
+
+    // Unsorted ticks on a 0.01 grid with repeated timestamps
+    std::vector<CsvParser::ParserData> make_ticks(size_t count, uint64_t ts_step = 1)
+    {
+        std::mt19937_64 rng(7);
+        std::uniform_int_distribution<int> step(-5, 5);
+        std::uniform_int_distribution<uint64_t> jitter(0, 50);
+        std::vector<CsvParser::ParserData> ticks;
+        int64_t cents = 6848010;
+        for (size_t i = 0; i < count; ++i)
+        {
+            cents += step(rng);
+            ticks.push_back({1716810808000000 + (i / 2 + jitter(rng)) * ts_step, cents / 100.0});
+        }
+        return ticks;
+    }
+
+    std::vector<CsvParser::ParserData> unpack(const PackedChunk& chunk)
+    {
+        std::vector<CsvParser::ParserData> res;
+        for (size_t i = 0; i < chunk.size(); ++i)
+        {
+            res.push_back(chunk.at(i));
+        }
+        return res;
+    }
+
+    void expect_same(const std::vector<CsvParser::ParserData>& a, const std::vector<CsvParser::ParserData>& b)
+    {
+        ASSERT_EQ(a.size(), b.size());
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            EXPECT_EQ(a[i].receive_ts, b[i].receive_ts) << i;
+            EXPECT_EQ(a[i].price, b[i].price) << i;
+        }
+    }
+
+    // Forwards to the median engine and records what the writer handed over
+    class BudgetProbe : public IAlgorithm<CsvParser::ParserData>
+    {
+    public:
+        explicit BudgetProbe(MedianAlgorithm::Mode mode) : m_engine(mode, 4)
+        {
+
+        }
+        bool random_access() const override
+        {
+            return m_engine.random_access();
+        }
+        void process_in_memory(std::vector<CsvParser::ParserData>&& sorted_data, const std::string& output_file) override
+        {
+            max_capacity = std::max(max_capacity, sorted_data.capacity());
+            m_engine.process_in_memory(std::move(sorted_data), output_file);
+        }
+        void process_file(const std::shared_ptr<ISerializer<CsvParser::ParserData>> serializer, const std::string& sorted_input_file, const std::string& output_file) override
+        {
+            ++file_runs;
+            m_engine.process_file(serializer, sorted_input_file, output_file);
+        }
+        void process_sorted(IRecordCursor<CsvParser::ParserData>& sorted_data, const std::string& output_file) override
+        {
+            ++sorted_runs;
+            m_engine.process_sorted(sorted_data, output_file);
+        }
+
+        size_t max_capacity = 0;
+        uint32_t file_runs = 0;
+        uint32_t sorted_runs = 0;
+    private:
+        MedianAlgorithm m_engine;
+    };
+} //anonymous namespace
+
+TEST(PackedChunkTest, NarrowChunkRoundTripsSorted)
+{
+    auto data = make_ticks(5000);
+    data.push_back({1716810808000100, 68480.0001});
+    PackedChunk chunk = PackedChunk::pack(data, by_ts);
+    EXPECT_EQ(chunk.layout(), PackedChunk::Layout::narrow);
+    EXPECT_LE(chunk.bytes(), data.size() * 8);
+
+    std::stable_sort(data.begin(), data.end(), by_ts);
+    auto packed = unpack(chunk);
+    ASSERT_TRUE(std::is_sorted(packed.begin(), packed.end(), by_ts));
+    // Same multiset of records: equal timestamps may come in any order
+    auto by_ts_price = [](const CsvParser::ParserData& a, const CsvParser::ParserData& b)
+    {
+        return a.receive_ts != b.receive_ts ? a.receive_ts < b.receive_ts : a.price < b.price;
+    };
+    std::sort(data.begin(), data.end(), by_ts_price);
+    std::sort(packed.begin(), packed.end(), by_ts_price);
+    expect_same(packed, data);
+}
+
+TEST(PackedChunkTest, WideTimestampsAndOffGridPrices)
+{
+    auto wide = make_ticks(1000, 1ull << 30);
+    PackedChunk chunk = PackedChunk::pack(wide, by_ts);
+    EXPECT_EQ(chunk.layout(), PackedChunk::Layout::wide);
+    EXPECT_EQ(unpack(chunk).size(), wide.size());
+
+    std::vector<CsvParser::ParserData> off_grid {{3, 1.0 / 3.0}, {1, 2.5}, {2, 1e9}};
+    PackedChunk raw = PackedChunk::pack(off_grid, by_ts);
+    EXPECT_EQ(raw.layout(), PackedChunk::Layout::raw);
+    expect_same(unpack(raw), {{1, 2.5}, {2, 1e9}, {3, 1.0 / 3.0}});
+
+    std::vector<CsvParser::ParserData> negative {{2, -0.01}, {1, -1e7}, {3, 0.0}};
+    PackedChunk packed = PackedChunk::pack(negative, by_ts);
+    EXPECT_EQ(packed.layout(), PackedChunk::Layout::narrow);
+    expect_same(unpack(packed), {{1, -1e7}, {2, -0.01}, {3, 0.0}});
+}
+
+TEST(PackedChunkTest, MergeKeepsChunkOrderForEqualKeys)
+{
+    std::vector<PackedChunk> chunks;
+    chunks.push_back(PackedChunk::pack({{1, 10.0}, {3, 30.0}}, by_ts));
+    chunks.push_back(PackedChunk::pack({{1, 11.0}, {2, 20.0}}, by_ts));
+    PackedMerge merge(chunks, by_ts);
+    EXPECT_EQ(merge.size(), 4u);
+    std::vector<CsvParser::ParserData> res;
+    CsvParser::ParserData value;
+    while (merge.next(value))
+    {
+        res.push_back(value);
+    }
+    expect_same(res, {{1, 10.0}, {1, 11.0}, {2, 20.0}, {3, 30.0}});
+}
+
+TEST(PackedChunkTest, PackedWriterMatchesInMemoryMedian)
+{
+    const auto tmp = std::filesystem::temp_directory_path();
+    const auto packed_file = tmp / ("packed_median_" + std::to_string(::getpid()) + ".csv");
+    const auto expected_file = tmp / ("packed_expected_" + std::to_string(::getpid()) + ".csv");
+    // Distinct timestamps, so both paths see the same order
+    std::vector<CsvParser::ParserData> data;
+    for (const auto& tick : make_ticks(20000))
+    {
+        data.push_back({data.size() * 7 % 20000, tick.price});
+    }
+
+    auto ser = std::make_shared<ParserDataSerializer>();
+    {
+        OutWriter<CsvParser::ParserData, decltype(by_ts)> writer(data.size(), ser, std::make_shared<MedianAlgorithm>(), by_ts);
+        for (size_t i = 0; i < data.size(); i += 999)
+        {
+            writer.collect_data(std::vector<CsvParser::ParserData>(data.begin() + i, data.begin() + std::min(data.size(), i + 999)));
+        }
+        writer.write_data(packed_file.string());
+    }
+
+    auto sorted = data;
+    std::sort(sorted.begin(), sorted.end(), by_ts);
+    MedianAlgorithm().process_in_memory(std::move(sorted), expected_file.string());
+
+    const std::string expected = test_util::read_file(expected_file);
+    EXPECT_FALSE(expected.empty());
+    EXPECT_EQ(test_util::read_file(packed_file), expected);
+    std::filesystem::remove(packed_file);
+    std::filesystem::remove(expected_file);
+}
+
+TEST(PackedChunkTest, RandomAccessEngineStaysInBudget)
+{
+    const auto tmp = std::filesystem::temp_directory_path();
+    const auto output = tmp / ("packed_random_access_" + std::to_string(::getpid()) + ".csv");
+    const auto expected_file = tmp / ("packed_random_expected_" + std::to_string(::getpid()) + ".csv");
+    std::vector<CsvParser::ParserData> data;
+    for (const auto& tick : make_ticks(300000))
+    {
+        data.push_back({data.size() * 7 % 300000, tick.price});
+    }
+    auto ser = std::make_shared<ParserDataSerializer>();
+    auto run = [&](uint64_t max_elements)
+    {
+        auto probe = std::make_shared<BudgetProbe>(MedianAlgorithm::Mode::parallel);
+        OutWriter<CsvParser::ParserData, decltype(by_ts)> writer(max_elements, ser, probe, by_ts);
+        for (size_t i = 0; i < data.size(); i += 999)
+        {
+            writer.collect_data(std::vector<CsvParser::ParserData>(data.begin() + i, data.begin() + std::min(data.size(), i + 999)));
+        }
+        writer.write_data(output.string());
+        return probe;
+    };
+
+    // Nothing is packed and unpacked again: the engine gets the sort buffer itself
+    auto fits = run(data.size());
+    EXPECT_EQ(fits->sorted_runs, 0u);
+    EXPECT_EQ(fits->file_runs, 0u);
+    EXPECT_LE(fits->max_capacity, data.size());
+    auto sorted = data;
+    std::sort(sorted.begin(), sorted.end(), by_ts);
+    MedianAlgorithm().process_in_memory(std::move(sorted), expected_file.string());
+    EXPECT_EQ(test_util::read_file(output), test_util::read_file(expected_file));
+
+    // Packed, twice the rows would have stayed in memory; unpacked they spill
+    auto spills = run(data.size() / 2);
+    EXPECT_EQ(spills->sorted_runs, 0u);
+    EXPECT_EQ(spills->file_runs, 1u);
+    EXPECT_EQ(spills->max_capacity, 0u);
+    std::filesystem::remove(output);
+    std::filesystem::remove(expected_file);
+}
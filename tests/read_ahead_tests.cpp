@@ -0,0 +1,151 @@
+#include "../src/system/read_ahead.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::filesystem::path temp_file(const std::string& name, const std::string& content)
+    {
+        const auto file = std::filesystem::temp_directory_path() / (name + "_" + std::to_string(::getpid()));
+        std::ofstream out(file, std::ios::binary);
+        out << content;
+        return file;
+    }
+
+    std::string pattern(size_t bytes)
+    {
+        std::string content(bytes, '\0');
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            content[i] = static_cast<char>('a' + (i * 7 + i / 251) % 26);
+        }
+        return content;
+    }
+
+    std::string read_rest(read_ahead::File& file)
+    {
+        std::string res;
+        for (auto block = file.next(); !block.empty(); block = file.next())
+        {
+            res.append(block.data(), block.size());
+        }
+        return res;
+    }
+} //anonymous namespace
+
+TEST(ReadAheadTest, ReadsInOrderWithBothBackends)
+{
+    const auto content = pattern(300000);
+    const auto file = temp_file("read_ahead", content);
+    const auto saved = read_ahead::options();
+    for (auto backend : {read_ahead::Backend::threads, read_ahead::Backend::uring})
+    {
+        for (uint32_t depth : {2u, 5u})
+        {
+            read_ahead::Options options = saved;
+            options.backend = backend;
+            options.depth = depth;
+            read_ahead::configure(options);
+            // Blocks of 4 KB, so several rounds of the ring and a short last block
+            read_ahead::File in(file.string(), 1234, std::numeric_limits<uint64_t>::max(), 4096);
+            ASSERT_TRUE(in.is_open());
+            if (backend == read_ahead::Backend::threads)
+            {
+                EXPECT_EQ(in.backend(), read_ahead::Backend::threads);
+            }
+            EXPECT_EQ(read_rest(in), content.substr(1234)) << read_ahead::backend_name(in.backend()) << " depth " << depth;
+            EXPECT_TRUE(in.next().empty());
+        }
+    }
+    read_ahead::configure(saved);
+    EXPECT_FALSE(read_ahead::File(file.string() + ".missing").is_open());
+    EXPECT_EQ(read_ahead::parse_backend("uring"), read_ahead::Backend::uring);
+    EXPECT_THROW(read_ahead::parse_backend("aio"), std::invalid_argument);
+    std::filesystem::remove(file);
+}
+
+TEST(ReadAheadTest, ReadsPastLimitAndAppendedBytes)
+{
+    const auto content = pattern(50000);
+    const auto file = temp_file("read_ahead_limit", content);
+    // Only the blocks up to the limit are requested ahead, the rest still comes on demand
+    read_ahead::File in(file.string(), 0, 10000, 4096);
+    EXPECT_EQ(read_rest(in), content);
+
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::app);
+        out << "appended";
+    }
+    auto block = in.next();
+    EXPECT_EQ(std::string(block.data(), block.size()), "appended");
+    EXPECT_EQ(in.position(), content.size());
+    EXPECT_TRUE(in.next().empty());
+    std::filesystem::remove(file);
+}
+
+TEST(ReadAheadTest, StreamReadsLinesAndMoves)
+{
+    std::string content;
+    for (int i = 0; i < 5000; ++i)
+    {
+        content += std::to_string(i) + ";row\n";
+    }
+    const auto file = temp_file("read_ahead_stream", content);
+    std::vector<read_ahead::Stream> streams;
+    {
+        read_ahead::Stream in(file.string(), 0, std::numeric_limits<uint64_t>::max(), 4096);
+        ASSERT_TRUE(in.is_open());
+        std::string line;
+        ASSERT_TRUE(std::getline(in, line));
+        EXPECT_EQ(line, "0;row");
+        streams.push_back(std::move(in));
+    }
+    read_ahead::Stream& in = streams.front();
+    EXPECT_EQ(in.tellg(), 6);
+    std::string line;
+    int rows = 1;
+    while (std::getline(in, line))
+    {
+        EXPECT_EQ(line, std::to_string(rows) + ";row");
+        ++rows;
+    }
+    EXPECT_EQ(rows, 5000);
+
+    read_ahead::Stream missing(file.string() + ".missing");
+    EXPECT_FALSE(missing.is_open());
+    EXPECT_FALSE(missing);
+    std::filesystem::remove(file);
+}
+
+TEST(ReadAheadTest, FailedReadMakesTheStreamBad)
+{
+    // A directory opens, but every read of it fails with EISDIR
+    const auto dir = std::filesystem::temp_directory_path() / ("read_ahead_dir_" + std::to_string(::getpid()));
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir / "entry") << "x";
+
+    read_ahead::Stream in(dir.string());
+    ASSERT_TRUE(in.is_open());
+    std::string line;
+    EXPECT_FALSE(std::getline(in, line));
+    EXPECT_TRUE(in.bad());
+
+    // The parse task fails instead of ending as if the file was empty
+    CsvParser parser(1 << 20, 1);
+    parser.add_file_to_parse(dir.string());
+    parser.wait_task_done();
+    while (parser.get_ready_data())
+    {
+    }
+    EXPECT_TRUE(parser.failed());
+    EXPECT_TRUE(parser.get_file_progress().empty());
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,189 @@
+#include "../src/out_writer/run_journal.hpp"
+#include "../src/out_writer/out_writer.hpp"
+#include "../src/out_writer/algorithm_median.hpp"
+#include "../src/out_writer/custom_serializer.hpp"
+#include "../src/csv_parser/csv_parser.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    struct ByReceiveTs
+    {
+        static inline uint64_t key(const CsvParser::ParserData& record)
+        {
+            return record.receive_ts;
+        }
+        inline bool operator()(const CsvParser::ParserData& a, const CsvParser::ParserData& b) const
+        {
+            return a.receive_ts < b.receive_ts;
+        }
+    };
+} //anonymous namespace
+
+class RunJournalTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("run_journal_test_" + std::to_string(::getpid()));
+        std::filesystem::remove_all(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    RunJournal::Run write_run(const std::string& name, const std::string& content)
+    {
+        const auto file = dir / name;
+        std::ofstream(file, std::ios::binary) << content;
+        return RunJournal::Run{file.string(), content.size(), 1, 2, RunJournal::checksum(file)};
+    }
+};
+
+TEST_F(RunJournalTest, OnlyDurablePrefixIsListed)
+{
+    RunJournal journal(dir, 42);
+    EXPECT_FALSE(journal.recover().has_value());
+
+    journal.cover("a.csv", 0, 100);
+    const auto first = journal.seal();
+    journal.cover("a.csv", 0, 250);
+    journal.cover("b.csv", 0, 80);
+    const auto second = journal.seal();
+
+    // The second run finishing first must not list it, its rows would hide the missing first run
+    journal.durable(second, write_run("second.bin", "bbbb"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "manifest.bin"));
+
+    journal.durable(first, write_run("first.bin", "aaaaaaaaa"));
+    const auto manifest = RunJournal::load(dir / "manifest.bin");
+    EXPECT_EQ(manifest.job, 42u);
+    ASSERT_EQ(manifest.runs.size(), 2u);
+    EXPECT_EQ(manifest.runs[0].file, (dir / "first.bin").string());
+    EXPECT_EQ(manifest.runs[1].records, 4u);
+    EXPECT_EQ(manifest.coverage.at({"a.csv", 0}), 250u);
+    EXPECT_EQ(manifest.coverage.at({"b.csv", 0}), 80u);
+    EXPECT_TRUE(manifest.merged.empty());
+}
+
+TEST_F(RunJournalTest, RecoverRejectsOtherJobsAndDamagedRuns)
+{
+    {
+        RunJournal journal(dir, 7);
+        journal.cover("a.csv", 0, 100);
+        journal.durable(journal.seal(), write_run("run.bin", "0123456789"));
+    }
+    std::ofstream(dir / "stray.bin") << "left by a crash";
+
+    EXPECT_FALSE(RunJournal(dir, 8).recover().has_value());
+    EXPECT_FALSE(std::filesystem::exists(dir / "run.bin"));
+    EXPECT_FALSE(std::filesystem::exists(dir / "stray.bin"));
+
+    {
+        RunJournal journal(dir, 7);
+        journal.cover("a.csv", 0, 100);
+        journal.durable(journal.seal(), write_run("run.bin", "0123456789"));
+    }
+    std::ofstream(dir / "stray.bin") << "left by a crash";
+    {
+        RunJournal journal(dir, 7);
+        const auto manifest = journal.recover();
+        ASSERT_TRUE(manifest.has_value());
+        EXPECT_EQ(manifest->coverage.at({"a.csv", 0}), 100u);
+        EXPECT_TRUE(std::filesystem::exists(dir / "run.bin"));
+        EXPECT_FALSE(std::filesystem::exists(dir / "stray.bin"));
+    }
+
+    std::ofstream(dir / "run.bin", std::ios::binary) << "0123456780";
+    EXPECT_FALSE(RunJournal(dir, 7).recover().has_value());
+    EXPECT_FALSE(std::filesystem::exists(dir / "run.bin"));
+}
+
+TEST_F(RunJournalTest, ResumedSortMatchesFullRun)
+{
+    // Chunks of 1000 rows stand in for a parse task, the row index for its byte offsets. The resumed sort must
+    // write what the same sort writes without the crash
+    std::vector<CsvParser::ParserData> data;
+    int64_t ticks = 684800;
+    for (uint64_t i = 0; i < 10000; ++i)
+    {
+        ticks += static_cast<int64_t>((i * 7919) % 5) - 2;
+        data.push_back({1716810808000000 + (i * 7) % 10000, ticks / 10.0});
+    }
+    const uint64_t chunk = 1000;
+    auto feed = [&](auto& writer, RunJournal& journal, uint64_t from, uint64_t to)
+    {
+        for (uint64_t begin = from; begin < to; begin += chunk)
+        {
+            writer.collect_data(std::vector<CsvParser::ParserData>(data.begin() + begin, data.begin() + begin + chunk));
+            journal.cover("trades.csv", 0, begin + chunk);
+        }
+    };
+
+    auto make_writer = []()
+    {
+        return std::make_unique<OutWriter<CsvParser::ParserData, ByReceiveTs>>(2500, std::make_shared<ParserDataSerializer>(),
+            std::make_shared<MedianAlgorithm>(MedianAlgorithm::Mode::heaps, 2), ByReceiveTs(), 2);
+    };
+
+    const auto full_output = (dir / "median_full.csv").string();
+    {
+        auto journal = std::make_shared<RunJournal>(dir / "full", 1);
+        auto writer = make_writer();
+        writer->set_run_journal(journal);
+        feed(*writer, *journal, 0, data.size());
+        writer->write_data(full_output);
+    }
+
+    const auto spill_dir = dir / "spill";
+    {
+        auto journal = std::make_shared<RunJournal>(spill_dir, 1);
+        auto writer = make_writer();
+        writer->set_run_journal(journal);
+        feed(*writer, *journal, 0, 7000);
+        // Spills end at chunk boundaries: after 2000, 4000 and 6000 rows; the last chunk is still in memory
+        for (int i = 0; i < 500; ++i)
+        {
+            if (std::filesystem::exists(spill_dir / "manifest.bin") && RunJournal::load(spill_dir / "manifest.bin").runs.size() == 3)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        // Crash: the writer goes away without write_data
+    }
+
+    auto journal = std::make_shared<RunJournal>(spill_dir, 1);
+    const auto manifest = journal->recover();
+    ASSERT_TRUE(manifest.has_value());
+    ASSERT_EQ(manifest->runs.size(), 3u);
+    EXPECT_EQ(manifest->coverage.at({"trades.csv", 0}), 6000u);
+    EXPECT_EQ(manifest->runs[0].min_key, 1716810808000000u);
+
+    const auto resumed_output = (dir / "median_resumed.csv").string();
+    {
+        auto writer = make_writer();
+        writer->set_run_journal(journal);
+        writer->adopt(*manifest);
+        feed(*writer, *journal, manifest->coverage.at({"trades.csv", 0}), data.size());
+        writer->write_data(resumed_output);
+    }
+
+    EXPECT_EQ(test_util::read_file(resumed_output), test_util::read_file(full_output));
+    EXPECT_FALSE(std::filesystem::exists(spill_dir));
+    EXPECT_FALSE(std::filesystem::exists(dir / "full"));
+}
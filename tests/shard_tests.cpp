@@ -0,0 +1,211 @@
+#include "../src/pipeline/shard_coordinator.hpp"
+#include "../src/pipeline/median_pipeline.hpp"
+#include "../src/out_writer/shard_run.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <sstream>
+
+class ShardTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path dir;
+    std::vector<std::filesystem::path> files;
+
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() / ("shard_test_" + std::to_string(::getpid()));
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    // Files sorted by receive_ts with interleaved, unique timestamps
+    void write_inputs(size_t count, size_t rows)
+    {
+        for (size_t f = 0; f < count; ++f)
+        {
+            files.push_back(dir / ("part" + std::to_string(f) + ".csv"));
+            std::ofstream out(files.back());
+            out << "receive_ts;exchange_ts;price;quantity;side\n";
+            for (size_t i = 0; i < rows * (f + 1); ++i)
+            {
+                const size_t ts = 1000 + i * count + f;
+                out << ts << ';' << ts << ';' << 100 + (ts * 7919) % 503 << '.' << ts % 4 * 25 << ";1;bid\n";
+            }
+        }
+    }
+
+    MedianPipeline::Options pipeline_options(const std::string& output_file) const
+    {
+        MedianPipeline::Options options;
+        options.files = files;
+        options.output_file = output_file;
+        // In memory, file mode estimates the median
+        options.max_memory = 64 << 20;
+        options.max_threads = 2;
+        return options;
+    }
+
+    // Same as the workers and the coordinator of a sharded run, in this process
+    std::string sharded_output(ShardCoordinator::By by, uint32_t workers, bool sorted_input, CsvParser::TimeRange time_range = {})
+    {
+        const auto shard_dir = dir / "output.shards";
+        std::filesystem::create_directories(shard_dir);
+        const auto shards = ShardCoordinator::plan(files, workers, by, time_range, sorted_input);
+        for (uint32_t i = 0; i < shards.size(); ++i)
+        {
+            auto options = pipeline_options(ShardCoordinator::run_path(shard_dir, i).string());
+            options.files = shards[i].files;
+            options.time_range = shards[i].time_range;
+            options.sorted_input = sorted_input;
+            options.shard_run = true;
+            EXPECT_TRUE(MedianPipeline(options).run());
+        }
+        const auto output_file = dir / "sharded.csv";
+        EXPECT_TRUE(ShardCoordinator::merge(shard_dir, static_cast<uint32_t>(shards.size()), output_file.string(),
+            MedianAlgorithm::Mode::heaps, 1, OutputFormat::csv));
+        std::filesystem::remove_all(shard_dir);
+        return test_util::read_file(output_file);
+    }
+};
+
+TEST_F(ShardTest, RunRoundTripsWithSummary)
+{
+    const auto run = dir / "shard0.run";
+    std::vector<CsvParser::ParserData> records;
+    for (uint64_t i = 0; i < shard_run::Writer::block_records + 1000; ++i)
+    {
+        // Off-grid prices in the first block keep it in the raw layout
+        records.push_back({5000 + i * 3, i < 100 ? 1.0 / 3.0 + i : 10.25 + static_cast<double>(i % 40)});
+    }
+    shard_run::Writer writer(run);
+    for (const auto& record : records)
+    {
+        writer.add(record);
+    }
+    writer.finish();
+
+    const auto summary = shard_run::load(shard_run::summary_path(run));
+    EXPECT_EQ(summary.count, records.size());
+    EXPECT_EQ(summary.min_ts, records.front().receive_ts);
+    EXPECT_EQ(summary.max_ts, records.back().receive_ts);
+    EXPECT_LT(std::filesystem::file_size(run), records.size() * sizeof(CsvParser::ParserData));
+
+    shard_run::Reader reader(run, summary.count);
+    CsvParser::ParserData record;
+    for (const auto& expected : records)
+    {
+        ASSERT_TRUE(reader.next(record));
+        EXPECT_EQ(record.receive_ts, expected.receive_ts);
+        EXPECT_EQ(record.price, expected.price);
+    }
+    EXPECT_FALSE(reader.next(record));
+
+    shard_run::Reader short_reader(run, summary.count + 1);
+    // A run shorter than its summary is damaged
+    EXPECT_THROW(while (short_reader.next(record)) {}, std::runtime_error);
+}
+
+TEST_F(ShardTest, SummariesMergeIntoMedian)
+{
+    std::vector<double> prices;
+    shard_run::Summary total;
+    for (int shard = 0; shard < 3; ++shard)
+    {
+        const auto run = dir / ("shard" + std::to_string(shard) + ".run");
+        shard_run::Writer writer(run);
+        for (int i = 0; i < 11 + shard; ++i)
+        {
+            const double price = (i * 37 + shard * 11) % 23 + 0.5;
+            writer.add({static_cast<uint64_t>(shard * 100 + i), price});
+            prices.push_back(price);
+        }
+        writer.finish();
+        total.merge(shard_run::load(shard_run::summary_path(run)));
+
+        std::vector<double> sorted = prices;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+        EXPECT_EQ(total.count, n);
+        EXPECT_DOUBLE_EQ(total.median(), n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0);
+    }
+    EXPECT_EQ(total.min_ts, 0u);
+    EXPECT_EQ(total.max_ts, 212u);
+}
+
+TEST_F(ShardTest, PlanCoversInputOnce)
+{
+    write_inputs(5, 50);
+    const auto by_files = ShardCoordinator::plan(files, 3, ShardCoordinator::By::files, CsvParser::TimeRange{}, false);
+    ASSERT_EQ(by_files.size(), 3u);
+    std::multiset<std::filesystem::path> seen;
+    for (const auto& shard : by_files)
+    {
+        seen.insert(shard.files.begin(), shard.files.end());
+    }
+    EXPECT_EQ(seen, std::multiset<std::filesystem::path>(files.begin(), files.end()));
+    // The largest file has a shard of its own
+    EXPECT_EQ(by_files[0].files, std::vector<std::filesystem::path>{files.back()});
+
+    const auto by_time = ShardCoordinator::plan(files, 4, ShardCoordinator::By::time, CsvParser::TimeRange{100, 1100}, false);
+    ASSERT_EQ(by_time.size(), 4u);
+    EXPECT_EQ(by_time.front().time_range.from_ts, 100u);
+    EXPECT_EQ(by_time.back().time_range.to_ts, 1100u);
+    for (size_t i = 1; i < by_time.size(); ++i)
+    {
+        EXPECT_EQ(by_time[i].time_range.from_ts, by_time[i - 1].time_range.to_ts);
+        EXPECT_EQ(by_time[i].files, files);
+    }
+
+    // Without a window the bounds of unsorted files are unknown
+    const auto fallback = ShardCoordinator::plan(files, 2, ShardCoordinator::By::time, CsvParser::TimeRange{}, false);
+    ASSERT_EQ(fallback.size(), 2u);
+    EXPECT_FALSE(fallback[0].time_range.bounded());
+    EXPECT_LT(fallback[0].files.size(), files.size());
+}
+
+TEST_F(ShardTest, ShardedRunMatchesSingleProcess)
+{
+    write_inputs(3, 4000);
+    const auto single = dir / "single.csv";
+    ASSERT_TRUE(MedianPipeline(pipeline_options(single.string())).run());
+    const std::string expected = test_util::read_file(single);
+    ASSERT_FALSE(expected.empty());
+
+    EXPECT_EQ(sharded_output(ShardCoordinator::By::files, 2, false), expected);
+    EXPECT_EQ(sharded_output(ShardCoordinator::By::time, 4, true), expected);
+    EXPECT_EQ(sharded_output(ShardCoordinator::By::files, 5, false), expected);
+    // Every row is in the first window, the other shards write empty runs
+    EXPECT_EQ(sharded_output(ShardCoordinator::By::time, 3, false, CsvParser::TimeRange{1, 1000000}), expected);
+}
+
+TEST_F(ShardTest, FailedWorkerFailsRun)
+{
+    write_inputs(2, 10);
+    ShardCoordinator::Options options;
+    options.files = files;
+    options.workers = 2;
+    options.shard_dir = dir / "output.shards";
+    options.output_file = (dir / "output.csv").string();
+
+    options.worker_command = {"/bin/false"};
+    EXPECT_FALSE(ShardCoordinator(options).run());
+    // A worker that exits cleanly without its run fails the merge
+    options.worker_command = {"/bin/true"};
+    EXPECT_FALSE(ShardCoordinator(options).run());
+    EXPECT_FALSE(std::filesystem::exists(options.shard_dir));
+    EXPECT_FALSE(std::filesystem::exists(options.output_file));
+}
@@ -0,0 +1,84 @@
+#include "../src/trace/trace.hpp"
+#include "../src/csv_parser/thread_pool_queue.hpp"
+#include "test_util.hpp"
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    size_t count_of(const std::string& text, const std::string& pattern)
+    {
+        size_t res = 0;
+        for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+        {
+            ++res;
+        }
+        return res;
+    }
+} //anonymous namespace
+
+class TraceTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path file;
+
+    void SetUp() override
+    {
+        trace::Recorder::instance().reset();
+        file = std::filesystem::temp_directory_path() / ("trace_test_" + std::to_string(::getpid()) + ".json");
+    }
+
+    void TearDown() override
+    {
+        trace::Recorder::instance().stop();
+        trace::Recorder::instance().reset();
+        std::filesystem::remove(file);
+    }
+};
+
+TEST_F(TraceTest, DisabledRecordsNothing)
+{
+    {
+        trace::ScopedEvent event("sort");
+    }
+    EXPECT_EQ(count_of(trace::Recorder::instance().to_json(), "\"ph\""), 0u);
+}
+
+TEST_F(TraceTest, SessionWritesPoolTasksPerThread)
+{
+    constexpr size_t tasks = 5000;
+    {
+        trace::ScopedSession session(file);
+        {
+            trace::ScopedEvent event("merge");
+        }
+        ThreadPoolQueue pool;
+        pool.start_async(2, "spill");
+        for (size_t i = 0; i < tasks; ++i)
+        {
+            pool.push([] { trace::ScopedEvent event("write spill file"); });
+        }
+        pool.wait_for_pending();
+        pool.stop();
+    }
+
+    ASSERT_TRUE(std::filesystem::exists(file));
+    const std::string json = test_util::read_file(file);
+    EXPECT_EQ(json.rfind("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", 0), 0u);
+    EXPECT_EQ(count_of(json, "{\"name\": \"merge\", \"ph\": \"B\""), 1u);
+    EXPECT_EQ(count_of(json, "{\"name\": \"merge\", \"ph\": \"E\""), 1u);
+    // More events than one chunk holds, spread over both workers
+    EXPECT_EQ(count_of(json, "{\"name\": \"spill\", \"ph\": \"B\""), tasks);
+    EXPECT_EQ(count_of(json, "{\"name\": \"spill\", \"ph\": \"E\""), tasks);
+    EXPECT_EQ(count_of(json, "{\"name\": \"write spill file\", \"ph\": \"B\""), tasks);
+    EXPECT_EQ(count_of(json, "{\"name\": \"write spill file\", \"ph\": \"E\""), tasks);
+    EXPECT_NE(json.find("\"args\": {\"name\": \"main\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\": {\"name\": \"spill 0\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"args\": {\"name\": \"spill 1\"}"), std::string::npos);
+}
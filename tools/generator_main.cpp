@@ -0,0 +1,97 @@
+#include "../src/generator/market_data_generator.hpp"
+#include "../src/logger/logger.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+    MarketDataGenerator::Options options;
+    std::string kind = "trades";
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "Show help")
+        ("output", po::value<std::string>()->required(), "Directory for the generated files")
+        ("kind", po::value<std::string>(&kind)->default_value("trades"), "trades or level")
+        ("prefix", po::value<std::string>(&options.prefix), "File name prefix (default: the kind)")
+        ("files", po::value<uint32_t>(&options.files)->default_value(options.files), "Number of files")
+        ("rows", po::value<uint64_t>(&options.rows)->default_value(options.rows), "Lines over all files")
+        ("size", po::value<uint64_t>(), "Approximate total size in bytes, overrides --rows")
+        ("seed", po::value<uint64_t>(&options.seed)->default_value(options.seed), "Random seed")
+        ("disorder", po::value<double>(&options.disorder)->default_value(options.disorder), "Share of rows with receive_ts pushed back")
+        ("disorder-window", po::value<uint64_t>(&options.disorder_window)->default_value(options.disorder_window), "Maximum push back in receive_ts units")
+        ("overlap", po::value<double>(&options.overlap)->default_value(options.overlap), "Time range overlap between files, 0 to 1")
+        ("volatility", po::value<double>(&options.volatility)->default_value(options.volatility), "Standard deviation of a price step in ticks")
+        ("tick-size", po::value<double>(&options.tick_size)->default_value(options.tick_size), "Price grid")
+        ("start-price", po::value<double>(&options.start_price)->default_value(options.start_price), "First price of every file")
+        ("malformed-rate", po::value<double>(&options.malformed_rate)->default_value(options.malformed_rate), "Share of broken lines")
+        ("size-skew", po::value<double>(&options.size_skew)->default_value(options.size_skew), "File i gets rows proportional to 1/(i+1)^skew")
+        ("start-ts", po::value<uint64_t>(&options.start_ts)->default_value(options.start_ts), "First receive_ts")
+        ("duration", po::value<uint64_t>(&options.duration)->default_value(options.duration), "Time range of all files in receive_ts units")
+        ("threads", po::value<uint32_t>(&options.threads)->default_value(options.threads), "Formatting threads");
+
+    po::variables_map vm;
+    try
+    {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help"))
+        {
+            std::ostringstream oss;
+            oss << desc;
+            spdlog::info("Allowed commands {}", oss.str());
+            return EXIT_SUCCESS;
+        }
+        po::notify(vm);
+    }
+    catch (const po::error& e)
+    {
+        std::ostringstream oss;
+        oss << desc;
+        spdlog::error("Error parsing command line: {}. Allowed commands {}", e.what(), oss.str());
+        return EXIT_FAILURE;
+    }
+
+    if (kind == "level")
+    {
+        options.kind = MarketDataGenerator::Kind::level;
+    }
+    else if (kind != "trades")
+    {
+        spdlog::error("kind must be trades or level, got {}", kind);
+        return EXIT_FAILURE;
+    }
+    options.output_dir = vm["output"].as<std::string>();
+
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (vm.count("size"))
+        {
+            options.rows = MarketDataGenerator(options).rows_for_size(vm["size"].as<uint64_t>());
+        }
+        MarketDataGenerator generator(options);
+        uint64_t rows = 0;
+        uint64_t malformed = 0;
+        uint64_t bytes = 0;
+        for (const auto& file : generator.run())
+        {
+            rows += file.rows;
+            malformed += file.malformed;
+            bytes += file.bytes;
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        spdlog::info("Generated {} rows ({} malformed), {} bytes in {:.2f} s, {:.1f} MB/s", rows, malformed, bytes, seconds, bytes / seconds / 1e6);
+    }
+    catch (const std::exception& err)
+    {
+        spdlog::error("Error while generating data: {}", err.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}